@@ -11,12 +11,18 @@
 
 #pragma once
 
+#include <chrono>
+#include <fstream>
+#include <list>
+#include <memory>
 #include <string>
 #include <vector>
 #include <unordered_map>
 #include <mutex>
 
 #include <stdlib.h>
+#include <unistd.h>
+#include <zlib.h>
 #include <Log.hpp>
 #include <Exceptions.hpp>
 #include <Poco/MemoryStream.h>
@@ -83,20 +89,79 @@ struct ClipboardData
 };
 
 /// Used to store expired view's clipboards
+///
+/// Their content can still be pasted for a while after the view is gone, and
+/// copying a large Calc range or image makes for a large one. So we keep up
+/// to a budget of bytes in memory, dropping the least recently used ones to
+/// make room, and keep the large ones deflated in a file instead, with a
+/// budget of their own. Deflating, inflating and the files are dealt with
+/// outside the lock, which only guards the index.
 class ClipboardCache
 {
-    std::mutex _mutex;
     struct Entry {
+        std::string _keys[2];
         std::chrono::steady_clock::time_point _inserted;
-        std::shared_ptr<std::string> _rawData; // big.
+        std::shared_ptr<std::string> _rawData; // big, or null when spilled.
+        std::string _spillPath;
+        size_t _rawSize;
+        size_t _spillSize;
     };
+
+    mutable std::mutex _mutex;
+    size_t _maxMemoryBytes;
+    size_t _maxSpillBytes;
+    size_t _spillThresholdBytes;
+    std::string _spillDir;
+    /// Names the spill files apart, even for the same key.
+    uint64_t _spillCount;
+
+    /// Most recently used first.
+    std::list<Entry> _entries;
     // clipboard key -> data
-    std::unordered_map<std::string, Entry> _cache;
+    std::unordered_map<std::string, std::list<Entry>::iterator> _cache;
+    size_t _memorySize;
+    size_t _spillSize;
+    uint64_t _evictions;
+
 public:
-    ClipboardCache()
+    ClipboardCache(const size_t maxMemoryBytes = 64 * 1024 * 1024)
+        : _maxMemoryBytes(maxMemoryBytes)
+        , _maxSpillBytes(0)
+        , _spillThresholdBytes(0)
+        , _spillCount(0)
+        , _memorySize(0)
+        , _spillSize(0)
+        , _evictions(0)
     {
     }
 
+    ~ClipboardCache()
+    {
+        for (const Entry& entry : _entries)
+            removeSpill(entry._spillPath);
+    }
+
+    /// Keeps up to @maxMemoryBytes of clipboards in memory. Those of at least
+    /// @spillThresholdBytes go deflated to @spillDir, up to @maxSpillBytes,
+    /// unless either is 0.
+    void configure(const size_t maxMemoryBytes, const size_t maxSpillBytes,
+                   const size_t spillThresholdBytes, const std::string& spillDir)
+    {
+        std::vector<std::string> spills;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _maxMemoryBytes = maxMemoryBytes;
+            _maxSpillBytes = maxSpillBytes;
+            _spillThresholdBytes = spillThresholdBytes;
+            _spillDir = spillDir;
+            if (!_spillDir.empty() && _spillDir.back() != '/')
+                _spillDir += '/';
+            evict(0, 0, spills);
+        }
+
+        removeSpills(spills);
+    }
+
     void insertClipboard(const std::string key[2],
                          const char *data, size_t size)
     {
@@ -106,40 +171,234 @@ public:
             return;
         }
         Entry ent;
+        ent._keys[0] = key[0];
+        ent._keys[1] = key[1];
         ent._inserted = std::chrono::steady_clock::now();
-        ent._rawData = std::make_shared<std::string>(data, size);
-        LOG_TRC("insert cached clipboard: " + key[0] + " and " + key[1]);
-        std::lock_guard<std::mutex> lock(_mutex);
-        _cache[key[0]] = ent;
-        _cache[key[1]] = ent;
+        ent._rawSize = size;
+        ent._spillSize = 0;
+
+        std::string spillPath;
+        size_t maxSpillBytes;
+        size_t maxMemoryBytes;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (!_spillDir.empty() && _maxSpillBytes > 0 && _spillThresholdBytes > 0 &&
+                size >= _spillThresholdBytes)
+                spillPath = _spillDir + key[0] + '.' + std::to_string(++_spillCount);
+            maxSpillBytes = _maxSpillBytes;
+            maxMemoryBytes = _maxMemoryBytes;
+        }
+
+        if (!spillPath.empty())
+            spill(ent, data, size, spillPath, maxSpillBytes);
+
+        if (ent._spillPath.empty())
+        {
+            if (size > maxMemoryBytes)
+            {
+                LOG_DBG("clipboard cache - too large to cache: " << size << " bytes");
+                return;
+            }
+            ent._rawData = std::make_shared<std::string>(data, size);
+        }
+
+        std::vector<std::string> spills;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            remove(key[0], spills);
+            remove(key[1], spills);
+
+            evict(ent._rawData ? size : 0, ent._spillSize, spills);
+
+            LOG_TRC("insert cached clipboard: " + key[0] + " and " + key[1]);
+            _entries.push_front(ent);
+            _cache[key[0]] = _entries.begin();
+            _cache[key[1]] = _entries.begin();
+            if (ent._rawData)
+                _memorySize += size;
+            _spillSize += ent._spillSize;
+        }
+
+        removeSpills(spills);
     }
 
     std::shared_ptr<std::string> getClipboard(const std::string &key)
+    {
+        Entry ent;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto it = _cache.find(key);
+            if (it == _cache.end())
+                return nullptr;
+
+            _entries.splice(_entries.begin(), _entries, it->second);
+            if (it->second->_rawData)
+                return it->second->_rawData;
+
+            ent = *it->second;
+        }
+
+        // Should it go meanwhile, its file is gone, and so is the clipboard.
+        return unspill(ent);
+    }
+
+    void checkexpiry()
+    {
+        std::vector<std::string> spills;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto now = std::chrono::steady_clock::now();
+            LOG_TRC("check expiry of cached clipboards");
+            for (auto it = _entries.begin(); it != _entries.end();)
+            {
+                if (std::chrono::duration_cast<std::chrono::minutes>(now - it->_inserted).count() >= 10)
+                {
+                    LOG_TRC("expiring expiry of cached clipboard: " + it->_keys[0]);
+                    it = erase(it, spills);
+                }
+                else
+                    ++it;
+            }
+        }
+
+        removeSpills(spills);
+    }
+
+    /// The bytes of clipboards held in memory.
+    size_t getMemorySize() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _memorySize;
+    }
+
+    /// The bytes of deflated clipboards spilled to disk.
+    size_t getSpillSize() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _spillSize;
+    }
+
+    size_t getCount() const
     {
         std::lock_guard<std::mutex> lock(_mutex);
-        std::shared_ptr<std::string> data;
+        return _entries.size();
+    }
+
+    /// The clipboards dropped to stay within budget.
+    uint64_t getEvictions() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _evictions;
+    }
+
+private:
+    /// Drops the entry at @it, adding its file, if any, to @spills to remove
+    /// once unlocked.
+    std::list<Entry>::iterator erase(const std::list<Entry>::iterator it,
+                                     std::vector<std::string>& spills)
+    {
+        _cache.erase(it->_keys[0]);
+        _cache.erase(it->_keys[1]);
+        if (it->_rawData)
+            _memorySize -= it->_rawSize;
+        _spillSize -= it->_spillSize;
+        if (!it->_spillPath.empty())
+            spills.push_back(it->_spillPath);
+        return _entries.erase(it);
+    }
+
+    void remove(const std::string& key, std::vector<std::string>& spills)
+    {
         auto it = _cache.find(key);
         if (it != _cache.end())
-            data = it->second._rawData;
-        return data;
+            erase(it->second, spills);
     }
 
-    void checkexpiry()
+    /// Drops the least recently used clipboards to leave room for
+    /// @memoryBytes more in memory and @spillBytes more on disk.
+    void evict(const size_t memoryBytes, const size_t spillBytes, std::vector<std::string>& spills)
     {
-        std::lock_guard<std::mutex> lock(_mutex);
-        auto now = std::chrono::steady_clock::now();
-        LOG_TRC("check expiry of cached clipboards");
-        for (auto it = _cache.begin(); it != _cache.end();)
+        auto it = _entries.end();
+        while (it != _entries.begin() &&
+               (_memorySize + memoryBytes > _maxMemoryBytes || _spillSize + spillBytes > _maxSpillBytes))
         {
-            if (std::chrono::duration_cast<std::chrono::minutes>(now - it->second._inserted).count() >= 10)
+            --it;
+            if ((it->_rawData && _memorySize + memoryBytes > _maxMemoryBytes) ||
+                (it->_spillSize && _spillSize + spillBytes > _maxSpillBytes))
             {
-                LOG_TRC("expiring expiry of cached clipboard: " + it->first);
-                it = _cache.erase(it);
+                LOG_TRC("evicting cached clipboard: " + it->_keys[0]);
+                it = erase(it, spills);
+                ++_evictions;
             }
-            else
-                ++it;
         }
     }
+
+    /// Writes @data deflated to @path for @ent, if it fits in @maxSpillBytes.
+    static void spill(Entry& ent, const char *data, size_t size, const std::string& path,
+                      size_t maxSpillBytes)
+    {
+        uLongf compressedSize = compressBound(size);
+        std::string compressed(compressedSize, '\0');
+        if (compress2(reinterpret_cast<Bytef*>(&compressed[0]), &compressedSize,
+                      reinterpret_cast<const Bytef*>(data), size, Z_BEST_SPEED) != Z_OK)
+        {
+            LOG_WRN("clipboard cache - failed to deflate " << size << " bytes");
+            return;
+        }
+
+        if (compressedSize > maxSpillBytes)
+            return;
+
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(compressed.data(), compressedSize);
+        file.close();
+        if (file.fail())
+        {
+            LOG_WRN("clipboard cache - failed to write [" << path << "]");
+            ::unlink(path.c_str());
+            return;
+        }
+
+        LOG_TRC("spilled cached clipboard: " << size << " bytes to " << compressedSize << " in " << path);
+        ent._spillPath = path;
+        ent._spillSize = compressedSize;
+    }
+
+    static std::shared_ptr<std::string> unspill(const Entry& ent)
+    {
+        std::ifstream file(ent._spillPath, std::ios::binary);
+        std::string compressed(ent._spillSize, '\0');
+        file.read(&compressed[0], ent._spillSize);
+        if (file.fail())
+        {
+            LOG_WRN("clipboard cache - failed to read [" << ent._spillPath << "]");
+            return nullptr;
+        }
+
+        auto data = std::make_shared<std::string>(ent._rawSize, '\0');
+        uLongf size = ent._rawSize;
+        if (uncompress(reinterpret_cast<Bytef*>(&(*data)[0]), &size,
+                       reinterpret_cast<const Bytef*>(compressed.data()), ent._spillSize) != Z_OK ||
+            size != ent._rawSize)
+        {
+            LOG_WRN("clipboard cache - failed to inflate [" << ent._spillPath << "]");
+            return nullptr;
+        }
+
+        return data;
+    }
+
+    static void removeSpill(const std::string& path)
+    {
+        if (!path.empty())
+            ::unlink(path.c_str());
+    }
+
+    static void removeSpills(const std::vector<std::string>& paths)
+    {
+        for (const std::string& path : paths)
+            removeSpill(path);
+    }
 };
 
 /* vim:set shiftwidth=4 softtabstop=4 expandtab: */
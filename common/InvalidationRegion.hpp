@@ -0,0 +1,199 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 100 -*- */
+/*
+ * This file is part of the LibreOffice project.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "Rectangle.hpp"
+
+/// The union of the tile invalidations of a part, aligned to the tile grid.
+///
+/// The core sends many small, overlapping invalidations while it recalculates
+/// or repaints, each of which makes every client re-request the tiles under
+/// it. We collect them here between two passes over the queue, in cells of a
+/// tile at 100% zoom, and send out a few rectangles covering those cells.
+class InvalidationRegion
+{
+public:
+    /// The size of the cells, in twips.
+    static constexpr int CellSize = 3840;
+
+    /// Invalidations of more cells than this are kept as rectangles.
+    static constexpr int64_t MaxCells = 1024;
+
+    InvalidationRegion()
+        : _all(false)
+    {
+    }
+
+    /// Adds the cells under the given rectangle.
+    void add(const int x, const int y, const int width, const int height)
+    {
+        if (_all)
+            return;
+
+        // Nothing left or above the origin is ever rendered.
+        const int64_t col1 = std::max<int64_t>(x, 0) / CellSize;
+        const int64_t row1 = std::max<int64_t>(y, 0) / CellSize;
+        const int64_t col2 = cellsUpTo(static_cast<int64_t>(x) + std::max(width, 1));
+        const int64_t row2 = cellsUpTo(static_cast<int64_t>(y) + std::max(height, 1));
+        if (col2 <= col1 || row2 <= row1)
+            return;
+
+        if ((col2 - col1) * (row2 - row1) > MaxCells)
+        {
+            const Util::Rectangle rectangle = makeRectangle(col1, row1, col2, row2);
+            if (isCovered(rectangle))
+                return;
+
+            _large.erase(std::remove_if(_large.begin(), _large.end(),
+                                        [&rectangle](const Util::Rectangle& other) {
+                                            return covers(rectangle, other);
+                                        }),
+                         _large.end());
+            _large.push_back(rectangle);
+            return;
+        }
+
+        for (int64_t row = row1; row < row2; ++row)
+        {
+            for (int64_t col = col1; col < col2; ++col)
+                _cells.emplace(row, col);
+        }
+    }
+
+    /// Invalidates the whole part, as EMPTY does.
+    void addAll()
+    {
+        _all = true;
+        _cells.clear();
+        _large.clear();
+    }
+
+    bool isEmpty() const { return !_all && _cells.empty() && _large.empty(); }
+
+    /// True when the whole part is invalid.
+    bool isAll() const { return _all; }
+
+    /// The rectangles covering the region, in twips, merging the runs of
+    /// cells on a row, and then the same runs on consecutive rows.
+    std::vector<Util::Rectangle> getRectangles() const
+    {
+        if (_all)
+            return std::vector<Util::Rectangle>();
+
+        std::vector<Util::Rectangle> rectangles(_large);
+
+        // The runs of the previous row, by first and last column,
+        // and the rectangle they are the bottom of.
+        std::map<std::pair<int64_t, int64_t>, size_t> above;
+        std::map<std::pair<int64_t, int64_t>, size_t> current;
+        int64_t currentRow = 0;
+
+        auto it = _cells.begin();
+        while (it != _cells.end())
+        {
+            const int64_t row = it->first;
+            const int64_t first = it->second;
+            int64_t last = first;
+            for (++it; it != _cells.end() && it->first == row && it->second == last + 1; ++it)
+                ++last;
+
+            if (row != currentRow)
+            {
+                above = (row == currentRow + 1 ? std::move(current)
+                                               : std::map<std::pair<int64_t, int64_t>, size_t>());
+                current.clear();
+                currentRow = row;
+            }
+
+            const Util::Rectangle run = makeRectangle(first, row, last + 1, row + 1);
+            if (isCovered(run))
+                continue;
+
+            const auto merge = above.find(std::make_pair(first, last));
+            if (merge != above.end())
+            {
+                rectangles[merge->second].setBottom(run.getBottom());
+                current.emplace(merge->first, merge->second);
+                above.erase(merge);
+            }
+            else
+            {
+                current.emplace(std::make_pair(first, last), rectangles.size());
+                rectangles.push_back(run);
+            }
+        }
+
+        return rectangles;
+    }
+
+    void clear()
+    {
+        _all = false;
+        _cells.clear();
+        _large.clear();
+    }
+
+private:
+    /// The number of cells up to @twips, rounded up.
+    static int64_t cellsUpTo(const int64_t twips)
+    {
+        return (twips > 0 ? (twips + CellSize - 1) / CellSize : 0);
+    }
+
+    static Util::Rectangle makeRectangle(const int64_t col1, const int64_t row1,
+                                         const int64_t col2, const int64_t row2)
+    {
+        Util::Rectangle rectangle;
+        rectangle.setLeft(toTwips(col1));
+        rectangle.setTop(toTwips(row1));
+        rectangle.setRight(toTwips(col2));
+        rectangle.setBottom(toTwips(row2));
+        return rectangle;
+    }
+
+    static int toTwips(const int64_t cell)
+    {
+        return static_cast<int>(std::min<int64_t>(cell * CellSize, INT_MAX));
+    }
+
+    static bool covers(const Util::Rectangle& outer, const Util::Rectangle& inner)
+    {
+        return outer.getLeft() <= inner.getLeft() && inner.getRight() <= outer.getRight()
+               && outer.getTop() <= inner.getTop() && inner.getBottom() <= outer.getBottom();
+    }
+
+    /// Whether one of the large rectangles covers @rectangle.
+    bool isCovered(const Util::Rectangle& rectangle) const
+    {
+        for (const Util::Rectangle& other : _large)
+        {
+            if (covers(other, rectangle))
+                return true;
+        }
+
+        return false;
+    }
+
+    bool _all;
+    /// The invalid cells, by row and column.
+    std::set<std::pair<int64_t, int64_t>> _cells;
+    /// The invalidations too large to split into cells.
+    std::vector<Util::Rectangle> _large;
+};
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
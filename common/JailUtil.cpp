@@ -28,10 +28,15 @@
 
 namespace JailUtil
 {
-bool loolmount(const std::string& arg, std::string source, std::string target)
+/// Runs loolmount with @arg on @source and @target, and the @overlayDir
+/// of the writable layer, if given, between them.
+bool loolmount(const std::string& arg, std::string source, std::string target,
+               std::string overlayDir = std::string())
 {
     source = Util::trim(source, '/');
     target = Util::trim(target, '/');
+    if (!overlayDir.empty())
+        source += ' ' + Util::trim(overlayDir, '/');
     const std::string cmd = Poco::Path(Util::getApplicationPath(), "loolmount").toString() + ' '
                             + arg + ' ' + source + ' ' + target;
     LOG_TRC("Executing loolmount command: " << cmd);
@@ -60,6 +65,29 @@ bool remountReadonly(const std::string& source, const std::string& target)
     return res;
 }
 
+bool overlay(const std::string& source, const std::string& overlayDir, const std::string& target)
+{
+    // The writable layer and the work directory of overlayfs.
+    Poco::File(overlayDir + "/upper").createDirectories();
+    Poco::File(overlayDir + "/work").createDirectories();
+    Poco::File(target).createDirectory();
+
+    const bool res = loolmount("-o", source, target, overlayDir);
+    if (res)
+        LOG_TRC("Mounted overlay of [" << source << "] -> [" << target << "].");
+    else
+        LOG_ERR("Failed to mount overlay of [" << source << "] -> [" << target << "].");
+    return res;
+}
+
+std::string getOverlayPath(const std::string& root)
+{
+    // Next to the random temp dirs, which are removed with the jails.
+    const Poco::Path path = Poco::Path::forDirectory(root);
+    const std::string jailId = path[path.depth() - 1];
+    return Poco::Path(path.parent(), "tmp/" + jailId + ".overlay").toString();
+}
+
 bool unmount(const std::string& target)
 {
     LOG_DBG("Unmounting [" << target << "].");
@@ -134,6 +162,11 @@ void removeJail(const std::string& root)
 
     // Unmount/delete the jail (sysTemplate).
     safeRemoveDir(root);
+
+    // The writable layer, if the jail was an overlay.
+    const std::string overlayPath = getOverlayPath(root);
+    if (FileUtil::Stat(overlayPath).exists())
+        FileUtil::removeFile(overlayPath, true);
 }
 
 /// This cleans up the jails directories.
@@ -182,13 +215,15 @@ void cleanupJails(const std::string& root)
         LOG_WRN("Jails root directory [" << root << "] is not empty. Will not remove it.");
 }
 
-void setupJails(bool bindMount, const std::string& jailRoot, const std::string& sysTemplate)
+void setupJails(bool bindMount, bool overlayMount, const std::string& jailRoot,
+                const std::string& sysTemplate)
 {
     // Start with a clean slate.
     cleanupJails(jailRoot);
     Poco::File(jailRoot).createDirectories();
 
     disableBindMounting(); // Clear to avoid surprises.
+    disableOverlayMounting();
     if (bindMount)
     {
         // Test mounting to verify it actually works,
@@ -200,6 +235,27 @@ void setupJails(bool bindMount, const std::string& jailRoot, const std::string&
             safeRemoveDir(target);
             LOG_INF("Enabling Bind-Mounting of jail contents for better performance per "
                     "mount_jail_tree config in loolwsd.xml.");
+
+            if (overlayMount)
+            {
+                const std::string overlayTarget
+                    = Poco::Path(jailRoot, "lool_test_overlay").toString();
+                const std::string overlayPath = getOverlayPath(overlayTarget);
+                if (overlay(sysTemplate, overlayPath, overlayTarget))
+                {
+                    enableOverlayMounting();
+                    LOG_INF("Enabling Overlay-Mounting of jails per mount_jail_overlay config "
+                            "in loolwsd.xml.");
+                }
+                else
+                    LOG_ERR("Overlay-Mounting fails and will be disabled for this run, jails will "
+                            "be bind-mounted. To disable permanently set mount_jail_overlay config "
+                            "entry in loolwsd.xml to false.");
+
+                unmount(overlayTarget);
+                FileUtil::removeFile(overlayTarget, false);
+                FileUtil::removeFile(overlayPath, true);
+            }
         }
         else
             LOG_ERR("Bind-Mounting fails and will be disabled for this run. To disable permanently "
@@ -263,6 +319,19 @@ bool isBindMountingEnabled()
     return std::getenv(BIND_MOUNTING_ENVAR_NAME) != nullptr;
 }
 
+/// The envar name used to control mounting jails as overlays.
+constexpr const char* OVERLAY_MOUNTING_ENVAR_NAME = "LOOL_OVERLAY_MOUNT";
+
+void enableOverlayMounting() { setenv(OVERLAY_MOUNTING_ENVAR_NAME, "1", 1); }
+
+void disableOverlayMounting() { unsetenv(OVERLAY_MOUNTING_ENVAR_NAME); }
+
+bool isOverlayMountingEnabled()
+{
+    // Only on top of bind-mounting, which we need for the LO installation.
+    return isBindMountingEnabled() && std::getenv(OVERLAY_MOUNTING_ENVAR_NAME) != nullptr;
+}
+
 namespace SysTemplate
 {
 /// The network and other system files we need to keep up-to-date in jails.
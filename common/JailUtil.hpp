@@ -22,6 +22,12 @@ bool bind(const std::string& source, const std::string& target);
 /// Remount a bound mount point as readonly.
 bool remountReadonly(const std::string& source, const std::string& target);
 
+/// Mount an overlay of @source on @target, writing to a layer in @overlayDir.
+bool overlay(const std::string& source, const std::string& overlayDir, const std::string& target);
+
+/// The directory of the writable layer of the overlay on the jail at @root.
+std::string getOverlayPath(const std::string& root);
+
 /// Unmount a bind-mounted jail directory.
 bool unmount(const std::string& target);
 
@@ -37,8 +43,9 @@ void removeJail(const std::string& root);
 /// Remove all jails.
 void cleanupJails(const std::string& jailRoot);
 
-/// Setup the jails.
-void setupJails(bool bindMount, const std::string& jailRoot, const std::string& sysTemplate);
+/// Setup the jails, mounting them as overlays if @overlayMount and @bindMount.
+void setupJails(bool bindMount, bool overlayMount, const std::string& jailRoot,
+                const std::string& sysTemplate);
 
 /// Setup /dev/random and /dev/urandom in the given jail path.
 void setupJailDevNodes(const std::string& root);
@@ -52,6 +59,15 @@ void disableBindMounting();
 /// Returns true iff bind-mounting is enabled in this process.
 bool isBindMountingEnabled();
 
+/// Enable mounting jails as overlays in this process.
+void enableOverlayMounting();
+
+/// Disable mounting jails as overlays in this process.
+void disableOverlayMounting();
+
+/// Returns true iff jails are mounted as overlays in this process.
+bool isOverlayMountingEnabled();
+
 namespace SysTemplate
 {
 /// Setup links for /dev/random and /dev/urandom in systemplate.
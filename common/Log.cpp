@@ -15,14 +15,20 @@
 #endif
 #include <unistd.h>
 
+#include <algorithm>
 #include <atomic>
 #include <cassert>
+#include <condition_variable>
 #include <cstring>
 #include <ctime>
 #include <iomanip>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <sstream>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include <Poco/AutoPtr.h>
 #include <Poco/ConsoleChannel.h>
@@ -45,6 +51,7 @@ namespace Log
     {
     private:
         Poco::Logger* _logger;
+        Poco::AutoPtr<Poco::Channel> _channel;
         std::string _name;
         std::string _id;
         std::atomic<bool> _inited;
@@ -71,10 +78,281 @@ namespace Log
 
         void setLogger(Poco::Logger* logger) { _logger = logger; };
         Poco::Logger* getLogger() const { return _logger; }
+
+        /// The channel the messages are written to.
+        void setChannel(const Poco::AutoPtr<Poco::Channel>& channel) { _channel = channel; }
+        const Poco::AutoPtr<Poco::Channel>& getChannel() const { return _channel; }
     };
     static StaticNameHelper Source;
     bool IsShutdown = false;
 
+    // That of the root logger, used until initialize().
+    std::atomic<int> CurrentPriority(Poco::Message::PRIO_INFORMATION);
+
+    /// The log messages of one thread, waiting for the writer thread: a
+    /// lock-free ring with a single producer and a single consumer.
+    class MessageRing
+    {
+    public:
+        struct Entry
+        {
+            /// The order of the message among those of all the threads.
+            uint64_t _seq;
+            Poco::Message::Priority _priority;
+            std::string _text;
+        };
+
+        /// Enough for the bursts of tracing of a tile render, or of a load.
+        static constexpr size_t Capacity = 4096;
+
+        MessageRing()
+            : _entries(Capacity)
+            , _head(0)
+            , _tail(0)
+            , _closed(false)
+        {
+        }
+
+        /// Moves @entry to the ring, unless it is full. Called by the owning thread only.
+        bool push(Entry& entry)
+        {
+            const size_t tail = _tail.load(std::memory_order_relaxed);
+            if (tail - _head.load(std::memory_order_acquire) >= Capacity)
+                return false;
+
+            _entries[tail % Capacity] = std::move(entry);
+            _tail.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        size_t size() const
+        {
+            return _tail.load(std::memory_order_acquire) - _head.load(std::memory_order_acquire);
+        }
+
+        /// Moves the messages in the ring to @entries. Called by one thread at a time.
+        void pop(std::vector<Entry>& entries)
+        {
+            const size_t head = _head.load(std::memory_order_relaxed);
+            const size_t tail = _tail.load(std::memory_order_acquire);
+            for (size_t i = head; i < tail; ++i)
+                entries.push_back(std::move(_entries[i % Capacity]));
+
+            _head.store(tail, std::memory_order_release);
+        }
+
+        /// The owning thread is gone; there will be no more messages.
+        void close() { _closed = true; }
+        bool isClosed() const { return _closed; }
+
+    private:
+        std::vector<Entry> _entries;
+        std::atomic<size_t> _head;
+        std::atomic<size_t> _tail;
+        std::atomic<bool> _closed;
+    };
+
+    /// Hands the messages over to a thread that writes them to the channel,
+    /// through a ring per thread, so that logging costs the calling thread the
+    /// formatting only, and never waits for the writes. When a ring is full,
+    /// the message is dropped, and counted, rather than waiting for room.
+    /// Errors are written right away, after what was waiting, so that the
+    /// lines leading to them are not lost should the process die next.
+    class AsyncChannel : public Poco::Channel
+    {
+    public:
+        AsyncChannel(const Poco::AutoPtr<Poco::Channel>& channel, const std::string& source)
+            : _channel(channel)
+            , _source(source)
+            , _seq(0)
+            , _dropped(0)
+            , _droppedReported(0)
+            , _stop(false)
+        {
+            _thread = std::thread([this]() { writerThread(); });
+        }
+
+        void log(const Poco::Message& msg) override
+        {
+            if (msg.getPriority() <= Poco::Message::PRIO_ERROR)
+            {
+                std::lock_guard<std::mutex> lock(_writeMutex);
+                drainLocked();
+                _channel->log(msg);
+                return;
+            }
+
+            MessageRing& ring = getRing();
+            MessageRing::Entry entry{ _seq.fetch_add(1, std::memory_order_relaxed),
+                                      msg.getPriority(), msg.getText() };
+            if (!ring.push(entry))
+                _dropped.fetch_add(1, std::memory_order_relaxed);
+            else if (ring.size() == MessageRing::Capacity / 2)
+                _wakeup.notify_one();
+        }
+
+        void open() override { _channel->open(); }
+
+        void close() override
+        {
+            stop();
+            _channel->close();
+        }
+
+        void setProperty(const std::string& name, const std::string& value) override
+        {
+            _channel->setProperty(name, value);
+        }
+
+        std::string getProperty(const std::string& name) const override
+        {
+            return _channel->getProperty(name);
+        }
+
+        /// Stops the writer thread, once it wrote what was waiting.
+        void stop()
+        {
+            {
+                std::lock_guard<std::mutex> lock(_wakeupMutex);
+                _stop = true;
+            }
+
+            _wakeup.notify_one();
+            if (_thread.joinable())
+                _thread.join();
+
+            std::lock_guard<std::mutex> lock(_writeMutex);
+            drainLocked();
+        }
+
+        /// Writes what is waiting, unless the writes are under way already.
+        void tryFlush()
+        {
+            std::unique_lock<std::mutex> lock(_writeMutex, std::try_to_lock);
+            if (lock.owns_lock())
+                drainLocked();
+        }
+
+        uint64_t getDroppedCount() const { return _dropped.load(std::memory_order_relaxed); }
+
+    protected:
+        ~AsyncChannel() override { stop(); }
+
+    private:
+        /// The ring of the calling thread, made on its first message.
+        MessageRing& getRing()
+        {
+            struct RingHolder
+            {
+                const AsyncChannel* _channel = nullptr;
+                std::shared_ptr<MessageRing> _ring;
+
+                ~RingHolder()
+                {
+                    if (_ring)
+                        _ring->close();
+                }
+            };
+
+            static thread_local RingHolder holder;
+            if (holder._channel != this)
+            {
+                if (holder._ring)
+                    holder._ring->close();
+
+                holder._ring = std::make_shared<MessageRing>();
+                holder._channel = this;
+                std::lock_guard<std::mutex> lock(_ringsMutex);
+                _rings.push_back(holder._ring);
+            }
+
+            return *holder._ring;
+        }
+
+        void writerThread()
+        {
+            Util::setThreadName("log_writer");
+
+            std::unique_lock<std::mutex> lock(_wakeupMutex);
+            while (!_stop)
+            {
+                _wakeup.wait_for(lock, std::chrono::milliseconds(50));
+                lock.unlock();
+                {
+                    std::lock_guard<std::mutex> writeLock(_writeMutex);
+                    drainLocked();
+                }
+                lock.lock();
+            }
+        }
+
+        /// Writes the messages of all the rings, in the order they were logged.
+        void drainLocked()
+        {
+            std::vector<std::shared_ptr<MessageRing>> rings;
+            {
+                std::lock_guard<std::mutex> lock(_ringsMutex);
+                rings = _rings;
+            }
+
+            _entries.clear();
+            for (const std::shared_ptr<MessageRing>& ring : rings)
+            {
+                const bool closed = ring->isClosed();
+                ring->pop(_entries);
+                if (closed)
+                {
+                    std::lock_guard<std::mutex> lock(_ringsMutex);
+                    _rings.erase(std::remove(_rings.begin(), _rings.end(), ring), _rings.end());
+                }
+            }
+
+            std::sort(_entries.begin(), _entries.end(),
+                      [](const MessageRing::Entry& lhs, const MessageRing::Entry& rhs)
+                      { return lhs._seq < rhs._seq; });
+
+            for (const MessageRing::Entry& entry : _entries)
+                _channel->log(Poco::Message(_source, entry._text, entry._priority));
+
+            const uint64_t dropped = getDroppedCount();
+            if (dropped != _droppedReported)
+            {
+                char buffer[1024];
+                std::string text = prefix<sizeof(buffer) - 1>(buffer, "WRN");
+                text += "Dropped " + std::to_string(dropped - _droppedReported)
+                        + " log messages, logged faster than they could be written.";
+                _channel->log(Poco::Message(_source, text, Poco::Message::PRIO_WARNING));
+                _droppedReported = dropped;
+            }
+        }
+
+        Poco::AutoPtr<Poco::Channel> _channel;
+        const std::string _source;
+        std::atomic<uint64_t> _seq;
+        std::atomic<uint64_t> _dropped;
+        uint64_t _droppedReported;
+
+        /// The rings of the threads, guarded by _ringsMutex.
+        std::vector<std::shared_ptr<MessageRing>> _rings;
+        std::mutex _ringsMutex;
+
+        /// Guards writing to the channel, and the reading of the rings.
+        std::mutex _writeMutex;
+        std::vector<MessageRing::Entry> _entries;
+
+        std::mutex _wakeupMutex;
+        std::condition_variable _wakeup;
+        bool _stop;
+        std::thread _thread;
+    };
+
+    /// The channel all messages go through, when asynchronous.
+    static AsyncChannel* Async = nullptr;
+
+    /// The process that started the writer thread. A child forked from it
+    /// has the channel, but not the thread.
+    static pid_t AsyncPid = 0;
+
     // We need a signal safe means of writing messages
     //   $ man 7 signal
     void signalLog(const char *message)
@@ -307,8 +585,9 @@ namespace Log
         channel->open();
         auto& logger = Poco::Logger::create(Source.getName(), channel, Poco::Message::PRIO_TRACE);
         Source.setLogger(&logger);
+        Source.setChannel(channel);
 
-        logger.setLevel(logLevel.empty() ? std::string("trace") : logLevel);
+        setLevel(logLevel.empty() ? std::string("trace") : logLevel);
 
         const std::time_t t = std::time(nullptr);
         oss.str("");
@@ -327,6 +606,36 @@ namespace Log
         LOG_INF(oss.str());
     }
 
+    void setLevel(const std::string& level)
+    {
+        Poco::Logger& log = logger();
+        log.setLevel(level);
+        CurrentPriority.store(log.getLevel(), std::memory_order_relaxed);
+    }
+
+    void startAsync()
+    {
+        if (Async || Source.getChannel().isNull())
+            return;
+
+        Async = new AsyncChannel(Source.getChannel(), Source.getName());
+        AsyncPid = getpid();
+        AutoPtr<Channel> channel(Async);
+        logger().setChannel(channel);
+        LOG_INF("Logging asynchronously.");
+    }
+
+    uint64_t getDroppedCount()
+    {
+        return Async ? Async->getDroppedCount() : 0;
+    }
+
+    void flushAsync()
+    {
+        if (Async && getpid() == AsyncPid)
+            Async->tryFlush();
+    }
+
     Poco::Logger& logger()
     {
         Poco::Logger* pLogger = Source.getLogger();
@@ -338,6 +647,22 @@ namespace Log
     {
 #if !MOBILEAPP
         IsShutdown = true;
+        CurrentPriority.store(0, std::memory_order_relaxed);
+
+        // Write what is waiting, before the channel goes.
+        if (Async)
+        {
+            if (getpid() == AsyncPid)
+                Async->stop();
+            else
+            {
+                // Forked: there is no writer thread to stop, and the one the
+                // channel has is not to be joined, so it is never released.
+                Async->duplicate();
+            }
+
+            Async = nullptr;
+        }
 
         Poco::Logger::shutdown();
 
@@ -12,6 +12,7 @@
 #include <sys/syscall.h>
 #include <unistd.h>
 
+#include <atomic>
 #include <cerrno>
 #include <cstddef>
 #include <functional>
@@ -31,6 +32,12 @@
 
 #include "Util.hpp"
 
+// The least severe messages compiled in, as a Poco::Message::Priority: those
+// less severe compile to nothing. Set by --with-compiled-log-level.
+#ifndef LOG_COMPILED_PRIORITY
+#define LOG_COMPILED_PRIORITY 8 // Poco::Message::PRIO_TRACE, all of them.
+#endif
+
 inline std::ostream& operator<< (std::ostream& os, const Poco::Timestamp& ts)
 {
     os << Poco::DateTimeFormatter::format(Poco::DateTime(ts),
@@ -56,6 +63,21 @@ namespace Log
     /// Returns the underlying logging system.
     Poco::Logger& logger();
 
+    /// Writes the messages from a thread of its own, rather than in the
+    /// threads logging them, after initialize(). Messages logged faster
+    /// than they can be written are dropped; errors are written right away.
+    /// Not for processes that fork without exec, as forkit does.
+    void startAsync();
+
+    /// The number of messages dropped by the asynchronous writer.
+    uint64_t getDroppedCount();
+
+    /// Writes the messages waiting for the asynchronous writer, for the
+    /// fatal signal handler, which is not to lose them with the process.
+    /// Not signal safe: it is the last thing the process does, and it
+    /// skips the write, rather than wait, should another thread be at it.
+    void flushAsync();
+
     /// Shutdown and release the logging system.
     void shutdown();
 
@@ -78,12 +100,26 @@ namespace Log
         return prefix(Poco::DateTime(), buffer, level);
     }
 
-    inline bool traceEnabled() { return logger().trace(); }
-    inline bool debugEnabled() { return logger().debug(); }
-    inline bool infoEnabled() { return logger().information(); }
-    inline bool warnEnabled() { return logger().warning(); }
-    inline bool errorEnabled() { return logger().error(); }
-    inline bool fatalEnabled() { return logger().fatal(); }
+    /// The level of the logger, as a Poco::Message::Priority, for the log
+    /// statements to check with a single load. None once shut down.
+    extern std::atomic<int> CurrentPriority;
+
+    /// Sets the level of the logger, as Poco::Logger::setLevel() does.
+    void setLevel(const std::string& level);
+
+    /// Whether messages of @priority are compiled in, and logged at the level of the logger.
+    inline bool isEnabled(const Poco::Message::Priority priority)
+    {
+        return priority <= LOG_COMPILED_PRIORITY
+               && priority <= CurrentPriority.load(std::memory_order_relaxed);
+    }
+
+    inline bool traceEnabled() { return isEnabled(Poco::Message::PRIO_TRACE); }
+    inline bool debugEnabled() { return isEnabled(Poco::Message::PRIO_DEBUG); }
+    inline bool infoEnabled() { return isEnabled(Poco::Message::PRIO_INFORMATION); }
+    inline bool warnEnabled() { return isEnabled(Poco::Message::PRIO_WARNING); }
+    inline bool errorEnabled() { return isEnabled(Poco::Message::PRIO_ERROR); }
+    inline bool fatalEnabled() { return isEnabled(Poco::Message::PRIO_FATAL); }
 
     /// Signal safe prefix logging
     void signalLogPrefix();
@@ -302,9 +338,9 @@ namespace Log
 #define LOG_TRC(X)                                                                                 \
     do                                                                                             \
     {                                                                                              \
-        auto& log_ = Log::logger();                                                                \
-        if (log_.trace() && !Log::isShutdownCalled())                                              \
+        if (Log::isEnabled(Poco::Message::PRIO_TRACE))                                             \
         {                                                                                          \
+            auto& log_ = Log::logger();                                                            \
             LOG_BODY_(log_, TRACE, "TRC", X, true);                                                \
         }                                                                                          \
     } while (false)
@@ -312,9 +348,9 @@ namespace Log
 #define LOG_TRC_NOFILE(X)                                                                          \
     do                                                                                             \
     {                                                                                              \
-        auto& log_ = Log::logger();                                                                \
-        if (log_.trace() && !Log::isShutdownCalled())                                              \
+        if (Log::isEnabled(Poco::Message::PRIO_TRACE))                                             \
         {                                                                                          \
+            auto& log_ = Log::logger();                                                            \
             LOG_BODY_(log_, TRACE, "TRC", X, false);                                               \
         }                                                                                          \
     } while (false)
@@ -322,9 +358,9 @@ namespace Log
 #define LOG_DBG(X)                                                                                 \
     do                                                                                             \
     {                                                                                              \
-        auto& log_ = Log::logger();                                                                \
-        if (log_.debug() && !Log::isShutdownCalled())                                              \
+        if (Log::isEnabled(Poco::Message::PRIO_DEBUG))                                             \
         {                                                                                          \
+            auto& log_ = Log::logger();                                                            \
             LOG_BODY_(log_, DEBUG, "DBG", X, true);                                                \
         }                                                                                          \
     } while (false)
@@ -332,9 +368,9 @@ namespace Log
 #define LOG_INF(X)                                                                                 \
     do                                                                                             \
     {                                                                                              \
-        auto& log_ = Log::logger();                                                                \
-        if (log_.information() && !Log::isShutdownCalled())                                        \
+        if (Log::isEnabled(Poco::Message::PRIO_INFORMATION))                                       \
         {                                                                                          \
+            auto& log_ = Log::logger();                                                            \
             LOG_BODY_(log_, INFORMATION, "INF", X, true);                                          \
         }                                                                                          \
     } while (false)
@@ -342,9 +378,9 @@ namespace Log
 #define LOG_INF_NOFILE(X)                                                                          \
     do                                                                                             \
     {                                                                                              \
-        auto& log_ = Log::logger();                                                                \
-        if (log_.information() && !Log::isShutdownCalled())                                        \
+        if (Log::isEnabled(Poco::Message::PRIO_INFORMATION))                                       \
         {                                                                                          \
+            auto& log_ = Log::logger();                                                            \
             LOG_BODY_(log_, INFORMATION, "INF", X, false);                                         \
         }                                                                                          \
     } while (false)
@@ -352,9 +388,9 @@ namespace Log
 #define LOG_WRN(X)                                                                                 \
     do                                                                                             \
     {                                                                                              \
-        auto& log_ = Log::logger();                                                                \
-        if (!Log::isShutdownCalled() && log_.warning())                                            \
+        if (Log::isEnabled(Poco::Message::PRIO_WARNING))                                           \
         {                                                                                          \
+            auto& log_ = Log::logger();                                                            \
             LOG_BODY_(log_, WARNING, "WRN", X, true);                                              \
         }                                                                                          \
     } while (false)
@@ -362,9 +398,9 @@ namespace Log
 #define LOG_ERR(X)                                                                                 \
     do                                                                                             \
     {                                                                                              \
-        auto& log_ = Log::logger();                                                                \
-        if (!Log::isShutdownCalled() && log_.error())                                              \
+        if (Log::isEnabled(Poco::Message::PRIO_ERROR))                                             \
         {                                                                                          \
+            auto& log_ = Log::logger();                                                            \
             LOG_BODY_(log_, ERROR, "ERR", X, true);                                                \
         }                                                                                          \
     } while (false)
@@ -372,9 +408,9 @@ namespace Log
 #define LOG_SYS(X)                                                                                 \
     do                                                                                             \
     {                                                                                              \
-        auto& log_ = Log::logger();                                                                \
-        if (!Log::isShutdownCalled() && log_.error())                                              \
+        if (Log::isEnabled(Poco::Message::PRIO_ERROR))                                             \
         {                                                                                          \
+            auto& log_ = Log::logger();                                                            \
             LOG_BODY_(log_, ERROR, "ERR",                                                          \
                       X << " (" << Util::symbolicErrno(errno) << ": " << std::strerror(errno)      \
                         << ')',                                                                    \
@@ -386,9 +422,9 @@ namespace Log
     do                                                                                             \
     {                                                                                              \
         std::cerr << X << std::endl;                                                               \
-        auto& log_ = Log::logger();                                                                \
-        if (!Log::isShutdownCalled() && log_.fatal())                                              \
+        if (Log::isEnabled(Poco::Message::PRIO_FATAL))                                             \
         {                                                                                          \
+            auto& log_ = Log::logger();                                                            \
             LOG_BODY_(log_, FATAL, "FTL", X, true);                                                \
         }                                                                                          \
     } while (false)
@@ -396,9 +432,9 @@ namespace Log
 #define LOG_SFL(X)                                                                                 \
     do                                                                                             \
     {                                                                                              \
-        auto& log_ = Log::logger();                                                                \
-        if (!Log::isShutdownCalled() && log_.error())                                              \
+        if (Log::isEnabled(Poco::Message::PRIO_ERROR))                                             \
         {                                                                                          \
+            auto& log_ = Log::logger();                                                            \
             LOG_BODY_(log_, FATAL, "FTL",                                                          \
                       X << " (" << Util::symbolicErrno(errno) << ": " << std::strerror(errno)      \
                         << ')',                                                                    \
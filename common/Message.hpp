@@ -9,6 +9,7 @@
 
 #pragma once
 
+#include <algorithm>
 #include <atomic>
 #include <string>
 #include <vector>
@@ -35,7 +36,8 @@ public:
         _id(makeId(dir)),
         _firstLine(LOOLProtocol::getFirstLine(_data.data(), _data.size())),
         _abbr(_id + ' ' + LOOLProtocol::getAbbreviatedMessage(_data.data(), _data.size())),
-        _type(detectType())
+        _type(detectType()),
+        _dedupKey(makeDedupKey())
     {
         LOG_TRC("Message " << _abbr);
     }
@@ -52,7 +54,8 @@ public:
         _id(makeId(dir)),
         _firstLine(LOOLProtocol::getFirstLine(message)),
         _abbr(_id + ' ' + LOOLProtocol::getAbbreviatedMessage(message)),
-        _type(detectType())
+        _type(detectType()),
+        _dedupKey(makeDedupKey())
     {
         _data.resize(message.size());
         const char* offset = skipWhitespace(message.data() + _forwardToken.size());
@@ -71,7 +74,8 @@ public:
         _id(makeId(dir)),
         _firstLine(LOOLProtocol::getFirstLine(_data.data(), _data.size())),
         _abbr(_id + ' ' + LOOLProtocol::getAbbreviatedMessage(_data.data(), _data.size())),
-        _type(detectType())
+        _type(detectType()),
+        _dedupKey(makeDedupKey())
     {
         LOG_TRC("Message " << _abbr);
     }
@@ -92,14 +96,19 @@ public:
 
     /// Return the abbreviated message for logging purposes.
     const std::string& abbr() const { return _abbr; }
+
+    /// Returns the key under which a newer message supersedes an older one
+    /// still waiting to be sent, or an empty string if it never does.
+    const std::string& dedupKey() const { return _dedupKey; }
     const std::string& id() const { return _id; }
 
     /// Returns the json part of the message, if any.
     std::string jsonString() const
     {
-        if (_tokens.size() > 1 && _tokens[1].size() && _tokens[1][0] == '{')
+        if (_tokens.size() > 1 && _tokens.startsWith(1, "{"))
         {
-            const size_t firstTokenSize = _tokens[0].size();
+            size_t firstTokenSize = 0;
+            _tokens.data(0, firstTokenSize);
             return std::string(_data.data() + firstTokenSize, _data.size() - firstTokenSize);
         }
 
@@ -157,6 +166,82 @@ private:
         return Type::Text;
     }
 
+    std::string makeDedupKey() const
+    {
+        if (_tokens.equals(0, "tile:"))
+        {
+            // The fields compared by TileDesc::operator==, i.e. ignoring versions and wire-ids.
+            int viewId = 0, part = 0, width = 0, height = 0, tilePosX = 0, tilePosY = 0;
+            int tileWidth = 0, tileHeight = 0, id = -1;
+            std::string broadcast;
+            for (std::size_t i = 1; i < _tokens.size(); ++i)
+            {
+                LOOLProtocol::getTokenInteger(_tokens, i, "nviewid", viewId) ||
+                LOOLProtocol::getTokenInteger(_tokens, i, "part", part) ||
+                LOOLProtocol::getTokenInteger(_tokens, i, "width", width) ||
+                LOOLProtocol::getTokenInteger(_tokens, i, "height", height) ||
+                LOOLProtocol::getTokenInteger(_tokens, i, "tileposx", tilePosX) ||
+                LOOLProtocol::getTokenInteger(_tokens, i, "tileposy", tilePosY) ||
+                LOOLProtocol::getTokenInteger(_tokens, i, "tilewidth", tileWidth) ||
+                LOOLProtocol::getTokenInteger(_tokens, i, "tileheight", tileHeight) ||
+                LOOLProtocol::getTokenInteger(_tokens, i, "id", id) ||
+                LOOLProtocol::getTokenString(_tokens, i, "broadcast", broadcast);
+            }
+
+            return "tile: " + std::to_string(viewId) + ' ' + std::to_string(part) + ' ' +
+                   std::to_string(width) + ' ' + std::to_string(height) + ' ' +
+                   std::to_string(tilePosX) + ' ' + std::to_string(tilePosY) + ' ' +
+                   std::to_string(tileWidth) + ' ' + std::to_string(tileHeight) + ' ' +
+                   std::to_string(id) + (broadcast == "yes" ? " broadcast" : "");
+        }
+
+        if (_tokens.equals(0, "statusindicatorsetvalue:") ||
+            _tokens.equals(0, "invalidatecursor:") ||
+            _tokens.equals(0, "setpart:"))
+        {
+            // Only the most recent one matters.
+            return _tokens[0];
+        }
+
+        if (_tokens.equals(0, "invalidateviewcursor:"))
+        {
+            // One per view; the payload is JSON, but we only need the viewId.
+            const std::string viewId = findJsonValue("viewId");
+            if (!viewId.empty())
+                return "invalidateviewcursor: " + viewId;
+        }
+
+        return std::string();
+    }
+
+    /// Finds the value of a top-level scalar in a flat JSON payload without parsing it.
+    std::string findJsonValue(const char* key) const
+    {
+        const std::string quotedKey = '"' + std::string(key) + '"';
+        const auto end = _data.end();
+        auto it = std::search(_data.begin(), end, quotedKey.begin(), quotedKey.end());
+        if (it == end)
+            return std::string();
+
+        it += quotedKey.size();
+        while (it != end && (*it == ' ' || *it == '\t' || *it == '\n'))
+            ++it;
+        if (it == end || *it != ':')
+            return std::string();
+
+        ++it;
+        while (it != end && (*it == ' ' || *it == '\t' || *it == '\n'))
+            ++it;
+        if (it != end && *it == '"')
+            ++it;
+
+        const auto start = it;
+        while (it != end && *it != '"' && *it != ',' && *it != '}' && *it != ' ')
+            ++it;
+
+        return std::string(start, it);
+    }
+
     std::string getForwardToken(const char* buffer, int length)
     {
         std::string forward = LOOLProtocol::getFirstToken(buffer, length);
@@ -181,6 +266,7 @@ private:
     const std::string _firstLine;
     const std::string _abbr;
     const Type _type;
+    const std::string _dedupKey;
 };
 
 /* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -77,22 +77,6 @@ void TileQueue::put_impl(const Payload& value)
         MessageQueue::put_impl(value);
         return;
     }
-    else if (firstToken == "callback")
-    {
-        const std::string newMsg = removeCallbackDuplicate(msg);
-
-        if (newMsg.empty())
-        {
-            MessageQueue::put_impl(value);
-        }
-        else
-        {
-            MessageQueue::put_impl(Payload(newMsg.data(), newMsg.data() + newMsg.size()));
-        }
-
-        return;
-    }
-
     MessageQueue::put_impl(value);
 }
 
@@ -125,235 +109,219 @@ void TileQueue::removeTileDuplicate(const std::string& tileMsg)
 
 namespace {
 
-/// Read the viewId from the tokens.
-std::string extractViewId(const std::string& origMsg, const StringVector& tokens)
-{
-    size_t nonJson = tokens[0].size() + tokens[1].size() + tokens[2].size() + 3; // including spaces
-    std::string jsonString(origMsg.data() + nonJson, origMsg.size() - nonJson);
-
-    Poco::JSON::Parser parser;
-    const Poco::Dynamic::Var result = parser.parse(jsonString);
-    const auto& json = result.extract<Poco::JSON::Object::Ptr>();
-    return json->get("viewId").toString();
-}
-
 /// Extract the .uno: command ID from the potential command.
 std::string extractUnoCommand(const std::string& command)
 {
     if (!LOOLProtocol::matchPrefix(".uno:", command))
         return std::string();
 
-    size_t equalPos = command.find('=');
+    size_t equalPos = command.find_first_of("= ");
     if (equalPos != std::string::npos)
         return command.substr(0, equalPos);
 
     return command;
 }
 
-/// Extract rectangle from the invalidation callback
-bool extractRectangle(const StringVector& tokens, int& x, int& y, int& w, int& h, int& part)
+/// Extract the "x, y, width, height" rectangle, or EMPTY, from @tokens.
+bool extractRectangle(const StringVector& tokens, int& x, int& y, int& w, int& h, bool& isEmpty)
 {
     x = 0;
     y = 0;
     w = INT_MAX;
     h = INT_MAX;
-    part = 0;
+    isEmpty = false;
 
-    if (tokens.size() < 5)
-        return false;
-
-    if (tokens.equals(3, "EMPTY,"))
+    if (tokens.size() > 0 && tokens.equals(0, "EMPTY"))
     {
-        part = std::atoi(tokens[4].c_str());
+        isEmpty = true;
         return true;
     }
 
-    if (tokens.size() < 8)
+    if (tokens.size() < 4)
         return false;
 
-    x = std::atoi(tokens[3].c_str());
-    y = std::atoi(tokens[4].c_str());
-    w = std::atoi(tokens[5].c_str());
-    h = std::atoi(tokens[6].c_str());
-    part = std::atoi(tokens[7].c_str());
+    x = std::atoi(tokens[0].c_str());
+    y = std::atoi(tokens[1].c_str());
+    w = std::atoi(tokens[2].c_str());
+    h = std::atoi(tokens[3].c_str());
 
     return true;
 }
 
-}
-
-std::string TileQueue::removeCallbackDuplicate(const std::string& callbackMsg)
+bool isViewCallback(const int type)
 {
-    assert(LOOLProtocol::matchPrefix("callback", callbackMsg, /*ignoreWhitespace*/ true));
-
-    StringVector tokens = Util::tokenize(callbackMsg);
-
-    if (tokens.size() < 3)
-        return std::string();
-
-    // the message is "callback <view> <id> ..."
-    const auto pair = Util::i32FromString(tokens[2]);
-    if (!pair.second)
-        return std::string();
+    switch (type)
+    {
+        case LOK_CALLBACK_INVALIDATE_VIEW_CURSOR:
+        case LOK_CALLBACK_TEXT_VIEW_SELECTION:
+        case LOK_CALLBACK_CELL_VIEW_CURSOR:
+        case LOK_CALLBACK_GRAPHIC_VIEW_SELECTION:
+        case LOK_CALLBACK_VIEW_CURSOR_VISIBLE:
+        case LOK_CALLBACK_VIEW_LOCK:
+            return true;
+        default:
+            return false;
+    }
+}
 
-    const auto callbackType = static_cast<LibreOfficeKitCallbackType>(pair.first);
+}
 
-    switch (callbackType)
+TileQueue::Callback::Callback(const int view, const int type, const std::string& payload)
+    : _view(view)
+    , _type(type)
+    , _payload(payload)
+{
+    switch (type)
     {
-        case LOK_CALLBACK_INVALIDATE_TILES: // invalidation
+        case LOK_CALLBACK_INVALIDATE_TILES:
         {
-            int msgX, msgY, msgW, msgH, msgPart;
-
-            if (!extractRectangle(tokens, msgX, msgY, msgW, msgH, msgPart))
-                return std::string();
-
-            bool performedMerge = false;
-
-            // we always travel the entire queue
-            std::size_t i = 0;
-            while (i < getQueue().size())
-            {
-                auto& it = getQueue()[i];
+            // "x, y, width, height, part" or "EMPTY, part"
+            const StringVector tokens = Util::tokenize(payload, ',');
+            _hasRect = extractRectangle(tokens, _x, _y, _width, _height, _isEmpty);
+            const size_t partIndex = (_isEmpty ? 1 : 4);
+            if (_hasRect && tokens.size() > partIndex)
+                _part = std::atoi(tokens[partIndex].c_str());
+            else
+                _hasRect = false;
+        }
+        break;
 
-                StringVector queuedTokens = Util::tokenize(it.data(), it.size());
-                if (queuedTokens.size() < 3)
-                {
-                    ++i;
-                    continue;
-                }
+        case LOK_CALLBACK_CELL_CURSOR:
+            _hasRect = extractRectangle(Util::tokenize(payload, ','), _x, _y, _width, _height,
+                                        _isEmpty);
+        break;
 
-                // not a invalidation callback
-                if (queuedTokens[0] != tokens[0] || queuedTokens[1] != tokens[1]
-                    || queuedTokens[2] != tokens[2])
-                {
-                    ++i;
-                    continue;
-                }
+        case LOK_CALLBACK_STATE_CHANGED:
+            _unoCommand = extractUnoCommand(payload);
+        break;
 
-                int queuedX, queuedY, queuedW, queuedH, queuedPart;
+        default:
+        {
+            if (type != LOK_CALLBACK_INVALIDATE_VISIBLE_CURSOR && !isViewCallback(type))
+                break;
 
-                if (!extractRectangle(queuedTokens, queuedX, queuedY, queuedW, queuedH, queuedPart))
-                {
-                    ++i;
-                    continue;
-                }
+            // Older cores send the visible cursor as a bare rectangle.
+            if (payload.empty() || payload[0] != '{')
+            {
+                _hasRect = extractRectangle(Util::tokenize(payload, ','), _x, _y, _width,
+                                            _height, _isEmpty);
+                break;
+            }
 
-                if (msgPart != queuedPart)
-                {
-                    ++i;
-                    continue;
-                }
+            try
+            {
+                Poco::JSON::Parser parser;
+                const Poco::Dynamic::Var result = parser.parse(payload);
+                const auto& json = result.extract<Poco::JSON::Object::Ptr>();
+                if (json->has("viewId"))
+                    _viewId = std::stoi(json->get("viewId").toString());
 
-                // the invalidation in the queue is fully covered by the message,
-                // just remove it
-                if (msgX <= queuedX && queuedX + queuedW <= msgX + msgW && msgY <= queuedY
-                    && queuedY + queuedH <= msgY + msgH)
+                if (json->has("rectangle"))
                 {
-                    LOG_TRC("Removing smaller invalidation: "
-                            << std::string(it.data(), it.size()) << " -> " << tokens[0] << ' '
-                            << tokens[1] << ' ' << tokens[2] << ' ' << msgX << ' ' << msgY << ' '
-                            << msgW << ' ' << msgH << ' ' << msgPart);
-
-                    // remove from the queue
-                    getQueue().erase(getQueue().begin() + i);
-                    continue;
+                    _hasRect = extractRectangle(
+                        Util::tokenize(json->get("rectangle").toString(), ','), _x, _y, _width,
+                        _height, _isEmpty);
+                    if (json->has("part"))
+                        _part = std::stoi(json->get("part").toString());
                 }
+            }
+            catch (const std::exception& exc)
+            {
+                LOG_WRN("Failed to parse the payload of " << lokCallbackTypeToString(type) << " ["
+                                                          << payload << "]: " << exc.what());
+            }
+        }
+        break;
+    }
+}
 
-                // the invalidation just intersects, join those (if the result is
-                // small)
-                if (TileDesc::rectanglesIntersect(msgX, msgY, msgW, msgH, queuedX, queuedY, queuedW,
-                                                  queuedH))
-                {
-                    int joinX = std::min(msgX, queuedX);
-                    int joinY = std::min(msgY, queuedY);
-                    int joinW = std::max(msgX + msgW, queuedX + queuedW) - joinX;
-                    int joinH = std::max(msgY + msgH, queuedY + queuedH) - joinY;
-
-                    const int reasonableSizeX = 4 * 3840; // 4x tile at 100% zoom
-                    const int reasonableSizeY = 2 * 3840; // 2x tile at 100% zoom
-                    if (joinW > reasonableSizeX || joinH > reasonableSizeY)
-                    {
-                        ++i;
-                        continue;
-                    }
-
-                    LOG_TRC("Merging invalidations: "
-                            << std::string(it.data(), it.size()) << " and " << tokens[0] << ' '
-                            << tokens[1] << ' ' << tokens[2] << ' ' << msgX << ' ' << msgY << ' '
-                            << msgW << ' ' << msgH << ' ' << msgPart << " -> " << tokens[0] << ' '
-                            << tokens[1] << ' ' << tokens[2] << ' ' << joinX << ' ' << joinY << ' '
-                            << joinW << ' ' << joinH << ' ' << msgPart);
-
-                    msgX = joinX;
-                    msgY = joinY;
-                    msgW = joinW;
-                    msgH = joinH;
-                    performedMerge = true;
-
-                    // remove from the queue
-                    getQueue().erase(getQueue().begin() + i);
-                    continue;
-                }
+void TileQueue::putCallback_impl(const Callback& callback)
+{
+    if (callback._type == LOK_CALLBACK_INVALIDATE_TILES && callback._hasRect)
+    {
+        ++_invalidationsIn;
+        InvalidationRegion& region = _invalidations[std::make_pair(callback._view, callback._part)];
+        if (callback._isEmpty)
+            region.addAll();
+        else
+            region.add(callback._x, callback._y, callback._width, callback._height);
+        return;
+    }
 
-                ++i;
-            }
+    removeCallbackDuplicate(callback);
+    _callbacks.push_back(callback);
+}
 
-            if (performedMerge)
-            {
-                std::size_t pre = tokens[0].size() + tokens[1].size() + tokens[2].size() + 3;
-                std::size_t post = pre + tokens[3].size() + tokens[4].size() + tokens[5].size()
-                              + tokens[6].size() + 4;
+void TileQueue::flushInvalidations()
+{
+    if (_invalidations.empty())
+        return;
 
-                std::string result = callbackMsg.substr(0, pre) + std::to_string(msgX) + ", "
-                                     + std::to_string(msgY) + ", " + std::to_string(msgW) + ", "
-                                     + std::to_string(msgH) + ", " + callbackMsg.substr(post);
+    for (const auto& pair : _invalidations)
+    {
+        const int view = pair.first.first;
+        const int part = pair.first.second;
+        const InvalidationRegion& region = pair.second;
 
-                LOG_TRC("Merge result: " << result);
+        Callback callback;
+        callback._view = view;
+        callback._type = LOK_CALLBACK_INVALIDATE_TILES;
+        callback._hasRect = true;
+        callback._part = part;
 
-                return result;
-            }
+        if (region.isAll())
+        {
+            callback._isEmpty = true;
+            callback._x = 0;
+            callback._y = 0;
+            callback._width = INT_MAX;
+            callback._height = INT_MAX;
+            callback._payload = "EMPTY, " + std::to_string(part);
+            _callbacks.push_back(callback);
+            ++_invalidationsOut;
+            continue;
         }
-        break;
 
-        case LOK_CALLBACK_STATE_CHANGED: // state changed
+        for (const Util::Rectangle& rectangle : region.getRectangles())
         {
-            if (tokens.size() < 4)
-                return std::string();
+            callback._x = rectangle.getLeft();
+            callback._y = rectangle.getTop();
+            callback._width = rectangle.getWidth();
+            callback._height = rectangle.getHeight();
+            callback._payload = std::to_string(callback._x) + ", " + std::to_string(callback._y)
+                                + ", " + std::to_string(callback._width) + ", "
+                                + std::to_string(callback._height) + ", " + std::to_string(part);
+            _callbacks.push_back(callback);
+            ++_invalidationsOut;
+        }
+    }
 
-            std::string unoCommand = extractUnoCommand(tokens[3]);
-            if (unoCommand.empty())
-                return std::string();
+    LOG_TRC("Coalesced tile invalidations, " << _invalidationsIn << " in and "
+                                             << _invalidationsOut << " out so far.");
+    _invalidations.clear();
+}
 
+void TileQueue::removeCallbackDuplicate(const Callback& callback)
+{
+    switch (static_cast<LibreOfficeKitCallbackType>(callback._type))
+    {
+        case LOK_CALLBACK_STATE_CHANGED: // state changed
+        {
             // This is needed because otherwise it creates some problems when
             // a save occurs while a cell is still edited in Calc.
-            if (unoCommand == ".uno:ModifiedStatus")
-                return std::string();
+            if (callback._unoCommand.empty() || callback._unoCommand == ".uno:ModifiedStatus")
+                return;
 
             // remove obsolete states of the same .uno: command
-            for (std::size_t i = 0; i < getQueue().size(); ++i)
+            for (std::size_t i = 0; i < _callbacks.size(); ++i)
             {
-                auto& it = getQueue()[i];
-
-                StringVector queuedTokens = Util::tokenize(it.data(), it.size());
-                if (queuedTokens.size() < 4)
-                    continue;
-
-                if (queuedTokens[0] != tokens[0] || queuedTokens[1] != tokens[1]
-                    || queuedTokens[2] != tokens[2])
-                    continue;
-
-                // callback, the same target, state changed; now check it's
-                // the same .uno: command
-                std::string queuedUnoCommand = extractUnoCommand(queuedTokens[3]);
-                if (queuedUnoCommand.empty())
-                    continue;
-
-                if (unoCommand == queuedUnoCommand)
+                const Callback& queued = _callbacks[i];
+                if (queued._type == callback._type && queued._view == callback._view
+                    && queued._unoCommand == callback._unoCommand)
                 {
-                    LOG_TRC("Remove obsolete uno command: "
-                            << std::string(it.data(), it.size()) << " -> "
-                            << LOOLProtocol::getAbbreviatedMessage(callbackMsg));
-                    getQueue().erase(getQueue().begin() + i);
+                    LOG_TRC("Remove obsolete uno command: [" << queued._payload << "] -> ["
+                                                             << callback._payload << ']');
+                    _callbacks.erase(_callbacks.begin() + i);
                     break;
                 }
             }
@@ -369,53 +337,20 @@ std::string TileQueue::removeCallbackDuplicate(const std::string& callbackMsg)
         case LOK_CALLBACK_CELL_VIEW_CURSOR: // the view cell cursor has moved
         case LOK_CALLBACK_VIEW_CURSOR_VISIBLE: // the view cursor visibility has changed
         {
-            const bool isViewCallback = (callbackType == LOK_CALLBACK_INVALIDATE_VIEW_CURSOR
-                                         || callbackType == LOK_CALLBACK_CELL_VIEW_CURSOR
-                                         || callbackType == LOK_CALLBACK_VIEW_CURSOR_VISIBLE);
-
-            const std::string viewId
-                = (isViewCallback ? extractViewId(callbackMsg, tokens) : std::string());
-
-            for (std::size_t i = 0; i < getQueue().size(); ++i)
+            for (std::size_t i = 0; i < _callbacks.size(); ++i)
             {
-                const auto& it = getQueue()[i];
-
-                // skip non-callbacks quickly
-                if (!LOOLProtocol::matchPrefix("callback", it))
-                    continue;
-
-                StringVector queuedTokens = Util::tokenize(it.data(), it.size());
-                if (queuedTokens.size() < 3)
-                    continue;
+                const Callback& queued = _callbacks[i];
 
-                if (!isViewCallback
-                    && (queuedTokens.equals(1, tokens, 1) && queuedTokens.equals(2, tokens, 2)))
+                // view callbacks additionally need to be about the same view
+                // (otherwise we'd merge them all views into one)
+                if (queued._type == callback._type && queued._view == callback._view
+                    && queued._viewId == callback._viewId)
                 {
-                    LOG_TRC("Remove obsolete callback: "
-                            << std::string(it.data(), it.size()) << " -> "
-                            << LOOLProtocol::getAbbreviatedMessage(callbackMsg));
-                    getQueue().erase(getQueue().begin() + i);
+                    LOG_TRC("Remove obsolete callback: [" << queued._payload << "] -> ["
+                                                          << callback._payload << ']');
+                    _callbacks.erase(_callbacks.begin() + i);
                     break;
                 }
-                else if (isViewCallback
-                         && (queuedTokens.equals(1, tokens, 1)
-                             && queuedTokens.equals(2, tokens, 2)))
-                {
-                    // we additionally need to ensure that the payload is about
-                    // the same viewid (otherwise we'd merge them all views into
-                    // one)
-                    const std::string queuedViewId
-                        = extractViewId(std::string(it.data(), it.size()), queuedTokens);
-
-                    if (viewId == queuedViewId)
-                    {
-                        LOG_TRC("Remove obsolete view callback: "
-                                << std::string(it.data(), it.size()) << " -> "
-                                << LOOLProtocol::getAbbreviatedMessage(callbackMsg));
-                        getQueue().erase(getQueue().begin() + i);
-                        break;
-                    }
-                }
             }
         }
         break;
@@ -424,8 +359,6 @@ std::string TileQueue::removeCallbackDuplicate(const std::string& callbackMsg)
         break;
 
     } // switch
-
-    return std::string();
 }
 
 int TileQueue::priority(const std::string& tileMsg)
@@ -11,12 +11,16 @@
 
 #include <algorithm>
 #include <condition_variable>
+#include <deque>
 #include <functional>
 #include <map>
 #include <mutex>
 #include <string>
+#include <utility>
 #include <vector>
 
+#include "InvalidationRegion.hpp"
+
 /// Thread-safe message queue (FIFO).
 template <typename T>
 class MessageQueueBase
@@ -178,6 +182,79 @@ private:
     };
 
 public:
+    /// A LOK callback, parsed once as it arrives from the core.
+    struct Callback
+    {
+        Callback() {}
+
+        /// Parses the fields that deduplication and cursor tracking need from @payload.
+        Callback(int view, int type, const std::string& payload);
+
+        /// The view to forward to, or -1 for all of them.
+        int _view = -1;
+        int _type = -1;
+        std::string _payload;
+
+        /// The view a view callback is about, from its JSON payload, or -1.
+        int _viewId = -1;
+
+        /// The rectangle of an invalidation or a cursor, if it has one.
+        /// EMPTY is the whole of @_part.
+        bool _hasRect = false;
+        bool _isEmpty = false;
+        int _part = 0;
+        int _x = 0;
+        int _y = 0;
+        int _width = 0;
+        int _height = 0;
+
+        /// The .uno: command of a state change, without its value.
+        std::string _unoCommand;
+    };
+
+    /// Queues @callback, dropping or merging the queued ones it makes obsolete.
+    void putCallback(const Callback& callback)
+    {
+        std::unique_lock<std::mutex> lock = getLock();
+        putCallback_impl(callback);
+    }
+
+    /// Pops the oldest callback into @callback; false if there is none.
+    /// The invalidations collected so far go out once the rest are popped.
+    bool popCallback(Callback& callback)
+    {
+        std::unique_lock<std::mutex> lock = getLock();
+        if (_callbacks.empty())
+            flushInvalidations();
+
+        if (_callbacks.empty())
+            return false;
+
+        callback = std::move(_callbacks.front());
+        _callbacks.pop_front();
+        return true;
+    }
+
+    bool hasCallbacks()
+    {
+        std::unique_lock<std::mutex> lock = getLock();
+        return !_callbacks.empty() || !_invalidations.empty();
+    }
+
+    /// The number of tile invalidations the core sent us.
+    uint64_t getInvalidationsIn()
+    {
+        std::unique_lock<std::mutex> lock = getLock();
+        return _invalidationsIn;
+    }
+
+    /// The number of tile invalidations we passed on, once coalesced.
+    uint64_t getInvalidationsOut()
+    {
+        std::unique_lock<std::mutex> lock = getLock();
+        return _invalidationsOut;
+    }
+
     void updateCursorPosition(int viewId, int part, int x, int y, int width, int height)
     {
         const TileQueue::CursorPosition cursorPosition = CursorPosition(part, x, y, width, height);
@@ -227,13 +304,16 @@ private:
     /// Search the queue for a duplicate tile and remove it (if present).
     void removeTileDuplicate(const std::string& tileMsg);
 
+    void putCallback_impl(const Callback& callback);
+
     /// Search the queue for a duplicate callback and remove it (if present).
     ///
     /// This removes also callbacks that are made invalid by the current
-    /// message, like the new cursor position invalidates the old one etc.
-    ///
-    /// @return New message to put into the queue.  If empty, use what was in callbackMsg.
-    std::string removeCallbackDuplicate(const std::string& callbackMsg);
+    /// one, like the new cursor position invalidates the old one etc.
+    void removeCallbackDuplicate(const Callback& callback);
+
+    /// Queues the rectangles covering the invalidations collected so far.
+    void flushInvalidations();
 
     /// De-prioritize the previews (tiles with 'id') - move them to the end of
     /// the queue.
@@ -250,6 +330,15 @@ private:
     /// Check the views in the order of how the editing (cursor movement) has
     /// been happening (0 == oldest, size() - 1 == newest).
     std::vector<int> _viewOrder;
+
+    /// The callbacks, in the order they came, kept apart from the requests.
+    /// Popped from the front, so a deque.
+    std::deque<Callback> _callbacks;
+
+    /// The tile invalidations since the last flush, by view and part.
+    std::map<std::pair<int, int>, InvalidationRegion> _invalidations;
+    uint64_t _invalidationsIn = 0;
+    uint64_t _invalidationsOut = 0;
 };
 
 /* vim:set shiftwidth=4 softtabstop=4 expandtab: */
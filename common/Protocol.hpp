@@ -9,6 +9,7 @@
 
 #pragma once
 
+#include <algorithm>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
@@ -125,6 +126,111 @@ namespace LOOLProtocol
         return false;
     }
 
+    /// Finds the value of a "name=value" token given as a character range, without copying.
+    /// Returns a pointer to the first character of the value, or nullptr if the token has a
+    /// different name.
+    inline const char* getTokenValue(const char* token, const std::size_t length,
+                                     const char* name, const std::size_t nameLength,
+                                     std::size_t& valueLength)
+    {
+        if (token != nullptr && length > nameLength && token[nameLength] == '=' &&
+            std::memcmp(token, name, nameLength) == 0)
+        {
+            valueLength = length - nameLength - 1;
+            return token + nameLength + 1;
+        }
+
+        valueLength = 0;
+        return nullptr;
+    }
+
+    /// The following parse the nth token of tokens in-place, so the hot message handlers don't
+    /// have to create a substring for every token they look at.
+
+    template <std::size_t N>
+    inline bool getTokenInteger(const StringVector& tokens, std::size_t index,
+                                const char (&name)[N], int& value)
+    {
+        // N includes null termination.
+        static_assert(N > 1, "Token name must be at least one character long.");
+        std::size_t length = 0;
+        const char* token = tokens.data(index, length);
+        std::size_t valueLength = 0;
+        const char* str = getTokenValue(token, length, name, N - 1, valueLength);
+        if (str == nullptr || valueLength == 0)
+            return false;
+
+        char* endptr = nullptr;
+        value = std::strtol(str, &endptr, 10);
+        return (endptr > str && endptr <= str + valueLength);
+    }
+
+    template <std::size_t N>
+    inline bool getTokenUInt32(const StringVector& tokens, std::size_t index,
+                               const char (&name)[N], uint32_t& value)
+    {
+        static_assert(N > 1, "Token name must be at least one character long.");
+        std::size_t length = 0;
+        const char* token = tokens.data(index, length);
+        std::size_t valueLength = 0;
+        const char* str = getTokenValue(token, length, name, N - 1, valueLength);
+        if (str == nullptr || valueLength == 0)
+            return false;
+
+        char* endptr = nullptr;
+        value = std::strtoul(str, &endptr, 10);
+        return (endptr > str && endptr <= str + valueLength);
+    }
+
+    template <std::size_t N>
+    inline bool getTokenString(const StringVector& tokens, std::size_t index,
+                               const char (&name)[N], std::string& value)
+    {
+        static_assert(N > 1, "Token name must be at least one character long.");
+        std::size_t length = 0;
+        const char* token = tokens.data(index, length);
+        std::size_t valueLength = 0;
+        const char* str = getTokenValue(token, length, name, N - 1, valueLength);
+        if (str == nullptr)
+            return false;
+
+        value.assign(str, valueLength);
+        return true;
+    }
+
+    template <std::size_t N>
+    inline bool getTokenKeyword(const StringVector& tokens, std::size_t index,
+                                const char (&name)[N], const std::map<std::string, int>& map,
+                                int& value)
+    {
+        static_assert(N > 1, "Token name must be at least one character long.");
+        std::size_t length = 0;
+        const char* token = tokens.data(index, length);
+        std::size_t valueLength = 0;
+        const char* str = getTokenValue(token, length, name, N - 1, valueLength);
+        if (str == nullptr || valueLength == 0)
+            return false;
+
+        if (valueLength >= 2 && str[0] == '\'' && str[valueLength - 1] == '\'')
+        {
+            ++str;
+            valueLength -= 2;
+        }
+
+        // The keyword maps are tiny, a linear scan is cheaper than building a key string.
+        for (const auto& pair : map)
+        {
+            if (pair.first.size() == valueLength &&
+                pair.first.compare(0, valueLength, str, valueLength) == 0)
+            {
+                value = pair.second;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
     bool getTokenStringFromMessage(const std::string& message, const std::string& name, std::string& value);
     bool getTokenKeywordFromMessage(const std::string& message, const std::string& name, const std::map<std::string, int>& map, int& value);
 
@@ -216,7 +322,7 @@ namespace LOOLProtocol
     /// Notice that this doesn't guarantee editing activity,
     /// rather just user interaction with the UI.
     inline
-    bool tokenIndicatesUserInteraction(const std::string& token)
+    bool tokenIndicatesUserInteraction(const char* token, const std::size_t length)
     {
         // Exclude tokens that include these keywords, such as canceltiles statusindicator.
 
@@ -225,10 +331,31 @@ namespace LOOLProtocol
         // but that is coincidental. We should check what the actual whole token is, at least, not
         // look for a substring.
 
-        return (token.find("tile") == std::string::npos &&
-                token.find("status") == std::string::npos &&
-                token.find("state") == std::string::npos &&
-                token != "userinactive");
+        const auto contains = [token, length](const char* keyword, std::size_t keywordLength) {
+            const char* end = token + length;
+            return std::search(token, end, keyword, keyword + keywordLength) != end;
+        };
+
+        static const char userInactive[] = "userinactive";
+        return (!contains("tile", 4) &&
+                !contains("status", 6) &&
+                !contains("state", 5) &&
+                !(length == sizeof(userInactive) - 1 &&
+                  std::memcmp(token, userInactive, length) == 0));
+    }
+
+    inline
+    bool tokenIndicatesUserInteraction(const std::string& token)
+    {
+        return tokenIndicatesUserInteraction(token.data(), token.size());
+    }
+
+    inline
+    bool tokenIndicatesUserInteraction(const StringVector& tokens, std::size_t index)
+    {
+        std::size_t length = 0;
+        const char* token = tokens.data(index, length);
+        return tokenIndicatesUserInteraction(token, length);
     }
 
     /// Returns the first line of a message.
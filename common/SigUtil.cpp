@@ -253,8 +253,13 @@ namespace SigUtil
         sigaction(signal, &action, nullptr);
 
         if (!bReEntered)
+        {
             dumpBacktrace();
 
+            // The lines leading here, that the log writer has yet to write.
+            Log::flushAsync();
+        }
+
         // let default handler process the signal
         ::raise(signal);
     }
@@ -90,6 +90,22 @@ public:
         return _string.substr(token._index, token._length);
     }
 
+    /// Gives access to the nth token without creating a substring. The returned pointer is into
+    /// the underlying string, so it is not null-terminated at the token end and is only valid
+    /// while this StringVector is alive. Gives nullptr and 0 length if index is unexpected.
+    const char* data(std::size_t index, std::size_t& length) const
+    {
+        if (index >= _tokens.size())
+        {
+            length = 0;
+            return nullptr;
+        }
+
+        const StringToken& token = _tokens[index];
+        length = token._length;
+        return _string.data() + token._index;
+    }
+
     /// Concats tokens starting from begin, using separator as separator.
     template <typename T> inline std::string cat(const T& separator, std::size_t offset) const
     {
@@ -134,8 +150,23 @@ public:
             return false;
         }
 
+        // N includes null termination.
+        const StringToken& token = _tokens[index];
+        return _string.compare(token._index, token._length, string, N - 1) == 0;
+    }
+
+    /// Checks if the nth token starts with the given prefix.
+    template <std::size_t N>
+    bool startsWith(std::size_t index, const char (&prefix)[N]) const
+    {
+        if (index >= _tokens.size())
+        {
+            return false;
+        }
+
+        // N includes null termination.
         const StringToken& token = _tokens[index];
-        return _string.compare(token._index, token._length, string, N) == 0;
+        return token._length >= N - 1 && _string.compare(token._index, N - 1, prefix, N - 1) == 0;
     }
 
     /// Compares the nth token with the mth token from an other StringVector.
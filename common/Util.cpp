@@ -294,7 +294,8 @@ namespace Util
             int ret = execvp(params[0], &params[0]);
             if (ret < 0)
                 std::cerr << "Failed to exec command '" << cmd << "' with error '" << strerror(errno) << "'\n";
-            Log::shutdown();
+            // Not Log::shutdown(): the child has none of the threads of the
+            // parent, the log writer among them, and is not to wait for them.
             _exit(42);
         }
         // else spawning process still
@@ -439,6 +440,59 @@ namespace Util
         return std::make_pair(numPSSKb, numDirtyKb);
     }
 
+    /// The kind of the mapping on an smaps header line, e.g.
+    /// "7f2c1a000000-7f2c1a200000 r-xp 00000000 08:01 1234 /lo/program/libmergedlo.so".
+    static const char* getMappingKind(const char* line)
+    {
+        char path[4096] = { 0 };
+        if (sscanf(line, "%*s %*s %*s %*s %*s %4095[^\n]", path) != 1)
+            return "anonymous";
+
+        const std::string name(path);
+        if (name == "[heap]")
+            return "heap";
+        if (Util::startsWith(name, "[stack"))
+            return "stack";
+        if (name[0] == '[')
+            return "other";
+        // LibreOffice's own libraries and resources are all under its program/.
+        if (name.find("/program/") != std::string::npos)
+            return "libreoffice";
+        if (name.find("/fonts/") != std::string::npos || name.find("fontconfig") != std::string::npos
+            || Util::endsWith(name, ".ttf") || Util::endsWith(name, ".otf")
+            || Util::endsWith(name, ".ttc") || Util::endsWith(name, ".pfb"))
+            return "fonts";
+        if (name.find(".so") != std::string::npos)
+            return "libraries";
+        return "other";
+    }
+
+    std::map<std::string, size_t> getDirtyByMappingFromSMaps(FILE* file)
+    {
+        std::map<std::string, size_t> dirtyKb;
+        if (file)
+        {
+            rewind(file);
+            const char* kind = "other";
+            char line[4096] = { 0 };
+            while (fgets(line, sizeof (line), file))
+            {
+                unsigned long start, end;
+                const char *value;
+                if (sscanf(line, "%lx-%lx", &start, &end) == 2)
+                {
+                    kind = getMappingKind(line);
+                }
+                else if ((value = startsWith(line, "Private_Dirty:")))
+                {
+                    dirtyKb[kind] += atoi(value);
+                }
+            }
+        }
+
+        return dirtyKb;
+    }
+
     std::string getMemoryStats(FILE* file)
     {
         const std::pair<size_t, size_t> pssAndDirtyKb = getPssAndDirtyFromSMaps(file);
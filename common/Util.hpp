@@ -151,6 +151,11 @@ namespace Util
     /// returns them as a pair in the same order
     std::pair<size_t, size_t> getPssAndDirtyFromSMaps(FILE* file);
 
+    /// Reads from SMaps file the Private_Dirty values of each kind of mapping:
+    /// heap, stack, libreoffice, fonts, libraries, anonymous or other,
+    /// and returns them by kind.
+    std::map<std::string, size_t> getDirtyByMappingFromSMaps(FILE* file);
+
     size_t getCpuUsage(const pid_t pid);
 
     size_t getStatFromPid(const pid_t pid, int ind);
@@ -420,6 +425,13 @@ namespace Util
         return false;
     }
 
+    /// Return true iff s ends with t.
+    inline bool endsWith(const std::string& s, const std::string& t)
+    {
+        return s.length() >= t.length()
+               && memcmp(s.c_str() + s.length() - t.length(), t.c_str(), t.length()) == 0;
+    }
+
     /// Tokenize delimited values until we hit new-line or the end.
     inline void tokenize(const char* data, const std::size_t size, const char delimiter,
                          std::vector<StringToken>& tokens)
@@ -455,9 +467,14 @@ namespace Util
         if (size == 0 || data == nullptr || *data == '\0')
             return StringVector();
 
+        // No token extends past the first new-line, so don't copy the
+        // (potentially large, binary) payload that follows it.
+        const char* newline = static_cast<const char*>(std::memchr(data, '\n', size));
+        const std::size_t length = (newline ? newline - data : size);
+
         std::vector<StringToken> tokens;
-        tokenize(data, size, delimiter, tokens);
-        return StringVector(std::string(data, size), std::move(tokens));
+        tokenize(data, length, delimiter, tokens);
+        return StringVector(std::string(data, length), std::move(tokens));
     }
 
     /// Tokenize single-char delimited values until we hit new-line or the end.
@@ -117,7 +117,7 @@ bool ChildSession::_handleInput(const char *buffer, int length)
     const std::string firstLine = getFirstLine(buffer, length);
     const StringVector tokens = Util::tokenize(firstLine.data(), firstLine.size());
 
-    if (LOOLProtocol::tokenIndicatesUserInteraction(tokens[0]))
+    if (LOOLProtocol::tokenIndicatesUserInteraction(tokens, 0))
     {
         // Keep track of timestamps of incoming client messages that indicate user activity.
         updateLastActivityTime();
@@ -685,13 +685,13 @@ bool ChildSession::sendFontRendering(const char* /*buffer*/, int /*length*/, con
     bool bSuccess;
 
     if (tokens.size() < 3 ||
-        !getTokenString(tokens[1], "font", font))
+        !getTokenString(tokens, 1, "font", font))
     {
         sendTextFrameAndLogError("error: cmd=renderfont kind=syntax");
         return false;
     }
 
-    getTokenString(tokens[2], "char", text);
+    getTokenString(tokens, 2, "char", text);
 
     try
     {
@@ -798,7 +798,7 @@ bool ChildSession::getCommandValues(const char* /*buffer*/, int /*length*/, cons
     bool success;
     char* values;
     std::string command;
-    if (tokens.size() != 2 || !getTokenString(tokens[1], "command", command))
+    if (tokens.size() != 2 || !getTokenString(tokens, 1, "command", command))
     {
         sendTextFrameAndLogError("error: cmd=commandvalues kind=syntax");
         return false;
@@ -837,10 +837,10 @@ bool ChildSession::clientZoom(const char* /*buffer*/, int /*length*/, const Stri
     int tilePixelWidth, tilePixelHeight, tileTwipWidth, tileTwipHeight;
 
     if (tokens.size() != 5 ||
-        !getTokenInteger(tokens[1], "tilepixelwidth", tilePixelWidth) ||
-        !getTokenInteger(tokens[2], "tilepixelheight", tilePixelHeight) ||
-        !getTokenInteger(tokens[3], "tiletwipwidth", tileTwipWidth) ||
-        !getTokenInteger(tokens[4], "tiletwipheight", tileTwipHeight))
+        !getTokenInteger(tokens, 1, "tilepixelwidth", tilePixelWidth) ||
+        !getTokenInteger(tokens, 2, "tilepixelheight", tilePixelHeight) ||
+        !getTokenInteger(tokens, 3, "tiletwipwidth", tileTwipWidth) ||
+        !getTokenInteger(tokens, 4, "tiletwipheight", tileTwipHeight))
     {
         sendTextFrameAndLogError("error: cmd=clientzoom kind=syntax");
         return false;
@@ -860,10 +860,10 @@ bool ChildSession::clientVisibleArea(const char* /*buffer*/, int /*length*/, con
     int height;
 
     if ((tokens.size() != 5 && tokens.size() != 7) ||
-        !getTokenInteger(tokens[1], "x", x) ||
-        !getTokenInteger(tokens[2], "y", y) ||
-        !getTokenInteger(tokens[3], "width", width) ||
-        !getTokenInteger(tokens[4], "height", height))
+        !getTokenInteger(tokens, 1, "x", x) ||
+        !getTokenInteger(tokens, 2, "y", y) ||
+        !getTokenInteger(tokens, 3, "width", width) ||
+        !getTokenInteger(tokens, 4, "height", height))
     {
         sendTextFrameAndLogError("error: cmd=clientvisiblearea kind=syntax");
         return false;
@@ -881,11 +881,11 @@ bool ChildSession::outlineState(const char* /*buffer*/, int /*length*/, const St
     int level, index;
 
     if (tokens.size() != 5 ||
-        !getTokenString(tokens[1], "type", type) ||
+        !getTokenString(tokens, 1, "type", type) ||
         (type != "column" && type != "row") ||
-        !getTokenInteger(tokens[2], "level", level) ||
-        !getTokenInteger(tokens[3], "index", index) ||
-        !getTokenString(tokens[4], "state", state) ||
+        !getTokenInteger(tokens, 2, "level", level) ||
+        !getTokenInteger(tokens, 3, "index", index) ||
+        !getTokenString(tokens, 4, "state", state) ||
         (state != "visible" && state != "hidden"))
     {
         sendTextFrameAndLogError("error: cmd=outlinestate kind=syntax");
@@ -906,8 +906,8 @@ bool ChildSession::downloadAs(const char* /*buffer*/, int /*length*/, const Stri
     std::string name, id, format, filterOptions;
 
     if (tokens.size() < 5 ||
-        !getTokenString(tokens[1], "name", name) ||
-        !getTokenString(tokens[2], "id", id))
+        !getTokenString(tokens, 1, "name", name) ||
+        !getTokenString(tokens, 2, "id", id))
     {
         sendTextFrameAndLogError("error: cmd=downloadas kind=syntax");
         return false;
@@ -916,9 +916,9 @@ bool ChildSession::downloadAs(const char* /*buffer*/, int /*length*/, const Stri
     // Obfuscate the new name.
     Util::mapAnonymized(Util::getFilenameFromURL(name), _docManager->getObfuscatedFileId());
 
-    getTokenString(tokens[3], "format", format);
+    getTokenString(tokens, 3, "format", format);
 
-    if (getTokenString(tokens[4], "options", filterOptions))
+    if (getTokenString(tokens, 4, "options", filterOptions))
     {
         if (tokens.size() > 5)
         {
@@ -996,7 +996,7 @@ bool ChildSession::getTextSelection(const char* /*buffer*/, int /*length*/, cons
     std::string mimeType;
 
     if (tokens.size() != 2 ||
-        !getTokenString(tokens[1], "mimetype", mimeType))
+        !getTokenString(tokens, 1, "mimetype", mimeType))
     {
         sendTextFrameAndLogError("error: cmd=gettextselection kind=syntax");
         return false;
@@ -1135,7 +1135,7 @@ bool ChildSession::setClipboard(const char* buffer, int length, const StringVect
 bool ChildSession::paste(const char* buffer, int length, const StringVector& tokens)
 {
     std::string mimeType;
-    if (tokens.size() < 2 || !getTokenString(tokens[1], "mimetype", mimeType) ||
+    if (tokens.size() < 2 || !getTokenString(tokens, 1, "mimetype", mimeType) ||
         mimeType.empty())
     {
         sendTextFrameAndLogError("error: cmd=paste kind=syntax");
@@ -1157,7 +1157,7 @@ bool ChildSession::paste(const char* buffer, int length, const StringVector& tok
     {
         getLOKitDocument()->setView(_viewId);
 
-        if (Log::logger().trace())
+        if (Log::traceEnabled())
         {
             // Ensure 8 byte alignment for the start of the data, SpookyHash needs it.
             std::vector<char> toHash(data, data + size);
@@ -1182,8 +1182,8 @@ bool ChildSession::insertFile(const char* /*buffer*/, int /*length*/, const Stri
 
 #if !MOBILEAPP
     if (tokens.size() != 3 ||
-        !getTokenString(tokens[1], "name", name) ||
-        !getTokenString(tokens[2], "type", type))
+        !getTokenString(tokens, 1, "name", name) ||
+        !getTokenString(tokens, 2, "type", type))
     {
         sendTextFrameAndLogError("error: cmd=insertfile kind=syntax");
         return false;
@@ -1191,9 +1191,9 @@ bool ChildSession::insertFile(const char* /*buffer*/, int /*length*/, const Stri
 #else
     std::string data;
     if (tokens.size() != 4 ||
-        !getTokenString(tokens[1], "name", name) ||
-        !getTokenString(tokens[2], "type", type) ||
-        !getTokenString(tokens[3], "data", data))
+        !getTokenString(tokens, 1, "name", name) ||
+        !getTokenString(tokens, 2, "type", type) ||
+        !getTokenString(tokens, 3, "data", data))
     {
         sendTextFrameAndLogError("error: cmd=insertfile kind=syntax");
         return false;
@@ -1254,16 +1254,17 @@ bool ChildSession::extTextInputEvent(const char* /*buffer*/, int /*length*/,
 
     if (tokens.size() < 3)
         error = true;
-    else if (!getTokenInteger(tokens[1], "id", id) || id < 0)
+    else if (!getTokenInteger(tokens, 1, "id", id) || id < 0)
         error = true;
     else {
         // back-compat 'type'
-        if (getTokenKeyword(tokens[2], "type",
-                            {{"input", LOK_EXT_TEXTINPUT}, {"end", LOK_EXT_TEXTINPUT_END}},
-                            type))
-            error = !getTokenString(tokens[3], "text", text);
+        static const std::map<std::string, int> textInputTypes
+            = { { "input", LOK_EXT_TEXTINPUT }, { "end", LOK_EXT_TEXTINPUT_END } };
+
+        if (getTokenKeyword(tokens, 2, "type", textInputTypes, type))
+            error = !getTokenString(tokens, 3, "text", text);
         else // normal path:
-            error = !getTokenString(tokens[2], "text", text);
+            error = !getTokenString(tokens, 2, "text", text);
     }
 
     if (error)
@@ -1298,7 +1299,7 @@ bool ChildSession::keyEvent(const char* /*buffer*/, int /*length*/,
     if (target == LokEventTargetEnum::Window)
     {
         if (tokens.size() <= counter ||
-            !getTokenUInt32(tokens[counter++], "id", winId))
+            !getTokenUInt32(tokens, counter++, "id", winId))
         {
             LOG_ERR("Window key event expects a valid id= attribute");
             sendTextFrameAndLogError("error: cmd=" + std::string(tokens[0]) + " kind=syntax");
@@ -1308,12 +1309,13 @@ bool ChildSession::keyEvent(const char* /*buffer*/, int /*length*/,
             expectedTokens++;
     }
 
+    static const std::map<std::string, int> keyTypes
+        = { { "input", LOK_KEYEVENT_KEYINPUT }, { "up", LOK_KEYEVENT_KEYUP } };
+
     if (tokens.size() != expectedTokens ||
-        !getTokenKeyword(tokens[counter++], "type",
-                         {{"input", LOK_KEYEVENT_KEYINPUT}, {"up", LOK_KEYEVENT_KEYUP}},
-                         type) ||
-        !getTokenInteger(tokens[counter++], "char", charcode) ||
-        !getTokenInteger(tokens[counter++], "key", keycode))
+        !getTokenKeyword(tokens, counter++, "type", keyTypes, type) ||
+        !getTokenInteger(tokens, counter++, "char", charcode) ||
+        !getTokenInteger(tokens, counter++, "key", keycode))
     {
         sendTextFrameAndLogError("error: cmd=" + std::string(tokens[0]) + "  kind=syntax");
         return false;
@@ -1359,11 +1361,11 @@ bool ChildSession::gestureEvent(const char* /*buffer*/, int /*length*/,
         success = false;
 
     if (!success ||
-        !getTokenUInt32(tokens[1], "id", windowID) ||
-        !getTokenString(tokens[2], "type", type) ||
-        !getTokenInteger(tokens[3], "x", x) ||
-        !getTokenInteger(tokens[4], "y", y) ||
-        !getTokenInteger(tokens[5], "offset", offset))
+        !getTokenUInt32(tokens, 1, "id", windowID) ||
+        !getTokenString(tokens, 2, "type", type) ||
+        !getTokenInteger(tokens, 3, "x", x) ||
+        !getTokenInteger(tokens, 4, "y", y) ||
+        !getTokenInteger(tokens, 5, "offset", offset))
     {
         success = false;
     }
@@ -1397,7 +1399,7 @@ bool ChildSession::mouseEvent(const char* /*buffer*/, int /*length*/,
     if (target == LokEventTargetEnum::Window)
     {
         if (tokens.size() <= counter ||
-            !getTokenUInt32(tokens[counter++], "id", winId))
+            !getTokenUInt32(tokens, counter++, "id", winId))
         {
             LOG_ERR("Window mouse event expects a valid id= attribute");
             success = false;
@@ -1410,25 +1412,26 @@ bool ChildSession::mouseEvent(const char* /*buffer*/, int /*length*/,
     int x = 0;
     int y = 0;
     int count = 0;
+    static const std::map<std::string, int> mouseTypes
+        = { { "buttondown", LOK_MOUSEEVENT_MOUSEBUTTONDOWN },
+            { "buttonup", LOK_MOUSEEVENT_MOUSEBUTTONUP },
+            { "move", LOK_MOUSEEVENT_MOUSEMOVE } };
+
     if (tokens.size() < minTokens ||
-        !getTokenKeyword(tokens[counter++], "type",
-                         {{"buttondown", LOK_MOUSEEVENT_MOUSEBUTTONDOWN},
-                          {"buttonup", LOK_MOUSEEVENT_MOUSEBUTTONUP},
-                          {"move", LOK_MOUSEEVENT_MOUSEMOVE}},
-                         type) ||
-        !getTokenInteger(tokens[counter++], "x", x) ||
-        !getTokenInteger(tokens[counter++], "y", y) ||
-        !getTokenInteger(tokens[counter++], "count", count))
+        !getTokenKeyword(tokens, counter++, "type", mouseTypes, type) ||
+        !getTokenInteger(tokens, counter++, "x", x) ||
+        !getTokenInteger(tokens, counter++, "y", y) ||
+        !getTokenInteger(tokens, counter++, "count", count))
     {
         success = false;
     }
 
     // compatibility with older loleaflets
-    if (success && tokens.size() > counter && !getTokenInteger(tokens[counter++], "buttons", buttons))
+    if (success && tokens.size() > counter && !getTokenInteger(tokens, counter++, "buttons", buttons))
         success = false;
 
     // compatibility with older loleaflets
-    if (success && tokens.size() > counter && !getTokenInteger(tokens[counter++], "modifier", modifier))
+    if (success && tokens.size() > counter && !getTokenInteger(tokens, counter++, "modifier", modifier))
         success = false;
 
     if (!success)
@@ -1492,7 +1495,7 @@ bool ChildSession::completeFunction(const char* /*buffer*/, int /*length*/, cons
     std::string functionName;
 
     if (tokens.size() != 2 ||
-        !getTokenString(tokens[1], "name", functionName) ||
+        !getTokenString(tokens, 1, "name", functionName) ||
         functionName.empty())
     {
         sendTextFrameAndLogError("error: cmd=completefunction kind=syntax");
@@ -1514,22 +1517,22 @@ bool ChildSession::unoCommand(const char* /*buffer*/, int /*length*/, const Stri
     }
 
     // we need to get LOK_CALLBACK_UNO_COMMAND_RESULT callback when saving
-    const bool bNotify = (tokens[1] == ".uno:Save" ||
-                          tokens[1] == ".uno:Undo" ||
-                          tokens[1] == ".uno:Redo" ||
-                          Util::startsWith(tokens[1], "vnd.sun.star.script:"));
+    const bool bNotify = (tokens.equals(1, ".uno:Save") ||
+                          tokens.equals(1, ".uno:Undo") ||
+                          tokens.equals(1, ".uno:Redo") ||
+                          tokens.startsWith(1, "vnd.sun.star.script:"));
 
     getLOKitDocument()->setView(_viewId);
 
     if (tokens.size() == 2)
     {
-        if (tokens[1] == ".uno:fakeDiskFull")
+        if (tokens.equals(1, ".uno:fakeDiskFull"))
         {
             _docManager->alertAllUsers("internal", "diskfull");
         }
         else
         {
-            if (tokens[1] == ".uno:Copy" || tokens[1] == ".uno:CopyHyperlinkLocation")
+            if (tokens.equals(1, ".uno:Copy") || tokens.equals(1, ".uno:CopyHyperlinkLocation"))
                 _copyToClipboard = true;
 
             getLOKitDocument()->postUnoCommand(tokens[1].c_str(), nullptr, bNotify);
@@ -1553,11 +1556,11 @@ bool ChildSession::selectText(const char* /*buffer*/, int /*length*/,
     if (target == LokEventTargetEnum::Window)
     {
         if (tokens.size() != 5 ||
-            !getTokenUInt32(tokens[1], "id", winId) ||
-            !getTokenString(tokens[2], "swap", swap) ||
+            !getTokenUInt32(tokens, 1, "id", winId) ||
+            !getTokenString(tokens, 2, "swap", swap) ||
             (swap != "true" && swap != "false") ||
-            !getTokenInteger(tokens[3], "x", x) ||
-            !getTokenInteger(tokens[4], "y", y))
+            !getTokenInteger(tokens, 3, "x", x) ||
+            !getTokenInteger(tokens, 4, "y", y))
         {
             LOG_ERR("error: cmd=windowselecttext kind=syntax");
             return false;
@@ -1566,13 +1569,13 @@ bool ChildSession::selectText(const char* /*buffer*/, int /*length*/,
     else if (target == LokEventTargetEnum::Document)
     {
         if (tokens.size() != 4 ||
-            !getTokenKeyword(tokens[1], "type",
+            !getTokenKeyword(tokens, 1, "type",
                              {{"start", LOK_SETTEXTSELECTION_START},
                               {"end", LOK_SETTEXTSELECTION_END},
                               {"reset", LOK_SETTEXTSELECTION_RESET}},
                              type) ||
-            !getTokenInteger(tokens[2], "x", x) ||
-            !getTokenInteger(tokens[3], "y", y))
+            !getTokenInteger(tokens, 2, "x", x) ||
+            !getTokenInteger(tokens, 3, "y", y))
         {
             sendTextFrameAndLogError("error: cmd=selecttext kind=syntax");
             return false;
@@ -1604,7 +1607,7 @@ bool ChildSession::renderWindow(const char* /*buffer*/, int /*length*/, const St
     int bufferWidth = 800, bufferHeight = 600;
     double dpiScale = 1.0;
     std::string paintRectangle;
-    if (tokens.size() > 2 && getTokenString(tokens[2], "rectangle", paintRectangle)
+    if (tokens.size() > 2 && getTokenString(tokens, 2, "rectangle", paintRectangle)
         && paintRectangle != "undefined")
     {
         const StringVector rectParts
@@ -1621,7 +1624,7 @@ bool ChildSession::renderWindow(const char* /*buffer*/, int /*length*/, const St
         LOG_WRN("windowpaint command doesn't specify a rectangle= attribute.");
 
     std::string dpiScaleString;
-    if (tokens.size() > 3 && getTokenString(tokens[3], "dpiscale", dpiScaleString))
+    if (tokens.size() > 3 && getTokenString(tokens, 3, "dpiscale", dpiScaleString))
     {
         dpiScale = std::stod(dpiScaleString);
         if (dpiScale < 0.001)
@@ -1679,7 +1682,7 @@ bool ChildSession::resizeWindow(const char* /*buffer*/, int /*length*/, const St
     getLOKitDocument()->setView(_viewId);
 
     std::string size;
-    if (tokens.size() > 2 && getTokenString(tokens[2], "size", size))
+    if (tokens.size() > 2 && getTokenString(tokens, 2, "size", size))
     {
         const std::vector<int> sizeParts = LOOLProtocol::tokenizeInts(size, ',');
         if (sizeParts.size() == 2)
@@ -2001,12 +2004,12 @@ bool ChildSession::selectGraphic(const char* /*buffer*/, int /*length*/, const S
 {
     int type, x, y;
     if (tokens.size() != 4 ||
-        !getTokenKeyword(tokens[1], "type",
+        !getTokenKeyword(tokens, 1, "type",
                          {{"start", LOK_SETGRAPHICSELECTION_START},
                           {"end", LOK_SETGRAPHICSELECTION_END}},
                          type) ||
-        !getTokenInteger(tokens[2], "x", x) ||
-        !getTokenInteger(tokens[3], "y", y))
+        !getTokenInteger(tokens, 2, "x", x) ||
+        !getTokenInteger(tokens, 3, "y", y))
     {
         sendTextFrameAndLogError("error: cmd=selectgraphic kind=syntax");
         return false;
@@ -2039,7 +2042,7 @@ bool ChildSession::saveAs(const char* /*buffer*/, int /*length*/, const StringVe
     std::string wopiFilename, url, format, filterOptions;
 
     if (tokens.size() <= 1 ||
-        !getTokenString(tokens[1], "url", url))
+        !getTokenString(tokens, 1, "url", url))
     {
         sendTextFrameAndLogError("error: cmd=saveas kind=syntax");
         return false;
@@ -2072,9 +2075,9 @@ bool ChildSession::saveAs(const char* /*buffer*/, int /*length*/, const StringVe
     }
 
     if (tokens.size() > 2)
-        getTokenString(tokens[2], "format", format);
+        getTokenString(tokens, 2, "format", format);
 
-    if (tokens.size() > 3 && getTokenString(tokens[3], "options", filterOptions))
+    if (tokens.size() > 3 && getTokenString(tokens, 3, "options", filterOptions))
     {
         if (tokens.size() > 4)
         {
@@ -2144,7 +2147,7 @@ bool ChildSession::setClientPart(const char* /*buffer*/, int /*length*/, const S
 {
     int part = 0;
     if (tokens.size() < 2 ||
-        !getTokenInteger(tokens[1], "part", part))
+        !getTokenInteger(tokens, 1, "part", part))
     {
         sendTextFrameAndLogError("error: cmd=setclientpart kind=invalid");
         return false;
@@ -2165,8 +2168,8 @@ bool ChildSession::selectClientPart(const char* /*buffer*/, int /*length*/, cons
     int nPart;
     int nSelect;
     if (tokens.size() < 3 ||
-        !getTokenInteger(tokens[1], "part", nPart) ||
-        !getTokenInteger(tokens[2], "how", nSelect))
+        !getTokenInteger(tokens, 1, "part", nPart) ||
+        !getTokenInteger(tokens, 2, "how", nSelect))
     {
         sendTextFrameAndLogError("error: cmd=selectclientpart kind=invalid");
         return false;
@@ -2198,7 +2201,7 @@ bool ChildSession::moveSelectedClientParts(const char* /*buffer*/, int /*length*
 {
     int nPosition;
     if (tokens.size() < 2 ||
-        !getTokenInteger(tokens[1], "position", nPosition))
+        !getTokenInteger(tokens, 1, "position", nPosition))
     {
         sendTextFrameAndLogError("error: cmd=moveselectedclientparts kind=invalid");
         return false;
@@ -2227,7 +2230,7 @@ bool ChildSession::setPage(const char* /*buffer*/, int /*length*/, const StringV
 {
     int page;
     if (tokens.size() < 2 ||
-        !getTokenInteger(tokens[1], "page", page))
+        !getTokenInteger(tokens, 1, "page", page))
     {
         sendTextFrameAndLogError("error: cmd=setpage kind=invalid");
         return false;
@@ -2243,7 +2246,7 @@ bool ChildSession::renderShapeSelection(const char* /*buffer*/, int /*length*/,
 {
     std::string mimeType;
     if (tokens.size() != 2 ||
-        !getTokenString(tokens[1], "mimetype", mimeType) ||
+        !getTokenString(tokens, 1, "mimetype", mimeType) ||
         mimeType != "image/svg+xml")
     {
         sendTextFrameAndLogError("error: cmd=rendershapeselection kind=syntax");
@@ -2280,9 +2283,9 @@ bool ChildSession::removeTextContext(const char* /*buffer*/, int /*length*/,
     int id, before, after;
     std::string text;
     if (tokens.size() < 4 ||
-        !getTokenInteger(tokens[1], "id", id) || id < 0 ||
-        !getTokenInteger(tokens[2], "before", before) ||
-        !getTokenInteger(tokens[3], "after", after))
+        !getTokenInteger(tokens, 1, "id", id) || id < 0 ||
+        !getTokenInteger(tokens, 2, "before", before) ||
+        !getTokenInteger(tokens, 3, "after", after))
     {
         sendTextFrameAndLogError("error: cmd=" + std::string(tokens[0]) + " kind=syntax");
         return false;
@@ -2297,7 +2300,8 @@ bool ChildSession::removeTextContext(const char* /*buffer*/, int /*length*/,
 /* If the user is inactive we have to remember important events so that when
  * the user becomes active again, we can replay the events.
  */
-void ChildSession::rememberEventsForInactiveUser(const int type, const std::string& payload)
+void ChildSession::rememberEventsForInactiveUser(const int type, const std::string& payload,
+                                                 const int payloadViewId)
 {
     if (type == LOK_CALLBACK_INVALIDATE_TILES)
     {
@@ -2326,10 +2330,15 @@ void ChildSession::rememberEventsForInactiveUser(const int type, const std::stri
              type == LOK_CALLBACK_VIEW_CURSOR_VISIBLE ||
              type == LOK_CALLBACK_VIEW_LOCK)
     {
-        Poco::JSON::Parser parser;
+        int viewId = payloadViewId;
+        if (viewId < 0)
+        {
+            Poco::JSON::Parser parser;
+
+            Poco::JSON::Object::Ptr root = parser.parse(payload).extract<Poco::JSON::Object::Ptr>();
+            viewId = root->getValue<int>("viewId");
+        }
 
-        Poco::JSON::Object::Ptr root = parser.parse(payload).extract<Poco::JSON::Object::Ptr>();
-        int viewId = root->getValue<int>("viewId");
         _stateRecorder.recordViewEvent(viewId, type, payload);
     }
     else if (type == LOK_CALLBACK_STATE_CHANGED)
@@ -2376,7 +2385,7 @@ int ChildSession::getSpeed()
     return _cursorInvalidatedEvent.size();
 }
 
-void ChildSession::loKitCallback(const int type, const std::string& payload)
+void ChildSession::loKitCallback(const int type, const std::string& payload, const int payloadViewId)
 {
     const char* const typeName = lokCallbackTypeToString(type);
     LOG_TRC("ChildSession::loKitCallback [" << getName() << "]: " <<
@@ -2397,7 +2406,7 @@ void ChildSession::loKitCallback(const int type, const std::string& payload)
     }
     else if (!isActive())
     {
-        rememberEventsForInactiveUser(type, payload);
+        rememberEventsForInactiveUser(type, payload, payloadViewId);
 
         // Pass save notifications through.
         if (type != LOK_CALLBACK_UNO_COMMAND_RESULT || payload.find(".uno:Save") == std::string::npos)
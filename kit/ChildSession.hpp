@@ -214,7 +214,9 @@ public:
     void updateSpeed();
     int getSpeed();
 
-    void loKitCallback(const int type, const std::string& payload);
+    /// Handles a callback of the view, @payloadViewId is the view a view
+    /// callback is about, if the payload was already parsed, otherwise -1.
+    void loKitCallback(const int type, const std::string& payload, const int payloadViewId = -1);
 
     std::shared_ptr<Watermark> _docWatermark;
 
@@ -292,7 +294,8 @@ private:
     bool renderShapeSelection(const char* buffer, int length, const StringVector& tokens);
     bool removeTextContext(const char* /*buffer*/, int /*length*/, const StringVector& tokens);
 
-    void rememberEventsForInactiveUser(const int type, const std::string& payload);
+    void rememberEventsForInactiveUser(const int type, const std::string& payload,
+                                       const int payloadViewId);
     bool formFieldEvent(const char* buffer, int length, const StringVector& tokens);
 
     virtual void disconnect() override;
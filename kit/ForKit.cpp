@@ -13,10 +13,13 @@
 
 #include <config.h>
 
+#include <fcntl.h>
+#include <malloc.h>
 #include <sys/capability.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <sysexits.h>
+#include <unistd.h>
 
 #include <atomic>
 #include <cstdlib>
@@ -48,6 +51,7 @@
 #ifndef KIT_IN_PROCESS
 static bool NoCapsForKit = false;
 static bool NoSeccomp = false;
+static bool TrimMemory = false;
 #if ENABLE_DEBUG
 static bool SingleKit = false;
 #endif
@@ -62,6 +66,13 @@ static std::atomic<unsigned> ForkCounter(0);
 
 static std::map<pid_t, std::string> childJails;
 
+/// The kits report on this pipe when they are ready, see KitSpawnReport.
+static int KitSpawnReportPipe[2] = { -1, -1 };
+static unsigned SpawnedCount = 0;
+static uint64_t SpawnTotalMs = 0;
+static uint64_t SpawnMaxMs = 0;
+static uint64_t JailSetupTotalMs = 0;
+
 #ifndef KIT_IN_PROCESS
 int ClientPortNumber = DEFAULT_CLIENT_PORT_NUMBER;
 std::string MasterLocation;
@@ -84,8 +95,11 @@ void dump_forkit_state()
 #  endif
 #endif
         << "  ClientPortNumber: " << ClientPortNumber << "\n"
-        << "  MasterLocation: " << MasterLocation
-        << "\n";
+        << "  MasterLocation: " << MasterLocation << "\n"
+        << "  Spawned: " << SpawnedCount << " kits, avg "
+        << (SpawnedCount ? SpawnTotalMs / SpawnedCount : 0) << " ms, of which jail setup "
+        << (SpawnedCount ? JailSetupTotalMs / SpawnedCount : 0) << " ms, max " << SpawnMaxMs
+        << " ms\n";
 
     const std::string msg = oss.str();
     fprintf(stderr, "%s", msg.c_str());
@@ -313,6 +327,82 @@ static void cleanupChildren()
     }
 }
 
+/// Collects the reports of the kits that got ready since last time.
+static void readSpawnReports()
+{
+    if (KitSpawnReportPipe[0] < 0)
+        return;
+
+    KitSpawnReport reports[16];
+    ssize_t size;
+    while ((size = read(KitSpawnReportPipe[0], reports, sizeof(reports))) > 0)
+    {
+        // Each report is written atomically, so we read whole ones.
+        for (size_t i = 0; i < static_cast<size_t>(size) / sizeof(KitSpawnReport); ++i)
+        {
+            const KitSpawnReport& report = reports[i];
+            LOG_INF("Kit [" << report._pid << "] spawned in " << report._spawnMs << " ms, "
+                            << report._jailSetupMs << " ms of it setting up the jail, with PSS "
+                            << report._pssBeforeTrimKb << " -> " << report._pssKb
+                            << " KB, Private_Dirty " << report._dirtyBeforeTrimKb << " -> "
+                            << report._dirtyKb << " KB after trimming.");
+
+            ++SpawnedCount;
+            SpawnTotalMs += report._spawnMs;
+            SpawnMaxMs = std::max<uint64_t>(SpawnMaxMs, report._spawnMs);
+            JailSetupTotalMs += report._jailSetupMs;
+
+#ifdef KIT_IN_PROCESS
+#if !MOBILEAPP
+            LOOLWSD::SpareKits.addSpawnTime(std::chrono::milliseconds(report._spawnMs),
+                                            std::chrono::milliseconds(report._jailSetupMs));
+            Admin::instance().addSpareKitMemory(report._pssBeforeTrimKb, report._dirtyBeforeTrimKb,
+                                                report._pssKb, report._dirtyKb);
+#endif
+#else
+            if (WSHandler)
+            {
+                const std::string message = "kitspawn " + std::to_string(report._pid) + ' '
+                                            + std::to_string(report._spawnMs) + ' '
+                                            + std::to_string(report._jailSetupMs) + ' '
+                                            + std::to_string(report._pssBeforeTrimKb) + ' '
+                                            + std::to_string(report._dirtyBeforeTrimKb) + ' '
+                                            + std::to_string(report._pssKb) + ' '
+                                            + std::to_string(report._dirtyKb) + '\n';
+                if (WSHandler->sendMessage(message) == -1)
+                    LOG_WRN("Could not send 'kitspawn' message through websocket");
+            }
+#endif
+        }
+    }
+}
+
+#ifndef KIT_IN_PROCESS
+/// The read end of KitSpawnReportPipe in our poll, to pass on the reports as they come.
+class SpawnReportSocket final : public Socket
+{
+public:
+    SpawnReportSocket(const int fd) :
+        Socket(fd)
+    {
+    }
+
+    int getPollEvents(std::chrono::steady_clock::time_point /* now */,
+                      int64_t & /* timeoutMaxMicroS */) override
+    {
+        return POLLIN;
+    }
+
+    void handlePoll(SocketDisposition & /* disposition */,
+                    std::chrono::steady_clock::time_point /* now */,
+                    int events) override
+    {
+        if (events & POLLIN)
+            readSpawnReports();
+    }
+};
+#endif
+
 static int createLibreOfficeKit(const std::string& childRoot,
                                 const std::string& sysTemplate,
                                 const std::string& loTemplate,
@@ -330,6 +420,10 @@ static int createLibreOfficeKit(const std::string& childRoot,
     ++spareKitId;
     LOG_DBG("Forking a loolkit process with jailId: " << jailId << " as spare loolkit #" << spareKitId << '.');
 
+    if (KitSpawnReportPipe[0] < 0 && pipe2(KitSpawnReportPipe, O_NONBLOCK | O_CLOEXEC) != 0)
+        LOG_SYS("Failed to create the pipe for kits to report spawning on.");
+
+    const auto forkTime = std::chrono::steady_clock::now();
     const pid_t pid = fork();
     if (!pid)
     {
@@ -338,6 +432,13 @@ static int createLibreOfficeKit(const std::string& childRoot,
         // Close the pipe from loolwsd
         close(0);
 
+        // Only write our report to forkit.
+        if (KitSpawnReportPipe[0] >= 0)
+        {
+            close(KitSpawnReportPipe[0]);
+            setKitSpawnReport(KitSpawnReportPipe[1], forkTime);
+        }
+
 #ifndef KIT_IN_PROCESS
         UnitKit::get().postFork();
 #endif
@@ -390,6 +491,11 @@ void forkLibreOfficeKit(const std::string& childRoot,
     // Cleanup first, to reduce disk load.
     cleanupChildren();
 
+#ifdef KIT_IN_PROCESS
+    // We have no poll of our own to read them as they come.
+    readSpawnReports();
+#endif
+
 #ifndef KIT_IN_PROCESS
     (void) limit;
 #else
@@ -577,6 +683,27 @@ int main(int argc, char** argv)
             eq = std::strchr(cmd, '=');
             UserInterface = std::string(eq+1);
         }
+
+        // the kits load and close these types of documents before their first
+        else if (std::strstr(cmd, "--warm=") == cmd)
+        {
+            eq = std::strchr(cmd, '=');
+            ::setenv("LOOL_WARM_DOCUMENT_TYPES", eq+1, 1);
+        }
+
+        // we and the kits return our free heap memory once ready
+        else if (std::strstr(cmd, "--trim-memory") == cmd)
+        {
+            TrimMemory = true;
+            ::setenv("LOOL_TRIM_KIT_MEMORY", "1", 1);
+        }
+
+        // the kits host up to this many read-only documents each
+        else if (std::strstr(cmd, "--docs-per-kit=") == cmd)
+        {
+            eq = std::strchr(cmd, '=');
+            ::setenv("LOOL_KIT_MAX_DOCUMENTS", eq+1, 1);
+        }
     }
 
     if (loSubPath.empty() || sysTemplate.empty() ||
@@ -625,6 +752,16 @@ int main(int argc, char** argv)
 
     LOG_INF("Preinit stage OK.");
 
+    if (TrimMemory)
+    {
+        // The kits dirty the free memory preinit left in our heap as much as
+        // fresh pages, so there's no point in us keeping it.
+        const size_t rssKb = Util::getMemoryUsageRSS(getpid());
+        malloc_trim(0);
+        LOG_INF("Trimmed forkit memory, RSS " << rssKb << " -> " << Util::getMemoryUsageRSS(getpid())
+                                               << " KB.");
+    }
+
     // We must have at least one child, more are created dynamically.
     // Ask this first child to send version information to master process and trace startup.
     ::setenv("LOOL_TRACE_STARTUP", "1", 1);
@@ -641,7 +778,7 @@ int main(int argc, char** argv)
     if (LogLevel != "trace")
     {
         LOG_INF("Forkit initialization complete: setting log-level to [" << LogLevel << "] as configured.");
-        Log::logger().setLevel(LogLevel);
+        Log::setLevel(LogLevel);
     }
 
     SocketPoll mainPoll(Util::getThreadName());
@@ -653,6 +790,10 @@ int main(int argc, char** argv)
     mainPoll.insertNewUnixSocket(MasterLocation, FORKIT_URI, WSHandler);
 #endif
 
+    // The first kit created the pipe, which the socket owns from now on.
+    if (KitSpawnReportPipe[0] >= 0)
+        mainPoll.insertNewSocket(std::make_shared<SpawnReportSocket>(KitSpawnReportPipe[0]));
+
     SigUtil::setUserSignals();
 
     LOG_INF("ForKit process is ready.");
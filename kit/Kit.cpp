@@ -17,6 +17,7 @@
 #include <dlfcn.h>
 #ifdef __linux
 #include <ftw.h>
+#include <malloc.h>
 #include <sys/capability.h>
 #include <sys/sysmacros.h>
 #endif
@@ -26,6 +27,7 @@
 #include <sys/resource.h>
 #include <sysexits.h>
 
+#include <algorithm>
 #include <atomic>
 #include <cassert>
 #include <climits>
@@ -34,6 +36,7 @@
 #include <cstring>
 #include <iostream>
 #include <memory>
+#include <set>
 #include <string>
 #include <sstream>
 #include <thread>
@@ -118,6 +121,118 @@ static uint64_t AnonymizationSalt = 82589933;
 
 static LokHookFunction2* initFunction = nullptr;
 
+/// The types of the documents we loaded and closed before our first, see warmDocumentTypes().
+static std::set<std::string> WarmedDocumentTypes;
+static bool FirstLoadReported = false;
+
+/// Loads and closes a new document of each of the comma-separated @types
+/// (writer, calc, impress or draw), so that the first real one of these
+/// types doesn't pay for initializing their modules.
+static void warmDocumentTypes(const std::shared_ptr<lok::Office>& loKit, const std::string& types)
+{
+    static const std::map<std::string, std::string> factories = {
+        { "writer", "private:factory/swriter" },
+        { "calc", "private:factory/scalc" },
+        { "impress", "private:factory/simpress" },
+        { "draw", "private:factory/sdraw" },
+    };
+
+    StringVector tokens = Util::tokenize(types, ',');
+    for (const auto& token : tokens)
+    {
+        const std::string type = Util::trimmed(tokens.getParam(token));
+        const auto it = factories.find(type);
+        if (it == factories.end())
+        {
+            LOG_WRN("Unknown document type [" << type << "] to warm.");
+            continue;
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        std::unique_ptr<lok::Document> document(loKit->documentLoad(it->second.c_str()));
+        if (!document || !document->get())
+        {
+            LOG_WRN("Failed to warm " << type << ": " << loKit->getError());
+            continue;
+        }
+
+        const std::string docType = LOKitHelper::getDocumentTypeAsString(document->get());
+        document.reset();
+        WarmedDocumentTypes.insert(docType);
+        LOG_INF("Warmed " << type << " (" << docType << ") in " <<
+                std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::steady_clock::now() - start).count() << " ms.");
+    }
+}
+
+/// Where to report being ready, and when forkit forked us.
+static int KitSpawnReportFd = -1;
+static std::chrono::steady_clock::time_point KitForkTime;
+/// How long we took to set up our jail.
+static uint32_t KitJailSetupMs = 0;
+/// Our own smaps, to measure our memory once ready.
+static FILE* KitSMapsFile = nullptr;
+/// Whether to trim our memory once ready, see trim_kit_memory in loolwsd.xml.
+static bool KitTrimMemory = false;
+/// How many read-only documents we may host, see per_document.read_only_docs_per_kit in loolwsd.xml.
+static size_t KitMaxDocuments = 1;
+
+void setKitSpawnReport(int fd, std::chrono::steady_clock::time_point forkTime)
+{
+    KitSpawnReportFd = fd;
+    KitForkTime = forkTime;
+}
+
+/// Tells forkit how long we took to get ready for a document, and how much
+/// memory we use, before and after trimming it.
+static void reportKitReady()
+{
+    const std::pair<size_t, size_t> before = Util::getPssAndDirtyFromSMaps(KitSMapsFile);
+    std::pair<size_t, size_t> after = before;
+    if (KitTrimMemory)
+    {
+        // Initializing and warming left free memory in our heap, in pages we
+        // dirtied; hand it back, so it isn't counted against us while we wait.
+        malloc_trim(0);
+        after = Util::getPssAndDirtyFromSMaps(KitSMapsFile);
+    }
+
+    std::ostringstream dirtyByMapping;
+    for (const auto& it : Util::getDirtyByMappingFromSMaps(KitSMapsFile))
+        dirtyByMapping << ' ' << it.first << '=' << it.second;
+    LOG_INF("Ready with PSS " << before.first << " -> " << after.first << " KB, Private_Dirty "
+                              << before.second << " -> " << after.second << " KB"
+                              << (KitTrimMemory ? " after trimming" : "")
+                              << ", by mapping (KB):" << dirtyByMapping.str());
+
+    if (KitSMapsFile)
+    {
+        fclose(KitSMapsFile);
+        KitSMapsFile = nullptr;
+    }
+
+    if (KitSpawnReportFd < 0)
+        return;
+
+    KitSpawnReport report;
+    report._pid = getpid();
+    report._spawnMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                          std::chrono::steady_clock::now() - KitForkTime).count();
+    report._jailSetupMs = KitJailSetupMs;
+    report._pssBeforeTrimKb = before.first;
+    report._dirtyBeforeTrimKb = before.second;
+    report._pssKb = after.first;
+    report._dirtyKb = after.second;
+    LOG_INF("Spawned in " << report._spawnMs << " ms, " << KitJailSetupMs << " ms of it setting up the jail.");
+
+    // Smaller than PIPE_BUF, so written atomically with the other kits' reports.
+    if (write(KitSpawnReportFd, &report, sizeof(report)) != sizeof(report))
+        LOG_SYS("Failed to report spawning to forkit.");
+
+    close(KitSpawnReportFd);
+    KitSpawnReportFd = -1;
+}
+
 namespace
 {
 #ifndef BUILDING_TESTS
@@ -419,7 +534,8 @@ namespace
 /// Owns LOKitDocument instance and connections.
 /// Manages the lifetime of a document.
 /// Technically, we can host multiple documents
-/// per process. But for security reasons don't.
+/// per process. But for security reasons don't,
+/// except for read-only ones when configured to.
 /// However, we could have a loolkit instance
 /// per user or group of users (a trusted circle).
 class Document final : public DocumentManagerInterface
@@ -456,7 +572,9 @@ public:
         _editorId(-1),
         _editorChangeWarning(false),
         _mobileAppDocId(mobileAppDocId),
-        _inputProcessingEnabled(true)
+        _inputProcessingEnabled(true),
+        _reusable(false),
+        _sharedKit(false)
     {
         LOG_INF("Document ctor for [" << _docKey <<
                 "] url [" << anonymizeUrl(_url) << "] on child [" << _jailId <<
@@ -490,6 +608,35 @@ public:
 
     const std::string& getUrl() const { return _url; }
 
+    /// Whether to keep the process for another document, rather than exit, once the last session is gone.
+    bool isReusable() const { return _reusable; }
+    void setReusable(bool reusable) { _reusable = reusable; }
+
+    /// Whether other documents share our process, so it must outlive us.
+    void setSharedKit(bool sharedKit) { _sharedKit = sharedKit; }
+
+    bool hasSessions() const
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        return !_sessions.empty();
+    }
+
+    /// Whether we are loaded, and only viewed, so could share our process with other such documents.
+    bool isLoadedReadOnly() const
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (!_loKitDocument || _reusable || _sessions.empty())
+            return false;
+
+        for (const auto& it : _sessions)
+        {
+            if (!it.second->isReadOnly())
+                return false;
+        }
+
+        return true;
+    }
+
     /// Post the message - in the unipoll world we're in the right thread anyway
     bool postMessage(const char* data, int size, const WSOpCode code) const
     {
@@ -574,7 +721,7 @@ public:
 
             num_sessions = _sessions.size();
 #if !MOBILEAPP
-            if (num_sessions == 0)
+            if (num_sessions == 0 && !_reusable && !_sharedKit)
             {
                 LOG_FTL("Document [" << anonymizeUrl(_url) << "] has no more views, exiting bluntly.");
                 Log::shutdown();
@@ -769,73 +916,31 @@ public:
                 "] [" << lokCallbackTypeToString(type) <<
                 "] [" << payload << "].");
 
-        // when we examine the content of the JSON
-        std::string targetViewId;
+        // no point in handling invalidations or page resizes per-view,
+        // all views have to be in sync
+        const bool broadcast = (type == LOK_CALLBACK_INVALIDATE_TILES ||
+                                type == LOK_CALLBACK_DOCUMENT_SIZE_CHANGED);
 
-        if (type == LOK_CALLBACK_CELL_CURSOR)
-        {
-            StringVector tokens(Util::tokenize(payload, ','));
-            // Payload may be 'EMPTY'.
-            if (tokens.size() == 4)
-            {
-                int cursorX = std::stoi(tokens[0]);
-                int cursorY = std::stoi(tokens[1]);
-                int cursorWidth = std::stoi(tokens[2]);
-                int cursorHeight = std::stoi(tokens[3]);
+        const TileQueue::Callback callback(broadcast ? -1 : descriptor->getViewId(), type, payload);
 
-                tileQueue->updateCursorPosition(0, 0, cursorX, cursorY, cursorWidth, cursorHeight);
-            }
-        }
-        else if (type == LOK_CALLBACK_INVALIDATE_VISIBLE_CURSOR)
+        if (callback._hasRect && !callback._isEmpty)
         {
-            Poco::JSON::Parser parser;
-            const Poco::Dynamic::Var result = parser.parse(payload);
-            const auto& command = result.extract<Poco::JSON::Object::Ptr>();
-            std::string rectangle = command->get("rectangle").toString();
-            StringVector tokens(Util::tokenize(rectangle, ','));
-            // Payload may be 'EMPTY'.
-            if (tokens.size() == 4)
+            if (type == LOK_CALLBACK_CELL_CURSOR ||
+                type == LOK_CALLBACK_INVALIDATE_VISIBLE_CURSOR)
             {
-                int cursorX = std::stoi(tokens[0]);
-                int cursorY = std::stoi(tokens[1]);
-                int cursorWidth = std::stoi(tokens[2]);
-                int cursorHeight = std::stoi(tokens[3]);
-
-                tileQueue->updateCursorPosition(0, 0, cursorX, cursorY, cursorWidth, cursorHeight);
+                tileQueue->updateCursorPosition(0, 0, callback._x, callback._y,
+                                                callback._width, callback._height);
             }
-        }
-        else if (type == LOK_CALLBACK_INVALIDATE_VIEW_CURSOR ||
-                 type == LOK_CALLBACK_CELL_VIEW_CURSOR)
-        {
-            Poco::JSON::Parser parser;
-            const Poco::Dynamic::Var result = parser.parse(payload);
-            const auto& command = result.extract<Poco::JSON::Object::Ptr>();
-            targetViewId = command->get("viewId").toString();
-            std::string part = command->get("part").toString();
-            std::string text = command->get("rectangle").toString();
-            StringVector tokens(Util::tokenize(text, ','));
-            // Payload may be 'EMPTY'.
-            if (tokens.size() == 4)
+            else if (type == LOK_CALLBACK_INVALIDATE_VIEW_CURSOR ||
+                     type == LOK_CALLBACK_CELL_VIEW_CURSOR)
             {
-                int cursorX = std::stoi(tokens[0]);
-                int cursorY = std::stoi(tokens[1]);
-                int cursorWidth = std::stoi(tokens[2]);
-                int cursorHeight = std::stoi(tokens[3]);
-
-                tileQueue->updateCursorPosition(std::stoi(targetViewId), std::stoi(part), cursorX, cursorY, cursorWidth, cursorHeight);
+                tileQueue->updateCursorPosition(callback._viewId, callback._part, callback._x,
+                                                callback._y, callback._width, callback._height);
             }
         }
 
         // merge various callback types together if possible
-        if (type == LOK_CALLBACK_INVALIDATE_TILES ||
-            type == LOK_CALLBACK_DOCUMENT_SIZE_CHANGED)
-        {
-            // no point in handling invalidations or page resizes per-view,
-            // all views have to be in sync
-            tileQueue->put("callback all " + std::to_string(type) + ' ' + payload);
-        }
-        else
-            tileQueue->put("callback " + std::to_string(descriptor->getViewId()) + ' ' + std::to_string(type) + ' ' + payload);
+        tileQueue->putCallback(callback);
 
         LOG_TRC("Document::ViewCallback end.");
     }
@@ -845,7 +950,7 @@ private:
     /// Helper method to broadcast callback and its payload to all clients
     void broadcastCallbackToClients(const int type, const std::string& payload)
     {
-        _tileQueue->put("callback all " + std::to_string(type) + ' ' + payload);
+        _tileQueue->putCallback(TileQueue::Callback(-1, type, payload));
     }
 
     /// Load a document (or view) and register callbacks.
@@ -922,7 +1027,7 @@ private:
         {
             std::unique_lock<std::mutex> lock(_mutex);
 #if !MOBILEAPP
-            if (_sessions.empty())
+            if (_sessions.empty() && !_reusable && !_sharedKit)
             {
                 LOG_INF("Document [" << anonymizeUrl(_url) << "] has no more views, exiting bluntly.");
                 Log::shutdown();
@@ -1179,6 +1284,20 @@ private:
             const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
             const double totalTime = elapsed/1000.;
             LOG_DBG("Returned lokit::documentLoad(" << FileUtil::anonymizeUrl(pURL) << ") in " << totalTime << "ms.");
+#if !MOBILEAPP
+            if (!FirstLoadReported && _loKitDocument && _loKitDocument->get())
+            {
+                // The first load of the kit pays for initializing the modules of its type, unless warmed.
+                FirstLoadReported = true;
+                const std::string docType = LOKitHelper::getDocumentTypeAsString(_loKitDocument->get());
+                const bool warmed = WarmedDocumentTypes.count(docType) > 0;
+                LOG_INF("First load, of a " << docType << " document, in " << totalTime << "ms, " <<
+                        (warmed ? "warmed." : "cold."));
+                session->sendTextFrame("firstload: type=" + docType + " ms=" +
+                                       std::to_string(static_cast<int>(totalTime)) +
+                                       " warmed=" + (warmed ? "true" : "false"));
+            }
+#endif
 #ifdef IOS
             getDocumentDataForMobileAppDocId(_mobileAppDocId).loKitDocument = _loKitDocument.get();
 #endif
@@ -1389,13 +1508,53 @@ private:
         return std::string();
     }
 
+    /// Forward the callback to its view, demultiplexing is done by the LibreOffice core.
+    void forwardCallback(const TileQueue::Callback& callback)
+    {
+        const bool broadcast = (callback._view < 0);
+
+        // TODO: replace with a map to be faster.
+        bool isFound = false;
+        for (auto& it : _sessions)
+        {
+            std::shared_ptr<ChildSession> session = it.second;
+            if (session && (broadcast || session->getViewId() == callback._view))
+            {
+                if (!session->isCloseFrame())
+                {
+                    isFound = true;
+                    session->loKitCallback(callback._type, callback._payload, callback._viewId);
+                }
+                else
+                {
+                    LOG_ERR("Session-thread of session [" << session->getId() << "] for view [" <<
+                            callback._view << "] is not running. Dropping [" <<
+                            lokCallbackTypeToString(callback._type) << "] payload [" <<
+                            callback._payload << "].");
+                }
+
+                if (!broadcast)
+                {
+                    break;
+                }
+            }
+        }
+
+        if (!isFound)
+        {
+            LOG_WRN("Document::ViewCallback. Session [" << callback._view <<
+                    "] is no longer active to process [" << lokCallbackTypeToString(callback._type) <<
+                    "] [" << callback._payload << "] message to Master Session.");
+        }
+    }
+
 public:
     void enableProcessInput(bool enable = true){ _inputProcessingEnabled = enable; }
     bool processInputEnabled() const { return _inputProcessingEnabled; }
 
     bool hasQueueItems() const
     {
-        return _tileQueue && !_tileQueue->isEmpty();
+        return _tileQueue && (_tileQueue->hasCallbacks() || !_tileQueue->isEmpty());
     }
 
     void drainQueue(const std::chrono::steady_clock::time_point &/*now*/)
@@ -1410,6 +1569,14 @@ public:
                     break;
                 }
 
+                // Callbacks go out ahead of the rendering requests.
+                TileQueue::Callback callback;
+                if (_tileQueue->popCallback(callback))
+                {
+                    forwardCallback(callback);
+                    continue;
+                }
+
                 const TileQueue::Payload input = _tileQueue->pop();
 
                 LOG_TRC("Kit handling queue message: " << LOOLProtocol::getAbbreviatedMessage(input));
@@ -1434,74 +1601,6 @@ public:
                 {
                     forwardToChild(tokens[0], input);
                 }
-                else if (tokens.equals(0, "callback"))
-                {
-                    if (tokens.size() >= 3)
-                    {
-                        bool broadcast = false;
-                        int viewId = -1;
-                        int exceptViewId = -1;
-
-                        const std::string& target = tokens[1];
-                        if (target == "all")
-                        {
-                            broadcast = true;
-                        }
-                        else if (LOOLProtocol::matchPrefix("except-", target))
-                        {
-                            exceptViewId = std::stoi(target.substr(7));
-                            broadcast = true;
-                        }
-                        else
-                        {
-                            viewId = std::stoi(target);
-                        }
-
-                        const int type = std::stoi(tokens[2]);
-
-                        // payload is the rest of the message
-                        const size_t offset = tokens[0].length() + tokens[1].length() + tokens[2].length() + 3; // + delims
-                        const std::string payload(input.data() + offset, input.size() - offset);
-
-                        // Forward the callback to the same view, demultiplexing is done by the LibreOffice core.
-                        // TODO: replace with a map to be faster.
-                        bool isFound = false;
-                        for (auto& it : _sessions)
-                        {
-                            std::shared_ptr<ChildSession> session = it.second;
-                            if (session && ((broadcast && (session->getViewId() != exceptViewId)) || (!broadcast && (session->getViewId() == viewId))))
-                            {
-                                if (!it.second->isCloseFrame())
-                                {
-                                    isFound = true;
-                                    session->loKitCallback(type, payload);
-                                }
-                                else
-                                {
-                                    LOG_ERR("Session-thread of session [" << session->getId() << "] for view [" <<
-                                            viewId << "] is not running. Dropping [" << lokCallbackTypeToString(type) <<
-                                            "] payload [" << payload << "].");
-                                }
-
-                                if (!broadcast)
-                                {
-                                    break;
-                                }
-                            }
-                        }
-
-                        if (!isFound)
-                        {
-                            LOG_WRN("Document::ViewCallback. Session [" << viewId <<
-                                    "] is no longer active to process [" << lokCallbackTypeToString(type) <<
-                                    "] [" << payload << "] message to Master Session.");
-                        }
-                    }
-                    else
-                    {
-                        LOG_ERR("Invalid callback message: [" << LOOLProtocol::getAbbreviatedMessage(input) << "].");
-                    }
-                }
                 else
                 {
                     LOG_ERR("Unexpected request: [" << LOOLProtocol::getAbbreviatedMessage(input) << "].");
@@ -1574,6 +1673,8 @@ public:
             << "\n\tdocPasswordType: " << (int)_docPasswordType
             << "\n\teditorId: " << _editorId
             << "\n\teditorChangeWarning: " << _editorChangeWarning
+            << "\n\tinvalidationsIn: " << _tileQueue->getInvalidationsIn()
+            << "\n\tinvalidationsOut: " << _tileQueue->getInvalidationsOut()
             << "\n";
 
         // dumpState:
@@ -1646,6 +1747,8 @@ private:
 
     const unsigned _mobileAppDocId;
     bool _inputProcessingEnabled;
+    bool _reusable;
+    bool _sharedKit;
 };
 
 #ifdef __ANDROID__
@@ -1662,7 +1765,27 @@ std::shared_ptr<lok::Document> getLOKDocumentForAndroidOnly()
 class KitSocketPoll final : public SocketPoll
 {
     std::chrono::steady_clock::time_point _pollEnd;
-    std::shared_ptr<Document> _document;
+    /// Each with its own connection to wsd, session and tile queue.
+    std::vector<std::shared_ptr<Document>> _documents;
+#if !MOBILEAPP
+    std::shared_ptr<lok::Office> _warmupKit;
+    std::string _warmupTypes;
+    /// Our first connection to wsd, held back until we're warmed.
+    std::shared_ptr<ProtocolHandlerInterface> _warmupHandler;
+    bool _ready = false;
+
+    /// To connect to wsd for more documents, see openConnection().
+    std::weak_ptr<KitSocketPoll> _self;
+    std::shared_ptr<lok::Office> _loKit;
+    std::string _jailId;
+    std::string _location;
+    std::string _pathAndQuery;
+    int _smapsFD = -1;
+    /// The connections to wsd, with or without a document.
+    size_t _connections = 0;
+    /// Whether we host, or have offered to host, more than one document.
+    bool _sharing = false;
+#endif
 
     static KitSocketPoll *mainPoll;
 
@@ -1686,11 +1809,12 @@ public:
     {
         if (mainPoll)
         {
-            if (!mainPoll->_document)
+            if (mainPoll->_documents.empty())
                 oss << "KitSocketPoll: no doc\n";
             else
             {
-                mainPoll->_document->dumpState(oss);
+                for (const auto& document : mainPoll->_documents)
+                    document->dumpState(oss);
                 mainPoll->dumpState(oss);
             }
         }
@@ -1702,6 +1826,9 @@ public:
     {
         KitSocketPoll *p = new KitSocketPoll();
         auto result = std::shared_ptr<KitSocketPoll>(p);
+#if !MOBILEAPP
+        p->_self = result;
+#endif
 
 #ifdef IOS
         std::unique_lock<std::mutex> lock(KSPollsMutex);
@@ -1715,8 +1842,19 @@ public:
     {
         SigUtil::checkDumpGlobalState(dump_kit_state);
 
-        if (_document)
-            _document->drainQueue(now);
+        for (const auto& document : _documents)
+            document->drainQueue(now);
+    }
+
+    bool hasQueueItems() const
+    {
+        for (const auto& document : _documents)
+        {
+            if (document->hasQueueItems())
+                return true;
+        }
+
+        return false;
     }
 
     // called from inside poll, inside a wakeup
@@ -1735,6 +1873,27 @@ public:
             return -1;
         }
 
+#if !MOBILEAPP
+        // Documents can only be loaded in the main loop, so warm up here, the
+        // first time, and only then offer ourselves to wsd for one.
+        if (!_ready)
+        {
+            _ready = true;
+            if (_warmupKit)
+            {
+                const std::shared_ptr<lok::Office> loKit = std::move(_warmupKit);
+                _warmupKit.reset();
+                warmDocumentTypes(loKit, _warmupTypes);
+
+                insertNewUnixSocket(_location, _pathAndQuery, _warmupHandler, _smapsFD);
+                _warmupHandler.reset();
+                LOG_INF("New kit client websocket inserted, once warmed.");
+            }
+
+            reportKitReady();
+        }
+#endif
+
         // The maximum number of extra events to process beyond the first.
         int maxExtraEvents = 15;
         int eventsSignalled = 0;
@@ -1752,7 +1911,7 @@ public:
             do
             {
                 int realTimeout = timeoutMicroS;
-                if (_document && _document->hasQueueItems())
+                if (hasQueueItems())
                     realTimeout = 0;
                 if (poll(realTimeout) <= 0)
                     break;
@@ -1769,22 +1928,113 @@ public:
         drainQueue(std::chrono::steady_clock::now());
 
 #if !MOBILEAPP
-        if (_document && _document->purgeSessions() == 0)
+        // When sharing, wsd tells each document to go with 'exit' instead.
+        for (const auto& document : _documents)
         {
-            LOG_INF("Last session discarded. Setting TerminationFlag");
-            SigUtil::setTerminationFlag();
-            return -1;
+            if (document->purgeSessions() == 0 && !document->isReusable() && !_sharing)
+            {
+                LOG_INF("Last session discarded. Setting TerminationFlag");
+                SigUtil::setTerminationFlag();
+                return -1;
+            }
+        }
+
+        // Offer to host another document, while all ours are only viewed.
+        if (KitMaxDocuments > 1 && _connections == _documents.size() &&
+            _connections < KitMaxDocuments && canShare())
+        {
+            openConnection();
         }
 #endif
         // Report the number of events we processed.
         return eventsSignalled;
     }
 
-    void setDocument(std::shared_ptr<Document> document)
+    void addDocument(const std::shared_ptr<Document>& document)
     {
-        _document = std::move(document);
+#if !MOBILEAPP
+        document->setSharedKit(_sharing);
+#endif
+        _documents.push_back(document);
+    }
+
+    void removeDocument(const std::shared_ptr<Document>& document)
+    {
+        _documents.erase(std::remove(_documents.begin(), _documents.end(), document),
+                         _documents.end());
     }
 
+#if !MOBILEAPP
+    /// Warms the document @types with @loKit once the main loop runs.
+    void setWarmup(const std::shared_ptr<lok::Office>& loKit, const std::string& types)
+    {
+        _warmupKit = loKit;
+        _warmupTypes = types;
+    }
+
+    /// Connects to wsd with @websocketHandler, as set by setConnection(),
+    /// or once warmed, if we warm, so that wsd doesn't take us for a spare before.
+    /// Returns true if connected now.
+    bool connect(const std::shared_ptr<ProtocolHandlerInterface>& websocketHandler)
+    {
+        if (_warmupKit)
+        {
+            _warmupHandler = websocketHandler;
+            return false;
+        }
+
+        insertNewUnixSocket(_location, _pathAndQuery, websocketHandler, _smapsFD);
+        return true;
+    }
+
+    /// We connected to wsd at @location and @pathAndQuery, passing it @smapsFD,
+    /// and can connect again likewise for more documents.
+    void setConnection(const std::shared_ptr<lok::Office>& loKit, const std::string& jailId,
+                       const std::string& location, const std::string& pathAndQuery, int smapsFD)
+    {
+        _loKit = loKit;
+        _jailId = jailId;
+        _location = location;
+        _pathAndQuery = pathAndQuery;
+        _smapsFD = smapsFD;
+        _connections = 1;
+    }
+
+    /// Drops @document and its connection, when others share the kit.
+    /// Returns false when we should exit instead.
+    bool closeConnection(const std::shared_ptr<Document>& document)
+    {
+        if (!_sharing)
+            return false;
+
+        if (document)
+            removeDocument(document);
+        --_connections;
+
+        LOG_INF("Closed a connection, " << _documents.size() << " documents in " <<
+                _connections << " connections remain.");
+        return !_documents.empty();
+    }
+
+private:
+    /// Whether the documents we have may share the kit with more.
+    bool canShare() const
+    {
+        for (const auto& document : _documents)
+        {
+            if (!document->isLoadedReadOnly())
+                return false;
+        }
+
+        return !_documents.empty();
+    }
+
+    /// Connects to wsd once more, for another read-only document.
+    void openConnection();
+
+public:
+#endif
+
 #ifdef IOS
     static std::mutex KSPollsMutex;
     // static std::condition_variable KSPollsCV;
@@ -1881,13 +2131,27 @@ protected:
 #ifndef IOS
             Util::setThreadName("kit" SHARED_DOC_THREADNAME_SUFFIX + docId);
 #endif
+            // A reusable document, done with, makes way for the next.
+            if (_document && _document->isReusable() && url != _document->getUrl() &&
+                !_document->hasSessions())
+            {
+                LOG_INF("Replacing finished document [" << anonymizeUrl(_document->getUrl()) <<
+                        "] with url [" << anonymizeUrl(url) << "].");
+                _ksPoll->removeDocument(_document);
+                _document.reset();
+
+                // Drop what is left of the last document's messages.
+                _queue->clear();
+            }
+
             if (!_document)
             {
                 _document = std::make_shared<Document>(
                     _loKit, _jailId, docKey, docId, url, _queue,
                     std::static_pointer_cast<WebSocketHandler>(shared_from_this()),
                     _mobileAppDocId);
-                _ksPoll->setDocument(_document);
+                _document->setReusable(tokens.equals(4, "reusable"));
+                _ksPoll->addDocument(_document);
             }
 
             // Validate and create session.
@@ -1900,6 +2164,15 @@ protected:
         else if (tokens.equals(0, "exit"))
         {
 #if !MOBILEAPP
+            if (_ksPoll->closeConnection(_document))
+            {
+                LOG_INF("Closing document due to parent 'exit' command, others share the kit.");
+                _document.reset();
+                _ksPoll.reset();
+                shutdown();
+                return;
+            }
+
             LOG_INF("Terminating immediately due to parent 'exit' command.");
             Log::shutdown();
             std::_Exit(EX_SOFTWARE);
@@ -1961,6 +2234,15 @@ protected:
     void onDisconnect() override
     {
 #if !MOBILEAPP
+        // Closed on 'exit' already, or the others sharing the kit carry on.
+        if (!_ksPoll || _ksPoll->closeConnection(_document))
+        {
+            LOG_INF("Kit connection closed, others share the kit.");
+            _document.reset();
+            _ksPoll.reset();
+            return;
+        }
+
         LOG_WRN("Kit connection lost without exit arriving from wsd. Setting TerminationFlag");
         SigUtil::setTerminationFlag();
 #endif
@@ -1975,6 +2257,27 @@ protected:
     }
 };
 
+#if !MOBILEAPP
+
+void KitSocketPoll::openConnection()
+{
+    if (!_sharing)
+    {
+        _sharing = true;
+        for (const auto& document : _documents)
+            document->setSharedKit(true);
+    }
+
+    ++_connections;
+    LOG_INF("Offering to host another read-only document, in connection #" << _connections << '.');
+
+    std::shared_ptr<KitWebSocketHandler> websocketHandler = std::make_shared<KitWebSocketHandler>(
+        "child_ws_" + std::to_string(_connections), _loKit, _jailId, _self.lock(), 0);
+    insertNewUnixSocket(_location, _pathAndQuery + "&shared=1", websocketHandler, _smapsFD);
+}
+
+#endif
+
 void documentViewCallback(const int type, const char* payload, void* data)
 {
     Document::ViewCallback(type, payload, data);
@@ -2041,6 +2344,7 @@ void wakeCallback(void* pData)
 
 #ifndef BUILDING_TESTS
 
+
 void lokit_main(
 #if !MOBILEAPP
                 const std::string& childRoot,
@@ -2084,6 +2388,8 @@ void lokit_main(
     const std::string LogLevel = logLevel ? logLevel : "trace";
     const bool bTraceStartup = (std::getenv("LOOL_TRACE_STARTUP") != nullptr);
     Log::initialize("kit", bTraceStartup ? "trace" : logLevel, logColor != nullptr, logToFile, logProperties);
+    if (std::getenv("LOOL_LOGASYNC"))
+        Log::startAsync();
     if (bTraceStartup && LogLevel != "trace")
     {
         LOG_INF("Setting log-level to [trace] and delaying setting to configured [" << LogLevel << "] until after Kit initialization.");
@@ -2108,6 +2414,7 @@ void lokit_main(
     std::string userdir_url;
     std::string instdir_path;
     int ProcSMapsFile = -1;
+    uint32_t jailSetupMs = 0;
 
     // lokit's destroy typically throws from
     // framework/source/services/modulemanager.cxx:198
@@ -2125,6 +2432,13 @@ void lokit_main(
         File(jailPath).createDirectories();
         chmod(jailPathStr.c_str(), S_IXUSR | S_IWUSR | S_IRUSR);
 
+        // Our own, to measure our memory once ready; wsd gets ProcSMapsFile.
+        KitSMapsFile = fopen("/proc/self/smaps", "r");
+        KitTrimMemory = std::getenv("LOOL_TRIM_KIT_MEMORY") != nullptr;
+        const char* maxDocuments = std::getenv("LOOL_KIT_MAX_DOCUMENTS");
+        if (maxDocuments)
+            KitMaxDocuments = std::max(std::atoi(maxDocuments), 1);
+
         if (!ChildSession::NoCapsForKit)
         {
             std::chrono::time_point<std::chrono::steady_clock> jailSetupStartTime
@@ -2140,14 +2454,31 @@ void lokit_main(
             // The bind-mount implementation: inlined here to mirror
             // the fallback link/copy version bellow.
             const auto mountJail = [&]() -> bool {
-                // Mount sysTemplate for the jail directory.
-                LOG_INF("Mounting " << sysTemplate << " -> " << jailPathStr);
-                if (!JailUtil::bind(sysTemplate, jailPathStr)
-                    || !JailUtil::remountReadonly(sysTemplate, jailPathStr))
+                // Mount sysTemplate for the jail directory: as an overlay, the jail
+                // is writable, with its /tmp in a layer of its own, in one mount.
+                const bool overlay = JailUtil::isOverlayMountingEnabled();
+                if (overlay)
                 {
-                    LOG_WRN("Failed to mount [" << sysTemplate << "] -> [" << jailPathStr
-                                                << "], will link/copy contents.");
-                    return false;
+                    LOG_INF("Mounting overlay of " << sysTemplate << " -> " << jailPathStr);
+                    if (!JailUtil::overlay(sysTemplate, JailUtil::getOverlayPath(jailPathStr),
+                                           jailPathStr))
+                    {
+                        LOG_WRN("Failed to mount overlay of [" << sysTemplate << "] -> ["
+                                                               << jailPathStr
+                                                               << "], will link/copy contents.");
+                        return false;
+                    }
+                }
+                else
+                {
+                    LOG_INF("Mounting " << sysTemplate << " -> " << jailPathStr);
+                    if (!JailUtil::bind(sysTemplate, jailPathStr)
+                        || !JailUtil::remountReadonly(sysTemplate, jailPathStr))
+                    {
+                        LOG_WRN("Failed to mount [" << sysTemplate << "] -> [" << jailPathStr
+                                                    << "], will link/copy contents.");
+                        return false;
+                    }
                 }
 
                 // Mount loTemplate inside it.
@@ -2161,6 +2492,12 @@ void lokit_main(
                     return false;
                 }
 
+                if (overlay)
+                {
+                    Poco::File(Poco::Path(jailPath, "tmp")).createDirectories();
+                    return true;
+                }
+
                 // Hard-random tmpdir inside the jail for added sercurity.
                 const std::string tempRoot = Poco::Path(childRoot, "tmp").toString();
                 Poco::File(tempRoot).createDirectories();
@@ -2187,6 +2524,7 @@ void lokit_main(
                     JailUtil::removeJail(jailPathStr);
                     bindMount = false;
                     JailUtil::disableBindMounting();
+                    JailUtil::disableOverlayMounting();
                 }
             }
 
@@ -2223,10 +2561,10 @@ void lokit_main(
             Poco::File(Poco::Path(jailPath, HomePathInJail)).createDirectories();
             ::setenv("HOME", HomePathInJail, 1);
 
-            const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
-                                std::chrono::steady_clock::now() - jailSetupStartTime)
-                                .count();
-            LOG_DBG("Initialized jail files in " << ms << " ms.");
+            jailSetupMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                              std::chrono::steady_clock::now() - jailSetupStartTime)
+                              .count();
+            LOG_DBG("Initialized jail files in " << jailSetupMs << " ms.");
 
             ProcSMapsFile = open("/proc/self/smaps", O_RDONLY);
             if (ProcSMapsFile < 0)
@@ -2325,6 +2663,7 @@ void lokit_main(
             LOG_SYS("Failed to get RLIMIT_NOFILE.");
 
         LOG_INF("Process is ready.");
+        KitJailSetupMs = jailSetupMs;
 
         std::string pathAndQuery(NEW_CHILD_URI);
         pathAndQuery.append("?jailid=");
@@ -2378,22 +2717,31 @@ void lokit_main(
         auto mainKit = KitSocketPoll::create();
         mainKit->runOnClientThread(); // We will do the polling on this thread.
 
+#if !MOBILEAPP
+        const char* warmTypes = std::getenv("LOOL_WARM_DOCUMENT_TYPES");
+        if (warmTypes && *warmTypes)
+            mainKit->setWarmup(loKit, warmTypes);
+#endif
+
         std::shared_ptr<KitWebSocketHandler> websocketHandler =
             std::make_shared<KitWebSocketHandler>("child_ws", loKit, jailId, mainKit, numericIdentifier);
 
 #if !MOBILEAPP
-        mainKit->insertNewUnixSocket(MasterLocation, pathAndQuery, websocketHandler, ProcSMapsFile);
+        mainKit->setConnection(loKit, jailId, MasterLocation, pathAndQuery, ProcSMapsFile);
+        if (mainKit->connect(websocketHandler))
+            LOG_INF("New kit client websocket inserted.");
+        else
+            LOG_INF("New kit client websocket held back until warmed.");
 #else
         mainKit->insertNewFakeSocket(docBrokerSocket, websocketHandler);
-#endif
-
         LOG_INF("New kit client websocket inserted.");
+#endif
 
 #if !MOBILEAPP
         if (bTraceStartup && LogLevel != "trace")
         {
             LOG_INF("Kit initialization complete: setting log-level to [" << LogLevel << "] as configured.");
-            Log::logger().setLevel(LogLevel);
+            Log::setLevel(LogLevel);
         }
 #endif
 
@@ -9,9 +9,13 @@
 
 #pragma once
 
+#include <chrono>
+#include <cstdint>
 #include <map>
 #include <string>
 
+#include <sys/types.h>
+
 #include <common/Util.hpp>
 
 #define LOK_USE_UNSTABLE_API
@@ -47,6 +51,26 @@ void lokit_main(
 void runKitLoopInAThread();
 #endif
 
+#if !MOBILEAPP
+/// What a kit reports to forkit once it's ready, to time its spawning end-to-end.
+struct KitSpawnReport
+{
+    pid_t _pid;
+    /// From forkit forking it to it being ready for a document.
+    uint32_t _spawnMs;
+    /// Of which setting up the jail.
+    uint32_t _jailSetupMs;
+    /// Its memory once ready, in KB, before and after trimming it.
+    uint32_t _pssBeforeTrimKb;
+    uint32_t _dirtyBeforeTrimKb;
+    uint32_t _pssKb;
+    uint32_t _dirtyKb;
+};
+
+/// Makes the kit forked next report on @fd, timing from @forkTime.
+void setKitSpawnReport(int fd, std::chrono::steady_clock::time_point forkTime);
+#endif
+
 bool globalPreinit(const std::string& loTemplate);
 /// Wrapper around private Document::ViewCallback().
 void documentViewCallback(const int type, const char* p, void* data);
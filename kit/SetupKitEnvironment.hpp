@@ -42,7 +42,7 @@ inline void setupKitEnvironment(const std::string& userInterface)
     // Set various options we need.
     std::string options = "unipoll";
 #if !MOBILEAPP
-    if (Log::logger().trace())
+    if (Log::traceEnabled())
         options += ":profile_events";
 #endif
 
@@ -16,7 +16,8 @@
 #include "common/Common.hpp"
 #include "ChildSession.hpp"
 
-void ChildSession::loKitCallback(const int /* type */, const std::string& /* payload */) {}
+void ChildSession::loKitCallback(const int /* type */, const std::string& /* payload */,
+                                 const int /* payloadViewId */) {}
 void ChildSession::disconnect() {}
 bool ChildSession::_handleInput(const char* /*buffer*/, int /*length*/) { return false; }
 ChildSession::~ChildSession() {}
@@ -801,10 +801,22 @@ L.Socket = L.Class.extend({
 			}
 			// var name = command.name; - ignored, we get the new name via the wopi's BaseFileName
 		}
+		else if (textMsg.startsWith('statusindicator: download')) {
+			// The document is being downloaded from storage, before it is loaded.
+			var downloaded = parseInt(textMsg.match(/bytes=(\d+)/)[1]);
+			var total = parseInt(textMsg.match(/total=(\d+)/)[1]);
+			if (!this._downloading) {
+				this._downloading = true;
+				this._map.showBusy(_('Downloading...'), true);
+			}
+			if (total > 0)
+				this._map._progressBar.setValue(Math.round(100 * downloaded / total));
+		}
 		else if (textMsg.startsWith('statusindicator:')) {
 			//FIXME: We should get statusindicator when saving too, no?
 			this._map.showBusy(window.ThisIsAMobileApp? _('Loading...'): _('Connecting...'), true);
 			if (textMsg.startsWith('statusindicator: ready')) {
+				this._downloading = false;
 				// We're connected: cancel timer and dialog.
 				this.ReconnectCount = 0;
 				clearTimeout(vex.timer);
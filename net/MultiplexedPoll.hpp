@@ -0,0 +1,193 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 100 -*- */
+/*
+ * This file is part of the LibreOffice project.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Socket.hpp"
+
+/// A SocketPoll whose thread runs the event loops of many tasks.
+///
+/// The tasks share the thread's sockets and callbacks. A task runs when its
+/// deadline passes or when it's woken up, so an idle task costs no wakeups
+/// of its own. Tasks are visited round-robin, starting one further along each
+/// spin, so none is always served last. Since all of a task's code runs on
+/// this poll's thread, assertCorrectThread() holds for it as for a dedicated
+/// poll.
+class MultiplexedPoll : public SocketPoll
+{
+public:
+    using TimePoint = std::chrono::steady_clock::time_point;
+
+    /// An event loop run by a MultiplexedPoll.
+    class Task
+    {
+    public:
+        Task()
+            : _woken(false)
+        {
+        }
+
+        virtual ~Task() {}
+
+        /// Does the task's work for this spin and sets its next deadline.
+        /// Returns false when the task is finished, to remove it.
+        virtual bool run(TimePoint now) = 0;
+
+        /// Called on the poll thread when the poll stops with the task still in it.
+        virtual void abandon() {}
+
+        /// Run again no later than @deadline. Only valid in the poll thread.
+        void setDeadline(const TimePoint deadline) { _deadline = deadline; }
+
+    private:
+        friend class MultiplexedPoll;
+
+        std::atomic<bool> _woken;
+        TimePoint _deadline;
+    };
+
+    MultiplexedPoll(const std::string& threadName)
+        : SocketPoll(threadName)
+        , _next(0)
+        , _taskCount(0)
+        , _runCount(0)
+    {
+    }
+
+    /// Adds a task, which runs first thing on the next spin. Thread-safe.
+    void addTask(const std::shared_ptr<Task>& task)
+    {
+        task->_woken = true;
+        {
+            std::lock_guard<std::mutex> lock(_tasksMutex);
+            _newTasks.push_back(task);
+            ++_taskCount;
+        }
+
+        wakeup();
+    }
+
+    /// Runs @task as soon as possible. Thread-safe.
+    void wakeupTask(Task& task)
+    {
+        task._woken = true;
+
+        // In our thread the task is checked once the current poll returns.
+        if (std::this_thread::get_id() != getThreadOwner())
+            wakeup();
+    }
+
+    /// The number of tasks sharing the thread.
+    size_t getTaskCount() const { return _taskCount; }
+
+    /// The number of times tasks have been run, for benchmarking.
+    uint64_t getRunCount() const { return _runCount; }
+
+    void pollingThread() override
+    {
+        while (continuePolling())
+        {
+            pollTasks(DefaultPollTimeoutMicroS);
+        }
+
+        for (const std::shared_ptr<Task>& task : _tasks)
+            task->abandon();
+        _tasks.clear();
+
+        std::lock_guard<std::mutex> lock(_tasksMutex);
+        for (const std::shared_ptr<Task>& task : _newTasks)
+            task->abandon();
+        _newTasks.clear();
+        _taskCount = 0;
+    }
+
+    /// Polls until the nearest task deadline, at most @timeoutMaxMicroS,
+    /// and runs the tasks that are due or woken up.
+    void pollTasks(int64_t timeoutMaxMicroS)
+    {
+        {
+            std::lock_guard<std::mutex> lock(_tasksMutex);
+            _tasks.insert(_tasks.end(), _newTasks.begin(), _newTasks.end());
+            _newTasks.clear();
+        }
+
+        TimePoint now = std::chrono::steady_clock::now();
+        for (const std::shared_ptr<Task>& task : _tasks)
+        {
+            if (task->_woken)
+            {
+                timeoutMaxMicroS = 0;
+                break;
+            }
+
+            const int64_t untilDeadlineMicroS
+                = std::chrono::duration_cast<std::chrono::microseconds>(task->_deadline - now).count();
+            timeoutMaxMicroS = std::max<int64_t>(0, std::min(timeoutMaxMicroS, untilDeadlineMicroS));
+        }
+
+        poll(timeoutMaxMicroS);
+
+        now = std::chrono::steady_clock::now();
+        const size_t count = _tasks.size();
+        std::vector<size_t> finished;
+        for (size_t i = 0; i < count; ++i)
+        {
+            const size_t index = (_next + i) % count;
+            Task& task = *_tasks[index];
+            if (!task._woken.exchange(false) && task._deadline > now)
+                continue;
+
+            ++_runCount;
+            bool alive = false;
+            try
+            {
+                alive = task.run(now);
+            }
+            catch (const std::exception& exc)
+            {
+                LOG_ERR("Exception while running task in poll [" << name() << "]: " << exc.what());
+            }
+
+            if (!alive)
+                finished.push_back(index);
+        }
+
+        _next = (count ? (_next + 1) % count : 0);
+
+        if (!finished.empty())
+        {
+            std::sort(finished.begin(), finished.end());
+            for (auto it = finished.rbegin(); it != finished.rend(); ++it)
+                _tasks.erase(_tasks.begin() + *it);
+
+            _taskCount -= finished.size();
+        }
+    }
+
+private:
+    std::mutex _tasksMutex;
+    /// Tasks added since the last spin, guarded by _tasksMutex.
+    std::vector<std::shared_ptr<Task>> _newTasks;
+    /// Only used in the poll thread.
+    std::vector<std::shared_ptr<Task>> _tasks;
+    size_t _next;
+    std::atomic<size_t> _taskCount;
+    std::atomic<uint64_t> _runCount;
+};
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
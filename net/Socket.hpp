@@ -13,9 +13,11 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 
+#include <algorithm>
 #include <atomic>
 #include <cassert>
 #include <cerrno>
@@ -321,14 +323,17 @@ protected:
 
     void init()
     {
-        setNoDelay();
+        // Pipes polled as sockets take no socket options.
+        const bool isSocket = isSocketFd();
+        if (isSocket)
+            setNoDelay();
         _sendBufferSize = DefaultSendBufferSize;
         _owner = std::this_thread::get_id();
         LOG_DBG('#' << _fd << " Thread affinity set to " << Log::to_string(_owner) << '.');
 
 #if !MOBILEAPP
 #if ENABLE_DEBUG
-        if (std::getenv("LOOL_ZERO_BUFFER_SIZE"))
+        if (isSocket && std::getenv("LOOL_ZERO_BUFFER_SIZE"))
         {
             const int oldSize = getSocketBufferSize();
             setSocketBufferSize(0);
@@ -340,6 +345,17 @@ protected:
     }
 
 private:
+    /// Whether our fd is a socket, rather than say a pipe.
+    bool isSocketFd() const
+    {
+#if !MOBILEAPP
+        struct stat st;
+        return ::fstat(_fd, &st) != 0 || S_ISSOCK(st.st_mode);
+#else
+        return true;
+#endif
+    }
+
     std::string _clientAddress;
     const int _fd;
     int _sendBufferSize;
@@ -410,6 +426,9 @@ public:
 
     virtual void getIOStats(uint64_t &sent, uint64_t &recv) = 0;
 
+    /// The round-trip time last measured by a ping, 0 if none.
+    virtual int getPingTimeUs() const { return 0; }
+
     /// Append pretty printed internal state to a line
     virtual void dumpState(std::ostream& os) { os << "\n"; }
 };
@@ -557,6 +576,25 @@ public:
         }
     }
 
+    /// Remove a single socket, eg. one of several owners sharing this poll is done with it.
+    void removeSocket(const std::shared_ptr<Socket>& socket)
+    {
+        assertCorrectThread();
+
+        const auto it = std::find(_pollSockets.begin(), _pollSockets.end(), socket);
+        if (it != _pollSockets.end())
+        {
+            LOG_DBG("Removing socket #" << socket->getFD() << " from " << _name);
+            socket->setThreadOwner(std::thread::id());
+            _pollSockets.erase(it);
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        _newSockets.erase(std::remove(_newSockets.begin(), _newSockets.end(), socket),
+                          _newSockets.end());
+    }
+
     bool isAlive() const { return (_threadStarted && !_threadFinished) || _runOnClientThread; }
 
     /// Check if we should continue polling
@@ -1093,9 +1131,8 @@ protected:
                 " bytes, closeSocket? " << closed);
 
 #ifdef LOG_SOCKET_DATA
-        auto& log = Log::logger();
-        if (log.trace() && _inBuffer.size() > 0)
-            log.dump("", &_inBuffer[0], _inBuffer.size());
+        if (Log::traceEnabled() && _inBuffer.size() > 0)
+            Log::logger().dump("", &_inBuffer[0], _inBuffer.size());
 #endif
 
         // If we have data, allow the app to consume.
@@ -1163,9 +1200,8 @@ public:
                             << _outBuffer.size() << " bytes buffered.");
 
 #ifdef LOG_SOCKET_DATA
-                auto& log = Log::logger();
-                if (log.trace() && len > 0)
-                    log.dump("", &_outBuffer[0], len);
+                if (Log::traceEnabled() && len > 0)
+                    Log::logger().dump("", &_outBuffer[0], len);
 #endif
 
                 if (len <= 0 && errno != EAGAIN && errno != EWOULDBLOCK)
@@ -163,6 +163,10 @@ public:
         }
     }
 
+#if !MOBILEAPP
+    int getPingTimeUs() const override { return _pingTimeUs; }
+#endif
+
     void shutdown(const StatusCodes statusCode = StatusCodes::NORMAL_CLOSE, const std::string& statusMessage = "")
     {
         if (!_shuttingDown)
@@ -59,6 +59,7 @@ class TileCacheTests : public CPPUNIT_NS::TestFixture
 
     CPPUNIT_TEST(testDesc);
     CPPUNIT_TEST(testSimple);
+    CPPUNIT_TEST(testPrefetch);
     CPPUNIT_TEST(testSimpleCombine);
     CPPUNIT_TEST(testSize);
     CPPUNIT_TEST(testCancelTiles);
@@ -95,6 +96,7 @@ class TileCacheTests : public CPPUNIT_NS::TestFixture
 
     void testDesc();
     void testSimple();
+    void testPrefetch();
     void testSimpleCombine();
     void testSize();
     void testCancelTiles();
@@ -232,6 +234,49 @@ void TileCacheTests::testSimple()
     LOK_ASSERT_MESSAGE("found tile when none was expected", !tileData);
 }
 
+void TileCacheTests::testPrefetch()
+{
+    if (isStandalone())
+    {
+        if (!UnitWSD::init(UnitWSD::UnitType::Wsd, ""))
+            throw std::runtime_error("Failed to load wsd unit test library.");
+    }
+
+    TileCache tc("doc.odt", std::chrono::system_clock::time_point());
+
+    TileDesc tile(0, 0, 256, 256, 0, 0, 3840, 3840, 1, 0, -1, false);
+    LOK_ASSERT(tc.registerTilePrefetch(tile));
+    LOK_ASSERT_MESSAGE("prefetched a tile being rendered", !tc.registerTilePrefetch(tile));
+    LOK_ASSERT_EQUAL(static_cast<size_t>(1), tc.getPrefetchCount());
+
+    // Rendered with nobody waiting for it, then requested: a hit, once.
+    const std::vector<char> data = genRandomData(1024);
+    tc.saveTileAndNotify(tile, data.data(), data.size());
+    LOK_ASSERT_EQUAL(static_cast<size_t>(0), tc.getTilesBeingRenderedCount());
+    LOK_ASSERT(tc.lookupTile(tile));
+    LOK_ASSERT(tc.lookupTile(tile));
+    LOK_ASSERT_EQUAL(static_cast<size_t>(1), tc.getPrefetchHitCount());
+    LOK_ASSERT_MESSAGE("prefetched a cached tile", !tc.registerTilePrefetch(tile));
+
+    // The user jumps elsewhere: cancel what is far from the new visible area.
+    TileDesc near(0, 0, 256, 256, 0, 3840, 3840, 3840, 2, 0, -1, false);
+    TileDesc far(0, 0, 256, 256, 0, 38400, 3840, 3840, 3, 0, -1, false);
+    LOK_ASSERT(tc.registerTilePrefetch(near));
+    LOK_ASSERT(tc.registerTilePrefetch(far));
+    LOK_ASSERT_EQUAL(std::string("canceltiles 3,"),
+                     tc.cancelPrefetch(0, Util::Rectangle(0, 3840, 15360, 7680)));
+    LOK_ASSERT(tc.hasTileBeingRendered(near));
+    LOK_ASSERT(!tc.hasTileBeingRendered(far));
+    LOK_ASSERT_EQUAL(std::string(), tc.cancelPrefetch(1, Util::Rectangle(0, 0, 0, 0)));
+
+    // Invalidated before anyone asked for it: a miss.
+    tc.saveTileAndNotify(near, data.data(), data.size());
+    tc.invalidateTiles("invalidatetiles: EMPTY", 0);
+    LOK_ASSERT(!tc.lookupTile(near));
+    LOK_ASSERT_EQUAL(static_cast<size_t>(3), tc.getPrefetchCount());
+    LOK_ASSERT_EQUAL(static_cast<size_t>(1), tc.getPrefetchHitCount());
+}
+
 void TileCacheTests::testSimpleCombine()
 {
     const char* testname = "simpleCombine ";
@@ -12,10 +12,12 @@
 #include <test/lokassert.hpp>
 
 #include <Common.hpp>
+#include <InvalidationRegion.hpp>
 #include <Protocol.hpp>
 #include <Message.hpp>
 #include <MessageQueue.hpp>
 #include <SenderQueue.hpp>
+#include <TileDesc.hpp>
 #include <Util.hpp>
 
 namespace CPPUNIT_NS
@@ -48,10 +50,13 @@ class TileQueueTests : public CPPUNIT_NS::TestFixture
     CPPUNIT_TEST(testPreviewsDeprioritization);
     CPPUNIT_TEST(testSenderQueue);
     CPPUNIT_TEST(testSenderQueueTileDeduplication);
+    CPPUNIT_TEST(testSenderQueuePriority);
     CPPUNIT_TEST(testInvalidateViewCursorDeduplication);
     CPPUNIT_TEST(testCallbackInvalidation);
+    CPPUNIT_TEST(testInvalidationRegion);
     CPPUNIT_TEST(testCallbackIndicatorValue);
     CPPUNIT_TEST(testCallbackPageSize);
+    CPPUNIT_TEST(testCallbackViewCursor);
 
     CPPUNIT_TEST_SUITE_END();
 
@@ -62,10 +67,13 @@ class TileQueueTests : public CPPUNIT_NS::TestFixture
     void testPreviewsDeprioritization();
     void testSenderQueue();
     void testSenderQueueTileDeduplication();
+    void testSenderQueuePriority();
     void testInvalidateViewCursorDeduplication();
     void testCallbackInvalidation();
+    void testInvalidationRegion();
     void testCallbackIndicatorValue();
     void testCallbackPageSize();
+    void testCallbackViewCursor();
 };
 
 void TileQueueTests::testTileQueuePriority()
@@ -153,6 +161,15 @@ std::string payloadAsString(const MessageQueue::Payload& payload)
     return std::string(payload.data(), payload.size());
 }
 
+std::string popCallbackPayload(TileQueue& queue)
+{
+    TileQueue::Callback callback;
+    if (!queue.popCallback(callback))
+        return std::string();
+
+    return callback._payload;
+}
+
 }
 
 void TileQueueTests::testTileRecombining()
@@ -359,6 +376,128 @@ void TileQueueTests::testSenderQueueTileDeduplication()
     LOK_ASSERT_EQUAL(dup_messages[2], std::string(item->data().data(), item->data().size()));
 
     LOK_ASSERT_EQUAL(static_cast<size_t>(0), queue.size());
+    LOK_ASSERT_EQUAL(static_cast<size_t>(6), queue.getEnqueuedCount());
+    LOK_ASSERT_EQUAL(static_cast<size_t>(2), queue.getDedupHitCount());
+    LOK_ASSERT_EQUAL(static_cast<size_t>(3), queue.getMaxSize());
+
+    // A superseding tile goes to the back, behind messages queued meanwhile.
+    queue.enqueue(std::make_shared<Message>(dup_messages[0], Message::Dir::Out));
+    queue.enqueue(std::make_shared<Message>("message 1", Message::Dir::Out));
+    queue.enqueue(std::make_shared<Message>(part_messages[1], Message::Dir::Out));
+    queue.enqueue(std::make_shared<Message>(dup_messages[1], Message::Dir::Out));
+
+    LOK_ASSERT_EQUAL(static_cast<size_t>(3), queue.size());
+    LOK_ASSERT_EQUAL(true, queue.dequeue(item));
+    LOK_ASSERT_EQUAL(std::string("message 1"), std::string(item->data().data(), item->data().size()));
+    LOK_ASSERT_EQUAL(true, queue.dequeue(item));
+    LOK_ASSERT_EQUAL(part_messages[1], std::string(item->data().data(), item->data().size()));
+    LOK_ASSERT_EQUAL(true, queue.dequeue(item));
+    LOK_ASSERT_EQUAL(dup_messages[1], std::string(item->data().data(), item->data().size()));
+    LOK_ASSERT_EQUAL(false, queue.dequeue(item));
+    LOK_ASSERT_EQUAL(static_cast<size_t>(0), queue.size());
+}
+
+namespace
+{
+/// A tile message of exactly 1KB, so the round-robin quanta are easy to count.
+std::shared_ptr<Message> makeTileMessage(int tilePosX, int tileWidth)
+{
+    std::string msg = "tile: nviewid=0 part=0 width=256 height=256 tileposx="
+                      + std::to_string(tilePosX) + " tileposy=0 tilewidth="
+                      + std::to_string(tileWidth) + " tileheight=3840\n";
+    msg.resize(1024, 'x');
+    return std::make_shared<Message>(msg, Message::Dir::Out);
+}
+
+int getTilePosX(const std::shared_ptr<Message>& item)
+{
+    return TileDesc::parse(item->firstLine()).getTilePosX();
+}
+}
+
+void TileQueueTests::testSenderQueuePriority()
+{
+    SenderQueue<std::shared_ptr<Message>> queue;
+
+    std::shared_ptr<Message> item;
+
+    // Visible tiles have tileposx < 100, prefetched ones >= 100.
+    for (int i = 0; i < 20; ++i)
+    {
+        queue.enqueue(makeTileMessage(i, 3840));
+        queue.enqueue(makeTileMessage(100 + i, 3840), SendPriority::PrefetchTile);
+    }
+
+    queue.enqueue(std::make_shared<Message>("invalidatecursor: 0, 0, 10, 300", Message::Dir::Out));
+    LOK_ASSERT_EQUAL(static_cast<size_t>(41), queue.size());
+    LOK_ASSERT_EQUAL(static_cast<size_t>(40 * 1024 + 31), queue.getBytes());
+
+    // The cursor jumps the queue.
+    LOK_ASSERT_EQUAL(true, queue.dequeue(item));
+    LOK_ASSERT_EQUAL(std::string("invalidatecursor:"), item->firstToken());
+
+    // Then visible tiles get 16KB per round, prefetched ones 4KB, in order.
+    int visible = 0;
+    int prefetch = 100;
+    const int rounds[][2] = { { 16, 4 }, { 4, 4 }, { 0, 4 }, { 0, 4 }, { 0, 4 } };
+    for (const auto& round : rounds)
+    {
+        for (int i = 0; i < round[0]; ++i)
+        {
+            LOK_ASSERT_EQUAL(true, queue.dequeue(item));
+            LOK_ASSERT_EQUAL(visible++, getTilePosX(item));
+        }
+
+        for (int i = 0; i < round[1]; ++i)
+        {
+            LOK_ASSERT_EQUAL(true, queue.dequeue(item));
+            LOK_ASSERT_EQUAL(prefetch++, getTilePosX(item));
+        }
+    }
+
+    LOK_ASSERT_EQUAL(false, queue.dequeue(item));
+    LOK_ASSERT_EQUAL(static_cast<size_t>(0), queue.getBytes());
+    LOK_ASSERT_EQUAL(static_cast<uint64_t>(1), queue.getLatency(SendPriority::Cursor).getCount());
+    LOK_ASSERT_EQUAL(static_cast<uint64_t>(20), queue.getLatency(SendPriority::VisibleTile).getCount());
+    LOK_ASSERT_EQUAL(static_cast<uint64_t>(20), queue.getLatency(SendPriority::PrefetchTile).getCount());
+
+    // Tiles of an old zoom level can be dropped, text is left alone.
+    queue.enqueue(makeTileMessage(0, 3840));
+    queue.enqueue(std::make_shared<Message>("statechanged: .uno:Bold=true", Message::Dir::Out));
+    queue.enqueue(makeTileMessage(1, 1920));
+    queue.enqueue(makeTileMessage(100, 3840), SendPriority::PrefetchTile);
+
+    const std::vector<std::shared_ptr<Message>> dropped = queue.dropObsolete(
+        SendPriority::VisibleTile, [](const std::shared_ptr<Message>& msg) {
+            return msg->isBinary() && TileDesc::parse(msg->firstLine()).getTileWidth() != 1920;
+        });
+
+    LOK_ASSERT_EQUAL(static_cast<size_t>(2), dropped.size());
+    LOK_ASSERT_EQUAL(static_cast<size_t>(2), queue.size());
+    LOK_ASSERT_EQUAL(static_cast<size_t>(2), queue.getDroppedCount());
+    LOK_ASSERT_EQUAL(true, queue.dequeue(item));
+    LOK_ASSERT_EQUAL(std::string("statechanged:"), item->firstToken());
+    LOK_ASSERT_EQUAL(true, queue.dequeue(item));
+    LOK_ASSERT_EQUAL(1, getTilePosX(item));
+    LOK_ASSERT_EQUAL(false, queue.dequeue(item));
+
+    // The same tile, re-requested for the visible area, supersedes a prefetched one.
+    queue.enqueue(makeTileMessage(7, 3840), SendPriority::PrefetchTile);
+    queue.enqueue(makeTileMessage(7, 3840));
+    LOK_ASSERT_EQUAL(static_cast<size_t>(1), queue.size());
+    LOK_ASSERT_EQUAL(true, queue.dequeue(item));
+    LOK_ASSERT_EQUAL(false, queue.dequeue(item));
+    LOK_ASSERT_EQUAL(static_cast<uint64_t>(22), queue.getLatency(SendPriority::VisibleTile).getCount());
+
+    // An invalidation doesn't overtake the tiles queued before it.
+    queue.enqueue(makeTileMessage(0, 3840));
+    queue.enqueue(std::make_shared<Message>("invalidatetiles: part=0 x=0 y=0 width=3840 height=3840",
+                                            Message::Dir::Out));
+    LOK_ASSERT_EQUAL(true, queue.dequeue(item));
+    LOK_ASSERT_EQUAL(std::string("tile:"), item->firstToken());
+    LOK_ASSERT_EQUAL(true, queue.dequeue(item));
+    LOK_ASSERT_EQUAL(std::string("invalidatetiles:"), item->firstToken());
+    LOK_ASSERT_EQUAL(false, queue.dequeue(item));
 }
 
 void TileQueueTests::testInvalidateViewCursorDeduplication()
@@ -425,26 +564,88 @@ void TileQueueTests::testCallbackInvalidation()
     TileQueue queue;
 
     // join tiles
-    queue.put("callback all 0 284, 1418, 11105, 275, 0");
-    queue.put("callback all 0 4299, 1418, 7090, 275, 0");
+    queue.putCallback(TileQueue::Callback(-1, LOK_CALLBACK_INVALIDATE_TILES, "284, 1418, 11105, 275, 0"));
+    queue.putCallback(TileQueue::Callback(-1, LOK_CALLBACK_INVALIDATE_TILES, "4299, 1418, 7090, 275, 0"));
 
-    LOK_ASSERT_EQUAL(1, static_cast<int>(queue.getQueue().size()));
+    LOK_ASSERT_EQUAL(0, static_cast<int>(queue._callbacks.size()));
+    LOK_ASSERT_EQUAL(true, queue.hasCallbacks());
 
-    LOK_ASSERT_EQUAL(std::string("callback all 0 284, 1418, 11105, 275, 0"), payloadAsString(queue.get()));
+    LOK_ASSERT_EQUAL(std::string("0, 0, 11520, 3840, 0"), popCallbackPayload(queue));
+    LOK_ASSERT_EQUAL(false, queue.hasCallbacks());
 
     // invalidate everything with EMPTY, but keep the different part intact
-    queue.put("callback all 0 284, 1418, 11105, 275, 0");
-    queue.put("callback all 0 4299, 1418, 7090, 275, 1");
-    queue.put("callback all 0 4299, 10418, 7090, 275, 0");
-    queue.put("callback all 0 4299, 20418, 7090, 275, 0");
+    queue.putCallback(TileQueue::Callback(-1, LOK_CALLBACK_INVALIDATE_TILES, "284, 1418, 11105, 275, 0"));
+    queue.putCallback(TileQueue::Callback(-1, LOK_CALLBACK_INVALIDATE_TILES, "4299, 1418, 7090, 275, 1"));
+    queue.putCallback(TileQueue::Callback(-1, LOK_CALLBACK_INVALIDATE_TILES, "4299, 10418, 7090, 275, 0"));
+    queue.putCallback(TileQueue::Callback(-1, LOK_CALLBACK_INVALIDATE_TILES, "4299, 20418, 7090, 275, 0"));
+    queue.putCallback(TileQueue::Callback(-1, LOK_CALLBACK_INVALIDATE_TILES, "EMPTY, 0"));
+
+    LOK_ASSERT_EQUAL(std::string("EMPTY, 0"), popCallbackPayload(queue));
+    LOK_ASSERT_EQUAL(std::string("3840, 0, 7680, 3840, 1"), popCallbackPayload(queue));
+    LOK_ASSERT_EQUAL(std::string(), popCallbackPayload(queue));
+
+    // other callbacks go first, then the invalidations since the last pass
+    queue.putCallback(TileQueue::Callback(-1, LOK_CALLBACK_INVALIDATE_TILES, "0, 0, 1000, 1000, 2"));
+    queue.putCallback(TileQueue::Callback(0, LOK_CALLBACK_STATE_CHANGED, ".uno:Bold=true"));
+    queue.putCallback(TileQueue::Callback(-1, LOK_CALLBACK_INVALIDATE_TILES, "500, 500, 1000, 1000, 2"));
+
+    LOK_ASSERT_EQUAL(std::string(".uno:Bold=true"), popCallbackPayload(queue));
+
+    TileQueue::Callback callback;
+    LOK_ASSERT_EQUAL(true, queue.popCallback(callback));
+    LOK_ASSERT_EQUAL(std::string("0, 0, 3840, 3840, 2"), callback._payload);
+    LOK_ASSERT_EQUAL(3840, callback._width);
+    LOK_ASSERT_EQUAL(2, callback._part);
+    LOK_ASSERT_EQUAL(false, queue.popCallback(callback));
+
+    LOK_ASSERT_EQUAL(static_cast<uint64_t>(9), queue.getInvalidationsIn());
+    LOK_ASSERT_EQUAL(static_cast<uint64_t>(4), queue.getInvalidationsOut());
+}
 
-    LOK_ASSERT_EQUAL(4, static_cast<int>(queue.getQueue().size()));
+void TileQueueTests::testInvalidationRegion()
+{
+    InvalidationRegion region;
+    LOK_ASSERT_EQUAL(true, region.isEmpty());
 
-    queue.put("callback all 0 EMPTY, 0");
+    // A block of cells, recalculated in many small pieces, goes out as one rectangle.
+    for (int row = 0; row < 20; ++row)
+    {
+        for (int col = 0; col < 5; ++col)
+            region.add(3840 + col * 1000, 7680 + row * 500, 900, 400);
+    }
 
-    LOK_ASSERT_EQUAL(2, static_cast<int>(queue.getQueue().size()));
-    LOK_ASSERT_EQUAL(std::string("callback all 0 4299, 1418, 7090, 275, 1"), payloadAsString(queue.get()));
-    LOK_ASSERT_EQUAL(std::string("callback all 0 EMPTY, 0"), payloadAsString(queue.get()));
+    std::vector<Util::Rectangle> rectangles = region.getRectangles();
+    LOK_ASSERT_EQUAL(static_cast<size_t>(1), rectangles.size());
+    LOK_ASSERT_EQUAL(3840, rectangles[0].getLeft());
+    LOK_ASSERT_EQUAL(7680, rectangles[0].getTop());
+    LOK_ASSERT_EQUAL(7680, rectangles[0].getWidth());
+    LOK_ASSERT_EQUAL(11520, rectangles[0].getHeight());
+
+    // An L shape is two rectangles.
+    region.clear();
+    region.add(0, 0, 3840 * 3, 3840);
+    region.add(0, 3840, 3840, 3840 * 2);
+    rectangles = region.getRectangles();
+    LOK_ASSERT_EQUAL(static_cast<size_t>(2), rectangles.size());
+    LOK_ASSERT_EQUAL(3840 * 3, rectangles[0].getWidth());
+    LOK_ASSERT_EQUAL(3840, rectangles[0].getHeight());
+    LOK_ASSERT_EQUAL(3840, rectangles[1].getTop());
+    LOK_ASSERT_EQUAL(3840 * 2, rectangles[1].getHeight());
+
+    // A huge invalidation is kept as a rectangle, and swallows the cells under it.
+    region.add(3840 * 100, 0, 1000, 1000);
+    region.add(0, 0, INT_MAX, INT_MAX);
+    rectangles = region.getRectangles();
+    LOK_ASSERT_EQUAL(static_cast<size_t>(1), rectangles.size());
+    LOK_ASSERT_EQUAL(0, rectangles[0].getLeft());
+    LOK_ASSERT_EQUAL(INT_MAX, rectangles[0].getRight());
+
+    region.addAll();
+    LOK_ASSERT_EQUAL(true, region.isAll());
+    LOK_ASSERT_EQUAL(static_cast<size_t>(0), region.getRectangles().size());
+
+    region.clear();
+    LOK_ASSERT_EQUAL(true, region.isEmpty());
 }
 
 void TileQueueTests::testCallbackIndicatorValue()
@@ -452,11 +653,11 @@ void TileQueueTests::testCallbackIndicatorValue()
     TileQueue queue;
 
     // join tiles
-    queue.put("callback all 10 25");
-    queue.put("callback all 10 50");
+    queue.putCallback(TileQueue::Callback(-1, LOK_CALLBACK_STATUS_INDICATOR_SET_VALUE, "25"));
+    queue.putCallback(TileQueue::Callback(-1, LOK_CALLBACK_STATUS_INDICATOR_SET_VALUE, "50"));
 
-    LOK_ASSERT_EQUAL(1, static_cast<int>(queue.getQueue().size()));
-    LOK_ASSERT_EQUAL(std::string("callback all 10 50"), payloadAsString(queue.get()));
+    LOK_ASSERT_EQUAL(1, static_cast<int>(queue._callbacks.size()));
+    LOK_ASSERT_EQUAL(std::string("50"), popCallbackPayload(queue));
 }
 
 void TileQueueTests::testCallbackPageSize()
@@ -464,11 +665,48 @@ void TileQueueTests::testCallbackPageSize()
     TileQueue queue;
 
     // join tiles
-    queue.put("callback all 13 12474, 188626");
-    queue.put("callback all 13 12474, 205748");
+    queue.putCallback(TileQueue::Callback(-1, LOK_CALLBACK_DOCUMENT_SIZE_CHANGED, "12474, 188626"));
+    queue.putCallback(TileQueue::Callback(-1, LOK_CALLBACK_DOCUMENT_SIZE_CHANGED, "12474, 205748"));
+
+    LOK_ASSERT_EQUAL(1, static_cast<int>(queue._callbacks.size()));
+    LOK_ASSERT_EQUAL(std::string("12474, 205748"), popCallbackPayload(queue));
+}
+
+void TileQueueTests::testCallbackViewCursor()
+{
+    TileQueue queue;
 
-    LOK_ASSERT_EQUAL(1, static_cast<int>(queue.getQueue().size()));
-    LOK_ASSERT_EQUAL(std::string("callback all 13 12474, 205748"), payloadAsString(queue.get()));
+    const std::string view1 = "{ \"viewId\": \"1\", \"rectangle\": \"3999, 1418, 0, 298\", \"part\": \"2\" }";
+    const std::string view2 = "{ \"viewId\": \"2\", \"rectangle\": \"1000, 1418, 0, 298\", \"part\": \"0\" }";
+    const std::string view1Moved = "{ \"viewId\": \"1\", \"rectangle\": \"2000, 1418, 0, 298\", \"part\": \"2\" }";
+
+    // The viewId and the rectangle are parsed as it's queued.
+    const TileQueue::Callback parsed(0, LOK_CALLBACK_INVALIDATE_VIEW_CURSOR, view1);
+    LOK_ASSERT_EQUAL(1, parsed._viewId);
+    LOK_ASSERT_EQUAL(true, parsed._hasRect);
+    LOK_ASSERT_EQUAL(3999, parsed._x);
+    LOK_ASSERT_EQUAL(298, parsed._height);
+    LOK_ASSERT_EQUAL(2, parsed._part);
+
+    // Only the cursor of the same view, sent to the same view, is obsolete.
+    queue.putCallback(parsed);
+    queue.putCallback(TileQueue::Callback(0, LOK_CALLBACK_INVALIDATE_VIEW_CURSOR, view2));
+    queue.putCallback(TileQueue::Callback(3, LOK_CALLBACK_INVALIDATE_VIEW_CURSOR, view1));
+    queue.putCallback(TileQueue::Callback(0, LOK_CALLBACK_INVALIDATE_VIEW_CURSOR, view1Moved));
+
+    LOK_ASSERT_EQUAL(3, static_cast<int>(queue._callbacks.size()));
+    LOK_ASSERT_EQUAL(view2, popCallbackPayload(queue));
+    LOK_ASSERT_EQUAL(view1, popCallbackPayload(queue));
+    LOK_ASSERT_EQUAL(view1Moved, popCallbackPayload(queue));
+
+    // The same .uno: command supersedes its older state, but not the others.
+    queue.putCallback(TileQueue::Callback(0, LOK_CALLBACK_STATE_CHANGED, ".uno:Bold=true"));
+    queue.putCallback(TileQueue::Callback(0, LOK_CALLBACK_STATE_CHANGED, ".uno:Italic=true"));
+    queue.putCallback(TileQueue::Callback(0, LOK_CALLBACK_STATE_CHANGED, ".uno:Bold=false"));
+
+    LOK_ASSERT_EQUAL(2, static_cast<int>(queue._callbacks.size()));
+    LOK_ASSERT_EQUAL(std::string(".uno:Italic=true"), popCallbackPayload(queue));
+    LOK_ASSERT_EQUAL(std::string(".uno:Bold=false"), popCallbackPayload(queue));
 }
 
 CPPUNIT_TEST_SUITE_REGISTRATION(TileQueueTests);
@@ -0,0 +1,146 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 100 -*- */
+/*
+ * This file is part of the LibreOffice project.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <config.h>
+
+#include <cerrno>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include <signal.h>
+
+#include <Poco/Exception.h>
+#include <Poco/URI.h>
+#include <Poco/Util/LayeredConfiguration.h>
+#include <test/lokassert.hpp>
+
+#include <Unit.hpp>
+#include <helpers.hpp>
+#include <wsd/DocumentBroker.hpp>
+#include <wsd/LOOLWSD.hpp>
+
+class LOOLWebSocket;
+
+namespace
+{
+/// The kit of the only document, if it has one.
+pid_t getKitPid()
+{
+    const std::vector<std::shared_ptr<DocumentBroker>> brokers = LOOLWSD::getBrokersTestOnly();
+    LOK_ASSERT_EQUAL(static_cast<size_t>(1), brokers.size());
+    return brokers[0]->getPid();
+}
+
+/// Waits for the kit @pid to go, as it does once its document hibernates.
+bool waitForKitToGo(const pid_t pid, const std::string& testname)
+{
+    for (int i = 0; i < 100; ++i)
+    {
+        if (kill(pid, 0) == -1 && errno == ESRCH)
+            return true;
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+
+    TST_LOG("Kit [" << pid << "] is still there.");
+    return false;
+}
+}
+
+/// Lets documents idle for a second hibernate, and checks that they are
+/// loaded again, intact, as they are used.
+class UnitHibernate : public UnitWSD
+{
+    TestResult testRehydrate();
+
+public:
+    UnitHibernate()
+    {
+        setTimeout(60 * 1000);
+    }
+
+    void configure(Poco::Util::LayeredConfiguration& config) override
+    {
+        UnitWSD::configure(config);
+        config.setInt("per_document.hibernate_idle_secs", 1);
+    }
+
+    void invokeTest() override;
+};
+
+UnitBase::TestResult UnitHibernate::testRehydrate()
+{
+    const char* testname = "rehydrate ";
+    try
+    {
+        std::string documentPath, documentURL;
+        helpers::getDocumentPathAndURL("hello.odt", documentPath, documentURL, testname);
+
+        Poco::URI uri(helpers::getTestServerURI());
+        std::shared_ptr<LOOLWebSocket> socket
+            = helpers::loadDocAndGetSocket(uri, documentURL, testname);
+
+        const pid_t pid = getKitPid();
+        LOK_ASSERT(pid > 0);
+
+        TST_LOG("Waiting for the idle document to let its kit go.");
+        LOK_ASSERT_MESSAGE("The kit of the idle document was not released.",
+                           waitForKitToGo(pid, testname));
+        LOK_ASSERT_EQUAL(0, static_cast<int>(getKitPid()));
+
+        // Nothing was rendered yet, so this tile is not in the cache.
+        TST_LOG("Requesting a tile of the hibernated document.");
+        helpers::sendTextFrame(socket,
+                               "tile nviewid=0 part=0 width=256 height=256 tileposx=3840 "
+                               "tileposy=3840 tilewidth=3840 tileheight=3840",
+                               testname);
+        LOK_ASSERT(!helpers::assertTileMessage(socket, testname).empty());
+
+        const pid_t tilePid = getKitPid();
+        LOK_ASSERT(tilePid > 0);
+        LOK_ASSERT(tilePid != pid);
+
+        TST_LOG("Waiting for the document to hibernate again.");
+        LOK_ASSERT_MESSAGE("The kit of the idle document was not released.",
+                           waitForKitToGo(tilePid, testname));
+
+        // An edit wakes it up as well, with what it had.
+        TST_LOG("Editing the hibernated document.");
+        helpers::sendText(socket, "a", testname);
+        LOK_ASSERT_EQUAL(std::string("textselectioncontent: aHello world"),
+                         helpers::getAllText(socket, testname));
+
+        const pid_t editPid = getKitPid();
+        LOK_ASSERT(editPid > 0);
+        LOK_ASSERT(editPid != tilePid);
+    }
+    catch (const Poco::Exception& exc)
+    {
+        LOK_ASSERT_FAIL(exc.displayText());
+    }
+    return TestResult::Ok;
+}
+
+void UnitHibernate::invokeTest()
+{
+    UnitBase::TestResult result = testRehydrate();
+    if (result != TestResult::Ok)
+        exitTest(result);
+
+    exitTest(TestResult::Ok);
+}
+
+UnitBase *unit_create_wsd(void)
+{
+    return new UnitHibernate();
+}
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
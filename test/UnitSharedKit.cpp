@@ -0,0 +1,140 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 100 -*- */
+/*
+ * This file is part of the LibreOffice project.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <config.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include <signal.h>
+
+#include <Poco/Exception.h>
+#include <Poco/Path.h>
+#include <Poco/URI.h>
+#include <Poco/Util/LayeredConfiguration.h>
+#include <test/lokassert.hpp>
+
+#include <Unit.hpp>
+#include <helpers.hpp>
+#include <wsd/DocumentBroker.hpp>
+#include <wsd/LOOLWSD.hpp>
+
+class LOOLWebSocket;
+
+namespace
+{
+/// The kit of the document at @documentPath.
+pid_t getKitPid(const std::string& documentPath)
+{
+    const std::string fileName = Poco::Path(documentPath).getFileName();
+    for (const std::shared_ptr<DocumentBroker>& broker : LOOLWSD::getBrokersTestOnly())
+    {
+        if (broker->getDocKey().find(fileName) != std::string::npos)
+            return broker->getPid();
+    }
+
+    return 0;
+}
+
+/// The URL to load the document at @documentPath with, only to view it.
+std::string getReadOnlyURL(const std::string& documentPath)
+{
+    std::string encodedUri;
+    Poco::URI::encode("file://" + Poco::Path(documentPath).makeAbsolute().toString() +
+                          "?permission=readonly",
+                      ":/?", encodedUri);
+    return "lool/" + encodedUri + "/ws";
+}
+}
+
+/// Opens two documents read-only in the same kit, and checks that the one a
+/// session then opens for editing moves to a kit of its own, and is edited.
+class UnitSharedKit : public UnitWSD
+{
+    TestResult testWriterJoins();
+
+public:
+    UnitSharedKit()
+    {
+        setTimeout(60 * 1000);
+    }
+
+    void configure(Poco::Util::LayeredConfiguration& config) override
+    {
+        UnitWSD::configure(config);
+        config.setInt("per_document.read_only_docs_per_kit", 2);
+    }
+
+    void invokeTest() override;
+};
+
+UnitBase::TestResult UnitSharedKit::testWriterJoins()
+{
+    const char* testname = "writerJoins ";
+    try
+    {
+        Poco::URI uri(helpers::getTestServerURI());
+
+        std::string viewedPath, viewedURL;
+        helpers::getDocumentPathAndURL("hello.odt", viewedPath, viewedURL, testname);
+        std::shared_ptr<LOOLWebSocket> viewedSocket
+            = helpers::loadDocAndGetSocket(uri, getReadOnlyURL(viewedPath), testname);
+        const pid_t sharedPid = getKitPid(viewedPath);
+        LOK_ASSERT(sharedPid > 0);
+
+        // Give the kit a moment to offer to host another read-only document.
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+
+        std::string editedPath, editedURL;
+        helpers::getDocumentPathAndURL("hello.odt", editedPath, editedURL, testname);
+        std::shared_ptr<LOOLWebSocket> readerSocket
+            = helpers::loadDocAndGetSocket(uri, getReadOnlyURL(editedPath), testname);
+        LOK_ASSERT_EQUAL(static_cast<int>(sharedPid), static_cast<int>(getKitPid(editedPath)));
+
+        TST_LOG("Opening the shared document for editing.");
+        std::shared_ptr<LOOLWebSocket> writerSocket
+            = helpers::loadDocAndGetSocket(uri, editedURL, testname);
+
+        const pid_t editedPid = getKitPid(editedPath);
+        LOK_ASSERT(editedPid > 0);
+        LOK_ASSERT(editedPid != sharedPid);
+
+        // The other document carries on in the shared kit.
+        LOK_ASSERT_EQUAL(0, kill(sharedPid, 0));
+        LOK_ASSERT_EQUAL(static_cast<int>(sharedPid), static_cast<int>(getKitPid(viewedPath)));
+
+        // And the writer edits, rather than being made read-only.
+        helpers::sendText(writerSocket, "a", testname);
+        LOK_ASSERT_EQUAL(std::string("textselectioncontent: aHello world"),
+                         helpers::getAllText(writerSocket, testname));
+    }
+    catch (const Poco::Exception& exc)
+    {
+        LOK_ASSERT_FAIL(exc.displayText());
+    }
+    return TestResult::Ok;
+}
+
+void UnitSharedKit::invokeTest()
+{
+    UnitBase::TestResult result = testWriterJoins();
+    if (result != TestResult::Ok)
+        exitTest(result);
+
+    exitTest(TestResult::Ok);
+}
+
+UnitBase *unit_create_wsd(void)
+{
+    return new UnitSharedKit();
+}
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -0,0 +1,138 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 100 -*- */
+/*
+ * This file is part of the LibreOffice project.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <config.h>
+
+#include <WopiTestServer.hpp>
+#include <Log.hpp>
+#include <Unit.hpp>
+#include <UnitHTTP.hpp>
+#include <ZipPackage.hpp>
+#include <helpers.hpp>
+#include <Poco/Net/HTTPRequest.h>
+
+#include <sstream>
+
+/// Saves an edit to a host that takes the changed members of the package in
+/// PutFile, and checks that the package it puts together from them is the
+/// document, with the members that didn't change kept from the one it had.
+class UnitWOPIPackageDelta : public WopiTestServer
+{
+    enum class Phase
+    {
+        Load,
+        Modify,
+        SaveModified,
+        Polling
+    } _phase;
+
+    /// The document as the host first had it.
+    const std::string _originalContent;
+
+    /// The picture takes up most of the document, and doesn't change.
+    static constexpr const char* PictureName
+        = "Pictures/100002010000010E000000AB9D5D6726597AF84D.png";
+
+    static std::string readDocument()
+    {
+        const std::vector<char> data = helpers::readDataFromFile("non-shape-image.odt");
+        return std::string(data.begin(), data.end());
+    }
+
+public:
+    UnitWOPIPackageDelta()
+        : WopiTestServer(readDocument())
+        , _phase(Phase::Load)
+        , _originalContent(getFileContent())
+    {
+        setSupportsPackageDelta(true);
+    }
+
+    void assertPutFileRequest(const Poco::Net::HTTPRequest& request) override
+    {
+        // Only the changed members came.
+        LOK_ASSERT_EQUAL(std::string("true"), request.get("X-LOOL-WOPI-PackageDelta", ""));
+
+        // And the host put them together with the rest into a whole document.
+        std::istringstream original(_originalContent);
+        std::istringstream result(getFileContent());
+        ZipPackage originalPackage;
+        ZipPackage resultPackage;
+        LOK_ASSERT(originalPackage.read(original));
+        LOK_ASSERT(resultPackage.read(result));
+        LOK_ASSERT(!resultPackage.isEmpty());
+        LOK_ASSERT_EQUAL(std::string("mimetype"), resultPackage.getMembers()[0]._name);
+
+        const ZipPackage::Member* picture = resultPackage.find(PictureName);
+        LOK_ASSERT(picture);
+        LOK_ASSERT(picture->isSame(*originalPackage.find(PictureName)));
+
+        // With the edit.
+        const ZipPackage::Member* content = resultPackage.find("content.xml");
+        LOK_ASSERT(content);
+        LOK_ASSERT(!content->isSame(*originalPackage.find("content.xml")));
+
+        // Every member reads back whole, as the central directory has it.
+        std::istringstream check(getFileContent());
+        std::ostringstream copy;
+        LOK_ASSERT(resultPackage.writeDelta(check, ZipPackage(), copy) > 0);
+
+        exitTest(TestResult::Ok);
+    }
+
+    void invokeTest() override
+    {
+        constexpr char testName[] = "UnitWOPIPackageDelta";
+
+        switch (_phase)
+        {
+            case Phase::Load:
+            {
+                initWebsocket("/wopi/files/0?access_token=anything");
+
+                helpers::sendTextFrame(*getWs()->getLOOLWebSocket(), "load url=" + getWopiSrc(),
+                                       testName);
+
+                _phase = Phase::Modify;
+                SocketPoll::wakeupWorld();
+                break;
+            }
+            case Phase::Modify:
+            {
+                helpers::sendTextFrame(*getWs()->getLOOLWebSocket(),
+                                       "key type=input char=97 key=0", testName);
+                helpers::sendTextFrame(*getWs()->getLOOLWebSocket(),
+                                       "key type=up char=0 key=512", testName);
+
+                _phase = Phase::SaveModified;
+                break;
+            }
+            case Phase::SaveModified:
+            {
+                helpers::sendTextFrame(*getWs()->getLOOLWebSocket(),
+                                       "save dontTerminateEdit=0 dontSaveIfUnmodified=0", testName);
+
+                _phase = Phase::Polling;
+                break;
+            }
+            case Phase::Polling:
+            {
+                // just wait for the results
+                break;
+            }
+        }
+    }
+};
+
+UnitBase *unit_create_wsd(void)
+{
+    return new UnitWOPIPackageDelta();
+}
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
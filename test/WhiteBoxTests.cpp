@@ -21,10 +21,25 @@
 #include <Util.hpp>
 #include <JsonUtil.hpp>
 #include <RequestDetails.hpp>
+#include <wsd/ConvertToBatch.hpp>
+#include <wsd/ConvertToQueue.hpp>
+#include <wsd/PreviewCache.hpp>
+#include <wsd/TraceFile.hpp>
+#include <wsd/InvalidationFrame.hpp>
+#include <wsd/KitPoolSizer.hpp>
+#include <wsd/LinkEstimator.hpp>
+#include <wsd/ZipPackage.hpp>
+#include <net/MultiplexedPoll.hpp>
 
 #include <common/Authorization.hpp>
+#include <common/Clipboard.hpp>
+#include <common/FileUtil.hpp>
 #include <wsd/FileServer.hpp>
 
+#include <fstream>
+#include <sstream>
+#include <zlib.h>
+
 /// WhiteBox unit-tests.
 class WhiteBoxTests : public CPPUNIT_NS::TestFixture
 {
@@ -50,6 +65,17 @@ class WhiteBoxTests : public CPPUNIT_NS::TestFixture
     CPPUNIT_TEST(testRequestDetails_local);
     CPPUNIT_TEST(testRequestDetails);
     CPPUNIT_TEST(testUIDefaults);
+    CPPUNIT_TEST(testLinkEstimator);
+    CPPUNIT_TEST(testMultiplexedPoll);
+    CPPUNIT_TEST(testConvertToQueue);
+    CPPUNIT_TEST(testConvertToBatchTar);
+    CPPUNIT_TEST(testPreviewCache);
+    CPPUNIT_TEST(testKitPoolSizer);
+    CPPUNIT_TEST(testDirtyByMapping);
+    CPPUNIT_TEST(testInvalidationFrame);
+    CPPUNIT_TEST(testClipboardCache);
+    CPPUNIT_TEST(testZipPackage);
+    CPPUNIT_TEST(testBinaryTraceFormat);
 
     CPPUNIT_TEST_SUITE_END();
 
@@ -73,6 +99,17 @@ class WhiteBoxTests : public CPPUNIT_NS::TestFixture
     void testRequestDetails_local();
     void testRequestDetails();
     void testUIDefaults();
+    void testLinkEstimator();
+    void testMultiplexedPoll();
+    void testConvertToQueue();
+    void testConvertToBatchTar();
+    void testPreviewCache();
+    void testKitPoolSizer();
+    void testDirtyByMapping();
+    void testInvalidationFrame();
+    void testClipboardCache();
+    void testZipPackage();
+    void testBinaryTraceFormat();
 };
 
 void WhiteBoxTests::testLOOLProtocolFunctions()
@@ -106,6 +143,36 @@ void WhiteBoxTests::testLOOLProtocolFunctions()
     LOK_ASSERT(LOOLProtocol::getTokenKeyword(tokens, "mumble", map, mumble));
     LOK_ASSERT_EQUAL(2, mumble);
 
+    // The in-place, index-based variants.
+    LOK_ASSERT(LOOLProtocol::getTokenInteger(tokens, 1, "x", foo));
+    LOK_ASSERT_EQUAL(1, foo);
+    LOK_ASSERT(!LOOLProtocol::getTokenInteger(tokens, 1, "y", foo));
+    LOK_ASSERT(!LOOLProtocol::getTokenInteger(tokens, 4, "bar", foo));
+    LOK_ASSERT(!LOOLProtocol::getTokenInteger(tokens, 42, "x", foo));
+
+    uint32_t u32 = 0;
+    LOK_ASSERT(LOOLProtocol::getTokenUInt32(tokens, 3, "foo", u32));
+    LOK_ASSERT_EQUAL(static_cast<uint32_t>(42), u32);
+
+    LOK_ASSERT(LOOLProtocol::getTokenString(tokens, 4, "bar", bar));
+    LOK_ASSERT_EQUAL(std::string("hello-sailor"), bar);
+    LOK_ASSERT(!LOOLProtocol::getTokenString(tokens, 4, "ba", bar));
+
+    mumble = 0;
+    LOK_ASSERT(LOOLProtocol::getTokenKeyword(tokens, 5, "mumble", map, mumble));
+    LOK_ASSERT_EQUAL(2, mumble);
+    LOK_ASSERT(!LOOLProtocol::getTokenKeyword(tokens, 6, "zip", map, mumble));
+
+    StringVector emptyValue(Util::tokenize("cmd bar= x="));
+    LOK_ASSERT(LOOLProtocol::getTokenString(emptyValue, 1, "bar", bar));
+    LOK_ASSERT_EQUAL(std::string(), bar);
+    LOK_ASSERT(!LOOLProtocol::getTokenInteger(emptyValue, 2, "x", foo));
+
+    LOK_ASSERT(LOOLProtocol::tokenIndicatesUserInteraction(tokens, 0));
+    LOK_ASSERT(!LOOLProtocol::tokenIndicatesUserInteraction(Util::tokenize("canceltiles"), 0));
+    LOK_ASSERT(!LOOLProtocol::tokenIndicatesUserInteraction(Util::tokenize("userinactive"), 0));
+    LOK_ASSERT(LOOLProtocol::tokenIndicatesUserInteraction(Util::tokenize("useractive"), 0));
+
     LOK_ASSERT(LOOLProtocol::getTokenIntegerFromMessage(message, "foo", foo));
     LOK_ASSERT_EQUAL(42, foo);
 
@@ -983,6 +1050,21 @@ void WhiteBoxTests::testStringVector()
 
     CPPUNIT_ASSERT(vector.equals(0, vector2, 0));
     CPPUNIT_ASSERT(!vector.equals(0, vector2, 1));
+
+    // Test startsWith().
+    StringVector vector3(Util::tokenize("uno vnd.sun.star.script:foo"));
+    CPPUNIT_ASSERT(vector3.startsWith(0, "un"));
+    CPPUNIT_ASSERT(vector3.startsWith(0, "uno"));
+    CPPUNIT_ASSERT(!vector3.startsWith(0, "unox"));
+    CPPUNIT_ASSERT(vector3.startsWith(1, "vnd.sun.star.script:"));
+    CPPUNIT_ASSERT(!vector3.startsWith(2, ""));
+
+    // Test data().
+    std::size_t length = 42;
+    const char* data = vector3.data(1, length);
+    CPPUNIT_ASSERT_EQUAL(std::string("vnd.sun.star.script:foo"), std::string(data, length));
+    CPPUNIT_ASSERT(vector3.data(2, length) == nullptr);
+    CPPUNIT_ASSERT_EQUAL(static_cast<std::size_t>(0), length);
 }
 
 void WhiteBoxTests::testRequestDetails_DownloadURI()
@@ -1578,6 +1660,666 @@ void WhiteBoxTests::testUIDefaults()
                      FileServerRequestHandler::uiDefaultsToJSON(";;UIMode=notebookbar;;PresentationStatusbar=false;;TextRuler=true;;bah=ugh;;SpreadsheetSidebar=false"));
 }
 
+namespace
+{
+/// Sends rounds of 10 tiles of 10KB over a link of the given bandwidth
+/// (bytes/s) and RTT, acknowledging each once it has fully arrived.
+void simulateLink(LinkEstimator& link, LinkEstimator::TimePoint& now, int bandwidth,
+                  std::chrono::milliseconds rtt, int rounds)
+{
+    const size_t tileSize = 10 * 1024;
+    const auto serialization = std::chrono::microseconds(tileSize * 1000000 / bandwidth);
+    for (int round = 0; round < rounds; ++round)
+    {
+        std::vector<LinkEstimator::Sample> inFlight;
+        for (int i = 0; i < 10; ++i)
+            inFlight.push_back(link.onSend(tileSize, i, now));
+
+        const LinkEstimator::TimePoint sent = now;
+        for (int i = 0; i < 10; ++i)
+        {
+            now = sent + rtt + (i + 1) * serialization;
+            link.onAck(inFlight[i], now);
+        }
+    }
+}
+}
+
+void WhiteBoxTests::testLinkEstimator()
+{
+    LinkEstimator::TimePoint now = std::chrono::steady_clock::now();
+
+    // Nothing known yet: no window, and the default timeout.
+    LinkEstimator fast;
+    LOK_ASSERT(!fast.hasEstimate());
+    LOK_ASSERT_EQUAL(static_cast<size_t>(0), fast.getWindowTiles());
+    LOK_ASSERT_EQUAL(static_cast<int64_t>(TILE_ROUNDTRIP_TIMEOUT_MS), static_cast<int64_t>(fast.getTimeout().count()));
+
+    // 10MB/s with 20ms RTT. Sending only 10 tiles per round trip we can't
+    // measure more than that over a round trip, about a third of the link.
+    simulateLink(fast, now, 10 * 1024 * 1024, std::chrono::milliseconds(20), 5);
+    LOK_ASSERT(fast.hasEstimate());
+    LOK_ASSERT_EQUAL(static_cast<int64_t>(20), static_cast<int64_t>(
+        std::chrono::duration_cast<std::chrono::milliseconds>(fast.getMinRtt()).count()));
+    LOK_ASSERT(fast.getBandwidth() > 3 * 1024 * 1024);
+    LOK_ASSERT(fast.getBandwidth() <= 10 * 1024 * 1024);
+    LOK_ASSERT_EQUAL(static_cast<int64_t>(LinkEstimator::MinTimeoutMs), static_cast<int64_t>(fast.getTimeout().count()));
+
+    // A ping can only lower the RTT estimate.
+    fast.onPing(std::chrono::milliseconds(15), now);
+    LOK_ASSERT_EQUAL(static_cast<int64_t>(15000), static_cast<int64_t>(fast.getMinRtt().count()));
+    fast.onPing(std::chrono::milliseconds(30), now);
+    LOK_ASSERT_EQUAL(static_cast<int64_t>(15000), static_cast<int64_t>(fast.getMinRtt().count()));
+
+    // 100KB/s with 300ms RTT.
+    LinkEstimator slow;
+    simulateLink(slow, now, 100 * 1024, std::chrono::milliseconds(300), 5);
+    LOK_ASSERT(slow.getBandwidth() > 30 * 1024);
+    LOK_ASSERT(slow.getBandwidth() <= 100 * 1024);
+    LOK_ASSERT(slow.getWindowTiles() >= 1);
+    LOK_ASSERT(slow.getWindowTiles() <= 8);
+    LOK_ASSERT(slow.getWindowTiles() < fast.getWindowTiles());
+    LOK_ASSERT(slow.getTimeout().count() > LinkEstimator::MinTimeoutMs);
+
+    // The window is twice the bandwidth-delay product, in tiles.
+    const double bdp = fast.getBandwidth() * 0.015;
+    LOK_ASSERT_EQUAL(static_cast<size_t>(std::ceil(2 * bdp / (10 * 1024))), fast.getWindowTiles());
+
+    // An old minimum RTT expires, so a longer route is picked up.
+    now += std::chrono::seconds(11);
+    fast.onPing(std::chrono::milliseconds(40), now);
+    LOK_ASSERT_EQUAL(static_cast<int64_t>(40000), static_cast<int64_t>(fast.getMinRtt().count()));
+}
+
+namespace
+{
+/// Counts its runs, and finishes after a given number of them.
+class CountingTask : public MultiplexedPoll::Task
+{
+public:
+    CountingTask(int maxRuns)
+        : _runs(0)
+        , _maxRuns(maxRuns)
+    {
+    }
+
+    bool run(std::chrono::steady_clock::time_point now) override
+    {
+        ++_runs;
+        setDeadline(now + std::chrono::hours(1));
+        return _runs < _maxRuns;
+    }
+
+    int _runs;
+    const int _maxRuns;
+};
+}
+
+void WhiteBoxTests::testMultiplexedPoll()
+{
+    MultiplexedPoll poll("mux_poll");
+    poll.runOnClientThread();
+
+    const auto idle = std::make_shared<CountingTask>(100);
+    const auto once = std::make_shared<CountingTask>(1);
+    poll.addTask(idle);
+    poll.addTask(once);
+    LOK_ASSERT_EQUAL(static_cast<size_t>(2), poll.getTaskCount());
+
+    // New tasks run on the next spin, and finished ones are dropped.
+    poll.pollTasks(0);
+    LOK_ASSERT_EQUAL(1, idle->_runs);
+    LOK_ASSERT_EQUAL(1, once->_runs);
+    LOK_ASSERT_EQUAL(static_cast<size_t>(1), poll.getTaskCount());
+
+    // Neither due nor woken: an idle task isn't run.
+    poll.pollTasks(0);
+    poll.pollTasks(0);
+    LOK_ASSERT_EQUAL(1, idle->_runs);
+
+    poll.wakeupTask(*idle);
+    poll.pollTasks(0);
+    LOK_ASSERT_EQUAL(2, idle->_runs);
+
+    idle->setDeadline(std::chrono::steady_clock::now());
+    poll.pollTasks(0);
+    LOK_ASSERT_EQUAL(3, idle->_runs);
+    LOK_ASSERT_EQUAL(static_cast<uint64_t>(4), poll.getRunCount());
+}
+
+void WhiteBoxTests::testConvertToQueue()
+{
+    const std::chrono::milliseconds now(0);
+    ConvertToQueue queue(1, 3);
+
+    // With a kit free, a conversion starts right away.
+    const auto a1 = queue.enqueue("a");
+    LOK_ASSERT(queue.wait(a1, now));
+
+    const auto a2 = queue.enqueue("a");
+    const auto a3 = queue.enqueue("a");
+    const auto b1 = queue.enqueue("b");
+    LOK_ASSERT(a2 && a3 && b1);
+    LOK_ASSERT_EQUAL(static_cast<size_t>(3), queue.getQueuedCount());
+
+    // Full.
+    LOK_ASSERT(!queue.enqueue("c"));
+
+    // Clients take turns, rather than "a" going through its whole batch first.
+    queue.release(a1);
+    LOK_ASSERT(queue.wait(a2, now));
+    queue.release(a2);
+    LOK_ASSERT(queue.wait(b1, now));
+    LOK_ASSERT_EQUAL(static_cast<size_t>(1), queue.getRunningCount());
+
+    // Timing out gives up the place in the queue.
+    const auto c1 = queue.enqueue("c");
+    LOK_ASSERT(!queue.wait(c1, now));
+    LOK_ASSERT_EQUAL(static_cast<size_t>(1), queue.getQueuedCount());
+
+    queue.release(b1);
+    queue.release(b1);
+    LOK_ASSERT(queue.wait(a3, now));
+    queue.release(a3);
+    LOK_ASSERT_EQUAL(static_cast<size_t>(0), queue.getRunningCount());
+    LOK_ASSERT_EQUAL(static_cast<size_t>(0), queue.getQueuedCount());
+}
+
+namespace
+{
+/// Appends a ustar header and the @data of a file of @type to @tar.
+void appendTarEntry(std::string& tar, const std::string& prefix, const std::string& name,
+                    const std::string& data, char type = '0')
+{
+    std::string header(512, '\0');
+    header.replace(0, name.size(), name);
+    char size[12];
+    snprintf(size, sizeof(size), "%011o", static_cast<unsigned>(data.size()));
+    header.replace(124, 11, size);
+    header[156] = type;
+    header.replace(257, 5, "ustar");
+    header.replace(345, prefix.size(), prefix);
+
+    tar += header + data;
+    tar.append((512 - data.size() % 512) % 512, '\0');
+}
+}
+
+void WhiteBoxTests::testConvertToBatchTar()
+{
+    std::string tar;
+    appendTarEntry(tar, "", "docs/", "", '5');
+    appendTarEntry(tar, "", "docs/hello.odt", "hello");
+    appendTarEntry(tar, "in", "empty.ods", "");
+    appendTarEntry(tar, "", "big.odp", std::string(1000, 'x'));
+    tar.append(1024, '\0');
+
+    const std::string dir = "/tmp/" + FileUtil::createRandomDir("/tmp");
+    size_t count = 0;
+    const auto createFile = [&dir, &count](const std::string& name)
+    {
+        return dir + '/' + std::to_string(count++) + '-' + name;
+    };
+    const auto readFile = [](const std::string& path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        std::ostringstream oss;
+        oss << file.rdbuf();
+        return oss.str();
+    };
+
+    // One document at a time: nothing is written past the one asked for.
+    std::istringstream stream(tar);
+    ConvertToBatch::TarReader reader(stream);
+    ConvertToBatch::Document document;
+    LOK_ASSERT(reader.next(createFile, document));
+    LOK_ASSERT_EQUAL(std::string("hello.odt"), document._name);
+    LOK_ASSERT_EQUAL(std::string("hello"), readFile(document._path));
+    LOK_ASSERT_EQUAL(static_cast<size_t>(1), count);
+
+    LOK_ASSERT(reader.next(createFile, document));
+    LOK_ASSERT_EQUAL(std::string("empty.ods"), document._name);
+    LOK_ASSERT(FileUtil::Stat(document._path).exists());
+    LOK_ASSERT(readFile(document._path).empty());
+
+    // Skipped without writing it.
+    LOK_ASSERT(reader.next(nullptr, document));
+    LOK_ASSERT_EQUAL(std::string("big.odp"), document._name);
+    LOK_ASSERT(document._path.empty());
+    LOK_ASSERT_EQUAL(static_cast<size_t>(2), count);
+
+    LOK_ASSERT(!reader.next(createFile, document));
+    LOK_ASSERT(!reader.isFailed());
+    LOK_ASSERT(!reader.next(createFile, document));
+
+    // Truncated data.
+    std::istringstream truncated(tar.substr(0, 3 * 512 + 100));
+    ConvertToBatch::TarReader truncatedReader(truncated);
+    LOK_ASSERT(truncatedReader.next(createFile, document));
+    LOK_ASSERT(!truncatedReader.next(createFile, document));
+    LOK_ASSERT(truncatedReader.isFailed());
+    LOK_ASSERT(document._path.empty());
+
+    FileUtil::removeFile(dir, true);
+}
+
+void WhiteBoxTests::testPreviewCache()
+{
+    PreviewCache cache(10);
+    const std::string a = PreviewCache::makeKey("hash", 0, 256, 256);
+    const std::string b = PreviewCache::makeKey("hash", 1, 256, 256);
+    const std::string c = PreviewCache::makeKey("hash", 0, 128, 128);
+    LOK_ASSERT(a != b && a != c && b != c);
+
+    cache.insert(a, std::make_shared<const std::string>("aaaa"));
+    cache.insert(b, std::make_shared<const std::string>("bbbb"));
+    LOK_ASSERT_EQUAL(static_cast<size_t>(8), cache.getSize());
+    LOK_ASSERT_EQUAL(std::string("aaaa"), *cache.lookup(a));
+
+    // Over budget: b is the least recently used.
+    cache.insert(c, std::make_shared<const std::string>("cccc"));
+    LOK_ASSERT(!cache.lookup(b));
+    LOK_ASSERT(cache.lookup(a));
+    LOK_ASSERT(cache.lookup(c));
+    LOK_ASSERT_EQUAL(static_cast<size_t>(8), cache.getSize());
+    LOK_ASSERT_EQUAL(static_cast<uint64_t>(3), cache.getHits());
+    LOK_ASSERT_EQUAL(static_cast<uint64_t>(1), cache.getMisses());
+
+    // Replacing doesn't count twice, and too large isn't cached.
+    cache.insert(a, std::make_shared<const std::string>("AA"));
+    LOK_ASSERT_EQUAL(static_cast<size_t>(6), cache.getSize());
+    cache.insert(b, std::make_shared<const std::string>(std::string(11, 'b')));
+    LOK_ASSERT(!cache.lookup(b));
+    LOK_ASSERT_EQUAL(static_cast<size_t>(2), cache.getCount());
+
+    cache.setMaxBytes(0);
+    LOK_ASSERT_EQUAL(static_cast<size_t>(0), cache.getCount());
+    LOK_ASSERT_EQUAL(static_cast<size_t>(0), cache.getSize());
+}
+
+void WhiteBoxTests::testKitPoolSizer()
+{
+    KitPoolSizer sizer;
+    sizer.configure(1, 4, std::chrono::seconds(60), std::chrono::milliseconds(0));
+    sizer.addSpawnTime(std::chrono::milliseconds(1500), std::chrono::milliseconds(100));
+
+    auto now = KitPoolSizer::Clock::now();
+    LOK_ASSERT_EQUAL(static_cast<size_t>(1), sizer.getTarget(now));
+
+    // A steady open a second: two spares cover the 1.5 seconds to spawn.
+    for (int i = 0; i < 600; ++i)
+    {
+        now += std::chrono::seconds(1);
+        sizer.addRequest(now);
+    }
+    LOK_ASSERT(sizer.getRate(now) > 0.95 && sizer.getRate(now) < 1.05);
+    LOK_ASSERT_EQUAL(static_cast<size_t>(2), sizer.getTarget(now));
+
+    // A burst goes up to the maximum.
+    for (int i = 0; i < 100; ++i)
+        sizer.addRequest(now);
+    LOK_ASSERT_EQUAL(static_cast<size_t>(4), sizer.getTarget(now));
+
+    // And back down to the minimum when it's quiet.
+    now += std::chrono::minutes(30);
+    LOK_ASSERT_EQUAL(static_cast<size_t>(1), sizer.getTarget(now));
+    LOK_ASSERT_EQUAL(static_cast<uint64_t>(700), sizer.getRequestCount());
+
+    sizer.addWaitTime(std::chrono::milliseconds(5));
+    sizer.addWaitTime(std::chrono::milliseconds(10));
+    sizer.addWaitTime(std::chrono::milliseconds(11));
+    sizer.addWaitTime(std::chrono::seconds(20));
+    LOK_ASSERT_EQUAL(static_cast<uint64_t>(4), sizer.getWaitCount());
+    LOK_ASSERT_EQUAL(static_cast<uint64_t>(2), sizer.getWaitBucket(0));
+    LOK_ASSERT_EQUAL(static_cast<uint64_t>(1), sizer.getWaitBucket(1));
+    LOK_ASSERT_EQUAL(static_cast<uint64_t>(1), sizer.getWaitBucket(KitPoolSizer::BucketCount - 1));
+
+    std::ostringstream oss;
+    sizer.getMetrics(oss);
+    LOK_ASSERT(oss.str().find("kit_wait_duration_milliseconds_bucket{le=\"+Inf\"} 4\n")
+               != std::string::npos);
+}
+
+void WhiteBoxTests::testDirtyByMapping()
+{
+    std::string smaps =
+        "55d4c8a00000-55d4c8c00000 rw-p 00000000 00:00 0                          [heap]\n"
+        "Size:               2048 kB\n"
+        "Pss:                 300 kB\n"
+        "Private_Dirty:       200 kB\n"
+        "7f2c1a000000-7f2c1a200000 r-xp 00000000 08:01 1234                       /lo/program/libmergedlo.so\n"
+        "Pss:                1000 kB\n"
+        "Private_Dirty:         0 kB\n"
+        "7f2c1a200000-7f2c1a210000 rw-p 00200000 08:01 1234                       /lo/program/libmergedlo.so\n"
+        "Pss:                  64 kB\n"
+        "Private_Dirty:        40 kB\n"
+        "7f2c1b000000-7f2c1b100000 r--p 00000000 08:01 99                         /usr/share/fonts/truetype/dejavu/DejaVuSans.ttf\n"
+        "Private_Dirty:         0 kB\n"
+        "7f2c1c000000-7f2c1c100000 rw-p 00000000 00:00 0 \n"
+        "AnonHugePages:         0 kB\n"
+        "Private_Dirty:        16 kB\n"
+        "7f2c1d000000-7f2c1d010000 rw-p 00010000 08:01 77                         /lib/x86_64-linux-gnu/libc-2.31.so\n"
+        "Private_Dirty:         8 kB\n"
+        "7ffd2a000000-7ffd2a021000 rw-p 00000000 00:00 0                          [stack]\n"
+        "Private_Dirty:        12 kB\n"
+        "VmFlags: rd wr mr mw me gd ac\n";
+
+    FILE* file = fmemopen(&smaps[0], smaps.size(), "r");
+    LOK_ASSERT(file != nullptr);
+
+    const std::map<std::string, size_t> dirty = Util::getDirtyByMappingFromSMaps(file);
+    LOK_ASSERT_EQUAL(static_cast<size_t>(200), dirty.at("heap"));
+    LOK_ASSERT_EQUAL(static_cast<size_t>(40), dirty.at("libreoffice"));
+    LOK_ASSERT_EQUAL(static_cast<size_t>(0), dirty.at("fonts"));
+    LOK_ASSERT_EQUAL(static_cast<size_t>(16), dirty.at("anonymous"));
+    LOK_ASSERT_EQUAL(static_cast<size_t>(8), dirty.at("libraries"));
+    LOK_ASSERT_EQUAL(static_cast<size_t>(12), dirty.at("stack"));
+    LOK_ASSERT_EQUAL(static_cast<size_t>(6), dirty.size());
+
+    // It adds up to the total we track the kits by.
+    LOK_ASSERT_EQUAL(static_cast<size_t>(276), Util::getPssAndDirtyFromSMaps(file).second);
+
+    fclose(file);
+}
+
+void WhiteBoxTests::testInvalidationFrame()
+{
+    InvalidationFrame frame;
+    LOK_ASSERT(!frame.isEnabled());
+
+    frame.configure(30, 60);
+    LOK_ASSERT(frame.isEnabled());
+    LOK_ASSERT_EQUAL(static_cast<int64_t>(16), static_cast<int64_t>(frame.getInterval(std::chrono::microseconds(0)).count()));
+    LOK_ASSERT_EQUAL(static_cast<int64_t>(25), static_cast<int64_t>(frame.getInterval(std::chrono::milliseconds(50)).count()));
+    LOK_ASSERT_EQUAL(static_cast<int64_t>(33), static_cast<int64_t>(frame.getInterval(std::chrono::seconds(1)).count()));
+
+    // The first invalidation is due right away.
+    auto now = InvalidationFrame::TimePoint() + std::chrono::hours(1);
+    const std::chrono::milliseconds interval(25);
+    frame.add(0, Util::Rectangle(0, 0, 100, 100), now, interval);
+    LOK_ASSERT(frame.isDue(now));
+    std::vector<std::string> messages = frame.take(now);
+    LOK_ASSERT_EQUAL(static_cast<size_t>(1), messages.size());
+    LOK_ASSERT_EQUAL(std::string("invalidatetiles: part=0 x=0 y=0 width=100 height=100"), messages[0]);
+
+    // The next ones wait for the frame, merging those that touch, even through a third.
+    now += std::chrono::milliseconds(5);
+    frame.add(0, Util::Rectangle(0, 0, 100, 100), now, interval);
+    frame.add(0, Util::Rectangle(200, 0, 100, 100), now, interval);
+    frame.add(0, Util::Rectangle(100, 50, 100, 10), now, interval);
+    frame.add(0, Util::Rectangle(1000, 1000, 10, 10), now, interval);
+    frame.add(1, Util::Rectangle(0, 0, 100, 100), now, interval);
+    LOK_ASSERT(frame.isPending());
+    LOK_ASSERT(!frame.isDue(now));
+    LOK_ASSERT(frame.isDue(now + std::chrono::milliseconds(20)));
+
+    messages = frame.take(now + std::chrono::milliseconds(20));
+    LOK_ASSERT_EQUAL(static_cast<size_t>(3), messages.size());
+    LOK_ASSERT_EQUAL(std::string("invalidatetiles: part=0 x=0 y=0 width=300 height=100"), messages[0]);
+    LOK_ASSERT_EQUAL(std::string("invalidatetiles: part=0 x=1000 y=1000 width=10 height=10"), messages[1]);
+    LOK_ASSERT_EQUAL(std::string("invalidatetiles: part=1 x=0 y=0 width=100 height=100"), messages[2]);
+    LOK_ASSERT(!frame.isPending());
+
+    // EMPTY covers the part, and without one, all the parts.
+    now += std::chrono::seconds(1);
+    frame.add(0, Util::Rectangle(0, 0, 100, 100), now, interval);
+    frame.add(0, Util::Rectangle(0, 0, INT_MAX, INT_MAX), now, interval);
+    frame.add(0, Util::Rectangle(200, 200, 100, 100), now, interval);
+    frame.add(1, Util::Rectangle(0, 0, 100, 100), now, interval);
+    messages = frame.take(now);
+    LOK_ASSERT_EQUAL(static_cast<size_t>(2), messages.size());
+    LOK_ASSERT_EQUAL(std::string("invalidatetiles: EMPTY, 0"), messages[0]);
+
+    frame.add(1, Util::Rectangle(0, 0, 100, 100), now, interval);
+    frame.add(-1, Util::Rectangle(0, 0, INT_MAX, INT_MAX), now, interval);
+    frame.add(2, Util::Rectangle(0, 0, 100, 100), now, interval);
+    messages = frame.take(now);
+    LOK_ASSERT_EQUAL(static_cast<size_t>(1), messages.size());
+    LOK_ASSERT_EQUAL(std::string("invalidatetiles: EMPTY"), messages[0]);
+
+    LOK_ASSERT_EQUAL(static_cast<uint64_t>(13), frame.getMessagesIn());
+    LOK_ASSERT_EQUAL(static_cast<uint64_t>(7), frame.getMessagesOut());
+}
+
+void WhiteBoxTests::testClipboardCache()
+{
+    const std::string spillDir = Poco::Path::temp() + "clipboards-" + Util::rng::getHexString(8) + '/';
+    Poco::File(spillDir).createDirectories();
+
+    ClipboardCache cache;
+    cache.configure(10, 1000, 100, spillDir);
+
+    const std::string a[2] = { "a0", "a1" };
+    const std::string b[2] = { "b0", "b1" };
+    const std::string c[2] = { "c0", "c1" };
+    cache.insertClipboard(a, "aaaa", 4);
+    cache.insertClipboard(b, "bbbb", 4);
+    LOK_ASSERT_EQUAL(static_cast<size_t>(8), cache.getMemorySize());
+    LOK_ASSERT_EQUAL(std::string("aaaa"), *cache.getClipboard("a1"));
+
+    // Past the budget: b is the least recently used.
+    cache.insertClipboard(c, "cccc", 4);
+    LOK_ASSERT(!cache.getClipboard("b0"));
+    LOK_ASSERT(!cache.getClipboard("b1"));
+    LOK_ASSERT(cache.getClipboard("a0"));
+    LOK_ASSERT(cache.getClipboard("c0"));
+    LOK_ASSERT_EQUAL(static_cast<size_t>(8), cache.getMemorySize());
+    LOK_ASSERT_EQUAL(static_cast<size_t>(2), cache.getCount());
+    LOK_ASSERT_EQUAL(static_cast<uint64_t>(1), cache.getEvictions());
+
+    // Replacing doesn't count twice.
+    cache.insertClipboard(a, "AA", 2);
+    LOK_ASSERT_EQUAL(static_cast<size_t>(6), cache.getMemorySize());
+    LOK_ASSERT_EQUAL(std::string("AA"), *cache.getClipboard("a0"));
+
+    // Large ones go deflated to disk, and come back whole, leaving the memory alone.
+    const std::string large(10000, 'x');
+    cache.insertClipboard(b, large.data(), large.size());
+    LOK_ASSERT_EQUAL(static_cast<size_t>(6), cache.getMemorySize());
+    LOK_ASSERT(cache.getSpillSize() > 0 && cache.getSpillSize() < 1000);
+    LOK_ASSERT(FileUtil::Stat(spillDir + "b0.1").exists());
+    LOK_ASSERT_EQUAL(large, *cache.getClipboard("b1"));
+
+    // Filling the disk past its budget drops the least recently used spilled ones.
+    std::string random;
+    for (int i = 0; i < 200; ++i)
+        random += Util::rng::getHexString(8);
+    const std::string d[2] = { "d0", "d1" };
+    const std::string e[2] = { "e0", "e1" };
+    cache.insertClipboard(d, random.data(), random.size());
+    cache.insertClipboard(e, random.data(), random.size());
+    LOK_ASSERT(cache.getSpillSize() <= 1000);
+    LOK_ASSERT(!cache.getClipboard("b0"));
+    LOK_ASSERT(!cache.getClipboard("d0"));
+    LOK_ASSERT(!FileUtil::Stat(spillDir + "b0.1").exists());
+    LOK_ASSERT_EQUAL(random, *cache.getClipboard("e0"));
+    LOK_ASSERT_EQUAL(std::string("AA"), *cache.getClipboard("a0"));
+    LOK_ASSERT_EQUAL(static_cast<size_t>(6), cache.getMemorySize());
+
+    // Too large for either isn't cached.
+    std::string larger;
+    for (int i = 0; i < 1000; ++i)
+        larger += Util::rng::getHexString(8);
+    const std::string f[2] = { "f0", "f1" };
+    cache.insertClipboard(f, larger.data(), larger.size());
+    LOK_ASSERT(!cache.getClipboard("f0"));
+
+    cache.configure(0, 0, 0, std::string());
+    LOK_ASSERT_EQUAL(static_cast<size_t>(0), cache.getCount());
+    LOK_ASSERT_EQUAL(static_cast<size_t>(0), cache.getSpillSize());
+    LOK_ASSERT(FileUtil::isEmptyDirectory(spillDir.c_str()));
+
+    FileUtil::removeFile(spillDir, true);
+}
+
+namespace
+{
+void appendZip16(std::string& zip, const unsigned value)
+{
+    zip += static_cast<char>(value & 0xff);
+    zip += static_cast<char>((value >> 8) & 0xff);
+}
+
+void appendZip32(std::string& zip, const uint32_t value)
+{
+    appendZip16(zip, value & 0xffff);
+    appendZip16(zip, value >> 16);
+}
+
+/// A ZIP package of the @members, by name and content, stored uncompressed.
+std::string makeZip(const std::vector<std::pair<std::string, std::string>>& members)
+{
+    std::string zip;
+    std::string directory;
+    for (const auto& member : members)
+    {
+        const std::string& name = member.first;
+        const std::string& data = member.second;
+        const uint32_t crc = crc32(0, reinterpret_cast<const Bytef*>(data.data()), data.size());
+        const uint32_t offset = zip.size();
+
+        // Signature, version, flags, method, time and date.
+        appendZip32(zip, 0x04034b50);
+        appendZip16(zip, 20);
+        zip.append(8, '\0');
+        appendZip32(zip, crc);
+        appendZip32(zip, data.size());
+        appendZip32(zip, data.size());
+        appendZip16(zip, name.size());
+        appendZip16(zip, 0);
+        zip += name + data;
+
+        // Signature, versions, flags, method, time and date.
+        appendZip32(directory, 0x02014b50);
+        appendZip16(directory, 20);
+        appendZip16(directory, 20);
+        directory.append(8, '\0');
+        appendZip32(directory, crc);
+        appendZip32(directory, data.size());
+        appendZip32(directory, data.size());
+        appendZip16(directory, name.size());
+        // Extra field and comment lengths, disk and attributes.
+        directory.append(12, '\0');
+        appendZip32(directory, offset);
+        directory += name;
+    }
+
+    const uint32_t directoryOffset = zip.size();
+    zip += directory;
+    appendZip32(zip, 0x06054b50);
+    zip.append(4, '\0');
+    appendZip16(zip, members.size());
+    appendZip16(zip, members.size());
+    appendZip32(zip, directory.size());
+    appendZip32(zip, directoryOffset);
+    appendZip16(zip, 0);
+    return zip;
+}
+}
+
+void WhiteBoxTests::testZipPackage()
+{
+    const std::string mimetype = "application/vnd.oasis.opendocument.text";
+    const std::string content(1000, 'c');
+    const std::string v1 = makeZip({ { "mimetype", mimetype },
+                                     { "content.xml", content },
+                                     { "meta.xml", "<meta>1</meta>" },
+                                     { "Thumbnails/thumbnail.png", "png" } });
+    const std::string v2 = makeZip({ { "mimetype", mimetype },
+                                     { "content.xml", content },
+                                     { "meta.xml", "<meta>2</meta>" },
+                                     { "styles.xml", "<styles/>" } });
+
+    std::istringstream stream1(v1);
+    std::istringstream stream2(v2);
+    ZipPackage package1;
+    ZipPackage package2;
+    LOK_ASSERT(package1.read(stream1));
+    LOK_ASSERT(package2.read(stream2));
+    LOK_ASSERT_EQUAL(static_cast<size_t>(4), package1.getMembers().size());
+    LOK_ASSERT_EQUAL(std::string("content.xml"), package1.getMembers()[1]._name);
+
+    // meta.xml changed, styles.xml is new, and the thumbnail is gone.
+    const std::vector<const ZipPackage::Member*> changed = package2.getChanged(package1);
+    LOK_ASSERT_EQUAL(static_cast<size_t>(2), changed.size());
+    LOK_ASSERT_EQUAL(std::string("meta.xml"), changed[0]->_name);
+    LOK_ASSERT_EQUAL(std::string("styles.xml"), changed[1]->_name);
+    const std::vector<std::string> removed = package2.getRemoved(package1);
+    LOK_ASSERT_EQUAL(static_cast<size_t>(1), removed.size());
+    LOK_ASSERT_EQUAL(std::string("Thumbnails/thumbnail.png"), removed[0]);
+
+    // The delta has only those, and applied to the first version gives the second.
+    std::ostringstream delta;
+    LOK_ASSERT(package2.writeDelta(stream2, package1, delta) > 0);
+    LOK_ASSERT(delta.str().size() < v2.size() / 2);
+    std::istringstream deltaStream(delta.str());
+    ZipPackage deltaPackage;
+    LOK_ASSERT(deltaPackage.read(deltaStream));
+    LOK_ASSERT_EQUAL(static_cast<size_t>(2), deltaPackage.getMembers().size());
+
+    std::ostringstream result;
+    LOK_ASSERT(ZipPackage::applyDelta(stream1, deltaStream, removed, result));
+    LOK_ASSERT_EQUAL(v2, result.str());
+
+    // Not a package.
+    std::istringstream text("Hello, world");
+    ZipPackage none;
+    LOK_ASSERT(!none.read(text));
+    LOK_ASSERT(none.isEmpty());
+}
+
+void WhiteBoxTests::testBinaryTraceFormat()
+{
+    std::vector<char> out;
+    BinaryTraceFormat::appendHeader(out, 1600000000123456);
+    BinaryTraceFormat::appendRecord(out, '>', 0, "doc1", "0001", "load url=file:///tmp/a.odt");
+    // Long enough that the timestamp and the payload size take more than a byte.
+    BinaryTraceFormat::appendRecord(out, '<', 300000, "doc1", "0001", std::string(200, 'x'));
+    const std::string data(out.begin(), out.end());
+
+    uint64_t epochStart = 0;
+    std::vector<BinaryTraceFormat::Record> records;
+    LOK_ASSERT(BinaryTraceFormat::read(data, epochStart, records));
+    LOK_ASSERT_EQUAL(static_cast<uint64_t>(1600000000123456), epochStart);
+    LOK_ASSERT_EQUAL(static_cast<size_t>(2), records.size());
+    LOK_ASSERT_EQUAL('>', records[0]._dir);
+    LOK_ASSERT_EQUAL(static_cast<uint64_t>(0), records[0]._usec);
+    LOK_ASSERT_EQUAL(std::string("doc1"), records[0]._id);
+    LOK_ASSERT_EQUAL(std::string("0001"), records[0]._sessionId);
+    LOK_ASSERT_EQUAL(std::string("load url=file:///tmp/a.odt"), records[0]._payload);
+    LOK_ASSERT_EQUAL('<', records[1]._dir);
+    LOK_ASSERT_EQUAL(static_cast<uint64_t>(300000), records[1]._usec);
+    LOK_ASSERT_EQUAL(std::string(200, 'x'), records[1]._payload);
+
+    // A truncated last record, as when the process died, is left out.
+    records.clear();
+    LOK_ASSERT(BinaryTraceFormat::read(data.substr(0, data.size() - 10), epochStart, records));
+    LOK_ASSERT_EQUAL(static_cast<size_t>(1), records.size());
+    LOK_ASSERT_EQUAL(std::string("load url=file:///tmp/a.odt"), records[0]._payload);
+
+    // Not a binary trace.
+    records.clear();
+    LOK_ASSERT(!BinaryTraceFormat::read("Hello, world", epochStart, records));
+    LOK_ASSERT(records.empty());
+
+    // The mapped file is written a window at a time, and truncated on close to what was used.
+    const std::string path
+        = Poco::Path::temp() + "tracefile-" + Util::rng::getHexString(8) + ".bin";
+    {
+        MappedTraceFile file(path, 1600000000123456);
+        file.write('>', 0, "doc1", "0001", "load url=file:///tmp/a.odt");
+        file.write('<', 300000, "doc1", "0001", std::string(200, 'x'));
+    }
+
+    std::ifstream file(path, std::ios::binary);
+    const std::string written((std::istreambuf_iterator<char>(file)),
+                              std::istreambuf_iterator<char>());
+    file.close();
+    FileUtil::removeFile(path);
+    LOK_ASSERT_EQUAL(data.size(), written.size());
+    LOK_ASSERT(data == written);
+}
+
 CPPUNIT_TEST_SUITE_REGISTRATION(WhiteBoxTests);
 
 /* vim:set shiftwidth=4 softtabstop=4 expandtab: */
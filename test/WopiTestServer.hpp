@@ -12,6 +12,7 @@
 #include "Log.hpp"
 #include "Unit.hpp"
 #include "UnitHTTP.hpp"
+#include "ZipPackage.hpp"
 
 #include <Poco/DateTimeFormat.h>
 #include <Poco/DateTimeFormatter.h>
@@ -42,6 +43,9 @@ private:
     /// Last modified time of the file
     std::chrono::system_clock::time_point _fileLastModifiedTime;
 
+    /// Whether we take the changed members of the package in PutFile.
+    bool _supportsPackageDelta;
+
 protected:
     const std::string& getWopiSrc() const { return _wopiSrc; }
 
@@ -58,9 +62,12 @@ protected:
 
     const std::chrono::system_clock::time_point& getFileLastModifiedTime() const { return _fileLastModifiedTime; }
 
+    void setSupportsPackageDelta(bool supportsPackageDelta) { _supportsPackageDelta = supportsPackageDelta; }
+
 public:
     WopiTestServer(std::string fileContent = "Hello, world")
         : _fileContent(std::move(fileContent))
+        , _supportsPackageDelta(false)
     {
     }
 
@@ -145,6 +152,8 @@ protected:
             fileInfo->set("PostMessageOrigin", "localhost");
             fileInfo->set("LastModifiedTime", Util::getIso8601FracformatTime(_fileLastModifiedTime));
             fileInfo->set("EnableOwnerTermination", "true");
+            if (_supportsPackageDelta)
+                fileInfo->set("SupportsPackageDelta", "true");
 
             std::ostringstream jsonStream;
             fileInfo->stringify(jsonStream);
@@ -249,7 +258,37 @@ protected:
             std::streamsize size = request.getContentLength();
             char buffer[size];
             message.read(buffer, size);
-            setFileContent(std::string(buffer, size));
+            std::string content(buffer, size);
+
+            if (request.get("X-LOOL-WOPI-PackageDelta", "") == "true")
+            {
+                // Apply the changed members to the package we have.
+                std::vector<std::string> removed;
+                StringVector tokens(Util::tokenize(request.get("X-LOOL-WOPI-PackageRemoved", ""), ','));
+                for (const auto& token : tokens)
+                {
+                    std::string name;
+                    Poco::URI::decode(tokens.getParam(token), name);
+                    removed.push_back(name);
+                }
+
+                std::istringstream base(_fileContent);
+                std::istringstream delta(content);
+                std::ostringstream result;
+                if (!ZipPackage::applyDelta(base, delta, removed, result))
+                {
+                    LOG_ERR("Fake wopi host failed to apply the package delta in PutFile.");
+                    socket->send("HTTP/1.1 500 Internal Server Error\r\n"
+                                 "User-Agent: " WOPI_AGENT_STRING "\r\n"
+                                 "\r\n");
+                    socket->shutdown();
+                    return true;
+                }
+
+                content = result.str();
+            }
+
+            setFileContent(content);
 
             assertPutFileRequest(request);
 
@@ -0,0 +1,174 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 100 -*- */
+/*
+ * This file is part of the LibreOffice project.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Replays a trace of LOK callbacks through the TileQueue the way
+ * Document::ViewCallback and Document::drainQueue do, and reports the CPU
+ * time spent per callback, and how many of them were coalesced away.
+ *
+ * Usage: loolcallbackbench [trace-file [iterations [batch]]]
+ *
+ * The trace file, if given, has one callback per line, as
+ * "<view> <type> <payload>", the view being -1 for all views. The batch is
+ * the number of callbacks queued between two drains of the queue.
+ */
+
+#include <config.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#define LOK_USE_UNSTABLE_API
+#include <LibreOfficeKit/LibreOfficeKitEnums.h>
+
+#include <MessageQueue.hpp>
+
+namespace
+{
+struct TraceEntry
+{
+    int _view;
+    int _type;
+    std::string _payload;
+};
+
+/// Two users in a spreadsheet, one typing into cells down a column, the
+/// other watching; roughly what Calc sends for each keystroke.
+std::vector<TraceEntry> makeCalcTrace()
+{
+    std::vector<TraceEntry> trace;
+    for (int row = 0; row < 20; ++row)
+    {
+        const int y = 1418 + row * 256;
+        const std::string cell = "2318, " + std::to_string(y) + ", 1135, 256";
+        for (const char ch : std::string("1234"))
+        {
+            trace.push_back({ -1, LOK_CALLBACK_INVALIDATE_TILES, cell + ", 0" });
+            trace.push_back({ 0, LOK_CALLBACK_CELL_FORMULA, std::string(1, ch) });
+            trace.push_back({ 0, LOK_CALLBACK_INVALIDATE_VISIBLE_CURSOR,
+                              "{ \"viewId\": \"0\", \"rectangle\": \"" + cell
+                                  + "\", \"mispelledWord\": \"\" }" });
+            trace.push_back({ 1, LOK_CALLBACK_INVALIDATE_VIEW_CURSOR,
+                              "{ \"viewId\": \"0\", \"rectangle\": \"" + cell
+                                  + "\", \"part\": \"0\" }" });
+            trace.push_back({ 0, LOK_CALLBACK_STATE_CHANGED, ".uno:Undo=enabled" });
+            trace.push_back({ 0, LOK_CALLBACK_STATE_CHANGED, ".uno:ModifiedStatus=true" });
+            trace.push_back({ 0, LOK_CALLBACK_STATE_CHANGED, ".uno:StateSum=Sum: 1234" });
+        }
+
+        // Enter moves to the next row.
+        const std::string next = "2318, " + std::to_string(y + 256) + ", 1135, 256";
+        trace.push_back({ -1, LOK_CALLBACK_INVALIDATE_TILES, "0, " + std::to_string(y) + ", 24000, 512, 0" });
+        trace.push_back({ 0, LOK_CALLBACK_CELL_CURSOR, next });
+        trace.push_back({ 1, LOK_CALLBACK_CELL_VIEW_CURSOR,
+                          "{ \"viewId\": \"0\", \"rectangle\": \"" + next + "\", \"part\": \"0\" }" });
+        trace.push_back({ 0, LOK_CALLBACK_CELL_ADDRESS, "1, " + std::to_string(row + 1) });
+        trace.push_back({ 0, LOK_CALLBACK_INVALIDATE_HEADER, "row" });
+        trace.push_back({ 0, LOK_CALLBACK_STATE_CHANGED, ".uno:StatusDocPos=Sheet 1 of 1" });
+        trace.push_back({ -1, LOK_CALLBACK_DOCUMENT_SIZE_CHANGED, "24000, " + std::to_string(y + 512) });
+    }
+
+    return trace;
+}
+
+bool readTrace(const char* path, std::vector<TraceEntry>& trace)
+{
+    std::ifstream file(path);
+    std::string line;
+    while (std::getline(file, line))
+    {
+        const size_t viewEnd = line.find(' ');
+        const size_t typeEnd = (viewEnd != std::string::npos ? line.find(' ', viewEnd + 1)
+                                                             : std::string::npos);
+        if (typeEnd == std::string::npos)
+            continue;
+
+        trace.push_back({ std::atoi(line.c_str()), std::atoi(line.c_str() + viewEnd + 1),
+                          line.substr(typeEnd + 1) });
+    }
+
+    return !trace.empty();
+}
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<TraceEntry> trace;
+    if (argc > 1)
+    {
+        if (!readTrace(argv[1], trace))
+        {
+            std::cerr << "No callbacks to replay.\n";
+            return EXIT_FAILURE;
+        }
+    }
+    else
+        trace = makeCalcTrace();
+
+    const int iterations = (argc > 2 ? std::atoi(argv[2]) : 2000);
+    const size_t batch = (argc > 3 ? std::max(std::atoi(argv[3]), 1) : 8);
+    std::cout << "Replaying " << trace.size() << " callbacks " << iterations << " times, draining every "
+              << batch << ".\n";
+
+    TileQueue queue;
+    TileQueue::Callback callback;
+    size_t forwarded = 0;
+    long checksum = 0;
+
+    const std::clock_t cpuStart = std::clock();
+    const auto start = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < iterations; ++i)
+    {
+        size_t queued = 0;
+        for (const TraceEntry& entry : trace)
+        {
+            // What Document::ViewCallback does.
+            const TileQueue::Callback parsed(entry._view, entry._type, entry._payload);
+            if (parsed._hasRect && !parsed._isEmpty
+                && (entry._type == LOK_CALLBACK_INVALIDATE_VIEW_CURSOR
+                    || entry._type == LOK_CALLBACK_CELL_VIEW_CURSOR))
+                queue.updateCursorPosition(parsed._viewId, parsed._part, parsed._x, parsed._y,
+                                           parsed._width, parsed._height);
+            queue.putCallback(parsed);
+
+            // What Document::drainQueue does, once the core yields.
+            if (++queued % batch == 0 || queued == trace.size())
+            {
+                while (queue.popCallback(callback))
+                {
+                    ++forwarded;
+                    checksum += callback._payload.size() + callback._viewId;
+                }
+            }
+        }
+    }
+
+    const auto end = std::chrono::steady_clock::now();
+    const double cpuNs = (std::clock() - cpuStart) * 1e9 / CLOCKS_PER_SEC;
+    const double wallNs = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    const double callbacks = static_cast<double>(trace.size()) * iterations;
+
+    std::cout << "cpu: " << cpuNs / callbacks << " ns/callback, wall: " << wallNs / callbacks
+              << " ns/callback\n";
+    std::cout << "forwarded " << forwarded << " of " << static_cast<size_t>(callbacks) << " ("
+              << 100.0 * forwarded / callbacks << "%, checksum " << checksum << ")\n";
+    std::cout << "invalidations: " << queue.getInvalidationsIn() << " in, "
+              << queue.getInvalidationsOut() << " out\n";
+
+    return EXIT_SUCCESS;
+}
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
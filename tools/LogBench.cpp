@@ -0,0 +1,110 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 100 -*- */
+/*
+ * This file is part of the LibreOffice project.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Measures what logging costs the tile render path: the lines RenderTiles
+ * logs for each tile, from as many threads as render tiles, with tracing
+ * disabled, written synchronously as before, or written by the asynchronous
+ * writer (logging.async). Reports the time per tile in the rendering
+ * threads, which is what the user waits for, and the messages dropped.
+ *
+ * Usage: loollogbench [disabled|sync|async [tiles [threads [log-file]]]]
+ *
+ * The log is written to /dev/null by default, flushing every line, as the
+ * console does; give a file to measure the writes to disk instead.
+ */
+
+#include <config.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <Log.hpp>
+
+namespace
+{
+/// What RenderTiles logs while rendering and encoding tile @index of a combined tile.
+void logTile(const int index, const char* pixmap)
+{
+    const int x = (index % 8) * 3840;
+    const int y = (index / 8) * 3840;
+    LOG_TRC("Calling paintPartTile(" << static_cast<const void*>(pixmap) << ')');
+    LOG_DBG("paintPartTile at (" << x << ", " << y << "), (" << 256 << ", " << 256
+                                 << ") rendered in 1234 ms (1.3 MP/s).");
+    LOG_TRC("Match for tile #" << index << " at (" << x << ',' << y << ") to "
+                               << index - 1 << " at (" << x - 3840 << ',' << y << ")");
+    LOG_DBG("Encode a new png for tile #" << index);
+    LOG_TRC("Sending back painted tiles for tile: part=0 width=256 height=256 tileposx=" << x
+            << " tileposy=" << y << " tilewidth=3840 tileheight=3840 ver=" << index);
+}
+}
+
+int main(int argc, char** argv)
+{
+    const std::string mode = (argc > 1 ? argv[1] : "async");
+    const int tiles = (argc > 2 ? std::atoi(argv[2]) : 200000);
+    const int threads = (argc > 3 ? std::max(std::atoi(argv[3]), 1) : 4);
+    const std::string path = (argc > 4 ? argv[4] : "/dev/null");
+    if (mode != "disabled" && mode != "sync" && mode != "async")
+    {
+        std::cerr << "Usage: loollogbench [disabled|sync|async [tiles [threads [log-file]]]]\n";
+        return EXIT_FAILURE;
+    }
+
+    std::map<std::string, std::string> logProperties;
+    logProperties["path"] = path;
+    logProperties["flush"] = (argc > 4 ? "false" : "true");
+    Log::initialize("logbench", "trace", false, true, logProperties);
+    if (mode == "async")
+        Log::startAsync();
+    if (mode == "disabled")
+        Log::setLevel("warning");
+
+    std::cout << "Logging " << tiles << " tiles from " << threads << " threads, " << mode
+              << ", to " << path << ".\n";
+
+    const std::clock_t cpuStart = std::clock();
+    const auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> renderers;
+    for (int i = 0; i < threads; ++i)
+    {
+        renderers.emplace_back([i, tiles, threads]() {
+            char pixmap[1];
+            for (int tile = i; tile < tiles; tile += threads)
+                logTile(tile, pixmap);
+        });
+    }
+
+    for (std::thread& renderer : renderers)
+        renderer.join();
+
+    const auto end = std::chrono::steady_clock::now();
+    const double cpuNs = (std::clock() - cpuStart) * 1e9 / CLOCKS_PER_SEC;
+    const double wallNs = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+
+    // The time the writer takes after the renderers are done is not theirs.
+    const uint64_t dropped = Log::getDroppedCount();
+    Log::shutdown();
+
+    std::cout << "process cpu: " << cpuNs / tiles << " ns/tile, wall: " << wallNs / tiles
+              << " ns/tile (" << wallNs * threads / tiles << " ns/tile per thread)\n";
+    std::cout << "dropped " << dropped << " of " << tiles * 5 << " messages\n";
+
+    return EXIT_SUCCESS;
+}
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -0,0 +1,217 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 100 -*- */
+/*
+ * This file is part of the LibreOffice project.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Measures what idle documents cost the WSD process: once with a poll
+ * thread per document, as DocumentBroker does by default, and once with
+ * the documents multiplexed onto a few MultiplexedPoll threads, as with
+ * per_document.poll_threads. Reports the threads, memory, CPU time, context
+ * switches and housekeeping runs while idle, and how long it takes an idle
+ * document to run a callback.
+ *
+ * Usage: loolpollbench [documents [poll-threads [seconds]]]
+ *
+ * Each document has a poll and its wakeup pipe, so keep an eye on ulimit -n.
+ */
+
+#include <config.h>
+
+#include <sys/resource.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <Log.hpp>
+#include <MultiplexedPoll.hpp>
+#include <Socket.hpp>
+
+namespace
+{
+std::atomic<uint64_t> HousekeepingCount(0);
+
+/// The dedicated loop: housekeeping after every poll, as DocumentBroker::pollThread.
+class DedicatedPoll final : public SocketPoll
+{
+public:
+    DedicatedPoll(const std::string& threadName)
+        : SocketPoll(threadName)
+    {
+    }
+
+    void pollingThread() override
+    {
+        while (continuePolling())
+        {
+            poll(DefaultPollTimeoutMicroS);
+            ++HousekeepingCount;
+        }
+    }
+};
+
+/// An idle document in a MultiplexedPoll, as DocumentBroker::runSharedPoll.
+class IdleTask final : public MultiplexedPoll::Task
+{
+public:
+    bool run(std::chrono::steady_clock::time_point now) override
+    {
+        ++HousekeepingCount;
+        setDeadline(now + std::chrono::microseconds(SocketPoll::DefaultPollTimeoutMicroS));
+        return true;
+    }
+};
+
+struct Usage
+{
+    std::chrono::steady_clock::time_point _time;
+    double _cpuMs;
+    long _contextSwitches;
+    uint64_t _housekeeping;
+};
+
+Usage getUsage()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    const double cpuMs = (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000.
+                         + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000.;
+    return Usage{ std::chrono::steady_clock::now(), cpuMs, usage.ru_nvcsw + usage.ru_nivcsw,
+                  HousekeepingCount };
+}
+
+/// Reads a field, eg. Threads or VmRSS, from /proc/self/status.
+long getStatus(const std::string& field)
+{
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line))
+    {
+        if (line.compare(0, field.size() + 1, field + ':') == 0)
+            return std::atol(line.c_str() + field.size() + 1);
+    }
+
+    return -1;
+}
+
+/// Average time from adding a callback to an idle document's poll to it running.
+double measureCallbackLatencyUs(const std::vector<SocketPoll*>& polls)
+{
+    constexpr int Samples = 200;
+    std::atomic<int64_t> totalUs(0);
+    std::atomic<int> done(0);
+    for (int i = 0; i < Samples; ++i)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        polls[(i * 7919) % polls.size()]->addCallback(
+            [start, &totalUs, &done]()
+            {
+                totalUs += std::chrono::duration_cast<std::chrono::microseconds>(
+                               std::chrono::steady_clock::now() - start).count();
+                ++done;
+            });
+
+        // One at a time, so we measure an idle poll rather than a queue.
+        while (done <= i)
+            std::this_thread::yield();
+    }
+
+    return static_cast<double>(totalUs) / Samples;
+}
+
+void report(const char* name, const std::vector<SocketPoll*>& polls, int seconds)
+{
+    // Let the threads settle before measuring them idle.
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+    const Usage before = getUsage();
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    const Usage after = getUsage();
+
+    const double elapsedSecs
+        = std::chrono::duration_cast<std::chrono::milliseconds>(after._time - before._time).count()
+          / 1000.;
+    std::cout << name << ": " << getStatus("Threads") << " threads, " << getStatus("VmRSS")
+              << " KB RSS, " << (after._cpuMs - before._cpuMs) / elapsedSecs << " ms CPU/s, "
+              << (after._contextSwitches - before._contextSwitches) / elapsedSecs
+              << " context switches/s, "
+              << (after._housekeeping - before._housekeeping) / elapsedSecs
+              << " housekeeping runs/s, callback latency " << measureCallbackLatencyUs(polls)
+              << " us\n";
+}
+
+void runDedicated(int documents, int seconds)
+{
+    std::vector<std::unique_ptr<DedicatedPoll>> polls;
+    std::vector<SocketPoll*> pollPtrs;
+    for (int i = 0; i < documents; ++i)
+    {
+        polls.emplace_back(new DedicatedPoll("docbroker_" + std::to_string(i)));
+        polls.back()->startThread();
+        pollPtrs.push_back(polls.back().get());
+    }
+
+    report("dedicated  ", pollPtrs, seconds);
+
+    for (const auto& poll : polls)
+        poll->joinThread();
+}
+
+void runMultiplexed(int documents, int threads, int seconds)
+{
+    std::vector<std::unique_ptr<MultiplexedPoll>> polls;
+    std::vector<SocketPoll*> pollPtrs;
+    for (int i = 0; i < threads; ++i)
+    {
+        polls.emplace_back(new MultiplexedPoll("docbroker_poll" + std::to_string(i)));
+        polls.back()->startThread();
+        pollPtrs.push_back(polls.back().get());
+    }
+
+    for (int i = 0; i < documents; ++i)
+        polls[i % threads]->addTask(std::make_shared<IdleTask>());
+
+    report("multiplexed", pollPtrs, seconds);
+
+    for (const auto& poll : polls)
+        poll->joinThread();
+}
+}
+
+int main(int argc, char** argv)
+{
+    const int documents = (argc > 1 ? std::atoi(argv[1]) : 200);
+    const int threads = (argc > 2 ? std::atoi(argv[2]) : std::thread::hardware_concurrency());
+    const int seconds = (argc > 3 ? std::atoi(argv[3]) : 10);
+    if (documents <= 0 || threads <= 0 || seconds <= 0)
+    {
+        std::cerr << "Usage: loolpollbench [documents [poll-threads [seconds]]]\n";
+        return EXIT_FAILURE;
+    }
+
+    Log::initialize("pollbench", "warning", false, false, std::map<std::string, std::string>());
+
+    std::cout << documents << " idle documents, " << threads << " poll threads, " << seconds
+              << "s each, housekeeping every " << SocketPoll::DefaultPollTimeoutMicroS / 1000
+              << "ms.\n";
+
+    runDedicated(documents, seconds);
+    runMultiplexed(documents, threads, seconds);
+
+    return EXIT_SUCCESS;
+}
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
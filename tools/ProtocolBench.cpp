@@ -0,0 +1,251 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 100 -*- */
+/*
+ * This file is part of the LibreOffice project.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Replays a typing trace through the protocol parsers used by
+ * ClientSession::_handleInput and ChildSession::_handleInput and reports
+ * the heap allocations and time spent per message, once with the
+ * substring-based token accessors and once with the in-place ones.
+ *
+ * Usage: loolprotocolbench [trace-file [iterations]]
+ *
+ * The trace file, if given, has one client message per line.
+ */
+
+#include <config.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <new>
+#include <string>
+#include <vector>
+
+#define LOK_USE_UNSTABLE_API
+#include <LibreOfficeKit/LibreOfficeKitEnums.h>
+
+#include <Protocol.hpp>
+#include <Util.hpp>
+
+static std::atomic<std::size_t> AllocationCount(0);
+
+void* operator new(std::size_t size)
+{
+    ++AllocationCount;
+    void* ptr = std::malloc(size ? size : 1);
+    if (ptr == nullptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+
+namespace
+{
+/// A user typing a word, with the odd click and command, the way loleaflet sends it.
+std::vector<std::string> makeTypingTrace()
+{
+    std::vector<std::string> trace;
+    const std::string word = "Hello, world ";
+    for (const char ch : word)
+    {
+        const std::string code = std::to_string(static_cast<int>(ch));
+        trace.emplace_back("key type=input char=" + code + " key=0");
+        trace.emplace_back("key type=up char=" + code + " key=0");
+        trace.emplace_back("textinput id=0 text=" + std::string(1, ch));
+    }
+
+    trace.emplace_back("mouse type=buttondown x=2318 y=1567 count=1 buttons=1 modifier=0");
+    trace.emplace_back("mouse type=buttonup x=2318 y=1567 count=1 buttons=1 modifier=0");
+    trace.emplace_back("windowkey id=3 type=input char=0 key=1280");
+    trace.emplace_back("windowmouse id=3 type=move x=120 y=40 count=1 buttons=0 modifier=0");
+    trace.emplace_back("uno .uno:Bold");
+    trace.emplace_back("useractive");
+    trace.emplace_back("clientvisiblearea x=0 y=0 width=24000 height=13000");
+    trace.emplace_back("tileprocessed tile=0:0:0:3840:3840:0");
+    return trace;
+}
+
+const std::map<std::string, int> KeyTypes
+    = { { "input", LOK_KEYEVENT_KEYINPUT }, { "up", LOK_KEYEVENT_KEYUP } };
+
+const std::map<std::string, int> MouseTypes
+    = { { "buttondown", LOK_MOUSEEVENT_MOUSEBUTTONDOWN },
+        { "buttonup", LOK_MOUSEEVENT_MOUSEBUTTONUP },
+        { "move", LOK_MOUSEEVENT_MOUSEMOVE } };
+
+/// Parses a message the way the handlers used to: one substring per token access.
+int parseWithSubstrings(const std::string& message)
+{
+    const std::string firstLine = LOOLProtocol::getFirstLine(message);
+    const StringVector tokens = Util::tokenize(firstLine.data(), firstLine.size());
+
+    int sum = LOOLProtocol::tokenIndicatesUserInteraction(tokens[0]) ? 1 : 0;
+    int type = 0, a = 0, b = 0, c = 0;
+    std::string text;
+    if (tokens[0] == "key" || tokens[0] == "windowkey")
+    {
+        const std::size_t offset = (tokens[0] == "windowkey" ? 2 : 1);
+        if (LOOLProtocol::getTokenKeyword(tokens[offset], "type",
+                                          { { "input", LOK_KEYEVENT_KEYINPUT },
+                                            { "up", LOK_KEYEVENT_KEYUP } },
+                                          type) &&
+            LOOLProtocol::getTokenInteger(tokens[offset + 1], "char", a) &&
+            LOOLProtocol::getTokenInteger(tokens[offset + 2], "key", b))
+            sum += type + a + b;
+    }
+    else if (tokens[0] == "mouse" || tokens[0] == "windowmouse")
+    {
+        const std::size_t offset = (tokens[0] == "windowmouse" ? 2 : 1);
+        if (LOOLProtocol::getTokenKeyword(tokens[offset], "type",
+                                          { { "buttondown", LOK_MOUSEEVENT_MOUSEBUTTONDOWN },
+                                            { "buttonup", LOK_MOUSEEVENT_MOUSEBUTTONUP },
+                                            { "move", LOK_MOUSEEVENT_MOUSEMOVE } },
+                                          type) &&
+            LOOLProtocol::getTokenInteger(tokens[offset + 1], "x", a) &&
+            LOOLProtocol::getTokenInteger(tokens[offset + 2], "y", b) &&
+            LOOLProtocol::getTokenInteger(tokens[offset + 3], "count", c))
+            sum += type + a + b + c;
+    }
+    else if (tokens[0] == "textinput")
+    {
+        if (LOOLProtocol::getTokenInteger(tokens[1], "id", a) &&
+            LOOLProtocol::getTokenString(tokens[2], "text", text))
+            sum += a + text.size();
+    }
+    else if (tokens[0] == "uno")
+    {
+        sum += (tokens[1] == ".uno:Save" || Util::startsWith(tokens[1], "vnd.sun.star.script:"));
+    }
+    else if (tokens[0] == "clientvisiblearea")
+    {
+        if (LOOLProtocol::getTokenInteger(tokens[1], "x", a) &&
+            LOOLProtocol::getTokenInteger(tokens[3], "width", b))
+            sum += a + b;
+    }
+    else if (tokens[0] == "tileprocessed")
+    {
+        if (LOOLProtocol::getTokenString(tokens[1], "tile", text))
+            sum += text.size();
+    }
+
+    return sum;
+}
+
+/// Parses a message with the in-place, index-based accessors.
+int parseInPlace(const std::string& message)
+{
+    const std::string firstLine = LOOLProtocol::getFirstLine(message);
+    const StringVector tokens = Util::tokenize(firstLine.data(), firstLine.size());
+
+    int sum = LOOLProtocol::tokenIndicatesUserInteraction(tokens, 0) ? 1 : 0;
+    int type = 0, a = 0, b = 0, c = 0;
+    std::string text;
+    if (tokens.equals(0, "key") || tokens.equals(0, "windowkey"))
+    {
+        const std::size_t offset = (tokens.equals(0, "windowkey") ? 2 : 1);
+        if (LOOLProtocol::getTokenKeyword(tokens, offset, "type", KeyTypes, type) &&
+            LOOLProtocol::getTokenInteger(tokens, offset + 1, "char", a) &&
+            LOOLProtocol::getTokenInteger(tokens, offset + 2, "key", b))
+            sum += type + a + b;
+    }
+    else if (tokens.equals(0, "mouse") || tokens.equals(0, "windowmouse"))
+    {
+        const std::size_t offset = (tokens.equals(0, "windowmouse") ? 2 : 1);
+        if (LOOLProtocol::getTokenKeyword(tokens, offset, "type", MouseTypes, type) &&
+            LOOLProtocol::getTokenInteger(tokens, offset + 1, "x", a) &&
+            LOOLProtocol::getTokenInteger(tokens, offset + 2, "y", b) &&
+            LOOLProtocol::getTokenInteger(tokens, offset + 3, "count", c))
+            sum += type + a + b + c;
+    }
+    else if (tokens.equals(0, "textinput"))
+    {
+        if (LOOLProtocol::getTokenInteger(tokens, 1, "id", a) &&
+            LOOLProtocol::getTokenString(tokens, 2, "text", text))
+            sum += a + text.size();
+    }
+    else if (tokens.equals(0, "uno"))
+    {
+        sum += (tokens.equals(1, ".uno:Save") || tokens.startsWith(1, "vnd.sun.star.script:"));
+    }
+    else if (tokens.equals(0, "clientvisiblearea"))
+    {
+        if (LOOLProtocol::getTokenInteger(tokens, 1, "x", a) &&
+            LOOLProtocol::getTokenInteger(tokens, 3, "width", b))
+            sum += a + b;
+    }
+    else if (tokens.equals(0, "tileprocessed"))
+    {
+        if (LOOLProtocol::getTokenString(tokens, 1, "tile", text))
+            sum += text.size();
+    }
+
+    return sum;
+}
+
+template <typename F>
+void run(const char* name, const std::vector<std::string>& trace, int iterations, F parse)
+{
+    long checksum = 0;
+    const std::size_t allocationsBefore = AllocationCount;
+    const auto start = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < iterations; ++i)
+    {
+        for (const std::string& message : trace)
+            checksum += parse(message);
+    }
+
+    const auto end = std::chrono::steady_clock::now();
+    const std::size_t allocations = AllocationCount - allocationsBefore;
+    const double messages = static_cast<double>(trace.size()) * iterations;
+    const double ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+
+    std::cout << name << ": " << ns / messages << " ns/msg, "
+              << allocations / messages << " allocations/msg (checksum " << checksum << ")\n";
+}
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<std::string> trace;
+    if (argc > 1)
+    {
+        std::ifstream file(argv[1]);
+        std::string line;
+        while (std::getline(file, line))
+        {
+            if (!line.empty())
+                trace.push_back(line);
+        }
+    }
+    else
+        trace = makeTypingTrace();
+
+    if (trace.empty())
+    {
+        std::cerr << "No messages to replay.\n";
+        return EXIT_FAILURE;
+    }
+
+    const int iterations = (argc > 2 ? std::atoi(argv[2]) : 20000);
+    std::cout << "Replaying " << trace.size() << " messages " << iterations << " times.\n";
+
+    run("substrings", trace, iterations, parseWithSubstrings);
+    run("in-place  ", trace, iterations, parseInPlace);
+
+    return EXIT_SUCCESS;
+}
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -12,10 +12,13 @@
 #include <unistd.h>
 
 #include <algorithm>
+#include <chrono>
 #include <cstdlib>
 #include <cstring>
 #include <fstream>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <thread>
 #include <sysexits.h>
 
@@ -28,6 +31,8 @@
 #include <Poco/Net/SSLManager.h>
 #include <Poco/Net/KeyConsoleHandler.h>
 #include <Poco/Net/AcceptCertificateHandler.h>
+#include <Poco/File.h>
+#include <Poco/NullStream.h>
 #include <Poco/StreamCopier.h>
 #include <Poco/URI.h>
 #include <Poco/Util/Application.h>
@@ -49,12 +54,25 @@ public:
     const std::string& getServerURI() const { return _serverURI; }
     const std::string& getDestinationFormat() const { return _destinationFormat; }
     const std::string& getDestinationDir() const { return _destinationDir; }
+    bool isBenchmark() const { return _benchmark; }
+
+    /// Record the outcome of a conversion, for the benchmark.
+    void addResult(bool success, std::chrono::microseconds latency);
 
 private:
+    /// Report throughput and latency of the conversions in @elapsed.
+    void reportBenchmark(std::chrono::microseconds elapsed);
+
     unsigned    _numWorkers;
     std::string _serverURI;
     std::string _destinationFormat;
     std::string _destinationDir;
+    bool        _benchmark;
+    unsigned    _repeat;
+
+    std::mutex _resultsMutex;
+    std::vector<std::chrono::microseconds> _latencies;
+    size_t _failures;
 
 protected:
     void defineOptions(Poco::Util::OptionSet& options) override;
@@ -91,14 +109,22 @@ public:
     }
 
     void convertFile(const std::string& document)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        const bool success = doConvertFile(document);
+        _app.addResult(success, std::chrono::duration_cast<std::chrono::microseconds>(
+                                    std::chrono::steady_clock::now() - start));
+    }
+
+    bool doConvertFile(const std::string& document)
     {
         Poco::URI uri(_app.getServerURI());
 
-        Poco::Net::HTTPClientSession *session;
+        std::unique_ptr<Poco::Net::HTTPClientSession> session;
         if (_app.getServerURI().compare(0, 5, "https") == 0)
-            session = new Poco::Net::HTTPSClientSession(uri.getHost(), uri.getPort());
+            session.reset(new Poco::Net::HTTPSClientSession(uri.getHost(), uri.getPort()));
         else
-            session = new Poco::Net::HTTPClientSession(uri.getHost(), uri.getPort());
+            session.reset(new Poco::Net::HTTPClientSession(uri.getHost(), uri.getPort()));
 
         Poco::Net::HTTPRequest request(Poco::Net::HTTPRequest::HTTP_POST, "/lool/convert-to");
 
@@ -116,7 +142,7 @@ public:
         {
             std::cerr << "Failed to write data: " << e.name() <<
                   ' ' << e.message() << '\n';
-            return;
+            return false;
         }
 
         Poco::Net::HTTPResponse response;
@@ -125,20 +151,36 @@ public:
             // receiveResponse() resulted in a Poco::Net::NoMessageException.
             std::istream& responseStream = session->receiveResponse(response);
 
-            Poco::Path path(document);
-            std::string outPath = _app.getDestinationDir() + '/' + path.getBaseName() + '.' + _app.getDestinationFormat();
-            std::ofstream fileStream(outPath);
-
-            Poco::StreamCopier::copyStream(responseStream, fileStream);
+            if (_app.isBenchmark())
+            {
+                // Only the timing matters.
+                Poco::NullOutputStream nullStream;
+                Poco::StreamCopier::copyStream(responseStream, nullStream);
+            }
+            else
+            {
+                Poco::Path path(document);
+                std::string outPath = _app.getDestinationDir() + '/' + path.getBaseName() + '.' + _app.getDestinationFormat();
+                std::ofstream fileStream(outPath);
+
+                Poco::StreamCopier::copyStream(responseStream, fileStream);
+            }
         }
         catch (const Poco::Exception &e)
         {
             std::cerr << "Exception converting: " << e.name() <<
                   ' ' << e.message() << '\n';
-            return;
+            return false;
         }
 
-        delete session;
+        if (response.getStatus() != HTTPResponse::HTTP_OK)
+        {
+            std::cerr << "Failed to convert " << document << ": " << response.getStatus() <<
+                  ' ' << response.getReason() << '\n';
+            return false;
+        }
+
+        return true;
     }
 };
 
@@ -149,10 +191,44 @@ Tool::Tool() :
 #else
     _serverURI("http://127.0.0.1:" + std::to_string(DEFAULT_CLIENT_PORT_NUMBER)),
 #endif
-    _destinationFormat("txt")
+    _destinationFormat("txt"),
+    _benchmark(false),
+    _repeat(1),
+    _failures(0)
 {
 }
 
+void Tool::addResult(const bool success, const std::chrono::microseconds latency)
+{
+    std::lock_guard<std::mutex> lock(_resultsMutex);
+    if (success)
+        _latencies.push_back(latency);
+    else
+        ++_failures;
+}
+
+void Tool::reportBenchmark(const std::chrono::microseconds elapsed)
+{
+    std::sort(_latencies.begin(), _latencies.end());
+
+    const auto percentileMs = [this](const double percentile)
+    {
+        if (_latencies.empty())
+            return 0.;
+
+        const size_t index = std::min(_latencies.size() - 1,
+                                      static_cast<size_t>(percentile * _latencies.size() / 100));
+        return _latencies[index].count() / 1000.;
+    };
+
+    const double seconds = elapsed.count() / 1000000.;
+    std::cout << _latencies.size() << " documents converted, " << _failures << " failed, in "
+              << seconds << "s with " << _numWorkers << " threads: "
+              << (seconds > 0 ? _latencies.size() / seconds : 0) << " docs/sec, latency p50 "
+              << percentileMs(50) << "ms, p99 " << percentileMs(99) << "ms, max "
+              << percentileMs(100) << "ms." << std::endl;
+}
+
 void Tool::displayHelp()
 {
     std::cout << "LibreOffice Online document converter tool.\n"
@@ -162,6 +238,8 @@ void Tool::displayHelp()
               << "  --extension=format          File format to convert to\n"
               << "  --outdir=directory          Output directory for converted files\n"
               << "  --parallelism=threads       Number of simultaneous threads to use\n"
+              << "  --benchmark                 Discard the output and report docs/sec and latency\n"
+              << "  --repeat=count              Convert the files this many times\n"
               << "  --server=uri                URI of LOOL server\n"
               << "  --no-check-certificate      Disable checking of SSL certificate\n"
               << "In addition, the options taken by the libreoffice command for its --convert-to\n"
@@ -190,6 +268,10 @@ void Tool::handleOption(const std::string& optionName,
         _numWorkers = std::max(std::stoi(value), 1);
     else if (optionName == "server")
         _serverURI = value;
+    else if (optionName == "benchmark")
+        _benchmark = true;
+    else if (optionName == "repeat")
+        _repeat = std::max(std::stoi(value), 1);
     else if (optionName == "no-check-certificate")
     {
         Poco::SharedPtr<Poco::Net::PrivateKeyPassphraseHandler> consoleClientHandler = new Poco::Net::KeyConsoleHandler(false);
@@ -242,6 +324,32 @@ int Tool::main(const std::vector<std::string>& origArgs)
         handleOption(optionName, value);
     }
 
+    // Take the files of a directory, eg. of sample documents.
+    std::vector<std::string> files;
+    for (const std::string& arg : args)
+    {
+        Poco::File file(arg);
+        if (!file.exists() || !file.isDirectory())
+        {
+            files.push_back(arg);
+            continue;
+        }
+
+        std::vector<std::string> entries;
+        file.list(entries);
+        std::sort(entries.begin(), entries.end());
+        for (const std::string& entry : entries)
+        {
+            const std::string path = Poco::Path(Poco::Path::forDirectory(arg), entry).toString();
+            if (Poco::File(path).isFile())
+                files.push_back(path);
+        }
+    }
+
+    args.clear();
+    for (unsigned i = 0; i < _repeat; ++i)
+        args.insert(args.end(), files.begin(), files.end());
+
     if (args.empty())
     {
         std::cerr << "Nothing to do." << std::endl;
@@ -249,6 +357,8 @@ int Tool::main(const std::vector<std::string>& origArgs)
         return EX_NOINPUT;
     }
 
+    const auto start = std::chrono::steady_clock::now();
+
     std::vector<std::thread> clients;
     clients.reserve(_numWorkers);
 
@@ -259,10 +369,10 @@ int Tool::main(const std::vector<std::string>& origArgs)
         size_t toCopy = std::min(args.size() - offset, chunk);
         if (toCopy > 0)
         {
-            std::vector< std::string > files( toCopy );
-            std::copy( args.begin() + offset, args.begin() + offset + toCopy, files.begin() );
+            std::vector< std::string > chunkFiles( toCopy );
+            std::copy( args.begin() + offset, args.begin() + offset + toCopy, chunkFiles.begin() );
             offset += toCopy;
-            clients.emplace_back([this, &files]{Worker(*this, files).run();});
+            clients.emplace_back([this, chunkFiles]{Worker(*this, chunkFiles).run();});
         }
     }
 
@@ -271,6 +381,10 @@ int Tool::main(const std::vector<std::string>& origArgs)
         client.join();
     }
 
+    if (_benchmark)
+        reportBenchmark(std::chrono::duration_cast<std::chrono::microseconds>(
+                            std::chrono::steady_clock::now() - start));
+
     return EX_OK;
 }
 
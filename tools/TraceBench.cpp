@@ -0,0 +1,118 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 100 -*- */
+/*
+ * This file is part of the LibreOffice project.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Measures what tracing costs the threads of a busy server: the messages a
+ * typing session sends and gets back, recorded from as many threads as
+ * documents are served, to a text trace (trace.path), a compressed one
+ * (trace.path[@compress]) or a binary one (trace.path[@binary]). Reports the
+ * time per message in the recording threads and the size of the trace.
+ *
+ * Usage: looltracebench [text|gz|binary [messages [threads [trace-file]]]]
+ */
+
+#include <config.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <Log.hpp>
+#include <TraceFile.hpp>
+
+namespace
+{
+/// What a session typing into document @doc has traced for its message @index.
+void traceMessage(TraceFileWriter& writer, const std::string& doc, const int index)
+{
+    const std::string sessionId = "0001";
+    if (index % 2 == 0)
+    {
+        writer.writeIncoming(doc, sessionId,
+                             "key type=input char=" + std::to_string(97 + index % 26) + " key=0");
+        return;
+    }
+
+    writer.writeOutgoing(doc, sessionId,
+                         "invalidatetiles: part=0 x=" + std::to_string(index % 1000 * 15)
+                             + " y=2880 width=15 height=255");
+}
+}
+
+int main(int argc, char** argv)
+{
+    const std::string mode = (argc > 1 ? argv[1] : "binary");
+    const int messages = (argc > 2 ? std::atoi(argv[2]) : 1000000);
+    const int threads = (argc > 3 ? std::max(std::atoi(argv[3]), 1) : 4);
+    std::string path = (argc > 4 ? argv[4] : "/tmp/looltracebench.txt");
+    if (mode != "text" && mode != "gz" && mode != "binary")
+    {
+        std::cerr << "Usage: looltracebench [text|gz|binary [messages [threads [trace-file]]]]\n";
+        return EXIT_FAILURE;
+    }
+
+    // The reader, and looltraceconvert, tell compressed traces by their name.
+    if (mode == "gz" && (path.size() < 2 || path.substr(path.size() - 2) != "gz"))
+        path += ".gz";
+
+    Log::initialize("tracebench", "warning", false, false, std::map<std::string, std::string>());
+
+    std::cout << "Tracing " << messages << " messages from " << threads << " threads, " << mode
+              << ", to " << path << ".\n";
+
+    const std::clock_t cpuStart = std::clock();
+    const auto start = std::chrono::steady_clock::now();
+    {
+        TraceFileWriter writer(path, true, mode == "gz", mode == "binary", false,
+                               std::vector<std::string>());
+
+        std::vector<std::thread> sessions;
+        for (int i = 0; i < threads; ++i)
+        {
+            sessions.emplace_back([&writer, i, messages, threads]() {
+                const std::string doc = "doc" + std::to_string(i);
+                for (int message = i; message < messages; message += threads)
+                    traceMessage(writer, doc, message);
+            });
+        }
+
+        for (std::thread& session : sessions)
+            session.join();
+    }
+
+    // Closing the writer is in the time: it is when the last records are written.
+    const auto end = std::chrono::steady_clock::now();
+    const double cpuNs = (std::clock() - cpuStart) * 1e9 / CLOCKS_PER_SEC;
+    const double wallNs = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+
+    struct stat st;
+    const long size = (stat(path.c_str(), &st) == 0 ? st.st_size : -1);
+    Log::shutdown();
+
+    std::cout << "process cpu: " << cpuNs / messages << " ns/message, wall: " << wallNs / messages
+              << " ns/message (" << wallNs * threads / messages << " ns/message per thread)\n";
+    std::cout << "trace size: " << size << " bytes (" << static_cast<double>(size) / messages
+              << " bytes/message)\n";
+
+    if (argc <= 4)
+        unlink(path.c_str());
+
+    return EXIT_SUCCESS;
+}
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -0,0 +1,99 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 100 -*- */
+/*
+ * This file is part of the LibreOffice project.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Converts a binary trace file, as written with trace.path[@binary], to the
+ * text format, with the records in time order. The output is compressed if
+ * its name ends in .gz, as with trace.path[@compress].
+ *
+ * Usage: looltraceconvert binary-trace-file text-trace-file
+ */
+
+#include <config.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <TraceFile.hpp>
+
+namespace
+{
+void writeRecord(std::ostream& out, const BinaryTraceFormat::Record& record)
+{
+    // As TraceFileWriter writes it.
+    out.write(&record._dir, 1);
+    out << record._usec;
+    out.write(&record._dir, 1);
+    out << record._id;
+    out.write(&record._dir, 1);
+    out << record._sessionId;
+    out.write(&record._dir, 1);
+    out.write(record._payload.data(), record._payload.size());
+    out.write("\n", 1);
+}
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 3)
+    {
+        std::cerr << "Usage: looltraceconvert binary-trace-file text-trace-file\n";
+        return EXIT_FAILURE;
+    }
+
+    std::ifstream in(argv[1], std::ios::binary);
+    const std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    uint64_t epochStart = 0;
+    std::vector<BinaryTraceFormat::Record> records;
+    if (!BinaryTraceFormat::read(data, epochStart, records))
+    {
+        std::cerr << argv[1] << " is not a binary trace file.\n";
+        return EXIT_FAILURE;
+    }
+
+    std::stable_sort(records.begin(), records.end(),
+                     [](const BinaryTraceFormat::Record& lhs, const BinaryTraceFormat::Record& rhs)
+                     { return lhs._usec < rhs._usec; });
+
+    const std::string path = argv[2];
+    const bool compress = (path.size() > 2 && path.substr(path.size() - 2) == "gz");
+    std::ofstream out(path, compress ? std::ios::binary : std::ios::out);
+    if (compress)
+    {
+        Poco::DeflatingOutputStream deflater(out, Poco::DeflatingStreamBuf::STREAM_GZIP);
+        for (const BinaryTraceFormat::Record& record : records)
+            writeRecord(deflater, record);
+
+        deflater.close();
+    }
+    else
+    {
+        for (const BinaryTraceFormat::Record& record : records)
+            writeRecord(out, record);
+    }
+
+    out.close();
+
+    if (!out)
+    {
+        std::cerr << "Failed to write " << path << ".\n";
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "Converted " << records.size() << " records.\n";
+    return EXIT_SUCCESS;
+}
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
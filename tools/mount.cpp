@@ -14,6 +14,8 @@
 
 #include <stdio.h>
 #include <errno.h>
+#include <limits.h>
+#include <string.h>
 #include <sys/mount.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -23,9 +25,12 @@
 void usage(const char* program)
 {
     fprintf(stderr, "Usage: %s <-s|-r> <source path> <target path>\n", program);
+    fprintf(stderr, "       %s -o <source path> <overlay path> <target path>\n", program);
     fprintf(stderr, "       %s -u <target>.\n", program);
     fprintf(stderr, "       -b bind and mount the source to target.\n");
     fprintf(stderr, "       -r bind and mount the source to target as readonly.\n");
+    fprintf(stderr, "       -o mount an overlay of the source on target, writing to the\n");
+    fprintf(stderr, "          upper and work directories in the overlay path.\n");
     fprintf(stderr, "       -u to unmount the target.\n");
 }
 
@@ -132,6 +137,42 @@ int main(int argc, char** argv)
             }
         }
     }
+    else if (argc == 5 && strcmp(option, "-o") == 0) // Overlay Mount.
+    {
+        const char* source = argv[2];
+        const char* overlay = argv[3];
+        const char* target = argv[4];
+
+        struct stat sb;
+        if (stat(source, &sb) != 0 || !S_ISDIR(sb.st_mode) || stat(overlay, &sb) != 0
+            || !S_ISDIR(sb.st_mode) || stat(target, &sb) != 0 || !S_ISDIR(sb.st_mode))
+        {
+            fprintf(stderr, "%s: cannot mount overlay with invalid directories [%s], [%s], [%s].\n",
+                    program, source, overlay, target);
+            return 1;
+        }
+
+        // The jail's devices live in its writable layer, so no MS_NODEV.
+        char options[3 * PATH_MAX + 64];
+        const int len = snprintf(options, sizeof(options),
+                                 "lowerdir=%s,upperdir=%s/upper,workdir=%s/work", source, overlay,
+                                 overlay);
+        if (len < 0 || len >= static_cast<int>(sizeof(options))
+            || strpbrk(source, ",:") || strpbrk(overlay, ",:"))
+        {
+            fprintf(stderr, "%s: invalid overlay paths [%s], [%s].\n", program, source, overlay);
+            return 1;
+        }
+
+        const int retval
+            = mount("overlay", target, "overlay", (MS_NOATIME | MS_NOSUID | MS_SILENT), options);
+        if (retval)
+        {
+            fprintf(stderr, "%s: mount failed overlay [%s] on [%s]: %s.\n", program, source,
+                    target, strerror(errno));
+            return 1;
+        }
+    }
     else
     {
         usage(program);
@@ -638,7 +638,11 @@ void Admin::setChannelLogLevel(const std::string& _channelName, std::string _lev
     {
         if (nameList[i] == _channelName)
         {
-            Log::logger().get(nameList[i]).setLevel(_level);
+            // Ours is checked by the log statements without asking the logger.
+            if (_channelName == Log::logger().name())
+                Log::setLevel(_level);
+            else
+                Log::logger().get(nameList[i]).setLevel(_level);
             break;
         }
     }
@@ -708,6 +712,26 @@ void Admin::setViewLoadDuration(const std::string& docKey, const std::string& se
     addCallback([=]{ _model.setViewLoadDuration(docKey, sessionId, viewLoadDuration); });
 }
 
+void Admin::setDocPrefetchStats(const std::string& docKey, uint64_t prefetchedTiles, uint64_t prefetchHits)
+{
+    addCallback([=]{ _model.setDocPrefetchStats(docKey, prefetchedTiles, prefetchHits); });
+}
+
+void Admin::setViewLinkEstimate(const std::string& docKey, const std::string& sessionId, std::chrono::milliseconds rtt, uint64_t bandwidth)
+{
+    addCallback([=]{ _model.setViewLinkEstimate(docKey, sessionId, rtt, bandwidth); });
+}
+
+void Admin::setViewInvalidationStats(const std::string& docKey, const std::string& sessionId, uint64_t invalidationsSaved, uint64_t tileRequestsSaved)
+{
+    addCallback([=]{ _model.setViewInvalidationStats(docKey, sessionId, invalidationsSaved, tileRequestsSaved); });
+}
+
+void Admin::setViewSenderQueueStats(const std::string& docKey, const std::string& sessionId, uint64_t depth, uint64_t maxDepth, uint64_t dedupHits, uint64_t dropped)
+{
+    addCallback([=]{ _model.setViewSenderQueueStats(docKey, sessionId, depth, maxDepth, dedupHits, dropped); });
+}
+
 void Admin::setDocWopiDownloadDuration(const std::string& docKey, std::chrono::milliseconds wopiDownloadDuration)
 {
     addCallback([=]{ _model.setDocWopiDownloadDuration(docKey, wopiDownloadDuration); });
@@ -718,11 +742,51 @@ void Admin::setDocWopiUploadDuration(const std::string& docKey, const std::chron
     addCallback([=]{ _model.setDocWopiUploadDuration(docKey, uploadDuration); });
 }
 
+void Admin::setDocUploadStats(const std::string& docKey, uint64_t uploadedBytes, uint64_t uploadSavedBytes, uint64_t uploadsSkipped)
+{
+    addCallback([=]{ _model.setDocUploadStats(docKey, uploadedBytes, uploadSavedBytes, uploadsSkipped); });
+}
+
+void Admin::setDocSaveDurations(const std::string& docKey, const std::chrono::milliseconds saveDuration, const std::chrono::milliseconds stallDuration)
+{
+    addCallback([=]{ _model.setDocSaveDurations(docKey, saveDuration, stallDuration); });
+}
+
 void Admin::addSegFaultCount(unsigned segFaultCount)
 {
     addCallback([=]{ _model.addSegFaultCount(segFaultCount); });
 }
 
+void Admin::addFirstLoadDuration(const std::string& docType, bool warmed, std::chrono::milliseconds duration)
+{
+    addCallback([=]{ _model.addFirstLoadDuration(docType, warmed, duration); });
+}
+
+void Admin::addFirstTileDuration(const std::string& docType, std::chrono::milliseconds duration)
+{
+    addCallback([=]{ _model.addFirstTileDuration(docType, duration); });
+}
+
+void Admin::addSpareKitMemory(size_t pssBeforeTrimKb, size_t dirtyBeforeTrimKb, size_t pssKb, size_t dirtyKb)
+{
+    addCallback([=]{ _model.addSpareKitMemory(pssBeforeTrimKb, dirtyBeforeTrimKb, pssKb, dirtyKb); });
+}
+
+void Admin::addHibernation()
+{
+    addCallback([=]{ _model.addHibernation(); });
+}
+
+void Admin::setClipboardCacheStats(size_t count, size_t memoryBytes, size_t spillBytes, uint64_t evictions)
+{
+    addCallback([=]{ _model.setClipboardCacheStats(count, memoryBytes, spillBytes, evictions); });
+}
+
+void Admin::addRehydrateDuration(std::chrono::milliseconds duration)
+{
+    addCallback([=]{ _model.addRehydrateDuration(duration); });
+}
+
 void Admin::notifyForkit()
 {
     std::ostringstream oss;
@@ -866,6 +930,9 @@ void Admin::getMetrics(std::ostringstream &metrics)
     metrics << std::endl;
 
     _model.getMetrics(metrics);
+    metrics << std::endl;
+
+    LOOLWSD::SpareKits.getMetrics(metrics);
 }
 
 void Admin::sendMetrics(const std::shared_ptr<StreamSocket>& socket, const std::shared_ptr<Poco::Net::HTTPResponse>& response)
@@ -137,9 +137,22 @@ public:
     void sendMetricsAsync(const std::shared_ptr<StreamSocket>& socket, const std::shared_ptr<Poco::Net::HTTPResponse>& response);
 
     void setViewLoadDuration(const std::string& docKey, const std::string& sessionId, std::chrono::milliseconds viewLoadDuration);
+    void setDocPrefetchStats(const std::string& docKey, uint64_t prefetchedTiles, uint64_t prefetchHits);
+    void setViewLinkEstimate(const std::string& docKey, const std::string& sessionId, std::chrono::milliseconds rtt, uint64_t bandwidth);
+    void setViewInvalidationStats(const std::string& docKey, const std::string& sessionId, uint64_t invalidationsSaved, uint64_t tileRequestsSaved);
+    void setViewSenderQueueStats(const std::string& docKey, const std::string& sessionId, uint64_t depth, uint64_t maxDepth, uint64_t dedupHits, uint64_t dropped);
     void setDocWopiDownloadDuration(const std::string& docKey, std::chrono::milliseconds wopiDownloadDuration);
     void setDocWopiUploadDuration(const std::string& docKey, const std::chrono::milliseconds uploadDuration);
+    void setDocUploadStats(const std::string& docKey, uint64_t uploadedBytes, uint64_t uploadSavedBytes, uint64_t uploadsSkipped);
+    void setDocSaveDurations(const std::string& docKey, std::chrono::milliseconds saveDuration, std::chrono::milliseconds stallDuration);
     void addSegFaultCount(unsigned segFaultCount);
+    void addFirstLoadDuration(const std::string& docType, bool warmed, std::chrono::milliseconds duration);
+    void addFirstTileDuration(const std::string& docType, std::chrono::milliseconds duration);
+
+    void addSpareKitMemory(size_t pssBeforeTrimKb, size_t dirtyBeforeTrimKb, size_t pssKb, size_t dirtyKb);
+    void addHibernation();
+    void addRehydrateDuration(std::chrono::milliseconds duration);
+    void setClipboardCacheStats(size_t count, size_t memoryBytes, size_t spillBytes, uint64_t evictions);
 
     void getMetrics(std::ostringstream &metrics);
 
@@ -11,6 +11,7 @@
 
 #include "AdminModel.hpp"
 
+#include <algorithm>
 #include <chrono>
 #include <memory>
 #include <set>
@@ -65,6 +66,27 @@ void Document::setViewLoadDuration(const std::string& sessionId, std::chrono::mi
         it->second.setLoadDuration(viewLoadDuration);
 }
 
+void Document::setViewLinkEstimate(const std::string& sessionId, std::chrono::milliseconds rtt, uint64_t bandwidth)
+{
+    std::map<std::string, View>::iterator it = _views.find(sessionId);
+    if (it != _views.end())
+        it->second.setLinkEstimate(rtt, bandwidth);
+}
+
+void Document::setViewInvalidationStats(const std::string& sessionId, uint64_t invalidationsSaved, uint64_t tileRequestsSaved)
+{
+    std::map<std::string, View>::iterator it = _views.find(sessionId);
+    if (it != _views.end())
+        it->second.setInvalidationStats(invalidationsSaved, tileRequestsSaved);
+}
+
+void Document::setViewSenderQueueStats(const std::string& sessionId, uint64_t depth, uint64_t maxDepth, uint64_t dedupHits, uint64_t dropped)
+{
+    std::map<std::string, View>::iterator it = _views.find(sessionId);
+    if (it != _views.end())
+        it->second.setSenderQueueStats(depth, maxDepth, dedupHits, dropped);
+}
+
 std::pair<std::time_t, std::string> Document::getSnapshot() const
 {
     std::time_t ct = std::time(nullptr);
@@ -141,7 +163,10 @@ void Document::updateMemoryDirty()
     if (now - _lastTimeSMapsRead >= 5)
     {
         size_t lastMemDirty = _memoryDirty;
-        _memoryDirty = _procSMaps  ? Util::getPssAndDirtyFromSMaps(_procSMaps).second : 0;
+        _memoryDirtyByMapping = Util::getDirtyByMappingFromSMaps(_procSMaps);
+        _memoryDirty = 0;
+        for (const auto& it : _memoryDirtyByMapping)
+            _memoryDirty += it.second;
         _lastTimeSMapsRead = now;
         if (lastMemDirty != _memoryDirty)
             _hasMemDirtyChanged = true;
@@ -295,9 +320,11 @@ unsigned AdminModel::getKitsMemoryUsage()
 
     unsigned totalMem = 0;
     unsigned docs = 0;
+    std::set<pid_t> kitPids;
     for (const auto& it : _documents)
     {
-        if (!it.second->isExpired())
+        // The memory of a kit hosting several documents counts once.
+        if (!it.second->isExpired() && kitPids.insert(it.second->getPid()).second)
         {
             const int bytes = it.second->getMemoryDirty();
             if (bytes > 0)
@@ -829,6 +856,34 @@ void AdminModel::setViewLoadDuration(const std::string& docKey, const std::strin
         it->second->setViewLoadDuration(sessionId, viewLoadDuration);
 }
 
+void AdminModel::setDocPrefetchStats(const std::string& docKey, uint64_t prefetchedTiles, uint64_t prefetchHits)
+{
+    auto it = _documents.find(docKey);
+    if (it != _documents.end())
+        it->second->setPrefetchStats(prefetchedTiles, prefetchHits);
+}
+
+void AdminModel::setViewLinkEstimate(const std::string& docKey, const std::string& sessionId, std::chrono::milliseconds rtt, uint64_t bandwidth)
+{
+    auto it = _documents.find(docKey);
+    if (it != _documents.end())
+        it->second->setViewLinkEstimate(sessionId, rtt, bandwidth);
+}
+
+void AdminModel::setViewInvalidationStats(const std::string& docKey, const std::string& sessionId, uint64_t invalidationsSaved, uint64_t tileRequestsSaved)
+{
+    auto it = _documents.find(docKey);
+    if (it != _documents.end())
+        it->second->setViewInvalidationStats(sessionId, invalidationsSaved, tileRequestsSaved);
+}
+
+void AdminModel::setViewSenderQueueStats(const std::string& docKey, const std::string& sessionId, uint64_t depth, uint64_t maxDepth, uint64_t dedupHits, uint64_t dropped)
+{
+    auto it = _documents.find(docKey);
+    if (it != _documents.end())
+        it->second->setViewSenderQueueStats(sessionId, depth, maxDepth, dedupHits, dropped);
+}
+
 void AdminModel::setDocWopiDownloadDuration(const std::string& docKey, std::chrono::milliseconds wopiDownloadDuration)
 {
     auto it = _documents.find(docKey);
@@ -843,11 +898,81 @@ void AdminModel::setDocWopiUploadDuration(const std::string& docKey, const std::
         it->second->setWopiUploadDuration(wopiUploadDuration);
 }
 
+void AdminModel::setDocUploadStats(const std::string& docKey, uint64_t uploadedBytes, uint64_t uploadSavedBytes, uint64_t uploadsSkipped)
+{
+    auto it = _documents.find(docKey);
+    if (it != _documents.end())
+        it->second->setUploadStats(uploadedBytes, uploadSavedBytes, uploadsSkipped);
+}
+
+void AdminModel::setDocSaveDurations(const std::string& docKey, const std::chrono::milliseconds saveDuration, const std::chrono::milliseconds stallDuration)
+{
+    auto it = _documents.find(docKey);
+    if (it != _documents.end())
+        it->second->setSaveDurations(saveDuration, stallDuration);
+}
+
 void AdminModel::addSegFaultCount(unsigned segFaultCount)
 {
     _segFaultCount += segFaultCount;
 }
 
+void AdminModel::addFirstLoadDuration(const std::string& docType, bool warmed, std::chrono::milliseconds duration)
+{
+    assertCorrectThread();
+
+    auto& stats = _firstLoadDurations[std::make_pair(docType, warmed)];
+    ++stats.first;
+    stats.second += duration.count();
+}
+
+void AdminModel::addFirstTileDuration(const std::string& docType, std::chrono::milliseconds duration)
+{
+    assertCorrectThread();
+
+    auto& stats = _firstTileDurations[docType];
+    ++stats.first;
+    stats.second += duration.count();
+}
+
+void AdminModel::addSpareKitMemory(size_t pssBeforeTrimKb, size_t dirtyBeforeTrimKb, size_t pssKb, size_t dirtyKb)
+{
+    assertCorrectThread();
+
+    ++_spareKitCount;
+    _spareKitPssBeforeTrimKb += pssBeforeTrimKb;
+    _spareKitDirtyBeforeTrimKb += dirtyBeforeTrimKb;
+    _spareKitPssKb += pssKb;
+    _spareKitDirtyKb += dirtyKb;
+}
+
+void AdminModel::setClipboardCacheStats(size_t count, size_t memoryBytes, size_t spillBytes, uint64_t evictions)
+{
+    assertCorrectThread();
+
+    _clipboardCount = count;
+    _clipboardMemoryBytes = memoryBytes;
+    _clipboardSpillBytes = spillBytes;
+    _clipboardEvictions = evictions;
+}
+
+void AdminModel::addHibernation()
+{
+    assertCorrectThread();
+
+    ++_hibernationCount;
+}
+
+void AdminModel::addRehydrateDuration(std::chrono::milliseconds duration)
+{
+    assertCorrectThread();
+
+    const uint64_t ms = std::max<int64_t>(duration.count(), 0);
+    ++_rehydrateCount;
+    _rehydrateTotalMs += ms;
+    _rehydrateMaxMs = std::max(_rehydrateMaxMs, ms);
+}
+
 int filterNumberName(const struct dirent *dir)
 {
     return !fnmatch("[0-9]*", dir->d_name, 0);
@@ -973,9 +1098,10 @@ public:
 
 struct DocumentAggregateStats
 {
-    void Update(const Document &d, bool active)
+    void Update(const Document &d, bool active, bool countKitMemory = true)
     {
-        _kitUsedMemory.Update(d.getMemoryDirty() * 1024, active);
+        if (countKitMemory)
+            _kitUsedMemory.Update(d.getMemoryDirty() * 1024, active);
         _viewsCount.Update(d.getViews().size(), active);
         _activeViewsCount.Update(d.getActiveViews(), active);
         _expiredViewsCount.Update(d.getViews().size() - d.getActiveViews(), active);
@@ -984,10 +1110,34 @@ struct DocumentAggregateStats
         _bytesRecvFromClients.Update(d.getRecvBytes(), active);
         _wopiDownloadDuration.Update(d.getWopiDownloadDuration().count(), active);
         _wopiUploadDuration.Update(d.getWopiUploadDuration().count(), active);
+        _uploadedBytes.Update(d.getUploadedBytes(), active);
+        _uploadSavedBytes.Update(d.getUploadSavedBytes(), active);
+        _uploadsSkipped.Update(d.getUploadsSkipped(), active);
+        _saveDuration.Update(d.getSaveDuration().count(), active);
+        _saveStallDuration.Update(d.getSaveStallDuration().count(), active);
+        _prefetchedTiles.Update(d.getPrefetchedTiles(), active);
+        _prefetchHits.Update(d.getPrefetchHits(), active);
+        if (d.getPrefetchedTiles())
+            _prefetchHitRate.Update(d.getPrefetchHits() * 100 / d.getPrefetchedTiles(), active);
 
         //View load duration
         for (const auto& v : d.getViews())
+        {
             _viewLoadDuration.Update(v.second.getLoadDuration().count(), active);
+            _viewInvalidationsSaved.Update(v.second.getInvalidationsSaved(), active);
+            _viewTileRequestsSaved.Update(v.second.getTileRequestsSaved(), active);
+            _viewQueueDepth.Update(v.second.getQueueDepth(), active);
+            _viewQueueMaxDepth.Update(v.second.getQueueMaxDepth(), active);
+            _viewQueueDedupHits.Update(v.second.getQueueDedupHits(), active);
+            _viewQueueDropped.Update(v.second.getQueueDropped(), active);
+
+            // Only views we have estimated the link of.
+            if (v.second.getBandwidth())
+            {
+                _viewRtt.Update(v.second.getRtt().count(), active);
+                _viewBandwidth.Update(v.second.getBandwidth(), active);
+            }
+        }
     }
 
     ActiveExpiredStats _kitUsedMemory;
@@ -999,7 +1149,23 @@ struct DocumentAggregateStats
     ActiveExpiredStats _bytesRecvFromClients;
     ActiveExpiredStats _wopiDownloadDuration;
     ActiveExpiredStats _wopiUploadDuration;
+    ActiveExpiredStats _uploadedBytes;
+    ActiveExpiredStats _uploadSavedBytes;
+    ActiveExpiredStats _uploadsSkipped;
+    ActiveExpiredStats _saveDuration;
+    ActiveExpiredStats _saveStallDuration;
+    ActiveExpiredStats _prefetchedTiles;
+    ActiveExpiredStats _prefetchHits;
+    ActiveExpiredStats _prefetchHitRate;
     ActiveExpiredStats _viewLoadDuration;
+    ActiveExpiredStats _viewRtt;
+    ActiveExpiredStats _viewBandwidth;
+    ActiveExpiredStats _viewInvalidationsSaved;
+    ActiveExpiredStats _viewTileRequestsSaved;
+    ActiveExpiredStats _viewQueueDepth;
+    ActiveExpiredStats _viewQueueMaxDepth;
+    ActiveExpiredStats _viewQueueDedupHits;
+    ActiveExpiredStats _viewQueueDropped;
 };
 
 struct KitProcStats
@@ -1018,8 +1184,10 @@ struct KitProcStats
 
 void AdminModel::CalcDocAggregateStats(DocumentAggregateStats& stats)
 {
+    // The memory of a kit hosting several documents counts once.
+    std::set<pid_t> kitPids;
     for (auto& d : _documents)
-        stats.Update(*d.second, true);
+        stats.Update(*d.second, true, kitPids.insert(d.second->getPid()).second);
 
     for (auto& d : _expiredDocuments)
         stats.Update(*d.second, false);
@@ -1053,6 +1221,10 @@ void AdminModel::getMetrics(std::ostringstream &oss)
     oss << "loolwsd_thread_count " << Util::getStatFromPid(getpid(), 19) << std::endl;
     oss << "loolwsd_cpu_time_seconds " << Util::getCpuUsage(getpid()) / sysconf (_SC_CLK_TCK) << std::endl;
     oss << "loolwsd_memory_used_bytes " << Util::getMemoryUsagePSS(getpid()) * 1024 << std::endl;
+    oss << "loolwsd_clipboard_cache_count " << _clipboardCount << std::endl;
+    oss << "loolwsd_clipboard_cache_memory_used_bytes " << _clipboardMemoryBytes << std::endl;
+    oss << "loolwsd_clipboard_cache_spilled_bytes " << _clipboardSpillBytes << std::endl;
+    oss << "loolwsd_clipboard_cache_evictions " << _clipboardEvictions << std::endl;
     oss << std::endl;
 
     oss << "forkit_count " << getPidsFromProcName(std::regex("forkit"), nullptr) << std::endl;
@@ -1074,6 +1246,76 @@ void AdminModel::getMetrics(std::ostringstream &oss)
     PrintKitAggregateMetrics(oss, "thread_count", "", kitStats._threadCount);
     PrintKitAggregateMetrics(oss, "memory_used", "bytes", docStats._kitUsedMemory._active);
     PrintKitAggregateMetrics(oss, "cpu_time", "seconds", kitStats._cpuTime);
+    for (const auto& it : _firstLoadDurations)
+    {
+        const std::string labels = "{type=\"" + it.first.first + "\",warmed=\"" +
+                                   (it.first.second ? "true" : "false") + "\"}";
+        oss << "kit_first_load_count" << labels << ' ' << it.second.first << std::endl;
+        oss << "kit_first_load_duration_average_milliseconds" << labels << ' ' <<
+            it.second.second / it.second.first << std::endl;
+    }
+
+    std::map<std::string, size_t> dirtyByMapping;
+    std::set<pid_t> kitPids;
+    for (const auto& it : _documents)
+    {
+        if (!kitPids.insert(it.second->getPid()).second)
+            continue;
+
+        for (const auto& mapping : it.second->getMemoryDirtyByMapping())
+            dirtyByMapping[mapping.first] += mapping.second;
+    }
+    for (const auto& it : dirtyByMapping)
+        oss << "kit_memory_used_by_mapping_bytes{mapping=\"" << it.first << "\"} " << it.second * 1024 << std::endl;
+
+    if (_spareKitCount)
+    {
+        oss << "kit_spare_pss_before_trim_average_bytes " << _spareKitPssBeforeTrimKb * 1024 / _spareKitCount << std::endl;
+        oss << "kit_spare_pss_average_bytes " << _spareKitPssKb * 1024 / _spareKitCount << std::endl;
+        oss << "kit_spare_memory_used_before_trim_average_bytes " << _spareKitDirtyBeforeTrimKb * 1024 / _spareKitCount << std::endl;
+        oss << "kit_spare_memory_used_average_bytes " << _spareKitDirtyKb * 1024 / _spareKitCount << std::endl;
+    }
+
+    // Kits hosting several read-only documents, against those hosting one, by document.
+    std::map<pid_t, std::pair<size_t, size_t>> kitDocs; // The documents and memory of each kit.
+    for (const auto& it : _documents)
+    {
+        if (it.second->isExpired())
+            continue;
+
+        std::pair<size_t, size_t>& kit = kitDocs[it.second->getPid()];
+        ++kit.first;
+        kit.second = std::max(kit.second, it.second->getMemoryDirty());
+    }
+
+    size_t sharedKits = 0;
+    size_t sharedDocs = 0;
+    size_t sharedDirtyKb = 0;
+    size_t ownDocs = 0;
+    size_t ownDirtyKb = 0;
+    for (const auto& it : kitDocs)
+    {
+        if (it.second.first > 1)
+        {
+            ++sharedKits;
+            sharedDocs += it.second.first;
+            sharedDirtyKb += it.second.second;
+        }
+        else
+        {
+            ++ownDocs;
+            ownDirtyKb += it.second.second;
+        }
+    }
+
+    oss << "kit_shared_count " << sharedKits << std::endl;
+    oss << "kit_shared_document_count " << sharedDocs << std::endl;
+    oss << "kit_document_average_count " <<
+        (kitDocs.empty() ? 0 : static_cast<double>(sharedDocs + ownDocs) / kitDocs.size()) << std::endl;
+    oss << "document_shared_kit_memory_used_average_bytes " <<
+        (sharedDocs ? sharedDirtyKb * 1024 / sharedDocs : 0) << std::endl;
+    oss << "document_own_kit_memory_used_average_bytes " <<
+        (ownDocs ? ownDirtyKb * 1024 / ownDocs : 0) << std::endl;
     oss << std::endl;
 
     PrintDocActExpMetrics(oss, "views_all_count", "", docStats._viewsCount);
@@ -1089,9 +1331,55 @@ void AdminModel::getMetrics(std::ostringstream &oss)
     oss << std::endl;
     PrintDocActExpMetrics(oss, "wopi_upload_duration", "milliseconds", docStats._wopiUploadDuration);
     oss << std::endl;
+    PrintDocActExpMetrics(oss, "storage_uploaded", "bytes", docStats._uploadedBytes);
+    oss << std::endl;
+    PrintDocActExpMetrics(oss, "storage_upload_saved", "bytes", docStats._uploadSavedBytes);
+    oss << std::endl;
+    PrintDocActExpMetrics(oss, "storage_uploads_skipped", "", docStats._uploadsSkipped);
+    oss << std::endl;
+    PrintDocActExpMetrics(oss, "save_duration", "milliseconds", docStats._saveDuration);
+    oss << std::endl;
+    PrintDocActExpMetrics(oss, "save_stall_duration", "milliseconds", docStats._saveStallDuration);
+    oss << std::endl;
     PrintDocActExpMetrics(oss, "wopi_download_duration", "milliseconds", docStats._wopiDownloadDuration);
     oss << std::endl;
     PrintDocActExpMetrics(oss, "view_load_duration", "milliseconds", docStats._viewLoadDuration);
+    for (const auto& it : _firstTileDurations)
+    {
+        const std::string labels = "{type=\"" + it.first + "\"}";
+        oss << "document_view_first_tile_count" << labels << ' ' << it.second.first << std::endl;
+        oss << "document_view_first_tile_duration_average_milliseconds" << labels << ' ' <<
+            it.second.second / it.second.first << std::endl;
+    }
+    oss << std::endl;
+    PrintDocActExpMetrics(oss, "prefetched_tiles", "", docStats._prefetchedTiles);
+    oss << std::endl;
+    PrintDocActExpMetrics(oss, "prefetch_hits", "", docStats._prefetchHits);
+    oss << std::endl;
+    PrintDocActExpMetrics(oss, "prefetch_hit_rate", "percent", docStats._prefetchHitRate);
+    oss << std::endl;
+    PrintDocActExpMetrics(oss, "view_rtt", "milliseconds", docStats._viewRtt);
+    oss << std::endl;
+    PrintDocActExpMetrics(oss, "view_bandwidth", "bytes_per_second", docStats._viewBandwidth);
+    oss << std::endl;
+    PrintDocActExpMetrics(oss, "view_invalidations_saved", "", docStats._viewInvalidationsSaved);
+    oss << std::endl;
+    PrintDocActExpMetrics(oss, "view_tile_requests_saved", "", docStats._viewTileRequestsSaved);
+    oss << std::endl;
+    PrintDocActExpMetrics(oss, "view_queue_depth", "", docStats._viewQueueDepth);
+    oss << std::endl;
+    PrintDocActExpMetrics(oss, "view_queue_max_depth", "", docStats._viewQueueMaxDepth);
+    oss << std::endl;
+    PrintDocActExpMetrics(oss, "view_queue_dedup_hits", "", docStats._viewQueueDedupHits);
+    oss << std::endl;
+    PrintDocActExpMetrics(oss, "view_queue_dropped", "", docStats._viewQueueDropped);
+    oss << std::endl;
+
+    oss << "document_hibernation_count " << _hibernationCount << std::endl;
+    oss << "document_rehydrate_count " << _rehydrateCount << std::endl;
+    oss << "document_rehydrate_duration_average_milliseconds " <<
+        (_rehydrateCount ? _rehydrateTotalMs / _rehydrateCount : 0) << std::endl;
+    oss << "document_rehydrate_duration_max_milliseconds " << _rehydrateMaxMs << std::endl;
 }
 
 std::set<pid_t> AdminModel::getDocumentPids() const
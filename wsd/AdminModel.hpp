@@ -33,6 +33,14 @@ public:
         , _userId(std::move(userId))
         , _start(std::time(nullptr))
         , _loadDuration(0)
+        , _rtt(0)
+        , _bandwidth(0)
+        , _invalidationsSaved(0)
+        , _tileRequestsSaved(0)
+        , _queueDepth(0)
+        , _queueMaxDepth(0)
+        , _queueDedupHits(0)
+        , _queueDropped(0)
     {
     }
 
@@ -43,6 +51,31 @@ public:
     bool isExpired() const { return _end != 0 && std::time(nullptr) >= _end; }
     std::chrono::milliseconds getLoadDuration() const { return _loadDuration; }
     void setLoadDuration(std::chrono::milliseconds loadDuration) { _loadDuration = loadDuration; }
+    /// The estimated round-trip time and bandwidth (bytes/s) of the link to the client.
+    std::chrono::milliseconds getRtt() const { return _rtt; }
+    uint64_t getBandwidth() const { return _bandwidth; }
+    void setLinkEstimate(std::chrono::milliseconds rtt, uint64_t bandwidth) { _rtt = rtt; _bandwidth = bandwidth; }
+    /// The invalidatetiles: messages and tile requests saved by pacing invalidations into frames.
+    uint64_t getInvalidationsSaved() const { return _invalidationsSaved; }
+    uint64_t getTileRequestsSaved() const { return _tileRequestsSaved; }
+    void setInvalidationStats(uint64_t invalidationsSaved, uint64_t tileRequestsSaved)
+    {
+        _invalidationsSaved = invalidationsSaved;
+        _tileRequestsSaved = tileRequestsSaved;
+    }
+    /// The messages waiting to be sent to the client, the most there were, and
+    /// those superseded by a newer one or dropped as obsolete before being sent.
+    uint64_t getQueueDepth() const { return _queueDepth; }
+    uint64_t getQueueMaxDepth() const { return _queueMaxDepth; }
+    uint64_t getQueueDedupHits() const { return _queueDedupHits; }
+    uint64_t getQueueDropped() const { return _queueDropped; }
+    void setSenderQueueStats(uint64_t depth, uint64_t maxDepth, uint64_t dedupHits, uint64_t dropped)
+    {
+        _queueDepth = depth;
+        _queueMaxDepth = maxDepth;
+        _queueDedupHits = dedupHits;
+        _queueDropped = dropped;
+    }
 
 private:
     const std::string _sessionId;
@@ -51,6 +84,14 @@ private:
     const std::time_t _start;
     std::time_t _end = 0;
     std::chrono::milliseconds _loadDuration;
+    std::chrono::milliseconds _rtt;
+    uint64_t _bandwidth;
+    uint64_t _invalidationsSaved;
+    uint64_t _tileRequestsSaved;
+    uint64_t _queueDepth;
+    uint64_t _queueMaxDepth;
+    uint64_t _queueDedupHits;
+    uint64_t _queueDropped;
 };
 
 struct DocCleanupSettings
@@ -148,6 +189,13 @@ public:
         , _recvBytes(0)
         , _wopiDownloadDuration(0)
         , _wopiUploadDuration(0)
+        , _prefetchedTiles(0)
+        , _prefetchHits(0)
+        , _uploadedBytes(0)
+        , _uploadSavedBytes(0)
+        , _uploadsSkipped(0)
+        , _saveDuration(0)
+        , _saveStallDuration(0)
         , _procSMaps(nullptr)
         , _lastTimeSMapsRead(0)
         , _isModified(false)
@@ -190,6 +238,7 @@ public:
     void updateLastActivityTime() { _lastActivity = std::time(nullptr); }
     void updateMemoryDirty();
     size_t getMemoryDirty() const { return _memoryDirty; }
+    const std::map<std::string, size_t>& getMemoryDirtyByMapping() const { return _memoryDirtyByMapping; }
 
     std::pair<std::time_t, std::string> getSnapshot() const;
     const std::string getHistory() const;
@@ -208,10 +257,32 @@ public:
     uint64_t getSentBytes() const { return _sentBytes; }
     uint64_t getRecvBytes() const { return _recvBytes; }
     void setViewLoadDuration(const std::string& sessionId, std::chrono::milliseconds viewLoadDuration);
+    void setViewLinkEstimate(const std::string& sessionId, std::chrono::milliseconds rtt, uint64_t bandwidth);
+    void setViewInvalidationStats(const std::string& sessionId, uint64_t invalidationsSaved, uint64_t tileRequestsSaved);
+    void setViewSenderQueueStats(const std::string& sessionId, uint64_t depth, uint64_t maxDepth, uint64_t dedupHits, uint64_t dropped);
     void setWopiDownloadDuration(std::chrono::milliseconds wopiDownloadDuration) { _wopiDownloadDuration = wopiDownloadDuration; }
     std::chrono::milliseconds getWopiDownloadDuration() const { return _wopiDownloadDuration; }
     void setWopiUploadDuration(const std::chrono::milliseconds wopiUploadDuration) { _wopiUploadDuration = wopiUploadDuration; }
     std::chrono::milliseconds getWopiUploadDuration() const { return _wopiUploadDuration; }
+    void setPrefetchStats(uint64_t prefetchedTiles, uint64_t prefetchHits) { _prefetchedTiles = prefetchedTiles; _prefetchHits = prefetchHits; }
+    uint64_t getPrefetchedTiles() const { return _prefetchedTiles; }
+    uint64_t getPrefetchHits() const { return _prefetchHits; }
+    void setUploadStats(uint64_t uploadedBytes, uint64_t uploadSavedBytes, uint64_t uploadsSkipped)
+    {
+        _uploadedBytes = uploadedBytes;
+        _uploadSavedBytes = uploadSavedBytes;
+        _uploadsSkipped = uploadsSkipped;
+    }
+    uint64_t getUploadedBytes() const { return _uploadedBytes; }
+    uint64_t getUploadSavedBytes() const { return _uploadSavedBytes; }
+    uint64_t getUploadsSkipped() const { return _uploadsSkipped; }
+    void setSaveDurations(const std::chrono::milliseconds saveDuration, const std::chrono::milliseconds stallDuration)
+    {
+        _saveDuration = saveDuration;
+        _saveStallDuration = stallDuration;
+    }
+    std::chrono::milliseconds getSaveDuration() const { return _saveDuration; }
+    std::chrono::milliseconds getSaveStallDuration() const { return _saveStallDuration; }
     void setProcSMapsFD(const int smapsFD) { _procSMaps = fdopen(smapsFD, "r"); }
     bool hasMemDirtyChanged() const { return _hasMemDirtyChanged; }
     void setMemDirtyChanged(bool changeStatus) { _hasMemDirtyChanged = changeStatus; }
@@ -233,6 +304,8 @@ private:
     std::string _filename;
     /// The dirty (ie. un-shared) memory of the document's Kit process.
     size_t _memoryDirty;
+    /// The same, by the kind of mapping it's in, see Util::getDirtyByMappingFromSMaps().
+    std::map<std::string, size_t> _memoryDirtyByMapping;
     /// Last noted Jiffy count
     unsigned _lastJiffy;
     std::chrono::time_point<std::chrono::system_clock> _lastJiffyTime;
@@ -250,6 +323,21 @@ private:
     std::chrono::milliseconds _wopiDownloadDuration;
     std::chrono::milliseconds _wopiUploadDuration;
 
+    /// Tiles rendered ahead of the user scrolling, and how many of them were then requested.
+    uint64_t _prefetchedTiles;
+    uint64_t _prefetchHits;
+
+    /// Bytes written to storage, those not written by skipping unchanged uploads or
+    /// sending only the changed members of the package to WOPI hosts, and the uploads skipped.
+    uint64_t _uploadedBytes;
+    uint64_t _uploadSavedBytes;
+    uint64_t _uploadsSkipped;
+
+    /// How long the last save took, from the request to the end of the upload,
+    /// and how long of that editing was stalled.
+    std::chrono::milliseconds _saveDuration;
+    std::chrono::milliseconds _saveStallDuration;
+
     FILE* _procSMaps;
     std::time_t _lastTimeSMapsRead;
 
@@ -371,9 +459,26 @@ public:
     void cleanupResourceConsumingDocs();
 
     void setViewLoadDuration(const std::string& docKey, const std::string& sessionId, std::chrono::milliseconds viewLoadDuration);
+    void setViewLinkEstimate(const std::string& docKey, const std::string& sessionId, std::chrono::milliseconds rtt, uint64_t bandwidth);
+    void setViewInvalidationStats(const std::string& docKey, const std::string& sessionId, uint64_t invalidationsSaved, uint64_t tileRequestsSaved);
+    void setViewSenderQueueStats(const std::string& docKey, const std::string& sessionId, uint64_t depth, uint64_t maxDepth, uint64_t dedupHits, uint64_t dropped);
     void setDocWopiDownloadDuration(const std::string& docKey, std::chrono::milliseconds wopiDownloadDuration);
     void setDocWopiUploadDuration(const std::string& docKey, const std::chrono::milliseconds wopiUploadDuration);
+    void setDocUploadStats(const std::string& docKey, uint64_t uploadedBytes, uint64_t uploadSavedBytes, uint64_t uploadsSkipped);
+    void setDocSaveDurations(const std::string& docKey, std::chrono::milliseconds saveDuration, std::chrono::milliseconds stallDuration);
+    void setDocPrefetchStats(const std::string& docKey, uint64_t prefetchedTiles, uint64_t prefetchHits);
     void addSegFaultCount(unsigned segFaultCount);
+    /// The first document a kit loaded, of @docType, took @duration, with its type @warmed or not.
+    void addFirstLoadDuration(const std::string& docType, bool warmed, std::chrono::milliseconds duration);
+    /// A view of a document of @docType got its first tile @duration after its client connected.
+    void addFirstTileDuration(const std::string& docType, std::chrono::milliseconds duration);
+    void addSpareKitMemory(size_t pssBeforeTrimKb, size_t dirtyBeforeTrimKb, size_t pssKb, size_t dirtyKb);
+    /// A document let its kit go while idle.
+    void addHibernation();
+    /// A hibernated document took @duration to load into a kit again.
+    void addRehydrateDuration(std::chrono::milliseconds duration);
+    /// The expired views' clipboards we keep, and the bytes they take in memory and deflated on disk.
+    void setClipboardCacheStats(size_t count, size_t memoryBytes, size_t spillBytes, uint64_t evictions);
     void setForKitPid(pid_t pid) { _forKitPid = pid; }
 
     void getMetrics(std::ostringstream &oss);
@@ -427,6 +532,33 @@ private:
 
     uint64_t _segFaultCount = 0;
 
+    /// The count and total milliseconds of the first loads of kits, by document type and warmed.
+    std::map<std::pair<std::string, bool>, std::pair<uint64_t, uint64_t>> _firstLoadDurations;
+
+    /// The count and total milliseconds from connecting to the first tile of views, by document type.
+    std::map<std::string, std::pair<uint64_t, uint64_t>> _firstTileDurations;
+
+    /// The count of kits that got ready, and the total KB of their PSS and
+    /// Private_Dirty memory then, before and after trimming it.
+    uint64_t _spareKitCount = 0;
+    uint64_t _spareKitPssBeforeTrimKb = 0;
+    uint64_t _spareKitDirtyBeforeTrimKb = 0;
+    uint64_t _spareKitPssKb = 0;
+    uint64_t _spareKitDirtyKb = 0;
+
+    /// The count of documents hibernated, and rehydrated, with the total and
+    /// maximum milliseconds until their views were loaded again.
+    uint64_t _hibernationCount = 0;
+    uint64_t _rehydrateCount = 0;
+    uint64_t _rehydrateTotalMs = 0;
+    uint64_t _rehydrateMaxMs = 0;
+
+    /// The last stats of the clipboard cache.
+    size_t _clipboardCount = 0;
+    size_t _clipboardMemoryBytes = 0;
+    size_t _clipboardSpillBytes = 0;
+    uint64_t _clipboardEvictions = 0;
+
     pid_t _forKitPid = 0;
 
     /// We check the owner even in the release builds, needs to be always correct.
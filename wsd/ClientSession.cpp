@@ -14,6 +14,7 @@
 #include <fstream>
 #include <sstream>
 #include <memory>
+#include <set>
 #include <unordered_map>
 
 #include <Poco/Net/HTTPResponse.h>
@@ -67,7 +68,18 @@ ClientSession::ClientSession(
     _tileHeightTwips(0),
     _kitViewId(-1),
     _serverURL(requestDetails),
-    _isTextDocument(false)
+    _isTextDocument(false),
+    _docWidthTwips(0),
+    _docHeightTwips(0),
+    _scrollVelocityX(0),
+    _scrollVelocityY(0),
+    _prefetchPart(-1),
+    _prefetchTileWidthTwips(0),
+    _invalidTilesUnpaced(0),
+    _invalidTilesRequested(0),
+    _connectTime(std::chrono::steady_clock::now()),
+    _isFirstTileDue(false),
+    _isViewReloading(false)
 {
     const size_t curConnections = ++LOOLWSD::NumConnections;
     LOG_INF("ClientSession ctor [" << getName() << "] for URI: [" << _uriPublic.toString()
@@ -88,6 +100,10 @@ ClientSession::ClientSession(
     for (auto it : _clipboardKeys)
         rotateClipboardKey(false);
 
+    static const int InvalidationMinFps = LOOLWSD::getConfigValue<int>("per_view.invalidation_min_fps", 30);
+    static const int InvalidationMaxFps = LOOLWSD::getConfigValue<int>("per_view.invalidation_max_fps", 60);
+    _invalidationFrame.configure(InvalidationMinFps, InvalidationMaxFps);
+
     // get timestamp set
     setState(SessionState::DETACHED);
 }
@@ -104,6 +120,22 @@ ClientSession::~ClientSession()
 {
     const size_t curConnections = --LOOLWSD::NumConnections;
     LOG_INF("~ClientSession dtor [" << getName() << "], current number of connections: " << curConnections);
+    LOG_DBG("Session [" << getName() << "] sender queue: " << _senderQueue.getEnqueuedCount()
+            << " messages enqueued, " << _senderQueue.getDedupHitCount()
+            << " superseded before sending, " << _senderQueue.getDroppedCount()
+            << " dropped as obsolete, max depth " << _senderQueue.getMaxSize() << '.');
+    for (int i = 0; i < SendPriorityCount; ++i)
+    {
+        const SendPriority priority = static_cast<SendPriority>(i);
+        const LatencyHistogram latency = _senderQueue.getLatency(priority);
+        if (latency.getCount())
+        {
+            std::ostringstream oss;
+            latency.dumpState(oss);
+            LOG_DBG("Session [" << getName() << "] " << nameShort(priority)
+                    << " queueing latency: " << oss.str());
+        }
+    }
 
     std::unique_lock<std::mutex> lock(GlobalSessionMapMutex);
     GlobalSessionMap.erase(getId());
@@ -342,7 +374,7 @@ bool ClientSession::_handleInput(const char *buffer, int length)
 
     LOOLWSD::dumpIncomingTrace(docBroker->getJailId(), getId(), firstLine);
 
-    if (LOOLProtocol::tokenIndicatesUserInteraction(tokens[0]))
+    if (LOOLProtocol::tokenIndicatesUserInteraction(tokens, 0))
     {
         // Keep track of timestamps of incoming client messages that indicate user activity.
         updateLastActivityTime();
@@ -398,7 +430,7 @@ bool ClientSession::_handleInput(const char *buffer, int length)
     else if (tokens.equals(0, "loadwithpassword"))
     {
         std::string docPassword;
-        if (tokens.size() > 1 && getTokenString(tokens[1], "password", docPassword))
+        if (tokens.size() > 1 && getTokenString(tokens, 1, "password", docPassword))
         {
             if (!docPassword.empty())
             {
@@ -490,17 +522,17 @@ bool ClientSession::_handleInput(const char *buffer, int length)
         {
             int dontTerminateEdit = 1;
             if (tokens.size() > 1)
-                getTokenInteger(tokens[1], "dontTerminateEdit", dontTerminateEdit);
+                getTokenInteger(tokens, 1, "dontTerminateEdit", dontTerminateEdit);
 
             // Don't save unmodified docs by default.
             int dontSaveIfUnmodified = 1;
             if (tokens.size() > 2)
-                getTokenInteger(tokens[2], "dontSaveIfUnmodified", dontSaveIfUnmodified);
+                getTokenInteger(tokens, 2, "dontSaveIfUnmodified", dontSaveIfUnmodified);
 
             std::string extendedData;
             if (tokens.size() > 3)
             {
-                getTokenString(tokens[3], "extendedData", extendedData);
+                getTokenString(tokens, 3, "extendedData", extendedData);
                 std::string decoded;
                 Poco::URI::decode(extendedData, decoded);
                 extendedData = decoded;
@@ -516,7 +548,7 @@ bool ClientSession::_handleInput(const char *buffer, int length)
     {
         int force = 0;
         if (tokens.size() > 1)
-            getTokenInteger(tokens[1], "force", force);
+            getTokenInteger(tokens, 1, "force", force);
 
         docBroker->saveToStorage(getId(), true, "" /* This is irrelevant when success is true*/, true);
     }
@@ -527,10 +559,10 @@ bool ClientSession::_handleInput(const char *buffer, int length)
         int width;
         int height;
         if ((tokens.size() != 5 && tokens.size() != 7) ||
-            !getTokenInteger(tokens[1], "x", x) ||
-            !getTokenInteger(tokens[2], "y", y) ||
-            !getTokenInteger(tokens[3], "width", width) ||
-            !getTokenInteger(tokens[4], "height", height))
+            !getTokenInteger(tokens, 1, "x", x) ||
+            !getTokenInteger(tokens, 2, "y", y) ||
+            !getTokenInteger(tokens, 3, "width", width) ||
+            !getTokenInteger(tokens, 4, "height", height))
         {
             // Be forgiving and log instead of disconnecting.
             // sendTextFrameAndLogError("error: cmd=clientvisiblearea kind=syntax");
@@ -542,8 +574,8 @@ bool ClientSession::_handleInput(const char *buffer, int length)
             if (tokens.size() == 7)
             {
                 int splitX, splitY;
-                if (!getTokenInteger(tokens[5], "splitx", splitX) ||
-                    !getTokenInteger(tokens[6], "splity", splitY))
+                if (!getTokenInteger(tokens, 5, "splitx", splitX) ||
+                    !getTokenInteger(tokens, 6, "splity", splitY))
                 {
                     LOG_WRN("Invalid syntax for '" << tokens[0] << "' message: [" << firstLine << "].");
                     return true;
@@ -553,7 +585,18 @@ bool ClientSession::_handleInput(const char *buffer, int length)
                 _splitY = splitY;
             }
 
-            _clientVisibleArea = Util::Rectangle(x, y, width, height);
+            const Util::Rectangle newArea(x, y, width, height);
+            updateScrollVelocity(newArea);
+
+            // If the user jumped away from where we were prefetching, stop rendering that.
+            Util::Rectangle prefetchArea = _prefetchArea;
+            if (prefetchArea.hasSurface() && !prefetchArea.intersects(newArea))
+            {
+                docBroker->cancelPrefetch(client_from_this(), newArea);
+                _prefetchArea = Util::Rectangle();
+            }
+
+            _clientVisibleArea = newArea;
             resetWireIdMap();
             return forwardToChild(std::string(buffer, length), docBroker);
         }
@@ -564,7 +607,7 @@ bool ClientSession::_handleInput(const char *buffer, int length)
         {
             int temp;
             if (tokens.size() != 2 ||
-                !getTokenInteger(tokens[1], "part", temp))
+                !getTokenInteger(tokens, 1, "part", temp))
             {
                 sendTextFrameAndLogError("error: cmd=setclientpart kind=syntax");
                 return false;
@@ -584,8 +627,8 @@ bool ClientSession::_handleInput(const char *buffer, int length)
             int part;
             int how;
             if (tokens.size() != 3 ||
-                !getTokenInteger(tokens[1], "part", part) ||
-                !getTokenInteger(tokens[2], "how", how))
+                !getTokenInteger(tokens, 1, "part", part) ||
+                !getTokenInteger(tokens, 2, "how", how))
             {
                 sendTextFrameAndLogError("error: cmd=selectclientpart kind=syntax");
                 return false;
@@ -602,7 +645,7 @@ bool ClientSession::_handleInput(const char *buffer, int length)
         {
             int nPosition;
             if (tokens.size() != 2 ||
-                !getTokenInteger(tokens[1], "position", nPosition))
+                !getTokenInteger(tokens, 1, "position", nPosition))
             {
                 sendTextFrameAndLogError("error: cmd=moveselectedclientparts kind=syntax");
                 return false;
@@ -617,10 +660,10 @@ bool ClientSession::_handleInput(const char *buffer, int length)
     {
         int tilePixelWidth, tilePixelHeight, tileTwipWidth, tileTwipHeight;
         if (tokens.size() != 5 ||
-            !getTokenInteger(tokens[1], "tilepixelwidth", tilePixelWidth) ||
-            !getTokenInteger(tokens[2], "tilepixelheight", tilePixelHeight) ||
-            !getTokenInteger(tokens[3], "tiletwipwidth", tileTwipWidth) ||
-            !getTokenInteger(tokens[4], "tiletwipheight", tileTwipHeight))
+            !getTokenInteger(tokens, 1, "tilepixelwidth", tilePixelWidth) ||
+            !getTokenInteger(tokens, 2, "tilepixelheight", tilePixelHeight) ||
+            !getTokenInteger(tokens, 3, "tiletwipwidth", tileTwipWidth) ||
+            !getTokenInteger(tokens, 4, "tiletwipheight", tileTwipHeight))
         {
             // Be forgiving and log instead of disconnecting.
             // sendTextFrameAndLogError("error: cmd=clientzoom kind=syntax");
@@ -634,6 +677,7 @@ bool ClientSession::_handleInput(const char *buffer, int length)
             _tileWidthTwips = tileTwipWidth;
             _tileHeightTwips = tileTwipHeight;
             resetWireIdMap();
+            dropObsoleteTiles();
             return forwardToChild(std::string(buffer, length), docBroker);
         }
     }
@@ -641,7 +685,7 @@ bool ClientSession::_handleInput(const char *buffer, int length)
     {
         std::string tileID;
         if (tokens.size() != 2 ||
-            !getTokenString(tokens[1], "tile", tileID))
+            !getTokenString(tokens, 1, "tile", tileID))
         {
             // Be forgiving and log instead of disconnecting.
             // sendTextFrameAndLogError("error: cmd=tileprocessed kind=syntax");
@@ -650,13 +694,19 @@ bool ClientSession::_handleInput(const char *buffer, int length)
         }
 
         auto iter = std::find_if(_tilesOnFly.begin(), _tilesOnFly.end(),
-        [&tileID](const std::pair<std::string, std::chrono::steady_clock::time_point>& curTile)
+        [&tileID](const std::pair<std::string, LinkEstimator::Sample>& curTile)
         {
             return curTile.first == tileID;
         });
 
         if(iter != _tilesOnFly.end())
+        {
+            const auto now = std::chrono::steady_clock::now();
+            _linkEstimator.onAck(iter->second, now);
+            if (_protocol)
+                _linkEstimator.onPing(std::chrono::microseconds(_protocol->getPingTimeUs()), now);
             _tilesOnFly.erase(iter);
+        }
         else
             LOG_INF("Tileprocessed message with an unknown tile ID");
 
@@ -676,7 +726,7 @@ bool ClientSession::_handleInput(const char *buffer, int length)
     else if (tokens.equals(0, "renamefile"))
     {
         std::string encodedWopiFilename;
-        if (tokens.size() < 2 || !getTokenString(tokens[1], "filename", encodedWopiFilename))
+        if (tokens.size() < 2 || !getTokenString(tokens, 1, "filename", encodedWopiFilename))
         {
             LOG_ERR("Bad syntax for: " << firstLine);
             sendTextFrameAndLogError("error: cmd=renamefile kind=syntax");
@@ -695,37 +745,37 @@ bool ClientSession::_handleInput(const char *buffer, int length)
     {
         return forwardToChild(std::string(buffer, length), docBroker);
     }
-    else if (tokens[0] == "outlinestate" ||
-             tokens[0] == "downloadas" ||
-             tokens[0] == "getchildid" ||
-             tokens[0] == "gettextselection" ||
-             tokens[0] == "paste" ||
-             tokens[0] == "insertfile" ||
-             tokens[0] == "key" ||
-             tokens[0] == "textinput" ||
-             tokens[0] == "windowkey" ||
-             tokens[0] == "mouse" ||
-             tokens[0] == "windowmouse" ||
-             tokens[0] == "windowgesture" ||
-             tokens[0] == "requestloksession" ||
-             tokens[0] == "resetselection" ||
-             tokens[0] == "saveas" ||
-             tokens[0] == "selectgraphic" ||
-             tokens[0] == "selecttext" ||
-             tokens[0] == "windowselecttext" ||
-             tokens[0] == "setpage" ||
-             tokens[0] == "uno" ||
-             tokens[0] == "useractive" ||
-             tokens[0] == "userinactive" ||
-             tokens[0] == "paintwindow" ||
-             tokens[0] == "windowcommand" ||
-             tokens[0] == "signdocument" ||
-             tokens[0] == "asksignaturestatus" ||
-             tokens[0] == "uploadsigneddocument" ||
-             tokens[0] == "exportsignanduploaddocument" ||
-             tokens[0] == "rendershapeselection" ||
-             tokens[0] == "resizewindow" ||
-             tokens[0] == "removetextcontext")
+    else if (tokens.equals(0, "outlinestate") ||
+             tokens.equals(0, "downloadas") ||
+             tokens.equals(0, "getchildid") ||
+             tokens.equals(0, "gettextselection") ||
+             tokens.equals(0, "paste") ||
+             tokens.equals(0, "insertfile") ||
+             tokens.equals(0, "key") ||
+             tokens.equals(0, "textinput") ||
+             tokens.equals(0, "windowkey") ||
+             tokens.equals(0, "mouse") ||
+             tokens.equals(0, "windowmouse") ||
+             tokens.equals(0, "windowgesture") ||
+             tokens.equals(0, "requestloksession") ||
+             tokens.equals(0, "resetselection") ||
+             tokens.equals(0, "saveas") ||
+             tokens.equals(0, "selectgraphic") ||
+             tokens.equals(0, "selecttext") ||
+             tokens.equals(0, "windowselecttext") ||
+             tokens.equals(0, "setpage") ||
+             tokens.equals(0, "uno") ||
+             tokens.equals(0, "useractive") ||
+             tokens.equals(0, "userinactive") ||
+             tokens.equals(0, "paintwindow") ||
+             tokens.equals(0, "windowcommand") ||
+             tokens.equals(0, "signdocument") ||
+             tokens.equals(0, "asksignaturestatus") ||
+             tokens.equals(0, "uploadsigneddocument") ||
+             tokens.equals(0, "exportsignanduploaddocument") ||
+             tokens.equals(0, "rendershapeselection") ||
+             tokens.equals(0, "resizewindow") ||
+             tokens.equals(0, "removetextcontext"))
     {
         if (tokens.equals(0, "key"))
             _keyEvents++;
@@ -735,7 +785,7 @@ bool ClientSession::_handleInput(const char *buffer, int length)
             const std::string dummyFrame = "dummymsg";
             return forwardToChild(dummyFrame, docBroker);
         }
-        else if (tokens[0] != "requestloksession")
+        else if (!tokens.equals(0, "requestloksession"))
         {
             return forwardToChild(std::string(buffer, length), docBroker);
         }
@@ -770,6 +820,7 @@ bool ClientSession::loadDocument(const char* /*buffer*/, int /*length*/,
     }
 
     _viewLoadStart = std::chrono::steady_clock::now();
+    _isFirstTileDue = true;
     LOG_INF("Requesting document load from child.");
     try
     {
@@ -777,89 +828,121 @@ bool ClientSession::loadDocument(const char* /*buffer*/, int /*length*/,
         int loadPart = -1;
         parseDocOptions(tokens, loadPart, timestamp, doctemplate);
 
-        std::ostringstream oss;
-        oss << "load";
-        oss << " url=" << docBroker->getPublicUri().toString();;
+        return forwardToChild(createLoadRequest(docBroker, loadPart, true), docBroker);
+    }
+    catch (const Poco::SyntaxException&)
+    {
+        sendTextFrameAndLogError("error: cmd=load kind=uriinvalid");
+    }
 
-        if (!getUserId().empty() && !getUserName().empty())
-        {
-            std::string encodedUserId;
-            Poco::URI::encode(getUserId(), "", encodedUserId);
-            oss << " authorid=" << encodedUserId;
-            encodedUserId = "";
-            Poco::URI::encode(LOOLWSD::anonymizeUsername(getUserId()), "", encodedUserId);
-            oss << " xauthorid=" << encodedUserId;
+    return false;
+}
 
-            std::string encodedUserName;
-            Poco::URI::encode(getUserName(), "", encodedUserName);
-            oss << " author=" << encodedUserName;
-            encodedUserName = "";
-            Poco::URI::encode(LOOLWSD::anonymizeUsername(getUserName()), "", encodedUserName);
-            oss << " xauthor=" << encodedUserName;
-        }
+std::string ClientSession::createLoadRequest(const std::shared_ptr<DocumentBroker>& docBroker,
+                                             const int loadPart, const bool fromTemplate) const
+{
+    std::ostringstream oss;
+    oss << "load";
+    oss << " url=" << docBroker->getPublicUri().toString();;
 
-        if (!getUserExtraInfo().empty())
-        {
-            std::string encodedUserExtraInfo;
-            Poco::URI::encode(getUserExtraInfo(), "", encodedUserExtraInfo);
-            oss << " authorextrainfo=" << encodedUserExtraInfo; //TODO: could this include PII?
-        }
+    if (!getUserId().empty() && !getUserName().empty())
+    {
+        std::string encodedUserId;
+        Poco::URI::encode(getUserId(), "", encodedUserId);
+        oss << " authorid=" << encodedUserId;
+        encodedUserId = "";
+        Poco::URI::encode(LOOLWSD::anonymizeUsername(getUserId()), "", encodedUserId);
+        oss << " xauthorid=" << encodedUserId;
 
-        oss << " readonly=" << isReadOnly();
+        std::string encodedUserName;
+        Poco::URI::encode(getUserName(), "", encodedUserName);
+        oss << " author=" << encodedUserName;
+        encodedUserName = "";
+        Poco::URI::encode(LOOLWSD::anonymizeUsername(getUserName()), "", encodedUserName);
+        oss << " xauthor=" << encodedUserName;
+    }
 
-        if (loadPart >= 0)
-        {
-            oss << " part=" << loadPart;
-        }
+    if (!getUserExtraInfo().empty())
+    {
+        std::string encodedUserExtraInfo;
+        Poco::URI::encode(getUserExtraInfo(), "", encodedUserExtraInfo);
+        oss << " authorextrainfo=" << encodedUserExtraInfo; //TODO: could this include PII?
+    }
 
-        if (getHaveDocPassword())
-        {
-            oss << " password=" << getDocPassword();
-        }
+    oss << " readonly=" << isReadOnly();
 
-        if (!getLang().empty())
-        {
-            oss << " lang=" << getLang();
-        }
+    if (loadPart >= 0)
+    {
+        oss << " part=" << loadPart;
+    }
 
-        if (!getDeviceFormFactor().empty())
-        {
-            oss << " deviceFormFactor=" << getDeviceFormFactor();
-        }
+    if (getHaveDocPassword())
+    {
+        oss << " password=" << getDocPassword();
+    }
 
-        if (!getWatermarkText().empty())
-        {
-            std::string encodedWatermarkText;
-            Poco::URI::encode(getWatermarkText(), "", encodedWatermarkText);
-            oss << " watermarkText=" << encodedWatermarkText;
-            oss << " watermarkOpacity=" << LOOLWSD::getConfigValue<double>("watermark.opacity", 0.2);
-        }
+    if (!getLang().empty())
+    {
+        oss << " lang=" << getLang();
+    }
 
-        if (!getDocOptions().empty())
-        {
-            oss << " options=" << getDocOptions();
-        }
+    if (!getDeviceFormFactor().empty())
+    {
+        oss << " deviceFormFactor=" << getDeviceFormFactor();
+    }
 
-        if (_wopiFileInfo && !_wopiFileInfo->getTemplateSource().empty())
-        {
-            oss << " template=" << _wopiFileInfo->getTemplateSource();
-        }
+    if (!getWatermarkText().empty())
+    {
+        std::string encodedWatermarkText;
+        Poco::URI::encode(getWatermarkText(), "", encodedWatermarkText);
+        oss << " watermarkText=" << encodedWatermarkText;
+        oss << " watermarkOpacity=" << LOOLWSD::getConfigValue<double>("watermark.opacity", 0.2);
+    }
 
-        return forwardToChild(oss.str(), docBroker);
+    if (!getDocOptions().empty())
+    {
+        oss << " options=" << getDocOptions();
     }
-    catch (const Poco::SyntaxException&)
+
+    if (fromTemplate && _wopiFileInfo && !_wopiFileInfo->getTemplateSource().empty())
     {
-        sendTextFrameAndLogError("error: cmd=load kind=uriinvalid");
+        oss << " template=" << _wopiFileInfo->getTemplateSource();
     }
 
-    return false;
+    return oss.str();
+}
+
+void ClientSession::reloadView(const std::shared_ptr<DocumentBroker>& docBroker)
+{
+    LOG_INF("Reloading view of session [" << getId() << "] into the new kit.");
+    _viewLoadStart = std::chrono::steady_clock::now();
+    _isViewReloading = true;
+
+    // The document is saved by now, so there's no template to create it from.
+    forwardToChild(createLoadRequest(docBroker, _isTextDocument ? -1 : _clientSelectedPart, false),
+                   docBroker);
+
+    // Tell the new view how it's shown, for its invalidations.
+    if (_tileWidthPixel > 0 && _tileHeightPixel > 0)
+        forwardToChild("clientzoom tilepixelwidth=" + std::to_string(_tileWidthPixel) +
+                       " tilepixelheight=" + std::to_string(_tileHeightPixel) +
+                       " tiletwipwidth=" + std::to_string(_tileWidthTwips) +
+                       " tiletwipheight=" + std::to_string(_tileHeightTwips), docBroker);
+
+    if (_clientVisibleArea.hasSurface())
+        forwardToChild("clientvisiblearea x=" + std::to_string(_clientVisibleArea.getLeft()) +
+                       " y=" + std::to_string(_clientVisibleArea.getTop()) +
+                       " width=" + std::to_string(_clientVisibleArea.getWidth()) +
+                       " height=" + std::to_string(_clientVisibleArea.getHeight()) +
+                       " splitx=" + std::to_string(_splitX) +
+                       " splity=" + std::to_string(_splitY), docBroker);
 }
 
 bool ClientSession::getCommandValues(const char *buffer, int length, const StringVector& tokens,
                                      const std::shared_ptr<DocumentBroker>& docBroker)
 {
     std::string command;
-    if (tokens.size() != 2 || !getTokenString(tokens[1], "command", command))
+    if (tokens.size() != 2 || !getTokenString(tokens, 1, "command", command))
         return sendTextFrameAndLogError("error: cmd=commandvalues kind=syntax");
 
     std::string cmdValues;
@@ -874,12 +957,12 @@ bool ClientSession::sendFontRendering(const char *buffer, int length, const Stri
 {
     std::string font, text;
     if (tokens.size() < 2 ||
-        !getTokenString(tokens[1], "font", font))
+        !getTokenString(tokens, 1, "font", font))
     {
         return sendTextFrameAndLogError("error: cmd=renderfont kind=syntax");
     }
 
-    getTokenString(tokens[2], "char", text);
+    getTokenString(tokens, 2, "char", text);
 
     TileCache::Tile cachedTile = docBroker->tileCache().lookupCachedStream(TileCache::StreamType::Font, font+text);
     if (cachedTile)
@@ -943,7 +1026,7 @@ bool ClientSession::filterMessage(const std::string& message) const
     if (tokens.equals(0, "downloadas"))
     {
         std::string id;
-        if (tokens.size() >= 3 && getTokenString(tokens[2], "id", id))
+        if (tokens.size() >= 3 && getTokenString(tokens, 2, "id", id))
         {
             if (id == "print" && _wopiFileInfo && _wopiFileInfo->getDisablePrint())
             {
@@ -1108,14 +1191,14 @@ bool ClientSession::handleKitToClientMessage(const char* buffer, const int lengt
         return false;
     }
 
-    const bool isConvertTo = static_cast<bool>(_saveAsSocket);
+    const bool isConvertTo = docBroker->isConvertTo();
 
 #if !MOBILEAPP
     LOOLWSD::dumpOutgoingTrace(docBroker->getJailId(), getId(), firstLine);
 #endif
 
     const auto& tokens = payload->tokens();
-    if (tokens[0] == "unocommandresult:")
+    if (tokens.equals(0, "unocommandresult:"))
     {
         const std::string stringMsg(buffer, length);
         LOG_INF(getName() << ": Command: " << stringMsg);
@@ -1152,12 +1235,12 @@ bool ClientSession::handleKitToClientMessage(const char* buffer, const int lengt
             LOG_WRN("Expected json unocommandresult. Ignoring: " << stringMsg);
         }
     }
-    else if (tokens[0] == "error:")
+    else if (tokens.equals(0, "error:"))
     {
         std::string errorCommand;
         std::string errorKind;
-        if (getTokenString(tokens[1], "cmd", errorCommand) &&
-            getTokenString(tokens[2], "kind", errorKind) )
+        if (getTokenString(tokens, 1, "cmd", errorCommand) &&
+            getTokenString(tokens, 2, "kind", errorKind) )
         {
             if (errorCommand == "load")
             {
@@ -1168,17 +1251,21 @@ bool ClientSession::handleKitToClientMessage(const char* buffer, const int lengt
                 {
                     if (isConvertTo)
                     {
-                        Poco::Net::HTTPResponse response;
-                        response.setStatusAndReason(Poco::Net::HTTPResponse::HTTP_UNAUTHORIZED);
-                        response.set("X-ERROR-KIND", errorKind);
-                        _saveAsSocket->send(response);
+#if !MOBILEAPP
+                        // A batch conversion reports the failure with the other results.
+                        if (_saveAsSocket)
+                        {
+                            Poco::Net::HTTPResponse response;
+                            response.setStatusAndReason(Poco::Net::HTTPResponse::HTTP_UNAUTHORIZED);
+                            response.set("X-ERROR-KIND", errorKind);
+                            _saveAsSocket->send(response);
+                        }
 
                         // Conversion failed, cleanup fake session.
                         LOG_TRC("Removing save-as ClientSession after conversion error.");
-                        // Remove us.
-                        docBroker->removeSession(getId());
-                        // Now terminate.
-                        docBroker->stop("Aborting saveas handler.");
+                        // Remove us, and terminate.
+                        std::static_pointer_cast<ConvertToBroker>(docBroker)->finishConversion(getId(), std::string());
+#endif
                     }
                     else
                     {
@@ -1193,18 +1280,18 @@ bool ClientSession::handleKitToClientMessage(const char* buffer, const int lengt
             }
         }
     }
-    else if (tokens[0] == "curpart:" && tokens.size() == 2)
+    else if (tokens.equals(0, "curpart:") && tokens.size() == 2)
     {
         //TODO: Should forward to client?
         int curPart;
-        return getTokenInteger(tokens[1], "part", curPart);
+        return getTokenInteger(tokens, 1, "part", curPart);
     }
-    else if (tokens[0] == "setpart:" && tokens.size() == 2)
+    else if (tokens.equals(0, "setpart:") && tokens.size() == 2)
     {
         if(!_isTextDocument)
         {
             int setPart;
-            if(getTokenInteger(tokens[1], "part", setPart))
+            if(getTokenInteger(tokens, 1, "part", setPart))
             {
                 _clientSelectedPart = setPart;
                 resetWireIdMap();
@@ -1219,11 +1306,11 @@ bool ClientSession::handleKitToClientMessage(const char* buffer, const int lengt
          }
     }
 #if !MOBILEAPP
-    else if (tokens.size() == 3 && tokens[0] == "saveas:")
+    else if (tokens.size() == 3 && tokens.equals(0, "saveas:"))
     {
 
         std::string encodedURL;
-        if (!getTokenString(tokens[1], "url", encodedURL))
+        if (!getTokenString(tokens, 1, "url", encodedURL))
         {
             LOG_ERR("Bad syntax for: " << firstLine);
             // we must not return early with convert-to so that we clean up
@@ -1236,7 +1323,7 @@ bool ClientSession::handleKitToClientMessage(const char* buffer, const int lengt
         }
 
         std::string encodedWopiFilename;
-        if (!isConvertTo && !getTokenString(tokens[2], "filename", encodedWopiFilename))
+        if (!isConvertTo && !getTokenString(tokens, 2, "filename", encodedWopiFilename))
         {
             LOG_ERR("Bad syntax for: " << firstLine);
             sendTextFrameAndLogError("error: cmd=saveas kind=syntax");
@@ -1293,7 +1380,7 @@ bool ClientSession::handleKitToClientMessage(const char* buffer, const int lengt
         {
             // using the convert-to REST API
             // TODO: Send back error when there is no output.
-            if (!resultURL.getPath().empty())
+            if (_saveAsSocket && !resultURL.getPath().empty())
             {
                 const std::string mimeType = "application/octet-stream";
                 std::string encodedFilePath;
@@ -1311,11 +1398,9 @@ bool ClientSession::handleKitToClientMessage(const char* buffer, const int lengt
             // Conversion is done, cleanup this fake session.
             LOG_TRC("Removing save-as ClientSession after conversion.");
 
-            // Remove us.
-            docBroker->removeSession(getId());
-
-            // Now terminate.
-            docBroker->stop("Finished saveas handler.");
+            // Remove us, and terminate or recycle the kit. A batch conversion
+            // gets the result from there.
+            std::static_pointer_cast<ConvertToBroker>(docBroker)->finishConversion(getId(), resultURL.getPath());
         }
 
         return true;
@@ -1368,12 +1453,12 @@ bool ClientSession::handleKitToClientMessage(const char* buffer, const int lengt
                 }
             }
         }
-    } else if (tokens[0] == "textselectioncontent:") {
+    } else if (tokens.equals(0, "textselectioncontent:")) {
 
         postProcessCopyPayload(payload);
         return forwardToClient(payload);
 
-    } else if (tokens[0] == "clipboardcontent:") {
+    } else if (tokens.equals(0, "clipboardcontent:")) {
 
 #if !MOBILEAPP // Most likely nothing of this makes sense in a mobile app
 
@@ -1427,7 +1512,22 @@ bool ClientSession::handleKitToClientMessage(const char* buffer, const int lengt
 #endif
         _clipSockets.clear();
         return true;
-    } else if (tokens[0] == "disconnected:") {
+    } else if (tokens.equals(0, "firstload:")) {
+
+#if !MOBILEAPP
+        // How long the first document of the kit took to load, with its type warmed or not.
+        std::string docType;
+        int ms = 0;
+        bool warmed = false;
+        if (tokens.size() == 4 && getTokenString(tokens[1], "type", docType) &&
+            getTokenInteger(tokens[2], "ms", ms))
+        {
+            warmed = tokens.equals(3, "warmed=true");
+            Admin::instance().addFirstLoadDuration(docType, warmed, std::chrono::milliseconds(ms));
+        }
+#endif
+        return true;
+    } else if (tokens.equals(0, "disconnected:")) {
 
         LOG_INF("End of disconnection handshake for " << getId());
         docBroker->finalRemoveSession(getId());
@@ -1436,12 +1536,15 @@ bool ClientSession::handleKitToClientMessage(const char* buffer, const int lengt
 
     if (!isDocPasswordProtected())
     {
-        if (tokens[0] == "tile:")
+        if (tokens.equals(0, "tile:"))
         {
             assert(false && "Tile traffic should go through the DocumentBroker-LoKit WS.");
         }
-        else if (tokens[0] == "status:")
+        else if (tokens.equals(0, "status:"))
         {
+            // Keep the invalidations the kit sent before the status ahead of it.
+            flushInvalidations(std::chrono::steady_clock::now(), true);
+
             setState(ClientSession::SessionState::LIVE);
             docBroker->setLoaded();
 
@@ -1449,13 +1552,14 @@ bool ClientSession::handleKitToClientMessage(const char* buffer, const int lengt
             Admin::instance().setViewLoadDuration(docBroker->getDocKey(), getId(), std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - _viewLoadStart));
 #endif
 
-            // Wopi post load actions
-            if (_wopiFileInfo && !_wopiFileInfo->getTemplateSource().empty())
+            // Wopi post load actions, done already if we are reloading.
+            if (!_isViewReloading && _wopiFileInfo && !_wopiFileInfo->getTemplateSource().empty())
             {
                 std::string result;
                 LOG_DBG("Saving template [" << _wopiFileInfo->getTemplateSource() << "] to storage");
                 docBroker->saveToStorage(getId(), true, result);
             }
+            _isViewReloading = false;
 
             for(auto &token : tokens)
             {
@@ -1472,18 +1576,23 @@ bool ClientSession::handleKitToClientMessage(const char* buffer, const int lengt
                 if(getTokenString(tokens.getParam(token), "type", docType))
                 {
                     _isTextDocument = docType.find("text") != std::string::npos;
+                    _docType = docType;
                 }
 
                 // Store our Kit ViewId
                 int viewId = -1;
                 if(getTokenInteger(tokens.getParam(token), "viewid", viewId))
                     _kitViewId = viewId;
+
+                // And the size of what we loaded
+                getTokenInteger(tokens.getParam(token), "width", _docWidthTwips);
+                getTokenInteger(tokens.getParam(token), "height", _docHeightTwips);
             }
 
             // Forward the status response to the client.
             return forwardToClient(payload);
         }
-        else if (tokens[0] == "commandvalues:")
+        else if (tokens.equals(0, "commandvalues:"))
         {
             const std::string stringMsg(buffer, length);
             const size_t index = stringMsg.find_first_of('{');
@@ -1502,17 +1611,39 @@ bool ClientSession::handleKitToClientMessage(const char* buffer, const int lengt
                 }
             }
         }
-        else if (tokens[0] == "invalidatetiles:")
+        else if (tokens.equals(0, "invalidatetiles:"))
         {
             assert(firstLine.size() == static_cast<std::string::size_type>(length));
 
+            if (_invalidationFrame.isEnabled())
+            {
+                const std::pair<int, Util::Rectangle> result = TileCache::parseInvalidateMsg(firstLine);
+                if (result.second.hasSurface())
+                {
+                    // The cache must not serve the old tiles any more, but the
+                    // client's repaint and our tile requests wait for the frame.
+                    docBroker->invalidateTiles(firstLine, getCanonicalViewId());
+                    _invalidTilesUnpaced += getInvalidTiles(result.first, result.second).size();
+
+                    const auto now = std::chrono::steady_clock::now();
+                    _invalidationFrame.add(result.first, result.second, now,
+                                           _invalidationFrame.getInterval(_linkEstimator.getSmoothedRtt()));
+                    if (_invalidationFrame.isDue(now))
+                        flushInvalidations(now);
+                    else
+                        docBroker->housekeepSoon(); // To poll no later than the deadline.
+
+                    return true;
+                }
+            }
+
             // First forward invalidation
             bool ret = forwardToClient(payload);
 
             handleTileInvalidation(firstLine, docBroker);
             return ret;
         }
-        else if (tokens[0] == "invalidatecursor:")
+        else if (tokens.equals(0, "invalidatecursor:"))
         {
             assert(firstLine.size() == static_cast<std::string::size_type>(length));
 
@@ -1541,17 +1672,17 @@ bool ClientSession::handleKitToClientMessage(const char* buffer, const int lengt
                 LOG_ERR("Unable to parse " << firstLine);
             }
         }
-        else if (tokens[0] == "renderfont:")
+        else if (tokens.equals(0, "renderfont:"))
         {
             std::string font, text;
             if (tokens.size() < 3 ||
-                !getTokenString(tokens[1], "font", font))
+                !getTokenString(tokens, 1, "font", font))
             {
                 LOG_ERR("Bad syntax for: " << firstLine);
                 return false;
             }
 
-            getTokenString(tokens[2], "char", text);
+            getTokenString(tokens, 2, "char", text);
             assert(firstLine.size() < static_cast<std::string::size_type>(length));
             docBroker->tileCache().saveStream(TileCache::StreamType::Font, font+text,
                                               buffer + firstLine.size() + 1, length - firstLine.size() - 1);
@@ -1599,20 +1730,117 @@ void ClientSession::enqueueSendMessage(const std::shared_ptr<Message>& data)
         }
     }
 
-    LOG_TRC(getName() << " enqueueing client message " << data->id());
+    // Cursor and text updates go before tiles, and tiles the user
+    // can see go before those outside the visible area or previews.
+    SendPriority priority = SenderQueue<std::shared_ptr<Message>>::getPriority(data);
+    if (tile && (tile->getId() != -1 ||
+                 (_clientVisibleArea.hasSurface() && !isTileInsideVisibleArea(*tile))))
+    {
+        priority = SendPriority::PrefetchTile;
+    }
+
+    LOG_TRC(getName() << " enqueueing client message " << data->id() << " as "
+                      << nameShort(priority));
+    if (command == "invalidatetiles:")
+        dropInvalidatedTiles(data->firstLine());
+
     size_t sizeBefore = _senderQueue.size();
-    size_t newSize = _senderQueue.enqueue(data);
+    size_t newSize = _senderQueue.enqueue(data, priority);
 
     // Track sent tile
     if (tile)
     {
-        traceTileBySend(*tile, sizeBefore == newSize);
+        traceTileBySend(*tile, data->size(), sizeBefore == newSize);
+
+#if !MOBILEAPP
+        if (_isFirstTileDue)
+        {
+            _isFirstTileDue = false;
+            Admin::instance().addFirstTileDuration(
+                _docType, std::chrono::duration_cast<std::chrono::milliseconds>(
+                              std::chrono::steady_clock::now() - _connectTime));
+        }
+#endif
+    }
+}
+
+void ClientSession::sendTextFrameNow(const std::string& message)
+{
+    LOG_TRC(getName() << ": sending now [" << message << "].");
+    if (_protocol)
+        _protocol->sendTextMessage(message.data(), message.size(), true);
+}
+
+void ClientSession::dropObsoleteTiles()
+{
+    // Only worth it when the client is behind; otherwise the queue drains soon enough.
+    if (!_senderQueue.isBacklogged())
+        return;
+
+    const size_t dropped = dropQueuedTiles(SendPriority::VisibleTile,
+        [this](const TileDesc& tile)
+        {
+            return tile.getTileWidth() != _tileWidthTwips
+                || tile.getTileHeight() != _tileHeightTwips;
+        });
+
+    if (dropped)
+        LOG_DBG(getName() << " dropped " << dropped << " queued tiles of the old zoom level.");
+}
+
+void ClientSession::dropInvalidatedTiles(const std::string& message)
+{
+    const std::pair<int, Util::Rectangle> result = TileCache::parseInvalidateMsg(message);
+    const int part = result.first;
+    Util::Rectangle rectangle = result.second;
+    if (!rectangle.hasSurface())
+        return;
+
+    const size_t dropped = dropQueuedTiles(SendPriority::PrefetchTile,
+        [part, &rectangle](const TileDesc& tile)
+        {
+            // Previews are not repainted for invalidations; the client waits for them.
+            return tile.getId() == -1 && (part < 0 || tile.getPart() == part)
+                && rectangle.intersects(Util::Rectangle(tile.getTilePosX(), tile.getTilePosY(),
+                                                        tile.getTileWidth(), tile.getTileHeight()));
+        });
+
+    if (dropped)
+        LOG_DBG(getName() << " dropped " << dropped << " queued tiles invalidated by [" << message << "].");
+}
+
+size_t ClientSession::dropQueuedTiles(const SendPriority priority,
+                                      const std::function<bool(const TileDesc&)>& obsolete)
+{
+    const std::vector<std::shared_ptr<Message>> dropped = _senderQueue.dropObsolete(
+        priority,
+        [&obsolete](const std::shared_ptr<Message>& item)
+        {
+            return item->tokens().equals(0, "tile:")
+                && obsolete(TileDesc::parse(item->firstLine()));
+        });
+
+    for (const std::shared_ptr<Message>& item : dropped)
+    {
+        // Not sent, so not on the fly either.
+        const std::string tileID = TileDesc::parse(item->firstLine()).generateID();
+        const auto iter = std::find_if(_tilesOnFly.begin(), _tilesOnFly.end(),
+            [&tileID](const std::pair<std::string, LinkEstimator::Sample>& curTile)
+            {
+                return curTile.first == tileID;
+            });
+        if (iter != _tilesOnFly.end())
+            _tilesOnFly.erase(iter);
     }
+
+    return dropped.size();
 }
 
-void ClientSession::addTileOnFly(const TileDesc& tile)
+void ClientSession::addTileOnFly(const TileDesc& tile, size_t size)
 {
-    _tilesOnFly.emplace_back(tile.generateID(), std::chrono::steady_clock::now());
+    _tilesOnFly.emplace_back(tile.generateID(),
+                             _linkEstimator.onSend(size, _tilesOnFly.size(),
+                                                   std::chrono::steady_clock::now()));
 }
 
 void ClientSession::clearTilesOnFly()
@@ -1622,13 +1850,16 @@ void ClientSession::clearTilesOnFly()
 
 void ClientSession::removeOutdatedTilesOnFly()
 {
+    // Wait a few round-trips of this client's link, rather than a fixed time.
+    const double timeoutMs = _linkEstimator.getTimeout().count();
+
     // Check only the beginning of the list, tiles are ordered by timestamp
     bool continueLoop = true;
     while(!_tilesOnFly.empty() && continueLoop)
     {
         auto tileIter = _tilesOnFly.begin();
-        double elapsedTimeMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - tileIter->second).count();
-        if(elapsedTimeMs > TILE_ROUNDTRIP_TIMEOUT_MS)
+        double elapsedTimeMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - tileIter->second._sent).count();
+        if(elapsedTimeMs > timeoutMs)
         {
             LOG_WRN("Tracker tileID " << tileIter->first << " was dropped because of time out ("
                                       << elapsedTimeMs
@@ -1749,6 +1980,9 @@ void ClientSession::dumpState(std::ostream& os)
         os << "\n\t\tsent/keystroke: " << (double)sent/_keyEvents << "bytes";
     }
 
+    os << "\n\t\tlink: ";
+    _linkEstimator.dumpState(os);
+
     os << '\n';
     _senderQueue.dumpState(os);
 
@@ -1767,19 +2001,58 @@ void ClientSession::handleTileInvalidation(const std::string& message,
 {
     docBroker->invalidateTiles(message, getCanonicalViewId());
 
+    const std::pair<int, Util::Rectangle> result = TileCache::parseInvalidateMsg(message);
+    requestInvalidTiles(getInvalidTiles(result.first, result.second), docBroker);
+}
+
+void ClientSession::flushInvalidations(const std::chrono::steady_clock::time_point now,
+                                       const bool force)
+{
+    if (!_invalidationFrame.isPending() || (!force && !_invalidationFrame.isDue(now)))
+        return;
+
+    const std::shared_ptr<DocumentBroker> docBroker = _docBroker.lock();
+    if (!docBroker)
+        return;
+
+    // Request the tiles under all the rectangles of the frame at once,
+    // as the same tile can be under more than one.
+    std::vector<TileDesc> invalidTiles;
+    std::set<std::string> tileIds;
+    for (const std::string& message : _invalidationFrame.take(now))
+    {
+        forwardToClient(std::make_shared<Message>(message, Message::Dir::Out));
+
+        const std::pair<int, Util::Rectangle> result = TileCache::parseInvalidateMsg(message);
+        for (const TileDesc& tile : getInvalidTiles(result.first, result.second))
+        {
+            if (tileIds.insert(tile.generateID()).second)
+                invalidTiles.push_back(tile);
+        }
+    }
+
+    _invalidTilesRequested += invalidTiles.size();
+    requestInvalidTiles(invalidTiles, docBroker);
+}
+
+uint64_t ClientSession::getTileRequestsSaved() const
+{
+    return (_invalidTilesUnpaced > _invalidTilesRequested ? _invalidTilesUnpaced - _invalidTilesRequested : 0);
+}
+
+std::vector<TileDesc> ClientSession::getInvalidTiles(int part, Util::Rectangle invalidateRect)
+{
+    std::vector<TileDesc> invalidTiles;
+
     // Skip requesting new tiles if we don't have client visible area data yet.
     if(!_clientVisibleArea.hasSurface() ||
        _tileWidthPixel == 0 || _tileHeightPixel == 0 ||
        _tileWidthTwips == 0 || _tileHeightTwips == 0 ||
        (_clientSelectedPart == -1 && !_isTextDocument))
     {
-        return;
+        return invalidTiles;
     }
 
-    std::pair<int, Util::Rectangle> result = TileCache::parseInvalidateMsg(message);
-    int part = result.first;
-    Util::Rectangle& invalidateRect = result.second;
-
     constexpr SplitPaneName panes[4] = {
         TOPLEFT_PANE,
         TOPRIGHT_PANE,
@@ -1801,14 +2074,13 @@ void ClientSession::handleTileInvalidation(const std::string& message,
 
     // We can ignore the invalidation if it's outside of all split-panes.
     if(!numPanes)
-        return;
+        return invalidTiles;
 
     if( part == -1 ) // If no part is specified we use the part used by the client
         part = _clientSelectedPart;
 
     int normalizedViewId = getCanonicalViewId();
 
-    std::vector<TileDesc> invalidTiles;
     if(part == _clientSelectedPart || _isTextDocument)
     {
         for(int paneIdx = 0; paneIdx < numPanes; ++paneIdx)
@@ -1840,10 +2112,16 @@ void ClientSession::handleTileInvalidation(const std::string& message,
         }
     }
 
+    return invalidTiles;
+}
+
+void ClientSession::requestInvalidTiles(const std::vector<TileDesc>& invalidTiles,
+                                        const std::shared_ptr<DocumentBroker>& docBroker)
+{
     if(!invalidTiles.empty())
     {
         TileCombined tileCombined = TileCombined::create(invalidTiles);
-        tileCombined.setNormalizedViewId(normalizedViewId);
+        tileCombined.setNormalizedViewId(getCanonicalViewId());
         docBroker->handleTileCombinedRequest(tileCombined, client_from_this());
     }
 }
@@ -1893,6 +2171,85 @@ Util::Rectangle ClientSession::getNormalizedVisiblePaneArea(const SplitPaneName
     return Util::Rectangle();
 }
 
+void ClientSession::updateScrollVelocity(const Util::Rectangle& newArea)
+{
+    const auto now = std::chrono::steady_clock::now();
+
+    // Only a move is a scroll, not a resize.
+    if (_clientVisibleArea.hasSurface() &&
+        newArea.getWidth() == _clientVisibleArea.getWidth() &&
+        newArea.getHeight() == _clientVisibleArea.getHeight())
+    {
+        const double seconds = std::max(
+            std::chrono::duration_cast<std::chrono::milliseconds>(now - _lastScrollTime).count() / 1000.,
+            0.01);
+        const double velocityX = (newArea.getLeft() - _clientVisibleArea.getLeft()) / seconds;
+        const double velocityY = (newArea.getTop() - _clientVisibleArea.getTop()) / seconds;
+
+        // Smooth out the jitter, but follow a change of direction within a couple of moves.
+        _scrollVelocityX = (_scrollVelocityX + velocityX) / 2;
+        _scrollVelocityY = (_scrollVelocityY + velocityY) / 2;
+    }
+
+    _lastScrollTime = now;
+}
+
+Util::Rectangle ClientSession::getPrefetchArea() const
+{
+    const Util::Rectangle visibleArea = getNormalizedVisibleArea();
+    if (!visibleArea.hasSurface())
+        return Util::Rectangle();
+
+    int deltaX = 0;
+    int deltaY = 0;
+    if (std::abs(_scrollVelocityX) > std::abs(_scrollVelocityY))
+        deltaX = (_scrollVelocityX > 0 ? visibleArea.getWidth() : -visibleArea.getWidth());
+    else
+        deltaY = (_scrollVelocityY < 0 ? -visibleArea.getHeight() : visibleArea.getHeight());
+
+    Util::Rectangle area(visibleArea.getLeft() + deltaX, visibleArea.getTop() + deltaY,
+                         visibleArea.getWidth(), visibleArea.getHeight());
+
+    // There are no tiles before the start of the document.
+    area.setLeft(std::max(area.getLeft(), 0));
+    area.setTop(std::max(area.getTop(), 0));
+    return area.hasSurface() ? area : Util::Rectangle();
+}
+
+std::vector<TileDesc> ClientSession::takeTilesToPrefetch()
+{
+    std::vector<TileDesc> tiles;
+
+    const int part = (_isTextDocument ? 0 : _clientSelectedPart);
+    if (part < 0 || _tileWidthPixel <= 0 || _tileHeightPixel <= 0 ||
+        _tileWidthTwips <= 0 || _tileHeightTwips <= 0)
+        return tiles;
+
+    const Util::Rectangle area = getPrefetchArea();
+    if (!area.hasSurface() ||
+        (area.getLeft() == _prefetchArea.getLeft() && area.getTop() == _prefetchArea.getTop() &&
+         area.getRight() == _prefetchArea.getRight() && area.getBottom() == _prefetchArea.getBottom() &&
+         part == _prefetchPart && _tileWidthTwips == _prefetchTileWidthTwips))
+        return tiles;
+
+    _prefetchArea = area;
+    _prefetchPart = part;
+    _prefetchTileWidthTwips = _tileWidthTwips;
+
+    const int normalizedViewId = getCanonicalViewId();
+    for (int i = area.getTop() / _tileHeightTwips; i * _tileHeightTwips < area.getBottom(); ++i)
+    {
+        for (int j = area.getLeft() / _tileWidthTwips; j * _tileWidthTwips < area.getRight(); ++j)
+        {
+            tiles.emplace_back(normalizedViewId, part, _tileWidthPixel, _tileHeightPixel,
+                               j * _tileWidthTwips, i * _tileHeightTwips,
+                               _tileWidthTwips, _tileHeightTwips, -1, 0, -1, false);
+        }
+    }
+
+    return tiles;
+}
+
 bool ClientSession::isTileInsideVisibleArea(const TileDesc& tile) const
 {
     if (!_splitX && !_splitY)
@@ -1927,7 +2284,7 @@ void ClientSession::resetWireIdMap()
     _oldWireIds.clear();
 }
 
-void ClientSession::traceTileBySend(const TileDesc& tile, bool deduplicated)
+void ClientSession::traceTileBySend(const TileDesc& tile, size_t size, bool deduplicated)
 {
     const std::string tileID = tile.generateID();
 
@@ -1948,7 +2305,7 @@ void ClientSession::traceTileBySend(const TileDesc& tile, bool deduplicated)
 
     // Record that the tile is sent
     if (!deduplicated)
-        addTileOnFly(tile);
+        addTileOnFly(tile, size);
 }
 
 /* vim:set shiftwidth=4 softtabstop=4 expandtab: */
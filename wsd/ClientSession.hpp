@@ -13,11 +13,14 @@
 #include "Storage.hpp"
 #include "MessageQueue.hpp"
 #include "SenderQueue.hpp"
+#include "InvalidationFrame.hpp"
+#include "LinkEstimator.hpp"
 #include "ServerURL.hpp"
 #include "DocumentBroker.hpp"
 #include <Poco/URI.h>
 #include <Rectangle.hpp>
 #include <deque>
+#include <functional>
 #include <map>
 #include <list>
 #include <utility>
@@ -58,6 +61,9 @@ public:
     /// transition to a new state
     void setState(SessionState newState);
 
+    /// Load our view again, where it was, into the new kit of a rehydrated document.
+    void reloadView(const std::shared_ptr<DocumentBroker>& docBroker);
+
     void setDocumentOwner(const bool documentOwner) { _isDocumentOwner = documentOwner; }
     bool isDocumentOwner() const { return _isDocumentOwner; }
 
@@ -99,6 +105,9 @@ public:
         return true;
     }
 
+    /// Sends @message now, rather than when the poll next runs, for the
+    /// progress of what keeps the poll busy.
+    void sendTextFrameNow(const std::string& message);
 
     void enqueueSendMessage(const std::shared_ptr<Message>& data);
 
@@ -108,6 +117,8 @@ public:
         _saveAsSocket = socket;
     }
 
+    const std::shared_ptr<StreamSocket>& getSaveAsSocket() const { return _saveAsSocket; }
+
     std::shared_ptr<DocumentBroker> getDocumentBroker() const { return _docBroker.lock(); }
 
     /// Exact URI (including query params - access tokens etc.) with which
@@ -129,17 +140,41 @@ public:
     /// Get requested tiles waiting for sending to the client
     std::deque<TileDesc>& getRequestedTiles() { return _requestedTiles; }
 
-    /// Mark a new tile as sent
-    void addTileOnFly(const TileDesc& tile);
+    /// Mark a new tile of the given size in bytes as sent
+    void addTileOnFly(const TileDesc& tile, size_t size);
     void clearTilesOnFly();
     size_t getTilesOnFlyCount() const { return _tilesOnFly.size(); }
     void removeOutdatedTilesOnFly();
     size_t countIdenticalTilesOnFly(const TileDesc& tile) const;
 
+    /// Bandwidth and RTT estimates of the link to the client.
+    const LinkEstimator& getLinkEstimator() const { return _linkEstimator; }
+
+    /// Sends the tile invalidations paced into a frame, if it is due at @now or we @force it.
+    void flushInvalidations(std::chrono::steady_clock::time_point now, bool force = false);
+
+    /// Whether tile invalidations wait for their frame, and when it's due.
+    bool hasPendingInvalidations() const { return _invalidationFrame.isPending(); }
+    std::chrono::steady_clock::time_point getInvalidationDeadline() const { return _invalidationFrame.getDeadline(); }
+
+    /// The invalidatetiles: messages, and the tile requests, pacing saved us.
+    uint64_t getInvalidationsSaved() const { return _invalidationFrame.getMessagesIn() - _invalidationFrame.getMessagesOut(); }
+    uint64_t getTileRequestsSaved() const;
+
+    /// The sender queue of the client, for its statistics.
+    const SenderQueue<std::shared_ptr<Message>>& getSenderQueue() const { return _senderQueue; }
+
     Util::Rectangle getVisibleArea() const { return _clientVisibleArea; }
     /// Visible area can have negative value as position, but we have tiles only in the positive range
     Util::Rectangle getNormalizedVisibleArea() const;
 
+    /// The screen after the visible one in the direction the user scrolls, downwards by default.
+    Util::Rectangle getPrefetchArea() const;
+
+    /// The tiles of the prefetch area, unless we returned them already for the same
+    /// area, part and zoom. Empty if we don't know enough about the view yet.
+    std::vector<TileDesc> takeTilesToPrefetch();
+
     /// The client's visible area can be divided into a maximum of 4 panes.
     enum SplitPaneName {
         TOPLEFT_PANE,
@@ -159,13 +194,30 @@ public:
 
     /// This method updates internal data related to sent tiles (wireID and tiles-on-fly)
     /// Call this method anytime when a new tile is sent to the client
-    void traceTileBySend(const TileDesc& tile, bool deduplicated = false);
+    void traceTileBySend(const TileDesc& tile, size_t size, bool deduplicated = false);
 
     /// Clear wireId map anytime when client visible area changes (visible area, zoom, part number)
     void resetWireIdMap();
 
+    /// Drop the queued tiles of a zoom level the client left, if it is falling behind.
+    void dropObsoleteTiles();
+
+    /// Drop the queued prefetched tiles under the invalidation @message, which
+    /// is queued ahead of them and would leave them stale on the client.
+    void dropInvalidatedTiles(const std::string& message);
+
+    /// Drop the queued tiles of @priority or less urgent for which @obsolete returns true.
+    size_t dropQueuedTiles(SendPriority priority, const std::function<bool(const TileDesc&)>& obsolete);
+
+    /// Track the scrolling speed and direction as the visible area moves to @newArea.
+    void updateScrollVelocity(const Util::Rectangle& newArea);
+
     bool isTextDocument() const { return _isTextDocument; }
 
+    /// The size, in twips, of the document, or of its current part, as of the last status.
+    int getDocWidthTwips() const { return _docWidthTwips; }
+    int getDocHeightTwips() const { return _docHeightTwips; }
+
     /// Do we recognize this clipboard ?
     bool matchesClipboardKeys(const std::string &viewId, const std::string &tag);
 
@@ -209,6 +261,9 @@ private:
 
     bool loadDocument(const char* buffer, int length, const StringVector& tokens,
                       const std::shared_ptr<DocumentBroker>& docBroker);
+    /// The load request for the kit, of @loadPart if not negative, creating from the template if @fromTemplate.
+    std::string createLoadRequest(const std::shared_ptr<DocumentBroker>& docBroker, int loadPart,
+                                  bool fromTemplate) const;
     bool getStatus(const char* buffer, int length,
                    const std::shared_ptr<DocumentBroker>& docBroker);
     bool getCommandValues(const char* buffer, int length, const StringVector& tokens,
@@ -236,6 +291,12 @@ private:
     void handleTileInvalidation(const std::string& message,
                                 const std::shared_ptr<DocumentBroker>& docBroker);
 
+    /// The visible tiles of @part under @invalidateRect, to request again.
+    std::vector<TileDesc> getInvalidTiles(int part, Util::Rectangle invalidateRect);
+
+    void requestInvalidTiles(const std::vector<TileDesc>& invalidTiles,
+                             const std::shared_ptr<DocumentBroker>& docBroker);
+
     bool isTileInsideVisibleArea(const TileDesc& tile) const;
 
     /// If this session is read-only because of failed lock, try to unlock and make it read-write.
@@ -302,11 +363,37 @@ private:
     /// Client is using a text document?
     bool _isTextDocument;
 
+    /// The type of the document, as the kit reports it: text, spreadsheet, etc.
+    std::string _docType;
+
+    int _docWidthTwips;
+    int _docHeightTwips;
+
     /// Rotating clipboard remote access identifiers - protected by GlobalSessionMapMutex
     std::string _clipboardKeys[2];
 
     /// TileID's of the sent tiles. Push by sending and pop by tileprocessed message from the client.
-    std::vector<std::pair<std::string, std::chrono::steady_clock::time_point>> _tilesOnFly;
+    std::vector<std::pair<std::string, LinkEstimator::Sample>> _tilesOnFly;
+
+    /// Estimates the link to the client from tileprocessed and ping round-trips.
+    LinkEstimator _linkEstimator;
+
+    /// Smoothed speed of the visible area in twips per second, and when it last moved.
+    double _scrollVelocityX;
+    double _scrollVelocityY;
+    std::chrono::steady_clock::time_point _lastScrollTime;
+
+    /// The area, part and tile width (zoom) we last prefetched tiles for.
+    Util::Rectangle _prefetchArea;
+    int _prefetchPart;
+    int _prefetchTileWidthTwips;
+
+    /// The tile invalidations waiting for their frame.
+    InvalidationFrame _invalidationFrame;
+
+    /// The tiles the paced invalidations would have had us request, and those we did request.
+    uint64_t _invalidTilesUnpaced;
+    uint64_t _invalidTilesRequested;
 
     /// Requested tiles are stored in this list, before we can send them to the client
     std::deque<TileDesc> _requestedTiles;
@@ -320,6 +407,14 @@ private:
     /// Time when loading of view started
     std::chrono::steady_clock::time_point _viewLoadStart;
 
+    /// When the client connected, and whether the first tile of the view
+    /// is yet to be sent, to tell how long the user waited for something to see.
+    const std::chrono::steady_clock::time_point _connectTime;
+    bool _isFirstTileDue;
+
+    /// Set while the view is loaded again into a new kit, rather than for the first time.
+    bool _isViewReloading;
+
     /// Secure session id token for proxyprotocol authentication
     std::string _proxyAccess;
 };
@@ -0,0 +1,218 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 100 -*- */
+/*
+ * This file is part of the LibreOffice project.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "ConvertToQueue.hpp"
+
+class ChildProcess;
+
+/// A batch of documents that ConvertToBrokers convert one after another with the same kit.
+///
+/// Each document still gets a ConvertToBroker of its own. When one is done with
+/// the kit it leaves it here for the next, rather than terminating it or
+/// returning it to the pool, and the batch gets the results as they come.
+class ConvertToBatch
+{
+public:
+    /// A document to convert, stored at @_path.
+    struct Document
+    {
+        std::string _name;
+        std::string _path;
+    };
+
+    /// Creates the file of a document called @name, and returns its path.
+    using CreateFile = std::function<std::string(const std::string& name)>;
+
+    /// Reads the documents of a batch from the request, one at a time as they
+    /// are converted, so that only the one converting is on disk.
+    class Reader
+    {
+    public:
+        Reader()
+            : _failed(false)
+        {
+        }
+
+        virtual ~Reader() {}
+
+        /// Copies the next document to the path @createFile returns for its
+        /// name, or skips its data when @createFile is empty, and returns it in
+        /// @document. Returns false once there are no more, or on failure, when
+        /// @document has the path of the file it was writing, if any.
+        virtual bool next(const CreateFile& createFile, Document& document) = 0;
+
+        /// Whether the request is malformed, or a file couldn't be written.
+        bool isFailed() const { return _failed; }
+
+    protected:
+        bool _failed;
+    };
+
+    /// Reads the regular files of a tar archive.
+    class TarReader final : public Reader
+    {
+    public:
+        TarReader(std::istream& stream)
+            : _stream(stream)
+            , _ended(false)
+        {
+        }
+
+        bool next(const CreateFile& createFile, Document& document) override
+        {
+            constexpr size_t BlockSize = 512;
+
+            document = Document();
+            char header[BlockSize];
+            char buffer[64 * 1024];
+            while (!_ended && !_failed)
+            {
+                _stream.read(header, BlockSize);
+                if (_stream.gcount() == 0)
+                    break;
+                if (static_cast<size_t>(_stream.gcount()) != BlockSize)
+                    return fail();
+
+                // The archive ends with zero blocks.
+                if (header[0] == '\0')
+                    break;
+
+                // The name, with the ustar prefix, if any.
+                std::string name(header, strnlen(header, 100));
+                if (std::memcmp(header + 257, "ustar", 5) == 0 && header[345] != '\0')
+                    name = std::string(header + 345, strnlen(header + 345, 155)) + '/' + name;
+
+                const std::string sizeField(header + 124, strnlen(header + 124, 12));
+                char* end = nullptr;
+                const size_t size = std::strtoull(sizeField.c_str(), &end, 8);
+                if (end == sizeField.c_str())
+                    return fail();
+
+                const size_t slash = name.rfind('/');
+                const std::string fileName
+                    = (slash == std::string::npos ? name : name.substr(slash + 1));
+
+                // Skip directories, links, and the like.
+                const char type = header[156];
+                const bool regular = ((type == '0' || type == '\0') && !fileName.empty());
+                std::ofstream file;
+                if (regular && createFile)
+                {
+                    document = Document{ fileName, createFile(fileName) };
+                    file.open(document._path, std::ios::binary);
+                    if (!file)
+                        return fail();
+                }
+
+                // The data is padded to whole blocks.
+                const size_t padded = (size + BlockSize - 1) / BlockSize * BlockSize;
+                for (size_t left = padded; left > 0; )
+                {
+                    const size_t count = std::min(left, sizeof(buffer));
+                    _stream.read(buffer, count);
+                    if (static_cast<size_t>(_stream.gcount()) != count)
+                        return fail();
+
+                    const size_t used = padded - left;
+                    if (file.is_open() && used < size)
+                        file.write(buffer, std::min(count, size - used));
+
+                    left -= count;
+                }
+
+                if (file.is_open())
+                {
+                    file.close();
+                    if (!file)
+                        return fail();
+                }
+
+                if (regular)
+                {
+                    document._name = fileName;
+                    return true;
+                }
+            }
+
+            _ended = true;
+            return false;
+        }
+
+    private:
+        bool fail()
+        {
+            _failed = true;
+            return false;
+        }
+
+        std::istream& _stream;
+        bool _ended;
+    };
+
+    ConvertToBatch(const std::shared_ptr<ConvertToQueue::Ticket>& ticket)
+        : _ticket(ticket)
+        , _kitJobs(0)
+        , _kitInUse(false)
+        , _ended(false)
+    {
+    }
+
+    virtual ~ConvertToBatch() {}
+
+    /// Our place in the queue for a pooled kit, shared by the documents, if we use one.
+    const std::shared_ptr<ConvertToQueue::Ticket>& getTicket() const { return _ticket; }
+
+    /// Called in a ConvertToBroker's thread with document @index converted
+    /// to @resultPath, or empty on failure, unless the batch is gone. The file
+    /// is gone after this returns.
+    virtual void onConverted(size_t index, const std::string& resultPath) = 0;
+
+    /// Waits up to @timeout for the previous document to be done with our
+    /// @kit, and takes it with the number of @jobs it converted. The @kit is
+    /// nullptr when the caller is to get one, as for the first document.
+    /// Returns false on timeout, or once the batch ended, otherwise putKit() must follow.
+    bool takeKit_Blocks(std::shared_ptr<ChildProcess>& kit, size_t& jobs,
+                        std::chrono::milliseconds timeout);
+
+    /// Leaves the @kit, having converted @jobs documents, for the next
+    /// document, or nullptr if it can't convert any more.
+    void putKit(const std::shared_ptr<ChildProcess>& kit, size_t jobs);
+
+    /// Called once we convert no more documents, to return our kit to the
+    /// pool, or close it, as soon as the last document is done with it.
+    void endBatch();
+
+private:
+    const std::shared_ptr<ConvertToQueue::Ticket> _ticket;
+
+    std::mutex _kitMutex;
+    std::condition_variable _kitCV;
+    std::shared_ptr<ChildProcess> _kit;
+    size_t _kitJobs;
+    /// A document is converting, or getting a kit to.
+    bool _kitInUse;
+    bool _ended;
+};
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
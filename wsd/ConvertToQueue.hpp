@@ -0,0 +1,191 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 100 -*- */
+/*
+ * This file is part of the LibreOffice project.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+/// A bounded queue of conversions waiting for one of a limited number of kits.
+///
+/// Waiting conversions are served round-robin by tenant (the client address
+/// for convert-to), so one client posting a large batch can't starve the
+/// others: each tenant with work waiting gets the next free kit in turn.
+class ConvertToQueue
+{
+public:
+    /// A conversion's place in the queue.
+    class Ticket
+    {
+    public:
+        Ticket(const std::string& tenant)
+            : _tenant(tenant)
+            , _state(State::Queued)
+        {
+        }
+
+        const std::string& getTenant() const { return _tenant; }
+
+    private:
+        friend class ConvertToQueue;
+
+        enum class State { Queued, Running, Done };
+
+        const std::string _tenant;
+        State _state;
+    };
+
+    ConvertToQueue(const size_t maxRunning, const size_t maxQueued)
+        : _maxRunning(std::max<size_t>(maxRunning, 1))
+        , _maxQueued(maxQueued)
+        , _running(0)
+        , _queued(0)
+    {
+    }
+
+    /// Queues a conversion for @tenant. Returns nullptr when the queue is full.
+    std::shared_ptr<Ticket> enqueue(const std::string& tenant)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+
+        // Start right away if we can, otherwise wait if there is room.
+        if (_queued >= _maxQueued && _running >= _maxRunning)
+            return nullptr;
+
+        std::shared_ptr<Ticket> ticket = std::make_shared<Ticket>(tenant);
+        std::deque<std::shared_ptr<Ticket>>& waiting = _waiting[tenant];
+        if (waiting.empty())
+            _tenants.push_back(tenant);
+
+        waiting.push_back(ticket);
+        ++_queued;
+
+        schedule();
+        return ticket;
+    }
+
+    /// Waits up to @timeout for @ticket's turn to run.
+    /// Returns false on timeout, having removed it from the queue.
+    bool wait(const std::shared_ptr<Ticket>& ticket, const std::chrono::milliseconds timeout)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (_cv.wait_for(lock, timeout,
+                         [&ticket]() { return ticket->_state != Ticket::State::Queued; }))
+        {
+            return ticket->_state == Ticket::State::Running;
+        }
+
+        remove(ticket);
+        return false;
+    }
+
+    /// Gives up @ticket's kit when its conversion is finished, or its place
+    /// in the queue when it never got to run. Safe to call more than once.
+    void release(const std::shared_ptr<Ticket>& ticket)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (ticket->_state == Ticket::State::Running)
+        {
+            ticket->_state = Ticket::State::Done;
+            --_running;
+            schedule();
+        }
+        else if (ticket->_state == Ticket::State::Queued)
+        {
+            remove(ticket);
+        }
+    }
+
+    size_t getRunningCount() const
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        return _running;
+    }
+
+    size_t getQueuedCount() const
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        return _queued;
+    }
+
+private:
+    /// Starts waiting conversions while there are kits for them,
+    /// taking the first of each tenant in turn.
+    void schedule()
+    {
+        bool started = false;
+        while (_running < _maxRunning && !_tenants.empty())
+        {
+            const std::string tenant = _tenants.front();
+            _tenants.pop_front();
+
+            std::deque<std::shared_ptr<Ticket>>& waiting = _waiting[tenant];
+            waiting.front()->_state = Ticket::State::Running;
+            waiting.pop_front();
+            --_queued;
+            ++_running;
+            started = true;
+
+            // Back of the line for the tenant's next one.
+            if (waiting.empty())
+                _waiting.erase(tenant);
+            else
+                _tenants.push_back(tenant);
+        }
+
+        if (started)
+            _cv.notify_all();
+    }
+
+    void remove(const std::shared_ptr<Ticket>& ticket)
+    {
+        ticket->_state = Ticket::State::Done;
+
+        const auto it = _waiting.find(ticket->getTenant());
+        if (it == _waiting.end())
+            return;
+
+        std::deque<std::shared_ptr<Ticket>>& waiting = it->second;
+        const auto ticketIt = std::find(waiting.begin(), waiting.end(), ticket);
+        if (ticketIt == waiting.end())
+            return;
+
+        waiting.erase(ticketIt);
+        --_queued;
+        if (waiting.empty())
+        {
+            _waiting.erase(it);
+            _tenants.erase(std::remove(_tenants.begin(), _tenants.end(), ticket->getTenant()),
+                           _tenants.end());
+        }
+    }
+
+private:
+    const size_t _maxRunning;
+    const size_t _maxQueued;
+
+    mutable std::mutex _mutex;
+    std::condition_variable _cv;
+
+    /// The waiting conversions of each tenant, in order of arrival.
+    std::map<std::string, std::deque<std::shared_ptr<Ticket>>> _waiting;
+    /// Tenants with conversions waiting, in the order they'll be served.
+    std::deque<std::string> _tenants;
+
+    size_t _running;
+    size_t _queued;
+};
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
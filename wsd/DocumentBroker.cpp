@@ -11,15 +11,18 @@
 
 #include "DocumentBroker.hpp"
 
+#include <algorithm>
 #include <atomic>
 #include <cassert>
 #include <chrono>
 #include <ctime>
+#include <exception>
 #include <fstream>
 #include <sstream>
 
 #include <Poco/DigestStream.h>
 #include <Poco/Exception.h>
+#include <Poco/File.h>
 #include <Poco/JSON/Object.h>
 #include <Poco/Path.h>
 #include <Poco/SHA1Engine.h>
@@ -67,6 +70,25 @@ void ChildProcess::setDocumentBroker(const std::shared_ptr<DocumentBroker>& docB
 namespace
 {
 
+#if !MOBILEAPP
+/// Makes a handler of the download progress that gives @send the statusindicator:
+/// message to send to the client, as often as the user can follow it.
+WopiStorage::ProgressHandler makeDownloadProgressHandler(const std::function<void(const std::string&)>& send)
+{
+    std::chrono::steady_clock::time_point lastProgress;
+    return [send, lastProgress](uint64_t downloaded, uint64_t total) mutable
+        {
+            const auto now = std::chrono::steady_clock::now();
+            if (downloaded != total && now - lastProgress < std::chrono::milliseconds(100))
+                return;
+
+            lastProgress = now;
+            send("statusindicator: download bytes=" + std::to_string(downloaded) +
+                 " total=" + std::to_string(total));
+        };
+}
+#endif
+
 void sendLastModificationTime(const std::shared_ptr<Session>& session,
                               DocumentBroker* documentBroker,
                               const std::chrono::system_clock::time_point& documentLastModifiedTime)
@@ -162,8 +184,91 @@ public:
     }
 };
 
+/// A poll thread shared by many documents, see per_document.poll_threads.
+class DocumentBroker::SharedPoll final : public MultiplexedPoll
+{
+public:
+    SharedPoll(const std::string &threadName) :
+        MultiplexedPoll(threadName)
+    {
+    }
+
+    bool continuePolling() override
+    {
+        return MultiplexedPoll::continuePolling() && !SigUtil::getTerminationFlag();
+    }
+};
+
+/// The poll loop of a DocumentBroker in a SharedPoll.
+class DocumentBroker::SharedPollTask final : public MultiplexedPoll::Task
+{
+    /// The DocBrokers map keeps it alive until the loop finishes.
+    std::weak_ptr<DocumentBroker> _docBroker;
+
+public:
+    void setDocumentBroker(const std::shared_ptr<DocumentBroker>& docBroker)
+    {
+        _docBroker = docBroker;
+    }
+
+    bool run(std::chrono::steady_clock::time_point now) override
+    {
+        std::shared_ptr<DocumentBroker> docBroker = _docBroker.lock();
+        return docBroker && docBroker->runSharedPoll(now);
+    }
+
+    void abandon() override
+    {
+        std::shared_ptr<DocumentBroker> docBroker = _docBroker.lock();
+        if (docBroker && docBroker->_pollState != PollState::Finished)
+        {
+            LOG_WRN("Poll thread stopped under doc [" << docBroker->getDocKey() << "].");
+            docBroker->finishPolling();
+        }
+    }
+};
+
 std::atomic<unsigned> DocumentBroker::DocBrokerId(1);
 
+std::vector<std::shared_ptr<DocumentBroker::SharedPoll>> DocumentBroker::SharedPolls;
+
+/// How long to keep polling once stopped, to flush our sockets.
+static constexpr int64_t FlushTimeoutMicroS = POLL_TIMEOUT_MICRO_S * 2; // ~1000ms
+
+void DocumentBroker::startSharedPolls(const int count)
+{
+    assert(SharedPolls.empty());
+
+    for (int i = 0; i < count; ++i)
+    {
+        SharedPolls.push_back(std::make_shared<SharedPoll>("doc" SHARED_DOC_THREADNAME_SUFFIX "poll" + std::to_string(i)));
+        SharedPolls.back()->startThread();
+    }
+
+    if (count > 0)
+        LOG_INF("DocumentBrokers share " << count << " poll threads.");
+}
+
+void DocumentBroker::joinSharedPolls()
+{
+    for (const auto& poll : SharedPolls)
+        poll->joinThread();
+
+    SharedPolls.clear();
+}
+
+std::shared_ptr<DocumentBroker::SharedPoll> DocumentBroker::getLeastBusySharedPoll()
+{
+    std::shared_ptr<SharedPoll> leastBusy;
+    for (const auto& poll : SharedPolls)
+    {
+        if (!leastBusy || poll->getTaskCount() < leastBusy->getTaskCount())
+            leastBusy = poll;
+    }
+
+    return leastBusy;
+}
+
 DocumentBroker::DocumentBroker(ChildType type,
                                const std::string& uri,
                                const Poco::URI& uriPublic,
@@ -179,6 +284,9 @@ DocumentBroker::DocumentBroker(ChildType type,
     _lastStorageSaveSuccessful(true),
     _lastSaveTime(std::chrono::steady_clock::now()),
     _lastSaveRequestTime(std::chrono::steady_clock::now() - std::chrono::milliseconds(COMMAND_TIMEOUT_MS)),
+    _uploadedBytes(0),
+    _uploadSavedBytes(0),
+    _uploadsSkipped(0),
     _markToDestroy(false),
     _closeRequest(false),
     _isLoaded(false),
@@ -187,13 +295,22 @@ DocumentBroker::DocumentBroker(ChildType type,
     _cursorPosY(0),
     _cursorWidth(0),
     _cursorHeight(0),
-    _poll(new DocumentBrokerPoll("doc" SHARED_DOC_THREADNAME_SUFFIX + _docId, *this)),
+    _sharedPoll(getLeastBusySharedPoll()),
+    _pollState(PollState::Idle),
     _stop(false),
     _closeReason("stopped"),
     _lockCtx(new LockContext()),
     _tileVersion(0),
     _debugRenderedTileCount(0),
     _wopiLoadDuration(0),
+    _adminSent(0),
+    _adminRecv(0),
+    _limitLoadSecs(0),
+    _hibernated(false),
+    _rehydrating(false),
+    _rehydrateDone(false),
+    _sessionRequested(false),
+    _canShareKit(false),
     _mobileAppDocId(mobileAppDocId)
 {
     assert(!_docKey.empty());
@@ -203,6 +320,14 @@ DocumentBroker::DocumentBroker(ChildType type,
     assert(_mobileAppDocId > 0);
 #endif
 
+    if (_sharedPoll)
+    {
+        _poll = _sharedPoll;
+        _sharedPollTask = std::make_shared<SharedPollTask>();
+    }
+    else
+        _poll = std::make_shared<DocumentBrokerPoll>("doc" SHARED_DOC_THREADNAME_SUFFIX + _docId, *this);
+
     LOG_INF("DocumentBroker [" << LOOLWSD::anonymizeUrl(_uriPublic.toString()) <<
             "] created with docKey [" << _docKey << ']');
 }
@@ -220,11 +345,47 @@ void DocumentBroker::setupPriorities()
 
 void DocumentBroker::startThread()
 {
-    _poll->startThread();
+    if (!_sharedPoll)
+    {
+        _poll->startThread();
+        return;
+    }
+
+    PollState expected = PollState::Idle;
+    if (!_pollState.compare_exchange_strong(expected, PollState::Starting))
+        return; // Already running.
+
+    LOG_INF("Starting docBroker polling for docKey [" << _docKey << "] in " << _sharedPoll->name() << '.');
+
+    std::shared_ptr<DocumentBroker> docBroker = shared_from_this();
+    _sharedPollTask->setDocumentBroker(docBroker);
+    _sharedPoll->addTask(_sharedPollTask);
+
+    // Getting a child may block, which would stall all the documents in
+    // the poll, so that is the one thing done in a thread of its own,
+    // which we join as we go away.
+    assert(!_spawnThread.joinable());
+    const std::weak_ptr<DocumentBroker> weak = docBroker;
+    _spawnThread = std::thread([this, weak]()
+                {
+                    Util::setThreadName("docspawn_" + _docId);
+                    const std::shared_ptr<ChildProcess> child = requestChild_Blocks();
+                    _sharedPoll->addCallback([weak, child]()
+                                             {
+                                                 const std::shared_ptr<DocumentBroker> docBroker = weak.lock();
+                                                 if (docBroker)
+                                                     docBroker->startPolling(child);
+                                             });
+                });
 }
 
 void DocumentBroker::assertCorrectThread() const
 {
+    // Until we start and once we finish, we aren't tied to the shared poll's thread,
+    // just as when our own poll thread isn't running.
+    if (_sharedPoll && (_pollState == PollState::Idle || _pollState == PollState::Finished))
+        return;
+
     _poll->assertCorrectThread();
 }
 
@@ -233,30 +394,132 @@ void DocumentBroker::pollThread()
 {
     LOG_INF("Starting docBroker polling thread for docKey [" << _docKey << "].");
 
+    _pollState = PollState::Starting;
+    if (!startPolling(requestChild_Blocks()))
+        return;
+
+    // Main polling loop goodness.
+    int64_t timeoutMicroS = SocketPoll::DefaultPollTimeoutMicroS;
+    while (!_stop && _poll->continuePolling() && !SigUtil::getTerminationFlag())
+    {
+        _poll->poll(timeoutMicroS);
+
+        const auto now = std::chrono::steady_clock::now();
+        pollHousekeeping(now);
+        timeoutMicroS = flushInvalidations(now, SocketPoll::DefaultPollTimeoutMicroS);
+    }
+
+    stopPolling();
+
+    while (_poll->getSocketCount())
+    {
+        const auto now = std::chrono::steady_clock::now();
+        const int64_t elapsedMicroS = std::chrono::duration_cast<std::chrono::microseconds>(now - _flushStartTime).count();
+        if (elapsedMicroS > FlushTimeoutMicroS)
+            break;
+
+        _poll->poll(std::min(FlushTimeoutMicroS - elapsedMicroS, (int64_t)POLL_TIMEOUT_MICRO_S / 5));
+    }
+
+    finishPolling();
+}
+
+bool DocumentBroker::runSharedPoll(const std::chrono::steady_clock::time_point now)
+{
+    assertCorrectThread();
+
+    _sharedPollTask->setDeadline(now + std::chrono::microseconds(SocketPoll::DefaultPollTimeoutMicroS));
+
+    const PollState state = _pollState;
+    if (state == PollState::Idle || state == PollState::Starting)
+        return true; // Waiting for a child.
+
+    if (state == PollState::Finished)
+        return false;
+
+    if (state == PollState::Running)
+    {
+        if (!_stop && _poll->continuePolling() && !SigUtil::getTerminationFlag())
+        {
+            pollHousekeeping(now);
+            _sharedPollTask->setDeadline(
+                now + std::chrono::microseconds(flushInvalidations(now, SocketPoll::DefaultPollTimeoutMicroS)));
+
+            // Start flushing right away, as the dedicated loop would.
+            if (_stop)
+                wakeupPoll();
+
+            return true;
+        }
+
+        stopPolling();
+    }
+
+    const int64_t elapsedMicroS = std::chrono::duration_cast<std::chrono::microseconds>(now - _flushStartTime).count();
+    if (hasUnflushedSockets() && elapsedMicroS <= FlushTimeoutMicroS)
+    {
+        _sharedPollTask->setDeadline(now + std::chrono::microseconds(POLL_TIMEOUT_MICRO_S / 5));
+        return true;
+    }
+
+    finishPolling();
+    return false;
+}
+
+std::shared_ptr<ChildProcess> DocumentBroker::requestChild_Blocks()
+{
     _threadStart = std::chrono::steady_clock::now();
+    return waitForChild_Blocks(_threadStart);
+}
 
+std::shared_ptr<ChildProcess> DocumentBroker::waitForChild_Blocks(const std::chrono::steady_clock::time_point start)
+{
     // Request a kit process for this doc.
 #if !MOBILEAPP
+    // A read-only document takes a kit's offer to host it alongside others, if there is one.
+    if (_canShareKit && !isConvertTo())
+    {
+        std::shared_ptr<ChildProcess> child = getSharedKitChild();
+        if (child)
+        {
+            LOG_INF("Doc [" << _docKey << "] shares kit [" << child->getPid() << "].");
+            return child;
+        }
+    }
+
+    LOOLWSD::SpareKits.addRequest(start);
+
+    std::shared_ptr<ChildProcess> child;
     do
     {
         static const int timeoutMs = COMMAND_TIMEOUT_MS * 5;
-        _childProcess = getNewChild_Blocks();
-        if (_childProcess ||
+        child = getNewChild_Blocks();
+        if (child ||
             std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() -
-                                                                  _threadStart).count() > timeoutMs)
+                                                                  start).count() > timeoutMs)
             break;
 
         // Nominal time between retries, lest we busy-loop. getNewChild could also wait, so don't double that here.
         std::this_thread::sleep_for(std::chrono::milliseconds(CHILD_REBALANCE_INTERVAL_MS / 10));
     }
     while (!_stop && _poll->continuePolling() && !SigUtil::getTerminationFlag() && !SigUtil::getShutdownRequestFlag());
+
+    if (child)
+        LOOLWSD::SpareKits.addWaitTime(std::chrono::duration_cast<std::chrono::milliseconds>(
+                                           std::chrono::steady_clock::now() - start));
+
+    return child;
 #else
 #ifdef IOS
     assert(_mobileAppDocId > 0);
 #endif
-    _childProcess = getNewChild_Blocks(_mobileAppDocId);
+    return getNewChild_Blocks(_mobileAppDocId);
 #endif
+}
 
+bool DocumentBroker::startPolling(const std::shared_ptr<ChildProcess>& child)
+{
+    _childProcess = child;
     if (!_childProcess)
     {
         // Let the client know we can't serve now.
@@ -273,14 +536,15 @@ void DocumentBroker::pollThread()
         stop("Failed to get new child.");
 
         // Stop to mark it done and cleanup.
-        _poll->stop();
-        _poll->removeSockets();
+        releaseSockets();
+        _startupCallbacks.clear();
+        _pollState = PollState::Finished;
 
         // Async cleanup.
         LOOLWSD::doHousekeeping();
 
         LOG_INF("Finished docBroker polling thread for docKey [" << _docKey << "].");
-        return;
+        return false;
     }
 
     _childProcess->setDocumentBroker(shared_from_this());
@@ -288,19 +552,15 @@ void DocumentBroker::pollThread()
 
     setupPriorities();
 
-    static const bool AutoSaveEnabled = !std::getenv("LOOL_NO_AUTOSAVE");
-
+    const auto now = std::chrono::steady_clock::now();
 #if !MOBILEAPP
-    static const size_t IdleDocTimeoutSecs = LOOLWSD::getConfigValue<int>(
-                                                      "per_document.idle_timeout_secs", 3600);
-
     // Used to accumulate B/W deltas.
-    uint64_t adminSent = 0;
-    uint64_t adminRecv = 0;
-    auto lastBWUpdateTime = std::chrono::steady_clock::now();
-    auto lastClipboardHashUpdateTime = std::chrono::steady_clock::now();
+    _adminSent = 0;
+    _adminRecv = 0;
+    _lastBWUpdateTime = now;
+    _lastClipboardHashUpdateTime = now;
 
-    const int limit_load_secs =
+    _limitLoadSecs =
 #ifdef ENABLE_DEBUG
         // paused waiting for a debugger to attach
         // ignore load time out
@@ -308,155 +568,463 @@ void DocumentBroker::pollThread()
 #endif
         LOOLWSD::getConfigValue<int>("per_document.limit_load_secs", 100);
 
-    const auto loadDeadline = std::chrono::steady_clock::now() + std::chrono::seconds(limit_load_secs);
+    _loadDeadline = now + std::chrono::seconds(_limitLoadSecs);
 #endif
-    auto last30SecCheckTime = std::chrono::steady_clock::now();
+    _last30SecCheckTime = now;
 
-    // Main polling loop goodness.
-    while (!_stop && _poll->continuePolling() && !SigUtil::getTerminationFlag())
-    {
-        _poll->poll(SocketPoll::DefaultPollTimeoutMicroS);
+    _pollState = PollState::Running;
 
-        const auto now = std::chrono::steady_clock::now();
+    // Now we can take the sessions that came while we waited for the child.
+    std::vector<SocketPoll::CallbackFn> callbacks;
+    std::swap(callbacks, _startupCallbacks);
+    for (const auto& callback : callbacks)
+        callback();
+
+    return true;
+}
+
+void DocumentBroker::pollHousekeeping(const std::chrono::steady_clock::time_point now)
+{
+    if (_upload && _upload->_done)
+        finishUpload();
 
 #if !MOBILEAPP
-        // a tile's data is ~8k, a 4k screen is ~128 256x256 tiles
-        if (_tileCache)
-            _tileCache->setMaxCacheSize(8 * 1024 * 128 * _sessions.size());
+    if (_download && _download->_done)
+        finishDownload();
+#endif
 
-        if (!_isLoaded && (limit_load_secs > 0) && (now > loadDeadline))
-        {
-            LOG_ERR("Doc [" << _docKey << "] is taking too long to load. Will kill process ["
-                    << _childProcess->getPid() << "]. per_document.limit_load_secs set to "
-                    << limit_load_secs << " secs.");
-            broadcastMessage("error: cmd=load kind=docloadtimeout");
+    if (_rehydrating && _rehydrateDone)
+        finishRehydrate();
 
-            // Brutal but effective.
-            if (_childProcess)
-                _childProcess->terminate();
+    static const bool AutoSaveEnabled = !std::getenv("LOOL_NO_AUTOSAVE");
 
-            stop("Load timed out");
-            continue;
-        }
+#if !MOBILEAPP
+    static const size_t IdleDocTimeoutSecs = LOOLWSD::getConfigValue<int>(
+                                                      "per_document.idle_timeout_secs", 3600);
+    static const size_t HibernateIdleSecs = LOOLWSD::getConfigValue<int>(
+                                                      "per_document.hibernate_idle_secs", 0);
 
-        if (_limitLifeSeconds > 0 &&
-            std::chrono::duration_cast<std::chrono::seconds>(now - _threadStart).count() > _limitLifeSeconds)
-        {
-            LOG_WRN("Doc [" << _docKey << "] is taking too long to convert. Will kill process ["
-                            << _childProcess->getPid() << "]. per_document.limit_convert_secs set to "
-                            << _limitLifeSeconds << " secs.");
-            broadcastMessage("error: cmd=load kind=docexpired");
+    // a tile's data is ~8k, a 4k screen is ~128 256x256 tiles
+    if (_tileCache)
+        _tileCache->setMaxCacheSize(8 * 1024 * 128 * _sessions.size());
 
-            // Brutal but effective.
-            if (_childProcess)
-                _childProcess->terminate();
+    if (!_isLoaded && (_limitLoadSecs > 0) && (now > _loadDeadline))
+    {
+        LOG_ERR("Doc [" << _docKey << "] is taking too long to load. Will kill process ["
+                << _childProcess->getPid() << "]. per_document.limit_load_secs set to "
+                << _limitLoadSecs << " secs.");
+        broadcastMessage("error: cmd=load kind=docloadtimeout");
 
-            stop("Load timed out");
-            continue;
-        }
+        // Brutal but effective.
+        if (_childProcess)
+            _childProcess->terminate();
 
-        if (std::chrono::duration_cast<std::chrono::milliseconds>
-                    (now - lastBWUpdateTime).count() >= COMMAND_TIMEOUT_MS)
-        {
-            lastBWUpdateTime = now;
-            uint64_t sent = 0, recv = 0;
-            getIOStats(sent, recv);
+        stop("Load timed out");
+        return;
+    }
 
-            uint64_t deltaSent = 0, deltaRecv = 0;
+    if (_limitLifeSeconds > 0 &&
+        std::chrono::duration_cast<std::chrono::seconds>(now - _threadStart).count() > _limitLifeSeconds)
+    {
+        LOG_WRN("Doc [" << _docKey << "] is taking too long to convert. Will kill process ["
+                        << _childProcess->getPid() << "]. per_document.limit_convert_secs set to "
+                        << _limitLifeSeconds << " secs.");
+        broadcastMessage("error: cmd=load kind=docexpired");
 
-            // connection drop transiently reduces this.
-            if (sent > adminSent)
-            {
-                deltaSent = sent - adminSent;
-                adminSent = sent;
-            }
-            if (recv > deltaRecv)
-            {
-                deltaRecv = recv - adminRecv;
-                adminRecv = recv;
-            }
-            LOG_TRC("Doc [" << _docKey << "] added stats sent: +" << deltaSent << ", recv: +" << deltaRecv << " bytes to totals.");
+        // Brutal but effective.
+        if (_childProcess)
+            _childProcess->terminate();
 
-            // send change since last notification.
-            Admin::instance().addBytes(getDocKey(), deltaSent, deltaRecv);
-        }
+        stop("Load timed out");
+        return;
+    }
 
-        if (_storage && _lockCtx->needsRefresh(now))
-            refreshLock();
-#endif
+    if (std::chrono::duration_cast<std::chrono::milliseconds>
+                (now - _lastBWUpdateTime).count() >= COMMAND_TIMEOUT_MS)
+    {
+        _lastBWUpdateTime = now;
+        uint64_t sent = 0, recv = 0;
+        getIOStats(sent, recv);
 
-        if (isSaving() &&
-            std::chrono::duration_cast<std::chrono::milliseconds>
-                    (now - _lastSaveRequestTime).count() <= COMMAND_TIMEOUT_MS)
+        uint64_t deltaSent = 0, deltaRecv = 0;
+
+        // connection drop transiently reduces this.
+        if (sent > _adminSent)
         {
-            // We are saving, nothing more to do but wait (until we save or we timeout).
-            continue;
+            deltaSent = sent - _adminSent;
+            _adminSent = sent;
         }
+        if (recv > deltaRecv)
+        {
+            deltaRecv = recv - _adminRecv;
+            _adminRecv = recv;
+        }
+        LOG_TRC("Doc [" << _docKey << "] added stats sent: +" << deltaSent << ", recv: +" << deltaRecv << " bytes to totals.");
+
+        // send change since last notification.
+        Admin::instance().addBytes(getDocKey(), deltaSent, deltaRecv);
 
-        if (SigUtil::getShutdownRequestFlag() || _closeRequest)
+        if (_tileCache)
+            Admin::instance().setDocPrefetchStats(getDocKey(), _tileCache->getPrefetchCount(),
+                                                  _tileCache->getPrefetchHitCount());
+
+        for (const auto& it : _sessions)
         {
-            const std::string reason = SigUtil::getShutdownRequestFlag() ? "recycling" : _closeReason;
-            LOG_INF("Autosaving DocumentBroker for docKey [" << getDocKey() << "] for " << reason);
-            if (!autoSave(isPossiblyModified()))
-            {
-                LOG_INF("Terminating DocumentBroker for docKey [" << getDocKey() << "].");
-                stop(reason);
-            }
+            const LinkEstimator& link = it.second->getLinkEstimator();
+            if (link.hasEstimate())
+                Admin::instance().setViewLinkEstimate(getDocKey(), it.first,
+                                                      std::chrono::duration_cast<std::chrono::milliseconds>(link.getMinRtt()),
+                                                      link.getBandwidth());
+
+            Admin::instance().setViewInvalidationStats(getDocKey(), it.first,
+                                                       it.second->getInvalidationsSaved(),
+                                                       it.second->getTileRequestsSaved());
+
+            const SenderQueue<std::shared_ptr<Message>>& queue = it.second->getSenderQueue();
+            Admin::instance().setViewSenderQueueStats(getDocKey(), it.first, queue.size(),
+                                                      queue.getMaxSize(), queue.getDedupHitCount(),
+                                                      queue.getDroppedCount());
         }
-        else if (AutoSaveEnabled && !_stop &&
-                 std::chrono::duration_cast<std::chrono::seconds>(now - last30SecCheckTime).count() >= 30)
+    }
+
+    if (_storage && !isUploading() && !isDownloading() && _lockCtx->needsRefresh(now))
+        refreshLock();
+#endif
+
+    if (isSaving() &&
+        std::chrono::duration_cast<std::chrono::milliseconds>
+                (now - _lastSaveRequestTime).count() <= COMMAND_TIMEOUT_MS)
+    {
+        // We are saving, nothing more to do but wait (until we save or we timeout).
+        return;
+    }
+
+    prefetchTiles();
+
+    // Saving again, closing, or hibernating wait for the upload, which wakes us up once done.
+    if (isUploading())
+        return;
+
+    if (SigUtil::getShutdownRequestFlag() || _closeRequest)
+    {
+        const std::string reason = SigUtil::getShutdownRequestFlag() ? "recycling" : _closeReason;
+        LOG_INF("Autosaving DocumentBroker for docKey [" << getDocKey() << "] for " << reason);
+        if (!autoSave(isPossiblyModified()))
         {
-            LOG_TRC("Triggering an autosave.");
-            autoSave(false);
-            last30SecCheckTime = std::chrono::steady_clock::now();
+            LOG_INF("Terminating DocumentBroker for docKey [" << getDocKey() << "].");
+            stop(reason);
         }
+    }
+    else if (AutoSaveEnabled && !_stop &&
+             std::chrono::duration_cast<std::chrono::seconds>(now - _last30SecCheckTime).count() >= 30)
+    {
+        LOG_TRC("Triggering an autosave.");
+        autoSave(false);
+        _last30SecCheckTime = std::chrono::steady_clock::now();
+    }
 
 #if !MOBILEAPP
-        if (std::chrono::duration_cast<std::chrono::minutes>(now - lastClipboardHashUpdateTime).count() >= 2)
-        for (auto &it : _sessions)
+    if (std::chrono::duration_cast<std::chrono::minutes>(now - _lastClipboardHashUpdateTime).count() >= 2)
+    for (auto &it : _sessions)
+    {
+        if (it.second->staleWaitDisconnect(now))
         {
-            if (it.second->staleWaitDisconnect(now))
-            {
-                std::string id = it.second->getId();
-                LOG_WRN("Unusual, Kit session " + id + " failed its disconnect handshake, killing");
-                finalRemoveSession(id);
-                break; // it invalid.
-            }
+            std::string id = it.second->getId();
+            LOG_WRN("Unusual, Kit session " + id + " failed its disconnect handshake, killing");
+            finalRemoveSession(id);
+            break; // it invalid.
         }
+    }
 
-        if (std::chrono::duration_cast<std::chrono::minutes>(now - lastClipboardHashUpdateTime).count() >= 5)
-        {
-            LOG_TRC("Rotating clipboard keys");
-            for (auto &it : _sessions)
-                it.second->rotateClipboardKey(true);
+    if (std::chrono::duration_cast<std::chrono::minutes>(now - _lastClipboardHashUpdateTime).count() >= 5)
+    {
+        LOG_TRC("Rotating clipboard keys");
+        for (auto &it : _sessions)
+            it.second->rotateClipboardKey(true);
+
+        _lastClipboardHashUpdateTime = now;
+    }
 
-            lastClipboardHashUpdateTime = now;
+    // Let the kit of documents idle for a while go, until they are used again.
+    if (HibernateIdleSecs > 0 && !_hibernated && _childProcess && isLoaded() && !isConvertTo() &&
+        !_documentChangedInStorage && !_markToDestroy && !_sessions.empty() &&
+        getIdleTimeSecs() >= HibernateIdleSecs && getIdleTimeSecs() < IdleDocTimeoutSecs &&
+        std::all_of(_sessions.begin(), _sessions.end(),
+                    [](const std::pair<const std::string, std::shared_ptr<ClientSession>>& it)
+                    { return it.second->isViewLoaded(); }))
+    {
+        // Only the read-only sessions can't save, and they can't have modified it either.
+        if (isModified() || (isPossiblyModified() && haveAnotherEditableSession(std::string())))
+        {
+            LOG_INF("Autosaving idle DocumentBroker for docKey [" << getDocKey() << "] to hibernate.");
+            autoSave(true);
         }
+        else if (hibernate())
+            return;
+    }
 
-        // Remove idle documents after 1 hour.
-        if (isLoaded() && getIdleTimeSecs() >= IdleDocTimeoutSecs)
+    // Remove idle documents after 1 hour.
+    if (isLoaded() && getIdleTimeSecs() >= IdleDocTimeoutSecs)
+    {
+        // Stop if there is nothing to save.
+        LOG_INF("Autosaving idle DocumentBroker for docKey [" << getDocKey() << "] to kill.");
+        if (!autoSave(isPossiblyModified()))
         {
-            // Stop if there is nothing to save.
-            LOG_INF("Autosaving idle DocumentBroker for docKey [" << getDocKey() << "] to kill.");
-            if (!autoSave(isPossiblyModified()))
-            {
-                LOG_INF("Terminating idle DocumentBroker for docKey [" << getDocKey() << "].");
-                stop("idle");
-            }
+            LOG_INF("Terminating idle DocumentBroker for docKey [" << getDocKey() << "].");
+            stop("idle");
         }
+    }
 #endif
-        else if (_sessions.empty() && (isLoaded() || _markToDestroy))
+    else if (_sessions.empty() && (isLoaded() || _markToDestroy))
+    {
+        // If all sessions have been removed, no reason to linger.
+        LOG_INF("Terminating dead DocumentBroker for docKey [" << getDocKey() << "].");
+        stop("dead");
+    }
+}
+
+bool DocumentBroker::hibernate()
+{
+    assertCorrectThread();
+
+    const pid_t pid = getPid();
+    if (!putAside())
+        return false;
+
+    LOG_INF("Hibernated doc [" << _docKey << "], idle for " << getIdleTimeSecs() <<
+            " secs, letting its kit [" << pid << "] go.");
+
+#if !MOBILEAPP
+    Admin::instance().addHibernation();
+#endif
+    return true;
+}
+
+bool DocumentBroker::putAside()
+{
+    assertCorrectThread();
+
+    // Out of the jail, which goes with the kit.
+    const std::string localPath = _storage->getRootFilePath();
+    const Poco::Path hibernatedDir(LOOLWSD::ChildRoot, "tmp/hibernated/" + _docId);
+    const std::string hibernatedPath = Poco::Path(hibernatedDir, Poco::Path(localPath).getFileName()).toString();
+    try
+    {
+        Poco::File(hibernatedDir).createDirectories();
+    }
+    catch (const Poco::Exception& exc)
+    {
+        LOG_ERR("Failed to create [" << hibernatedDir.toString() << "] to put doc [" <<
+                _docKey << "] aside: " << exc.displayText());
+        return false;
+    }
+
+    // Keep the timestamp, which tells whether the kit saved it since we last uploaded it.
+    if (!FileUtil::copyAtomic(localPath, hibernatedPath, /*preserveTimestamps=*/true))
+    {
+        LOG_ERR("Failed to put doc [" << _docKey << "] aside.");
+        return false;
+    }
+
+#if !MOBILEAPP
+    Admin::instance().rmDoc(_docKey);
+#endif
+
+    removeFromSharedKit();
+
+    // Out of our poll first, lest its going looks like it died on us.
+    const std::shared_ptr<ChildProcess> child = detachChild();
+    child->close();
+
+    _hibernated = true;
+    _hibernatedPath = hibernatedPath;
+    return true;
+}
+
+void DocumentBroker::leaveSharedKit(const std::shared_ptr<ClientSession>& session)
+{
+    assertCorrectThread();
+
+    LOG_INF("Session [" << session->getId() << "] edits doc [" << _docKey <<
+            "], moving it out of shared kit [" << getPid() << "].");
+    if (!putAside())
+    {
+        LOG_ERR("Doc [" << _docKey << "] stays in its shared kit, so session [" <<
+                session->getId() << "] is read-only.");
+        session->setReadOnly();
+        return;
+    }
+
+    // The views the kit was still loading are loaded into the next, with those it loaded.
+    const std::shared_ptr<DocumentBroker> docBroker = shared_from_this();
+    for (const auto& it : _sessions)
+    {
+        if (!it.second->isViewLoaded() && !it.second->getDocURL().empty())
+            it.second->reloadView(docBroker);
+    }
+
+    rehydrate();
+}
+
+void DocumentBroker::rehydrate()
+{
+    assertCorrectThread();
+
+    if (!_hibernated || _rehydrating || _stop)
+        return;
+
+    LOG_INF("Rehydrating doc [" << _docKey << "].");
+    _rehydrating = true;
+    _rehydrateStart = std::chrono::steady_clock::now();
+
+    // Waking up is activity, lest we hibernate again right away.
+    _lastActivityTime = _rehydrateStart;
+
+    // Getting a child may block, and we may be sharing our poll thread, as when we start.
+    // We wait for the thread before we go away, and let its child go if we stopped.
+    const std::chrono::steady_clock::time_point start = _rehydrateStart;
+    _rehydrateDone = false;
+    _rehydrateThread = std::thread([this, start]()
         {
-            // If all sessions have been removed, no reason to linger.
-            LOG_INF("Terminating dead DocumentBroker for docKey [" << getDocKey() << "].");
-            stop("dead");
-        }
+            Util::setThreadName("docwake_" + _docId);
+            _rehydrateChild = waitForChild_Blocks(start);
+            _rehydrateDone = true;
+            wakeupPoll();
+        });
+}
+
+void DocumentBroker::finishRehydrate()
+{
+    assertCorrectThread();
+
+    _rehydrateThread.join();
+    std::shared_ptr<ChildProcess> child;
+    std::swap(child, _rehydrateChild);
+    rehydrateInto(child);
+}
+
+void DocumentBroker::abandonRehydrate()
+{
+    if (!_rehydrateThread.joinable())
+        return;
+
+    _rehydrateThread.join();
+    _rehydrating = false;
+    if (_rehydrateChild)
+    {
+        LOG_DBG("Closing child [" << _rehydrateChild->getPid() << "] we got to rehydrate doc ["
+                                  << _docKey << "] as we stopped.");
+        _rehydrateChild->close();
+        _rehydrateChild.reset();
+    }
+}
+
+void DocumentBroker::rehydrateInto(const std::shared_ptr<ChildProcess>& child)
+{
+    assertCorrectThread();
+
+    _rehydrating = false;
+    if (_stop)
+    {
+        if (child)
+            child->close();
+        return;
+    }
+
+    if (!child)
+    {
+        LOG_ERR("Failed to get a new child to rehydrate doc [" << _docKey << "].");
+        stop("Failed to get new child.");
+        return;
+    }
+
+    // A session that edits it came while we got a kit shared with other documents.
+    if (child->isSharedKit() && !_canShareKit)
+    {
+        LOG_INF("Doc [" << _docKey << "] is edited, getting a kit of its own to rehydrate.");
+        child->close();
+        rehydrate();
+        return;
+    }
+
+    _childProcess = child;
+    _childProcess->setDocumentBroker(shared_from_this());
+    LOG_INF("Doc [" << _docKey << "] attached to child [" << _childProcess->getPid() << "] to rehydrate.");
+
+    setupPriorities();
+
+    // user/doc/jailId, as when loading.
+    _jailId = _childProcess->getJailId();
+    std::string localPath;
+    try
+    {
+        localPath = _storage->moveToJail(getJailRoot(), getJailedDocumentDir(_jailId), _hibernatedPath);
+    }
+    catch (const std::exception& exc)
+    {
+        LOG_ERR("Failed to rehydrate doc [" << _docKey << "]: " << exc.what());
+        stop("Failed to rehydrate.");
+        return;
+    }
+
+    FileUtil::removeFile(_hibernatedPath);
+    _hibernatedPath.clear();
+
+    std::string localPathEncoded;
+    Poco::URI::encode(localPath, "#?", localPathEncoded);
+    _uriJailed = Poco::URI(Poco::URI("file://"), localPathEncoded).toString();
+    _uriJailedAnonym = Poco::URI(Poco::URI("file://"), LOOLWSD::anonymizeUrl(localPathEncoded)).toString();
+
+    _hibernated = false;
+
+    // The sessions that came while hibernated are loading, and their load request is held with the rest.
+    const std::shared_ptr<DocumentBroker> docBroker = shared_from_this();
+    for (const auto& it : _sessions)
+    {
+        const std::shared_ptr<ClientSession> session = it.second;
+        _childProcess->sendTextFrame("session " + session->getId() + ' ' + _docKey + ' ' + _docId +
+                                     (isKitReusable() ? " reusable" : ""));
+#if !MOBILEAPP
+        Admin::instance().addDoc(_docKey, getPid(), getFilename(), session->getId(), session->getUserName(),
+                                 session->getUserId(), _childProcess->getSMapsFD());
+#endif
+        if (session->isViewLoaded())
+            session->reloadView(docBroker);
+    }
+
+    std::vector<std::pair<std::string, std::string>> messages;
+    std::swap(messages, _heldMessages);
+    for (const auto& message : messages)
+    {
+        if (message.first.empty())
+            _childProcess->sendTextFrame(message.second);
+        else
+            forwardToChild(message.first, message.second);
     }
+}
 
+void DocumentBroker::sendToChild(const std::string& message)
+{
+    if (_hibernated)
+    {
+        _heldMessages.emplace_back(std::string(), message);
+        rehydrate();
+        return;
+    }
+
+    _childProcess->sendTextFrame(message);
+}
+
+void DocumentBroker::stopPolling()
+{
     LOG_INF("Finished polling doc [" << _docKey << "]. stop: " << _stop << ", continuePolling: " <<
             _poll->continuePolling() << ", ShutdownRequestFlag: " << SigUtil::getShutdownRequestFlag() <<
             ", TerminationFlag: " << SigUtil::getTerminationFlag() << ", closeReason: " << _closeReason << ". Flushing socket.");
 
+    // A download, if any, we join as we go away, not to stall the other
+    // documents sharing our poll thread.
+    waitForUpload();
+
     if (isModified())
     {
         std::stringstream state;
@@ -464,25 +1032,23 @@ void DocumentBroker::pollThread()
         LOG_ERR("DocumentBroker stopping although modified " << state.str());
     }
 
+    // A kit that can serve another document goes back to its pool, rather than be terminated.
+    if (_childProcess && recycleChild())
+        LOG_INF("Doc [" << _docKey << "] handed its child over for another document.");
+
     // Flush socket data first.
-    constexpr int64_t flushTimeoutMicroS = POLL_TIMEOUT_MICRO_S * 2; // ~1000ms
     LOG_INF("Flushing socket for doc ["
-            << _docKey << "] for " << flushTimeoutMicroS << " us. stop: " << _stop
+            << _docKey << "] for " << FlushTimeoutMicroS << " us. stop: " << _stop
             << ", continuePolling: " << _poll->continuePolling()
             << ", ShutdownRequestFlag: " << SigUtil::getShutdownRequestFlag()
             << ", TerminationFlag: " << SigUtil::getTerminationFlag()
             << ". Terminating child with reason: [" << _closeReason << "].");
-    const auto flushStartTime = std::chrono::steady_clock::now();
-    while (_poll->getSocketCount())
-    {
-        const auto now = std::chrono::steady_clock::now();
-        const int64_t elapsedMicroS = std::chrono::duration_cast<std::chrono::microseconds>(now - flushStartTime).count();
-        if (elapsedMicroS > flushTimeoutMicroS)
-            break;
-
-        _poll->poll(std::min(flushTimeoutMicroS - elapsedMicroS, (int64_t)POLL_TIMEOUT_MICRO_S / 5));
-    }
+    _flushStartTime = std::chrono::steady_clock::now();
+    _pollState = PollState::Flushing;
+}
 
+void DocumentBroker::finishPolling()
+{
     LOG_INF("Finished flushing socket for doc [" << _docKey << "]. stop: " << _stop << ", continuePolling: " <<
             _poll->continuePolling() << ", ShutdownRequestFlag: " << SigUtil::getShutdownRequestFlag() <<
             ", TerminationFlag: " << SigUtil::getTerminationFlag() << ". Terminating child with reason: [" << _closeReason << "].");
@@ -490,9 +1056,19 @@ void DocumentBroker::pollThread()
     // Terminate properly while we can.
     terminateChild(_closeReason);
 
+    // Getting a kit to rehydrate into, if we are, gives up as we stopped; we
+    // close it as we go away, not to stall the other documents sharing our poll thread.
+    if (!_hibernatedPath.empty())
+        FileUtil::removeFile(_hibernatedPath);
+
+    removeFromSharedKit();
+
+    // The sessions that waited for the download won't be added.
+    _downloadCallbacks.clear();
+
     // Stop to mark it done and cleanup.
-    _poll->stop();
-    _poll->removeSockets();
+    releaseSockets();
+    _startupCallbacks.clear();
 
 #if !MOBILEAPP
     // Async cleanup.
@@ -502,12 +1078,89 @@ void DocumentBroker::pollThread()
     if (_tileCache)
         _tileCache->clear();
 
+    _pollState = PollState::Finished;
+
     LOG_INF("Finished docBroker polling thread for docKey [" << _docKey << "].");
 }
 
+std::shared_ptr<ChildProcess> DocumentBroker::detachChild()
+{
+    assertCorrectThread();
+
+    std::shared_ptr<ChildProcess> child;
+    std::swap(child, _childProcess);
+
+    const std::shared_ptr<Socket> socket = (child ? child->_socket : nullptr);
+    if (socket)
+    {
+        _poll->removeSocket(socket);
+        std::lock_guard<std::mutex> lock(_socketsMutex);
+        _sockets.erase(std::remove_if(_sockets.begin(), _sockets.end(),
+                                      [&socket](const std::weak_ptr<Socket>& weak)
+                                      { return weak.lock() == socket; }),
+                       _sockets.end());
+    }
+
+    return child;
+}
+
+void DocumentBroker::releaseSockets()
+{
+    if (!_sharedPoll)
+    {
+        _poll->stop();
+        _poll->removeSockets();
+        return;
+    }
+
+    // Leave the other documents' sockets in the shared poll.
+    std::lock_guard<std::mutex> lock(_socketsMutex);
+    for (const auto& weak : _sockets)
+    {
+        const std::shared_ptr<Socket> socket = weak.lock();
+        if (socket)
+            _sharedPoll->removeSocket(socket);
+    }
+
+    _sockets.clear();
+}
+
+bool DocumentBroker::hasUnflushedSockets() const
+{
+    std::lock_guard<std::mutex> lock(_socketsMutex);
+    for (const auto& weak : _sockets)
+    {
+        const std::shared_ptr<StreamSocket> socket = std::dynamic_pointer_cast<StreamSocket>(weak.lock());
+        if (socket && !socket->isClosed() && !socket->getOutBuffer().empty())
+            return true;
+    }
+
+    return false;
+}
+
+void DocumentBroker::wakeupPoll()
+{
+    if (_sharedPollTask)
+        _sharedPoll->wakeupTask(*_sharedPollTask);
+    else
+        _poll->wakeup();
+}
+
+void DocumentBroker::housekeepSoon()
+{
+    // A dedicated poll loop does its housekeeping after every event anyway.
+    if (_sharedPollTask)
+        _sharedPoll->wakeupTask(*_sharedPollTask);
+}
+
 bool DocumentBroker::isAlive() const
 {
-    if (!_stop || _poll->isAlive())
+    if (_sharedPoll)
+    {
+        if (!_stop || _pollState != PollState::Finished)
+            return true; // Not started or still running.
+    }
+    else if (!_stop || _poll->isAlive())
         return true; // Polling thread not started or still running.
 
     // Shouldn't have live child process outside of the polling thread.
@@ -526,7 +1179,17 @@ DocumentBroker::~DocumentBroker()
             "] destroyed with " << _sessions.size() << " sessions left.");
 
     // Do this early - to avoid operating on _childProcess from two threads.
-    _poll->joinThread();
+    joinThread();
+
+    // Our poll waits for the upload as it stops, should it not have stopped,
+    // but leaves the download, and getting a child, to us.
+    if (_upload && _upload->_thread.joinable())
+        _upload->_thread.join();
+    if (_download && _download->_thread.joinable())
+        _download->_thread.join();
+    if (_spawnThread.joinable())
+        _spawnThread.join();
+    abandonRehydrate();
 
     if (!_sessions.empty())
         LOG_WRN("DocumentBroker [" << _docKey << "] still has unremoved sessions.");
@@ -538,7 +1201,18 @@ DocumentBroker::~DocumentBroker()
 
 void DocumentBroker::joinThread()
 {
-    _poll->joinThread();
+    if (!_sharedPoll)
+    {
+        _poll->joinThread();
+        return;
+    }
+
+    // Our loop winds down in the shared poll thread, which we can't join.
+    while (_pollState != PollState::Idle && _pollState != PollState::Finished &&
+           _sharedPoll->isAlive() && std::this_thread::get_id() != _sharedPoll->getThreadOwner())
+    {
+        std::this_thread::sleep_for(std::chrono::microseconds(POLL_TIMEOUT_MICRO_S / 5));
+    }
 }
 
 void DocumentBroker::stop(const std::string& reason)
@@ -546,13 +1220,18 @@ void DocumentBroker::stop(const std::string& reason)
     LOG_DBG("Stopping DocumentBroker for docKey [" << _docKey << "] with reason: " << reason);
     _closeReason = reason; // used later in the polling loop
     _stop = true;
-    _poll->wakeup();
+    wakeupPoll();
 }
 
 bool DocumentBroker::load(const std::shared_ptr<ClientSession>& session, const std::string& jailId)
 {
     assertCorrectThread();
 
+    // The storage, and the file info we check, are the upload's until it's done,
+    // and the download's, for which sessions wait to be added instead.
+    waitForUpload();
+    assert(!isDownloading());
+
     const std::string sessionId = session->getId();
 
     LOG_INF("Loading [" << _docKey << "] for session [" << sessionId << "] and jail [" << jailId << "].");
@@ -575,11 +1254,10 @@ bool DocumentBroker::load(const std::shared_ptr<ClientSession>& session, const s
     // The URL is the publicly visible one, not visible in the chroot jail.
     // We need to map it to a jailed path and copy the file there.
 
-    // user/doc/jailId
-    const Poco::Path jailPath(JAILED_DOCUMENT_ROOT, jailId);
+    const std::string jailPath = getJailedDocumentDir(jailId);
     std::string jailRoot = getJailRoot();
 
-    LOG_INF("jailPath: " << jailPath.toString() << ", jailRoot: " << jailRoot);
+    LOG_INF("jailPath: " << jailPath << ", jailRoot: " << jailRoot);
 
     bool firstInstance = false;
     if (_storage == nullptr)
@@ -591,7 +1269,7 @@ bool DocumentBroker::load(const std::shared_ptr<ClientSession>& session, const s
 
         try
         {
-            _storage = StorageBase::create(uriPublic, jailRoot, jailPath.toString());
+            _storage = StorageBase::create(uriPublic, jailRoot, jailPath);
         }
         catch (...)
         {
@@ -602,7 +1280,7 @@ bool DocumentBroker::load(const std::shared_ptr<ClientSession>& session, const s
         if (_storage == nullptr)
         {
             // We should get an exception, not null.
-            LOG_ERR("Failed to create Storage instance for [" << _docKey << "] in " << jailPath.toString());
+            LOG_ERR("Failed to create Storage instance for [" << _docKey << "] in " << jailPath);
             return false;
         }
         firstInstance = true;
@@ -783,7 +1461,33 @@ bool DocumentBroker::load(const std::shared_ptr<ClientSession>& session, const s
     // Let's load the document now, if not loaded.
     if (!_storage->isLoaded())
     {
-        std::string localPath = _storage->loadStorageFileToLocal(
+        _filename = fileInfo.getFilename();
+
+#if !MOBILEAPP
+        // Downloading blocks, which would stall the other documents in a shared
+        // poll thread, so there it runs in the background, and the kit loads once it's done.
+        if (_sharedPoll && wopiStorage != nullptr)
+        {
+            std::unique_ptr<Download> download(new Download(session, templateSource, getInfoCallDuration));
+            startDownload(std::move(download));
+            return true;
+        }
+
+        // Nothing the client is sent is flushed until the download is done, so
+        // the progress is sent right away.
+        if (wopiStorage != nullptr)
+        {
+            wopiStorage->setDownloadProgressHandler(makeDownloadProgressHandler(
+                [&session](const std::string& message) { session->sendTextFrameNow(message); }));
+        }
+
+        Util::ScopeGuard progressGuard([wopiStorage]() {
+            if (wopiStorage != nullptr)
+                wopiStorage->setDownloadProgressHandler(nullptr);
+        });
+#endif
+
+        const std::string localPath = _storage->loadStorageFileToLocal(
             session->getAuthorization(), session->getCookies(), *_lockCtx, templateSource);
 
         // Only lock the document on storage for editing sessions
@@ -797,126 +1501,309 @@ bool DocumentBroker::load(const std::shared_ptr<ClientSession>& session, const s
             //       and a button to unlock
         }
 
+        if (!loadLocalFile(localPath, templateSource))
+            return false;
+    }
+
+#if !MOBILEAPP
+    reportLoaded(session, getInfoCallDuration);
+#endif
+    return true;
+}
+
+bool DocumentBroker::loadLocalFile(std::string localPath, const std::string& templateSource)
+{
 #if !MOBILEAPP
-        // Check if we have a prefilter "plugin" for this document format
-        for (const auto& plugin : LOOLWSD::PluginConfigurations)
+    // Check if we have a prefilter "plugin" for this document format
+    for (const auto& plugin : LOOLWSD::PluginConfigurations)
+    {
+        try
         {
-            try
+            const std::string extension(plugin->getString("prefilter.extension"));
+            const std::string newExtension(plugin->getString("prefilter.newextension"));
+            std::string commandLine(plugin->getString("prefilter.commandline"));
+
+            if (localPath.length() > extension.length()+1 &&
+                strcasecmp(localPath.substr(localPath.length() - extension.length() -1).data(), (std::string(".") + extension).data()) == 0)
             {
-                const std::string extension(plugin->getString("prefilter.extension"));
-                const std::string newExtension(plugin->getString("prefilter.newextension"));
-                std::string commandLine(plugin->getString("prefilter.commandline"));
+                // Extension matches, try the conversion. We convert the file to another one in
+                // the same (jail) directory, with just the new extension tacked on.
 
-                if (localPath.length() > extension.length()+1 &&
-                    strcasecmp(localPath.substr(localPath.length() - extension.length() -1).data(), (std::string(".") + extension).data()) == 0)
+                const std::string newRootPath = _storage->getRootFilePath() + '.' + newExtension;
+
+                // The commandline must contain the space-separated substring @INPUT@ that is
+                // replaced with the input file name, and @OUTPUT@ for the output file name.
+                int inputs(0), outputs(0);
+
+                std::string input("@INPUT");
+                size_t pos = commandLine.find(input);
+                if (pos != std::string::npos)
                 {
-                    // Extension matches, try the conversion. We convert the file to another one in
-                    // the same (jail) directory, with just the new extension tacked on.
-
-                    const std::string newRootPath = _storage->getRootFilePath() + '.' + newExtension;
-
-                    // The commandline must contain the space-separated substring @INPUT@ that is
-                    // replaced with the input file name, and @OUTPUT@ for the output file name.
-                    int inputs(0), outputs(0);
-
-                    std::string input("@INPUT");
-                    size_t pos = commandLine.find(input);
-                    if (pos != std::string::npos)
-                    {
-                        commandLine.replace(pos, input.length(), _storage->getRootFilePath());
-                        ++inputs;
-                    }
-
-                    std::string output("@OUTPUT@");
-                    pos = commandLine.find(output);
-                    if (pos != std::string::npos)
-                    {
-                        commandLine.replace(pos, output.length(), newRootPath);
-                        ++outputs;
-                    }
-
-                    StringVector args(Util::tokenize(commandLine, ' '));
-                    std::string command(args[0]);
-                    args.erase(args.begin()); // strip the command
-
-                    if (inputs != 1 || outputs != 1)
-                        throw std::exception();
-
-                    int process = Util::spawnProcess(command, args);
-                    int status = -1;
-                    const int rc = ::waitpid(process, &status, 0);
-                    if (rc != 0)
-                    {
-                        LOG_ERR("Conversion from " << extension << " to " << newExtension << " failed (" << rc << ").");
-                        return false;
-                    }
-
-                    _storage->setRootFilePath(newRootPath);
-                    localPath += '.' + newExtension;
+                    commandLine.replace(pos, input.length(), _storage->getRootFilePath());
+                    ++inputs;
                 }
 
-                // We successfully converted the file to something LO can use; break out of the for
-                // loop.
-                break;
+                std::string output("@OUTPUT@");
+                pos = commandLine.find(output);
+                if (pos != std::string::npos)
+                {
+                    commandLine.replace(pos, output.length(), newRootPath);
+                    ++outputs;
+                }
+
+                StringVector args(Util::tokenize(commandLine, ' '));
+                std::string command(args[0]);
+                args.erase(args.begin()); // strip the command
+
+                if (inputs != 1 || outputs != 1)
+                    throw std::exception();
+
+                int process = Util::spawnProcess(command, args);
+                int status = -1;
+                const int rc = ::waitpid(process, &status, 0);
+                if (rc != 0)
+                {
+                    LOG_ERR("Conversion from " << extension << " to " << newExtension << " failed (" << rc << ").");
+                    return false;
+                }
+
+                _storage->setRootFilePath(newRootPath);
+                localPath += '.' + newExtension;
+            }
+
+            // We successfully converted the file to something LO can use; break out of the for
+            // loop.
+            break;
+        }
+        catch (const std::exception&)
+        {
+            // This plugin is not a proper prefilter one
+        }
+    }
+#endif
+
+    std::ifstream istr(localPath, std::ios::binary);
+    Poco::SHA1Engine sha1;
+    Poco::DigestOutputStream dos(sha1);
+    Poco::StreamCopier::copyStream(istr, dos);
+    dos.close();
+    LOG_INF("SHA1 for DocKey [" << _docKey << "] of [" << LOOLWSD::anonymizeUrl(localPath) << "]: " <<
+            Poco::DigestEngine::digestToHex(sha1.digest()));
+
+    std::string localPathEncoded;
+    Poco::URI::encode(localPath, "#?", localPathEncoded);
+    _uriJailed = Poco::URI(Poco::URI("file://"), localPathEncoded).toString();
+    _uriJailedAnonym = Poco::URI(Poco::URI("file://"), LOOLWSD::anonymizeUrl(localPathEncoded)).toString();
+
+    // Use the local temp file's timestamp.
+    _lastFileModifiedTime = templateSource.empty() ? Util::getFileTimestamp(_storage->getRootFilePath()) :
+            std::chrono::system_clock::time_point();
+    _lastUploadedFileHash = templateSource.empty() ? StorageBase::getFileHash(_storage->getRootFilePath()) :
+            std::string();
+
+    bool dontUseCache = false;
+#if MOBILEAPP
+    // avoid memory consumption for single-user local bits.
+    // FIXME: arguably should/could do this for single user documents too.
+    dontUseCache = true;
+#endif
+
+    _tileCache.reset(new TileCache(_storage->getUriString(), _lastFileModifiedTime, dontUseCache));
+    _tileCache->setThreadOwner(std::this_thread::get_id());
+
+    return true;
+}
+
+#if !MOBILEAPP
+void DocumentBroker::reportLoaded(const std::shared_ptr<ClientSession>& session,
+                                  const std::chrono::duration<double> getInfoCallDuration)
+{
+    LOOLWSD::dumpNewSessionTrace(getJailId(), session->getId(), _uriOrig, _storage->getRootFilePath());
+
+    // Since document has been loaded, send the stats if its WOPI
+    WopiStorage* wopiStorage = dynamic_cast<WopiStorage*>(_storage.get());
+    if (wopiStorage != nullptr)
+    {
+        // Get the time taken to load the file from storage
+        auto callDuration = wopiStorage->getWopiLoadDuration();
+        // Add the time taken to check file info
+        callDuration += getInfoCallDuration;
+        _wopiLoadDuration = std::chrono::duration_cast<std::chrono::milliseconds>(callDuration);
+        const std::string msg = "stats: wopiloadduration " + std::to_string(callDuration.count());
+        LOG_TRC("Sending to Client [" << msg << "].");
+        session->sendTextFrame(msg);
+    }
+}
+#endif
+
+/// A download of the document from storage in the background, for the
+/// session that loads it first, and its result.
+struct DocumentBroker::Download
+{
+    Download(const std::shared_ptr<ClientSession>& session, const std::string& templateSource,
+             const std::chrono::duration<double> getInfoCallDuration)
+        : _session(session)
+        , _auth(session->getAuthorization())
+        , _cookies(session->getCookies())
+        , _isReadOnly(session->isReadOnly())
+        , _templateSource(templateSource)
+        , _getInfoCallDuration(getInfoCallDuration)
+        , _lockFailed(false)
+        , _done(false)
+    {
+    }
+
+    const std::weak_ptr<ClientSession> _session;
+    const Authorization _auth;
+    const std::string _cookies;
+    const bool _isReadOnly;
+    const std::string _templateSource;
+    const std::chrono::duration<double> _getInfoCallDuration;
+
+    /// Where the document was downloaded to, or what went wrong.
+    std::string _localPath;
+    std::exception_ptr _exception;
+    bool _lockFailed;
+
+    std::atomic<bool> _done;
+    std::thread _thread;
+};
+
+#if !MOBILEAPP
+void DocumentBroker::startDownload(std::unique_ptr<Download> download)
+{
+    assertCorrectThread();
+    assert(!_download);
+
+    LOG_DBG("Downloading docKey [" << _docKey << "] in the background.");
+
+    // The progress is sent from our poll thread, as everything else to the session is.
+    WopiStorage* wopiStorage = static_cast<WopiStorage*>(_storage.get());
+    const std::weak_ptr<ClientSession> weakSession = download->_session;
+    wopiStorage->setDownloadProgressHandler(makeDownloadProgressHandler(
+        [this, weakSession](const std::string& message)
+        {
+            addCallback([weakSession, message]()
+                        {
+                            const std::shared_ptr<ClientSession> session = weakSession.lock();
+                            if (session)
+                                session->sendTextFrameNow(message);
+                        });
+        }));
+
+    // We wait for the thread before we, or the storage, go away.
+    _download = std::move(download);
+    Download* const pending = _download.get();
+    pending->_thread = std::thread([this, pending, wopiStorage]()
+        {
+            Util::setThreadName("download_" + _docId);
+            try
+            {
+                pending->_localPath = _storage->loadStorageFileToLocal(
+                    pending->_auth, pending->_cookies, *_lockCtx, pending->_templateSource);
+
+                // Only lock the document on storage for editing sessions
+                pending->_lockFailed = !pending->_isReadOnly &&
+                    !_storage->updateLockState(pending->_auth, pending->_cookies, *_lockCtx, true);
             }
             catch (const std::exception&)
             {
-                // This plugin is not a proper prefilter one
+                pending->_exception = std::current_exception();
             }
-        }
-#endif
 
-        std::ifstream istr(localPath, std::ios::binary);
-        Poco::SHA1Engine sha1;
-        Poco::DigestOutputStream dos(sha1);
-        Poco::StreamCopier::copyStream(istr, dos);
-        dos.close();
-        LOG_INF("SHA1 for DocKey [" << _docKey << "] of [" << LOOLWSD::anonymizeUrl(localPath) << "]: " <<
-                Poco::DigestEngine::digestToHex(sha1.digest()));
+            wopiStorage->setDownloadProgressHandler(nullptr);
+            pending->_done = true;
+            wakeupPoll();
+        });
+}
 
-        std::string localPathEncoded;
-        Poco::URI::encode(localPath, "#?", localPathEncoded);
-        _uriJailed = Poco::URI(Poco::URI("file://"), localPathEncoded).toString();
-        _uriJailedAnonym = Poco::URI(Poco::URI("file://"), LOOLWSD::anonymizeUrl(localPathEncoded)).toString();
+void DocumentBroker::finishDownload()
+{
+    assertCorrectThread();
+
+    std::unique_ptr<Download> download;
+    std::swap(download, _download);
+    if (download->_thread.joinable())
+        download->_thread.join();
+
+    LOG_DBG("Finished downloading docKey [" << _docKey << "] in the background.");
+    const std::shared_ptr<ClientSession> session = download->_session.lock();
+    try
+    {
+        if (download->_exception)
+            std::rethrow_exception(download->_exception);
 
-        _filename = fileInfo.getFilename();
+        if (download->_lockFailed)
+        {
+            LOG_ERR("Failed to lock!");
+            if (session)
+                session->setLockFailed(_lockCtx->_lockFailureReason);
+        }
 
-        // Use the local temp file's timestamp.
-        _lastFileModifiedTime = templateSource.empty() ? Util::getFileTimestamp(_storage->getRootFilePath()) :
-                std::chrono::system_clock::time_point();
+        if (!loadLocalFile(download->_localPath, download->_templateSource))
+            throw std::runtime_error("Failed to load document with URI [" +
+                                     LOOLWSD::anonymizeUrl(_uriPublic.toString()) + "].");
+    }
+    catch (const std::exception& exc)
+    {
+        // As the sessions would have been told, had we loaded it while adding them.
+        LOG_ERR("Failed to download docKey [" << _docKey << "]: " << exc.what());
+        if (dynamic_cast<const StorageSpaceLowException*>(&exc))
+            alertAllUsers("internal", "diskfull");
+        else if (dynamic_cast<const UnauthorizedRequestException*>(&exc))
+            broadcastMessage("error: cmd=internal kind=unauthorized");
+        else
+            broadcastMessage("error: cmd=storage kind=loadfailed");
 
-        bool dontUseCache = false;
-#if MOBILEAPP
-        // avoid memory consumption for single-user local bits.
-        // FIXME: arguably should/could do this for single user documents too.
-        dontUseCache = true;
-#endif
+        _heldMessages.clear();
+        _markToDestroy = true;
+        stop("Failed to download.");
 
-        _tileCache.reset(new TileCache(_storage->getUriString(), _lastFileModifiedTime, dontUseCache));
-        _tileCache->setThreadOwner(std::this_thread::get_id());
+        // Those waiting for it are told as well.
+        addDownloadSessions();
+        return;
     }
 
-#if !MOBILEAPP
-    LOOLWSD::dumpNewSessionTrace(getJailId(), sessionId, _uriOrig, _storage->getRootFilePath());
+    if (session)
+        reportLoaded(session, download->_getInfoCallDuration);
 
-    // Since document has been loaded, send the stats if its WOPI
-    if (wopiStorage != nullptr)
+    // Now the kit can load it for the sessions that asked meanwhile.
+    std::vector<std::pair<std::string, std::string>> messages;
+    std::swap(messages, _heldMessages);
+    for (const auto& message : messages)
     {
-        // Get the time taken to load the file from storage
-        auto callDuration = wopiStorage->getWopiLoadDuration();
-        // Add the time taken to check file info
-        callDuration += getInfoCallDuration;
-        _wopiLoadDuration = std::chrono::duration_cast<std::chrono::milliseconds>(callDuration);
-        const std::string msg = "stats: wopiloadduration " + std::to_string(callDuration.count());
-        LOG_TRC("Sending to Client [" << msg << "].");
-        session->sendTextFrame(msg);
+        if (message.first.empty())
+            _childProcess->sendTextFrame(message.second);
+        else
+            forwardToChild(message.first, message.second);
     }
-#endif
-    return true;
+
+    addDownloadSessions();
+}
+
+void DocumentBroker::addDownloadSessions()
+{
+    std::vector<SocketPoll::CallbackFn> callbacks;
+    std::swap(callbacks, _downloadCallbacks);
+    for (const auto& callback : callbacks)
+        callback();
 }
+#endif
 
 bool DocumentBroker::attemptLock(const ClientSession& session, std::string& failReason)
 {
+    waitForUpload();
+
+    // Only a session that failed to lock tries again, which it learns once
+    // the download, that takes the lock, is done.
+    if (isDownloading())
+    {
+        LOG_WRN("Session [" << session.getId() << "] attempts to lock docKey [" << _docKey <<
+                "] while it downloads.");
+        failReason = "The document is still loading.";
+        return false;
+    }
+
     const bool bResult = _storage->updateLockState(session.getAuthorization(), session.getCookies(),
                                                   *_lockCtx, true);
     if (!bResult)
@@ -924,11 +1811,46 @@ bool DocumentBroker::attemptLock(const ClientSession& session, std::string& fail
     return bResult;
 }
 
+/// An upload of the saved document to storage, and what is needed to handle
+/// its result, whether it runs in the background or not.
+struct DocumentBroker::Upload
+{
+    Upload(const std::string& sessionId, const std::string& uriAnonym,
+           const std::chrono::system_clock::time_point newFileModifiedTime,
+           const std::string& newFileHash, const std::chrono::steady_clock::time_point requestTime,
+           const std::chrono::steady_clock::duration stallDuration)
+        : _sessionId(sessionId)
+        , _uriAnonym(uriAnonym)
+        , _newFileModifiedTime(newFileModifiedTime)
+        , _newFileHash(newFileHash)
+        , _requestTime(requestTime)
+        , _stallDuration(stallDuration)
+        , _result(StorageBase::SaveResult::FAILED)
+        , _done(false)
+    {
+    }
+
+    const std::string _sessionId;
+    const std::string _uriAnonym;
+    const std::chrono::system_clock::time_point _newFileModifiedTime;
+    const std::string _newFileHash;
+    /// When the save was requested, and how long editing has been stalled
+    /// for it: while the kit saved, and while we waited for the upload.
+    const std::chrono::steady_clock::time_point _requestTime;
+    std::chrono::steady_clock::duration _stallDuration;
+    StorageBase::SaveResult _result;
+    std::atomic<bool> _done;
+    std::thread _thread;
+};
+
 bool DocumentBroker::saveToStorage(const std::string& sessionId,
                                    bool success, const std::string& result, bool force)
 {
     assertCorrectThread();
 
+    // The document has been saved again, or is to be uploaded as it is.
+    waitForUpload();
+
     // Force saving on exit, if enabled.
     if (!force && isMarkedToDestroy())
     {
@@ -964,6 +1886,8 @@ bool DocumentBroker::saveAsToStorage(const std::string& sessionId, const std::st
 {
     assertCorrectThread();
 
+    waitForUpload();
+
     return saveToStorageInternal(sessionId, true, "", saveAsPath, saveAsFilename, isRename);
 }
 
@@ -974,6 +1898,10 @@ bool DocumentBroker::saveToStorageInternal(const std::string& sessionId, bool su
 {
     assertCorrectThread();
 
+    // The kit doesn't take input while it saves, which is what we asked it to.
+    const std::chrono::steady_clock::time_point requestTime
+        = (isSaving() ? _lastSaveRequestTime : std::chrono::steady_clock::now());
+
     // Record that we got a response to avoid timing out on saving.
     _lastSaveResponseTime = std::chrono::steady_clock::now();
 
@@ -986,7 +1914,7 @@ bool DocumentBroker::saveToStorageInternal(const std::string& sessionId, bool su
         LOG_DBG("Save skipped as document [" << _docKey << "] was not modified.");
         _lastSaveTime = std::chrono::steady_clock::now();
         broadcastSaveResult(true, "unmodified");
-        _poll->wakeup();
+        wakeupPoll();
         return true;
     }
 
@@ -1040,7 +1968,27 @@ bool DocumentBroker::saveToStorageInternal(const std::string& sessionId, bool su
                                             (std::chrono::system_clock::now() - _lastFileModifiedTime);
         LOG_DBG("Skipping unnecessary saving to URI [" << uriAnonym << "] with docKey [" << _docKey <<
                 "]. File last modified " << timeInSec.count() << " seconds ago, timestamp unchanged.");
-        _poll->wakeup();
+        wakeupPoll();
+        broadcastSaveResult(true, "unmodified");
+        return true;
+    }
+
+    // If the content is what we last uploaded, skip uploading it again, unless
+    // asked to overwrite what storage has now.
+    const std::string newFileHash = (!isSaveAs && !isRename ? StorageBase::getFileHash(_storage->getRootFilePath())
+                                                            : std::string());
+    if (!newFileHash.empty() && newFileHash == _lastUploadedFileHash && !force && !_storage->getForceSave())
+    {
+        LOG_DBG("Skipping unnecessary saving to URI [" << uriAnonym << "] with docKey [" << _docKey <<
+                "]. Content unchanged since the last upload.");
+        _lastFileModifiedTime = newFileModifiedTime;
+        _lastSaveTime = std::chrono::steady_clock::now();
+        ++_uploadsSkipped;
+        _uploadSavedBytes += StorageBase::getFileSize(_storage->getRootFilePath());
+#if !MOBILEAPP
+        Admin::instance().setDocUploadStats(_docKey, _uploadedBytes, _uploadSavedBytes, _uploadsSkipped);
+#endif
+        wakeupPoll();
         broadcastSaveResult(true, "unmodified");
         return true;
     }
@@ -1048,8 +1996,43 @@ bool DocumentBroker::saveToStorageInternal(const std::string& sessionId, bool su
     LOG_DBG("Persisting [" << _docKey << "] after saving to URI [" << uriAnonym << "].");
 
     assert(_storage && _tileCache);
-    const StorageBase::SaveResult storageSaveResult = _storage->saveLocalFileToStorage(
+    std::unique_ptr<Upload> upload(new Upload(sessionId, uriAnonym, newFileModifiedTime, newFileHash,
+                                              requestTime, _lastSaveResponseTime - requestTime));
+
+    // Upload in the background, unless we are about to stop, or the result is
+    // wanted right away, to rename or save as, or when forced.
+    static const bool backgroundUpload
+        = LOOLWSD::getConfigValue<bool>("per_document.background_upload", true);
+    if (backgroundUpload && !isSaveAs && !isRename && !force && !_markToDestroy && !_closeRequest
+        && !it->second->isCloseFrame() && !SigUtil::getShutdownRequestFlag())
+    {
+        startUpload(std::move(upload));
+        return true;
+    }
+
+    const std::chrono::steady_clock::time_point uploadStart = std::chrono::steady_clock::now();
+    upload->_result = _storage->saveLocalFileToStorage(
         auth, it->second->getCookies(), *_lockCtx, saveAsPath, saveAsFilename, isRename);
+    upload->_stallDuration += std::chrono::steady_clock::now() - uploadStart;
+
+    return handleUploadResult(*upload, saveAsPath, isRename);
+}
+
+bool DocumentBroker::handleUploadResult(const Upload& upload, const std::string& saveAsPath,
+                                        const bool isRename)
+{
+    assertCorrectThread();
+
+    const bool isSaveAs = !saveAsPath.empty();
+    const StorageBase::SaveResult& storageSaveResult = upload._result;
+    const std::string& uriAnonym = upload._uriAnonym;
+    if (!isSaveAs && !isRename)
+        reportSaveDurations(upload);
+
+    // The session may have gone while we uploaded in the background.
+    const auto it = _sessions.find(upload._sessionId);
+    const std::shared_ptr<ClientSession> session = (it != _sessions.end() ? it->second : nullptr);
+
     // Storage save is considered successful when either storage returns OK or the document on the storage
     // was changed and it was used to overwrite local changes
     _lastStorageSaveSuccessful
@@ -1066,9 +2049,19 @@ bool DocumentBroker::saveToStorageInternal(const std::string& sessionId, bool su
         if (!isSaveAs && !isRename)
         {
             // Saved and stored; update flags.
-            _lastFileModifiedTime = newFileModifiedTime;
+            _lastFileModifiedTime = upload._newFileModifiedTime;
+            _lastUploadedFileHash = upload._newFileHash;
             _lastSaveTime = std::chrono::steady_clock::now();
 
+            const uint64_t fileSize = StorageBase::getFileSize(_storage->getRootFilePath());
+            const uint64_t uploadedBytes = _storage->getUploadedBytes();
+            _uploadedBytes += uploadedBytes;
+            _uploadSavedBytes += (fileSize > uploadedBytes ? fileSize - uploadedBytes : 0);
+            LOG_DBG("Uploaded " << uploadedBytes << " bytes of the " << fileSize << " of docKey [" << _docKey << "].");
+#if !MOBILEAPP
+            Admin::instance().setDocUploadStats(_docKey, _uploadedBytes, _uploadSavedBytes, _uploadsSkipped);
+#endif
+
             // Save the storage timestamp.
             _documentLastModifiedTime = _storage->getFileInfo().getModifiedTime();
 
@@ -1079,7 +2072,7 @@ bool DocumentBroker::saveToStorageInternal(const std::string& sessionId, bool su
                     " Document modified timestamp: " << _documentLastModifiedTime);
 
             // Resume polling.
-            _poll->wakeup();
+            wakeupPoll();
         }
         else if (isRename)
         {
@@ -1109,13 +2102,15 @@ bool DocumentBroker::saveToStorageInternal(const std::string& sessionId, bool su
             std::ostringstream oss;
             oss << "saveas: url=" << url << " filename=" << encodedName
                 << " xfilename=" << filenameAnonym;
-            it->second->sendTextFrame(oss.str());
+            if (session)
+                session->sendTextFrame(oss.str());
 
             LOG_DBG("Saved As docKey [" << _docKey << "] to URI [" << LOOLWSD::anonymizeUrl(url) <<
                     "] with name [" << filenameAnonym << "] successfully.");
         }
 
-        sendLastModificationTime(it->second, this, _documentLastModifiedTime);
+        if (session)
+            sendLastModificationTime(session, this, _documentLastModifiedTime);
 
         return true;
     }
@@ -1135,7 +2130,8 @@ bool DocumentBroker::saveToStorageInternal(const std::string& sessionId, bool su
     {
         LOG_ERR("Cannot save docKey [" << _docKey << "] to storage URI [" << uriAnonym <<
                 "]. Invalid or expired access token. Notifying client.");
-        it->second->sendTextFrameAndLogError("error: cmd=storage kind=saveunauthorized");
+        if (session)
+            session->sendTextFrameAndLogError("error: cmd=storage kind=saveunauthorized");
         broadcastSaveResult(false, "Invalid or expired access token");
     }
     else if (storageSaveResult.getResult() == StorageBase::SaveResult::FAILED)
@@ -1144,7 +2140,8 @@ bool DocumentBroker::saveToStorageInternal(const std::string& sessionId, bool su
         LOG_ERR("Failed to save docKey [" << _docKey << "] to URI [" << uriAnonym << "]. Notifying client.");
         std::ostringstream oss;
         oss << "error: cmd=storage kind=" << (isRename ? "renamefailed" : "savefailed");
-        it->second->sendTextFrame(oss.str());
+        if (session)
+            session->sendTextFrame(oss.str());
         broadcastSaveResult(false, "Save failed", storageSaveResult.getErrorMsg());
     }
     else if (storageSaveResult.getResult() == StorageBase::SaveResult::DOC_CHANGED
@@ -1152,6 +2149,7 @@ bool DocumentBroker::saveToStorageInternal(const std::string& sessionId, bool su
     {
         LOG_ERR("PutFile says that Document changed in storage");
         _documentChangedInStorage = true;
+        _lastUploadedFileHash.clear();
         const std::string message
             = isModified() ? "error: cmd=storage kind=documentconflict" : "close: documentconflict";
 
@@ -1162,6 +2160,81 @@ bool DocumentBroker::saveToStorageInternal(const std::string& sessionId, bool su
     return false;
 }
 
+void DocumentBroker::startUpload(std::unique_ptr<Upload> upload)
+{
+    assertCorrectThread();
+    assert(!_upload);
+
+    const auto it = _sessions.find(upload->_sessionId);
+    assert(it != _sessions.end());
+    const Authorization auth = it->second->getAuthorization();
+    const std::string cookies = it->second->getCookies();
+
+    LOG_DBG("Uploading docKey [" << _docKey << "] to URI [" << upload->_uriAnonym
+                                 << "] in the background.");
+
+    // We wait for the thread before we, or the storage, go away.
+    _upload = std::move(upload);
+    Upload* const pending = _upload.get();
+    pending->_thread = std::thread([this, pending, auth, cookies]()
+        {
+            Util::setThreadName("upload_" + _docId);
+            try
+            {
+                pending->_result = _storage->saveLocalFileToStorage(
+                    auth, cookies, *_lockCtx, std::string(), std::string(), /*isRename=*/false);
+            }
+            catch (const std::exception& exc)
+            {
+                LOG_ERR("Failed to upload docKey [" << _docKey << "]: " << exc.what());
+            }
+
+            pending->_done = true;
+            wakeupPoll();
+        });
+}
+
+void DocumentBroker::finishUpload()
+{
+    assertCorrectThread();
+
+    std::unique_ptr<Upload> upload;
+    std::swap(upload, _upload);
+    if (upload->_thread.joinable())
+        upload->_thread.join();
+
+    LOG_DBG("Finished uploading docKey [" << _docKey << "] in the background.");
+    handleUploadResult(*upload, std::string(), /*isRename=*/false);
+}
+
+void DocumentBroker::waitForUpload()
+{
+    assertCorrectThread();
+
+    if (!_upload)
+        return;
+
+    LOG_DBG("Waiting for the background upload of docKey [" << _docKey << "] to finish.");
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    _upload->_thread.join();
+    _upload->_stallDuration += std::chrono::steady_clock::now() - start;
+
+    finishUpload();
+}
+
+void DocumentBroker::reportSaveDurations(const Upload& upload)
+{
+    const auto saveDuration = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - upload._requestTime);
+    const auto stallDuration
+        = std::chrono::duration_cast<std::chrono::milliseconds>(upload._stallDuration);
+    LOG_DBG("Saved docKey [" << _docKey << "] in " << saveDuration.count() << "ms, of which editing was stalled for "
+            << stallDuration.count() << "ms.");
+#if !MOBILEAPP
+    Admin::instance().setDocSaveDurations(_docKey, saveDuration, stallDuration);
+#endif
+}
+
 void DocumentBroker::broadcastSaveResult(bool success, const std::string& result, const std::string& errorMsg)
 {
     const std::string resultstr = success ? "true" : "false";
@@ -1182,6 +2255,17 @@ void DocumentBroker::setLoaded()
                                 std::chrono::steady_clock::now() - _threadStart);
         LOG_TRC("Document loaded in " << _loadDuration.count() << "ms");
     }
+
+    if (_rehydrateStart != std::chrono::steady_clock::time_point())
+    {
+        const auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(
+                                std::chrono::steady_clock::now() - _rehydrateStart);
+        LOG_INF("Doc [" << _docKey << "] rehydrated in " << duration.count() << "ms");
+#if !MOBILEAPP
+        Admin::instance().addRehydrateDuration(duration);
+#endif
+        _rehydrateStart = std::chrono::steady_clock::time_point();
+    }
 }
 
 std::string DocumentBroker::getWriteableSessionId() const
@@ -1232,7 +2316,7 @@ bool DocumentBroker::autoSave(const bool force, const bool dontSaveIfUnmodified)
     assertCorrectThread();
 
     LOG_TRC("autoSave(): forceful? " << force);
-    if (_sessions.empty() || _storage == nullptr || !_isLoaded ||
+    if (_sessions.empty() || _storage == nullptr || !_isLoaded || !_childProcess ||
         !_childProcess->isAlive() || (!isModified() && !force))
     {
         // Nothing to do.
@@ -1298,6 +2382,9 @@ bool DocumentBroker::sendUnoSave(const std::string& sessionId, bool dontTerminat
 {
     assertCorrectThread();
 
+    // Saving overwrites the document we may be uploading.
+    waitForUpload();
+
     LOG_INF("Saving doc [" << _docKey << "].");
 
     if (_sessions.find(sessionId) != _sessions.end())
@@ -1358,6 +2445,23 @@ std::string DocumentBroker::getJailRoot() const
     return Poco::Path(LOOLWSD::ChildRoot, _jailId).toString();
 }
 
+std::string DocumentBroker::getJailedDocumentDir(const std::string& jailId) const
+{
+    // user/doc/jailId, and our own within it when sharing the kit, lest
+    // documents of the same name overwrite each other.
+    if (_childProcess && _childProcess->isSharedKit())
+        return Poco::Path(Poco::Path(JAILED_DOCUMENT_ROOT, jailId), _docId).toString();
+
+    return Poco::Path(JAILED_DOCUMENT_ROOT, jailId).toString();
+}
+
+void DocumentBroker::removeFromSharedKit()
+{
+    // The kit carries on with the other documents, and the jail with it.
+    if (_childProcess && _childProcess->isSharedKit() && !_jailId.empty())
+        FileUtil::removeFile(getJailRoot() + getJailedDocumentDir(_jailId), true);
+}
+
 size_t DocumentBroker::addSession(const std::shared_ptr<ClientSession>& session)
 {
     try
@@ -1381,10 +2485,14 @@ size_t DocumentBroker::addSessionInternal(const std::shared_ptr<ClientSession>&
 {
     assertCorrectThread();
 
+    // Not to download it again for a session that waited for a download that failed.
+    if (_stop)
+        throw std::runtime_error("Doc [" + _docKey + "] is closing: " + _closeReason + '.');
+
     try
     {
         // First load the document, since this can fail.
-        if (!load(session, _childProcess->getJailId()))
+        if (!load(session, _childProcess ? _childProcess->getJailId() : _jailId))
         {
             const auto msg = "Failed to load document with URI [" + session->getPublicUri().toString() + "].";
             LOG_ERR(msg);
@@ -1410,16 +2518,33 @@ size_t DocumentBroker::addSessionInternal(const std::shared_ptr<ClientSession>&
 
     const std::string id = session->getId();
 
-    // Request a new session from the child kit.
-    const std::string aMessage = "session " + id + ' ' + _docKey + ' ' + _docId;
-    _childProcess->sendTextFrame(aMessage);
+    // A kit shared with other documents only hosts read-only views, so one that
+    // edits it takes the document to a kit of its own, and it's shared no longer.
+    if (!session->isReadOnly() && _canShareKit.exchange(false) && _childProcess &&
+        _childProcess->isSharedKit())
+    {
+        leaveSharedKit(session);
+    }
+
+    if (_hibernated)
+    {
+        // We ask the kit for the session, and tell the admin console, once we have one.
+        rehydrate();
+    }
+    else
+    {
+        // Request a new session from the child kit.
+        const std::string aMessage = "session " + id + ' ' + _docKey + ' ' + _docId +
+                                     (isKitReusable() ? " reusable" : "");
+        _childProcess->sendTextFrame(aMessage);
 
 #if !MOBILEAPP
-    // Tell the admin console about this new doc
-    Admin::instance().addDoc(_docKey, getPid(), getFilename(), id, session->getUserName(),
-                             session->getUserId(), _childProcess->getSMapsFD());
-    Admin::instance().setDocWopiDownloadDuration(_docKey, _wopiLoadDuration);
+        // Tell the admin console about this new doc
+        Admin::instance().addDoc(_docKey, getPid(), getFilename(), id, session->getUserName(),
+                                 session->getUserId(), _childProcess->getSMapsFD());
+        Admin::instance().setDocWopiDownloadDuration(_docKey, _wopiLoadDuration);
 #endif
+    }
 
     // Add and attach the session.
     _sessions.emplace(session->getId(), session);
@@ -1516,6 +2641,7 @@ void DocumentBroker::disconnectSessionInternal(const std::string& id)
             if (_markToDestroy && // last session to remove; FIXME: Editable?
                 _lockCtx->_isLocked && _storage)
             {
+                waitForUpload();
                 if (!_storage->updateLockState(it->second->getAuthorization(), it->second->getCookies(), *_lockCtx, false))
                     LOG_ERR("Failed to unlock!");
             }
@@ -1526,6 +2652,11 @@ void DocumentBroker::disconnectSessionInternal(const std::string& id)
                 LOG_TRC("hard disconnecting while waiting for disconnected handshake.");
                 hardDisconnect = true;
             }
+            else if (!_childProcess)
+            {
+                LOG_TRC("hard disconnecting while hibernated, without a kit to tell.");
+                hardDisconnect = true;
+            }
             else
             {
                 hardDisconnect = it->second->disconnectFromKit();
@@ -1566,6 +2697,8 @@ void DocumentBroker::finalRemoveSession(const std::string& id)
             it->second->dispose();
             _sessions.erase(it);
             const size_t count = _sessions.size();
+            if (count == 0)
+                housekeepSoon();
 
             Log::StreamLogger logger = Log::trace();
             if (logger.enabled())
@@ -1593,6 +2726,18 @@ void DocumentBroker::finalRemoveSession(const std::string& id)
     }
 }
 
+void DocumentBroker::requestSession(const bool isReadOnly)
+{
+#if !MOBILEAPP
+    // Only the first session, before we get a kit, decides.
+    static const bool sharing = LOOLWSD::getConfigValue<int>("per_document.read_only_docs_per_kit", 1) > 1;
+    if (!_sessionRequested.exchange(true))
+        _canShareKit = sharing && isReadOnly;
+#else
+    (void) isReadOnly;
+#endif
+}
+
 std::shared_ptr<ClientSession> DocumentBroker::createNewClientSession(
     const std::shared_ptr<ProtocolHandlerInterface> &ws,
     const std::string& id,
@@ -1626,13 +2771,69 @@ std::shared_ptr<ClientSession> DocumentBroker::createNewClientSession(
     return nullptr;
 }
 
+void DocumentBroker::addSessionCallback(const SocketPoll::CallbackFn& fn)
+{
+    const std::weak_ptr<DocumentBroker> weak = shared_from_this();
+    addCallback([weak, fn]()
+        {
+            const std::shared_ptr<DocumentBroker> docBroker = weak.lock();
+            if (!docBroker)
+                return;
+
+            // Rather than wait for the download in our poll thread.
+            if (docBroker->isDownloading())
+            {
+                LOG_DBG("Adding the session to docKey [" << docBroker->_docKey <<
+                        "] once it is downloaded.");
+                docBroker->_downloadCallbacks.push_back(fn);
+                return;
+            }
+
+            fn();
+        });
+}
+
 void DocumentBroker::addCallback(const SocketPoll::CallbackFn& fn)
 {
-    _poll->addCallback(fn);
+    if (!_sharedPoll)
+    {
+        _poll->addCallback(fn);
+        return;
+    }
+
+    // Our own poll runs callbacks only once we have a child and stops running
+    // them when we finish; keep that order in the shared poll.
+    const std::weak_ptr<DocumentBroker> weak = shared_from_this();
+    _sharedPoll->addCallback([weak, fn]()
+        {
+            const std::shared_ptr<DocumentBroker> docBroker = weak.lock();
+            if (!docBroker || docBroker->_pollState == PollState::Finished)
+                return;
+
+            if (docBroker->_pollState != PollState::Running &&
+                docBroker->_pollState != PollState::Flushing)
+            {
+                docBroker->_startupCallbacks.push_back(fn);
+                return;
+            }
+
+            fn();
+            docBroker->housekeepSoon();
+        });
 }
 
 void DocumentBroker::addSocketToPoll(const std::shared_ptr<Socket>& socket)
 {
+    if (_sharedPoll)
+    {
+        // Remember our sockets, to flush and remove just those when we finish.
+        std::lock_guard<std::mutex> lock(_socketsMutex);
+        _sockets.erase(std::remove_if(_sockets.begin(), _sockets.end(),
+                                      [](const std::weak_ptr<Socket>& weak) { return weak.expired(); }),
+                       _sockets.end());
+        _sockets.push_back(socket);
+    }
+
     _poll->insertNewSocket(socket);
 }
 
@@ -1676,6 +2877,9 @@ bool DocumentBroker::handleInput(const std::vector<char>& payload)
     const auto& msg = message->abbr();
     LOG_TRC("DocumentBroker handling child message: [" << msg << "].");
 
+    // Whatever the kit tells us may change what our housekeeping has to do.
+    housekeepSoon();
+
 #if !MOBILEAPP
     LOOLWSD::dumpOutgoingTrace(getJailId(), "0", msg);
 #endif
@@ -1776,7 +2980,7 @@ void DocumentBroker::handleTileRequest(TileDesc& tile,
     LOG_DBG("Sending render request for tile (" << tile.getPart() << ',' <<
             tile.getTilePosX() << ',' << tile.getTilePosY() << ").");
     const std::string request = "tile " + tileMsg;
-    _childProcess->sendTextFrame(request);
+    sendToChild(request);
     _debugRenderedTileCount++;
 }
 
@@ -1810,7 +3014,7 @@ void DocumentBroker::handleTileCombinedRequest(TileCombined& tileCombined,
         // Forward to child to render.
         const std::string req = newTileCombined.serialize("tilecombine");
         LOG_TRC("Sending uncached residual tilecombine request to Kit: " << req);
-        _childProcess->sendTextFrame(req);
+        sendToChild(req);
     }
 
     // Accumulate tiles
@@ -1945,6 +3149,15 @@ void DocumentBroker::sendRequestedTiles(const std::shared_ptr<ClientSession>& se
         tilesOnFlyUpperLimit = 200; // Have a big number here to get all tiles requested by file opening
     }
 
+    // Once we know the link, keep its bandwidth-delay product in flight rather than
+    // the whole visible area, which would queue up for seconds on a slow client.
+    const size_t linkWindow = session->getLinkEstimator().getWindowTiles();
+    if (linkWindow > 0)
+    {
+        tilesOnFlyUpperLimit = std::max(TILES_ON_FLY_MIN_UPPER_LIMIT,
+                                        std::min<float>(tilesOnFlyUpperLimit, linkWindow));
+    }
+
     // Drop tiles which we are waiting for too long
     session->removeOutdatedTilesOnFly();
 
@@ -1965,72 +3178,154 @@ void DocumentBroker::sendRequestedTiles(const std::shared_ptr<ClientSession>& se
         {
             TileDesc& tile = *(requestedTiles.begin());
 
-            // We already sent out two versions of the same tile, let's not send the third one
-            // until we get a tileprocessed message for this specific tile.
-            if (session->countIdenticalTilesOnFly(tile) >= 2)
-            {
-                LOG_DBG("Requested tile " << tile.getWireId() << " was delayed (already sent a version)!");
-                requestedTiles.push_back(requestedTiles.front());
-                requestedTiles.pop_front();
-                delayedTiles += 1;
-                continue;
-            }
+            // We already sent out two versions of the same tile, let's not send the third one
+            // until we get a tileprocessed message for this specific tile.
+            if (session->countIdenticalTilesOnFly(tile) >= 2)
+            {
+                LOG_DBG("Requested tile " << tile.getWireId() << " was delayed (already sent a version)!");
+                requestedTiles.push_back(requestedTiles.front());
+                requestedTiles.pop_front();
+                delayedTiles += 1;
+                continue;
+            }
+
+            // Satisfy as many tiles from the cache.
+            TileCache::Tile cachedTile = _tileCache->lookupTile(tile);
+            if (cachedTile)
+            {
+                //TODO: Combine the response to reduce latency.
+                const std::string response = tile.serialize("tile:", ADD_DEBUG_RENDERID);
+                session->sendTile(response, cachedTile);
+            }
+            else
+            {
+                // Not cached, needs rendering.
+                if (!tileCache().hasTileBeingRendered(tile, &now) || // There is no in progress rendering of the given tile
+                    tileCache().getTileBeingRenderedVersion(tile) < tile.getVersion()) // We need a newer version
+                {
+                    tile.setVersion(++_tileVersion);
+                    tilesNeedsRendering.push_back(tile);
+                    _debugRenderedTileCount++;
+                }
+                tileCache().subscribeToTileRendering(tile, session, now);
+                beingRendered++;
+            }
+            requestedTiles.pop_front();
+        }
+
+        // Send rendering request for those tiles which were not prerendered
+        if (!tilesNeedsRendering.empty())
+        {
+            TileCombined newTileCombined = TileCombined::create(tilesNeedsRendering);
+
+            // Forward to child to render.
+            const std::string req = newTileCombined.serialize("tilecombine");
+            LOG_TRC("Some of the tiles were not prerendered. Sending residual tilecombine: " << req);
+            sendToChild(req);
+        }
+    }
+}
+
+void DocumentBroker::cancelTileRequests(const std::shared_ptr<ClientSession>& session)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    // Clear tile requests
+    session->clearTilesOnFly();
+
+    session->getRequestedTiles().clear();
+
+    session->resetWireIdMap();
+
+    if (!hasTileCache())
+        return;
+
+    const std::string canceltiles = tileCache().cancelTiles(session);
+    if (!canceltiles.empty() && _childProcess)
+    {
+        LOG_DBG("Forwarding canceltiles request: " << canceltiles);
+        _childProcess->sendTextFrame(canceltiles);
+    }
+}
+
+int64_t DocumentBroker::flushInvalidations(const std::chrono::steady_clock::time_point now,
+                                           int64_t timeoutMaxMicroS)
+{
+    assertCorrectThread();
+
+    for (const auto& it : _sessions)
+    {
+        const std::shared_ptr<ClientSession> session = it.second;
+        session->flushInvalidations(now);
+        if (session->hasPendingInvalidations())
+        {
+            const int64_t untilDeadlineMicroS = std::chrono::duration_cast<std::chrono::microseconds>(
+                session->getInvalidationDeadline() - now).count();
+            timeoutMaxMicroS = std::max<int64_t>(0, std::min(timeoutMaxMicroS, untilDeadlineMicroS));
+        }
+    }
+
+    return timeoutMaxMicroS;
+}
+
+void DocumentBroker::prefetchTiles()
+{
+    assertCorrectThread();
+
+    if (!isLoaded() || !hasTileCache() || !_childProcess)
+        return;
+
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    // Only when the kit has nothing better to do: rendering or about to render for a client.
+    if (tileCache().getTilesBeingRenderedCount() > 0)
+        return;
+
+    for (const auto& it : _sessions)
+    {
+        if (!it.second->getRequestedTiles().empty())
+            return;
+    }
+
+    for (const auto& it : _sessions)
+    {
+        const std::shared_ptr<ClientSession> session = it.second;
+        if (!session->isViewLoaded())
+            continue;
 
-            // Satisfy as many tiles from the cache.
-            TileCache::Tile cachedTile = _tileCache->lookupTile(tile);
-            if (cachedTile)
-            {
-                //TODO: Combine the response to reduce latency.
-                const std::string response = tile.serialize("tile:", ADD_DEBUG_RENDERID);
-                session->sendTile(response, cachedTile);
-            }
-            else
-            {
-                // Not cached, needs rendering.
-                if (!tileCache().hasTileBeingRendered(tile, &now) || // There is no in progress rendering of the given tile
-                    tileCache().getTileBeingRenderedVersion(tile) < tile.getVersion()) // We need a newer version
-                {
-                    tile.setVersion(++_tileVersion);
-                    tilesNeedsRendering.push_back(tile);
-                    _debugRenderedTileCount++;
-                }
-                tileCache().subscribeToTileRendering(tile, session, now);
-                beingRendered++;
-            }
-            requestedTiles.pop_front();
+        std::vector<TileDesc> tilesNeedsRendering;
+        for (TileDesc& tile : session->takeTilesToPrefetch())
+        {
+            tile.setVersion(++_tileVersion);
+            if (tileCache().registerTilePrefetch(tile))
+                tilesNeedsRendering.push_back(tile);
         }
 
-        // Send rendering request for those tiles which were not prerendered
         if (!tilesNeedsRendering.empty())
         {
             TileCombined newTileCombined = TileCombined::create(tilesNeedsRendering);
 
             // Forward to child to render.
             const std::string req = newTileCombined.serialize("tilecombine");
-            LOG_TRC("Some of the tiles were not prerendered. Sending residual tilecombine: " << req);
+            LOG_TRC("Prefetching tiles for " << session->getName() << ": " << req);
             _childProcess->sendTextFrame(req);
+            _debugRenderedTileCount += tilesNeedsRendering.size();
         }
     }
 }
 
-void DocumentBroker::cancelTileRequests(const std::shared_ptr<ClientSession>& session)
+void DocumentBroker::cancelPrefetch(const std::shared_ptr<ClientSession>& session,
+                                    const Util::Rectangle& keep)
 {
     std::unique_lock<std::mutex> lock(_mutex);
 
-    // Clear tile requests
-    session->clearTilesOnFly();
-
-    session->getRequestedTiles().clear();
-
-    session->resetWireIdMap();
-
     if (!hasTileCache())
         return;
 
-    const std::string canceltiles = tileCache().cancelTiles(session);
-    if (!canceltiles.empty())
+    const std::string canceltiles = tileCache().cancelPrefetch(session->getCanonicalViewId(), keep);
+    if (!canceltiles.empty() && _childProcess)
     {
-        LOG_DBG("Forwarding canceltiles request: " << canceltiles);
+        LOG_DBG("Forwarding canceltiles request for prefetched tiles: " << canceltiles);
         _childProcess->sendTextFrame(canceltiles);
     }
 }
@@ -2049,9 +3344,13 @@ void DocumentBroker::handleTileResponse(const std::vector<char>& payload)
             const char* buffer = payload.data();
             const size_t offset = firstLine.size() + 1;
 
-            std::unique_lock<std::mutex> lock(_mutex);
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
 
-            tileCache().saveTileAndNotify(tile, buffer + offset, length - offset);
+                tileCache().saveTileAndNotify(tile, buffer + offset, length - offset);
+            }
+
+            onTileRendered(tile, buffer + offset, length - offset);
         }
         else
         {
@@ -2147,8 +3446,8 @@ bool DocumentBroker::forwardToChild(const std::string& viewId, const std::string
 {
     assertCorrectThread();
 
-    // Ignore userinactive, useractive message until document is loaded
-    if (!isLoaded() && (message == "userinactive" || message == "useractive"))
+    // Ignore userinactive, useractive message until document is loaded, or while hibernated.
+    if ((!isLoaded() || _hibernated) && (message == "userinactive" || message == "useractive"))
     {
         return true;
     }
@@ -2158,11 +3457,30 @@ bool DocumentBroker::forwardToChild(const std::string& viewId, const std::string
     if (Log::traceEnabled() && Util::startsWith(message, "paste "))
         LOG_TRC("Logging paste payload (" << message.size() << " bytes) '" << message << "' end paste");
 
+    // Saving overwrites the document we may be uploading.
+    if (isUploading() && Util::startsWith(message, "uno .uno:Save"))
+        waitForUpload();
+
     std::string msg = "child-" + viewId + ' ' + message;
 
     const auto it = _sessions.find(viewId);
     if (it != _sessions.end())
     {
+        if (_hibernated)
+        {
+            // The jail will have changed by the time we send it.
+            _heldMessages.emplace_back(viewId, message);
+            rehydrate();
+            return true;
+        }
+
+        if (isDownloading())
+        {
+            // The kit can't load it before it's downloaded.
+            _heldMessages.emplace_back(viewId, message);
+            return true;
+        }
+
         assert(!_uriJailed.empty());
 
         StringVector tokens = Util::tokenize(msg);
@@ -2307,6 +3625,7 @@ void DocumentBroker::closeDocument(const std::string& reason)
     LOG_DBG("Closing DocumentBroker for docKey [" << _docKey << "] with reason: " << reason);
     _closeReason = reason;
     _closeRequest = true;
+    housekeepSoon();
 }
 
 void DocumentBroker::broadcastMessage(const std::string& message)
@@ -2345,26 +3664,124 @@ void DocumentBroker::getIOStats(uint64_t &sent, uint64_t &recv)
 #if !MOBILEAPP
 static std::atomic<size_t> NumConverters;
 
+std::unique_ptr<ConvertToQueue> ConvertToBroker::Queue;
+
+namespace
+{
+/// Pooled kits waiting for a conversion, with the number of documents each converted.
+std::mutex WarmKitsMutex;
+std::vector<std::pair<std::shared_ptr<ChildProcess>, size_t>> WarmKits;
+
+/// Documents a pooled kit converts before we recycle it, or 0 for no limit.
+size_t MaxJobsPerKit = 0;
+
+/// Clear the last conversion's input and output out of a kit's jail.
+void removeJailedDocuments(const std::string& jailId)
+{
+    const std::string docsPath = LOOLWSD::ChildRoot + jailId + JAILED_DOCUMENT_ROOT;
+
+    std::vector<std::string> entries;
+    try
+    {
+        Poco::File(docsPath).list(entries);
+    }
+    catch (const std::exception& ex)
+    {
+        LOG_WRN("Failed to list jailed documents in [" << docsPath << "]: " << ex.what());
+    }
+
+    for (const std::string& entry : entries)
+        FileUtil::removeFile(docsPath + entry, true);
+}
+
+/// Takes a live kit out of the pool, with the number of documents it converted.
+std::shared_ptr<ChildProcess> takeWarmKit(size_t& jobs)
+{
+    std::lock_guard<std::mutex> lock(WarmKitsMutex);
+    while (!WarmKits.empty())
+    {
+        std::shared_ptr<ChildProcess> child = WarmKits.back().first;
+        jobs = WarmKits.back().second;
+        WarmKits.pop_back();
+
+        if (child->isAlive())
+            return child;
+
+        LOG_WRN("Pooled kit [" << child->getPid() << "] died while waiting for work.");
+    }
+
+    return nullptr;
+}
+}
+
 size_t ConvertToBroker::getInstanceCount()
 {
     return NumConverters;
 }
 
+void ConvertToBroker::initPool(const size_t maxKits, const size_t maxJobsPerKit, const size_t maxQueued)
+{
+    // Batches recycle their kits after as many documents, pooled or not.
+    MaxJobsPerKit = maxJobsPerKit;
+    if (maxKits == 0)
+        return;
+
+    LOG_INF("Converting with up to " << maxKits << " pooled kits, recycled after " << maxJobsPerKit <<
+            " documents, with up to " << maxQueued << " conversions queued.");
+    Queue.reset(new ConvertToQueue(maxKits, maxQueued));
+}
+
+std::shared_ptr<ConvertToQueue::Ticket> ConvertToBroker::enqueue(const std::string& tenant)
+{
+    return Queue ? Queue->enqueue(tenant) : nullptr;
+}
+
+void ConvertToBroker::shutdownPool()
+{
+    std::vector<std::pair<std::shared_ptr<ChildProcess>, size_t>> kits;
+    {
+        std::lock_guard<std::mutex> lock(WarmKitsMutex);
+        std::swap(kits, WarmKits);
+    }
+
+    for (const auto& kit : kits)
+        kit.first->close();
+}
+
+void ConvertToBroker::dumpPoolState(std::ostream& os)
+{
+    if (!Queue)
+        return;
+
+    std::lock_guard<std::mutex> lock(WarmKitsMutex);
+    os << "Conversion pool: " << Queue->getRunningCount() << " running, " <<
+        Queue->getQueuedCount() << " queued, " << WarmKits.size() << " warm kits\n";
+}
+
 ConvertToBroker::ConvertToBroker(const std::string& uri,
                                  const Poco::URI& uriPublic,
                                  const std::string& docKey,
                                  const std::string& format,
-                                 const std::string& sOptions) :
+                                 const std::string& sOptions,
+                                 const std::shared_ptr<ConvertToQueue::Ticket>& ticket,
+                                 const std::shared_ptr<ConvertToBatch>& batch,
+                                 const size_t batchIndex) :
     DocumentBroker(ChildType::Batch, uri, uriPublic, docKey),
     _format(format),
-    _sOptions(sOptions)
+    _sOptions(sOptions),
+    _ticket(batch ? batch->getTicket() : ticket),
+    _inBatch(static_cast<bool>(batch)),
+    _batch(batch),
+    _batchIndex(batchIndex),
+    _kitJobs(0),
+    _converted(false)
 {
     static const int limit_convert_secs = LOOLWSD::getConfigValue<int>("per_document.limit_convert_secs", 100);
     NumConverters++;
     _limitLifeSeconds = limit_convert_secs;
 }
 
-bool ConvertToBroker::startConversion(SocketDisposition &disposition, const std::string &id)
+bool ConvertToBroker::createSession(const std::string& id)
 {
     std::shared_ptr<ConvertToBroker> docBroker = std::static_pointer_cast<ConvertToBroker>(shared_from_this());
 
@@ -2376,9 +3793,30 @@ bool ConvertToBroker::startConversion(SocketDisposition &disposition, const std:
     _clientSession = std::make_shared<ClientSession>(nullPtr, id, docBroker, getPublicUri(), isReadOnly, requestDetails);
     _clientSession->construct();
 
-    if (!_clientSession)
+    return static_cast<bool>(_clientSession);
+}
+
+void ConvertToBroker::loadDocument()
+{
+    // First add and load the session.
+    addSession(_clientSession);
+
+    // Load the document manually and request saving in the target format.
+    std::string encodedFrom;
+    Poco::URI::encode(getPublicUri().getPath(), "", encodedFrom);
+    const std::string _load = "load url=" + encodedFrom + getLoadOptions();
+    std::vector<char> loadRequest(_load.begin(), _load.end());
+    _clientSession->handleMessage(loadRequest);
+
+    // Save is done in the setLoaded
+}
+
+bool ConvertToBroker::startConversion(SocketDisposition &disposition, const std::string &id)
+{
+    if (!createSession(id))
         return false;
 
+    std::shared_ptr<ConvertToBroker> docBroker = std::static_pointer_cast<ConvertToBroker>(shared_from_this());
     disposition.setMove([docBroker] (const std::shared_ptr<Socket> &moveSocket)
         {
             // Perform all of this after removing the socket
@@ -2397,22 +3835,178 @@ bool ConvertToBroker::startConversion(SocketDisposition &disposition, const std:
                      // Move the socket into DocBroker.
                      docBroker->addSocketToPoll(moveSocket);
 
-                     // First add and load the session.
-                     docBroker->addSession(docBroker->_clientSession);
-
-                     // Load the document manually and request saving in the target format.
-                     std::string encodedFrom;
-                     Poco::URI::encode(docBroker->getPublicUri().getPath(), "", encodedFrom);
-                     const std::string _load = "load url=" + encodedFrom;
-                     std::vector<char> loadRequest(_load.begin(), _load.end());
-                     docBroker->_clientSession->handleMessage(loadRequest);
-
-                     // Save is done in the setLoaded
+                     docBroker->loadDocument();
                  });
         });
     return true;
 }
 
+bool ConvertToBroker::startBatchConversion(const std::string &id)
+{
+    assert(_inBatch && "Must have a batch to convert for");
+
+    if (!createSession(id))
+        return false;
+
+    std::shared_ptr<ConvertToBroker> docBroker = std::static_pointer_cast<ConvertToBroker>(shared_from_this());
+    docBroker->startThread();
+    docBroker->addCallback([docBroker]() { docBroker->loadDocument(); });
+    return true;
+}
+
+std::shared_ptr<ChildProcess> ConvertToBroker::requestChild_Blocks()
+{
+    if (!_ticket && !_inBatch)
+        return DocumentBroker::requestChild_Blocks();
+
+    const std::shared_ptr<ConvertToBatch> batch = _batch.lock();
+    if (_inBatch && !batch)
+    {
+        LOG_DBG("Not converting [" << getDocKey() << "], its batch is gone.");
+        return nullptr;
+    }
+
+    const std::chrono::milliseconds timeout = (_limitLifeSeconds > 0
+                                               ? std::chrono::seconds(_limitLifeSeconds)
+                                               : std::chrono::hours(1));
+
+    std::shared_ptr<ChildProcess> child;
+
+    // Take over the kit of the previous document in our batch.
+    if (batch && !batch->takeKit_Blocks(child, _kitJobs, timeout))
+    {
+        LOG_WRN("Conversion of [" << getDocKey() << "] got no kit from its batch, which timed out or ended.");
+        return nullptr;
+    }
+
+    // Wait our turn for one of the pooled kits. A batch waits for its first document only.
+    if (!child && _ticket)
+    {
+        if (!Queue->wait(_ticket, timeout))
+        {
+            LOG_WRN("Conversion of [" << getDocKey() << "] timed out waiting for a kit.");
+            if (batch)
+                batch->putKit(nullptr, 0);
+            return nullptr;
+        }
+
+        child = takeWarmKit(_kitJobs);
+    }
+
+    if (child)
+    {
+        _threadStart = std::chrono::steady_clock::now();
+        LOG_DBG("Converting [" << getDocKey() << "] with " << (batch ? "batch" : "pooled") << " kit [" <<
+                child->getPid() << "] after " << _kitJobs << " documents.");
+        removeJailedDocuments(child->getJailId());
+        return child;
+    }
+
+    // We have room for another kit.
+    _kitJobs = 0;
+    child = DocumentBroker::requestChild_Blocks();
+    if (!child)
+    {
+        if (batch)
+            batch->putKit(nullptr, 0);
+        else
+            Queue->release(_ticket);
+    }
+
+    return child;
+}
+
+void ConvertToBroker::finishConversion(const std::string& id, const std::string& resultPath)
+{
+    const std::shared_ptr<ConvertToBatch> batch = _batch.lock();
+    if (batch)
+        batch->onConverted(_batchIndex, resultPath);
+
+    finishSession(id, !resultPath.empty());
+}
+
+void ConvertToBroker::finishSession(const std::string& id, const bool converted)
+{
+    _converted = converted;
+
+    // Remove us, which starts the disconnection handshake with the kit.
+    removeSession(id);
+
+    // A reusable kit is recycled once it is done with the document, which our
+    // housekeeping sees as having no sessions left. Otherwise we're done.
+    if (!_converted)
+        stop("Aborting saveas handler.");
+    else if (!isKitReusable())
+        stop("Finished saveas handler.");
+}
+
+bool ConvertToBroker::recycleChild()
+{
+    if (!isKitReusable())
+        return false;
+
+    ++_kitJobs;
+    const bool reuse = _converted && !hasSessions() && (MaxJobsPerKit == 0 || _kitJobs < MaxJobsPerKit);
+    std::shared_ptr<ChildProcess> child;
+    if (reuse)
+    {
+        child = detachChild();
+        if (!child->isAlive())
+            child.reset();
+    }
+    else
+    {
+        LOG_DBG("Not recycling kit [" << getPid() << "] of doc [" << getDocKey() << "] after " <<
+                _kitJobs << " documents" << (_converted ? "." : ", as the conversion failed."));
+    }
+
+    // Let the next document of the batch, or the next conversion, start while we flush.
+    if (_inBatch)
+    {
+        const std::shared_ptr<ConvertToBatch> batch = _batch.lock();
+        if (batch)
+            batch->putKit(child, _kitJobs);
+        else
+        {
+            // The batch ended while we had its kit, for us to release with its ticket.
+            releaseKit(child, _kitJobs);
+            if (_ticket)
+                Queue->release(_ticket);
+        }
+
+        return reuse;
+    }
+
+    if (child)
+    {
+        LOG_DBG("Returning kit [" << child->getPid() << "] to the pool after " << _kitJobs <<
+                " documents.");
+        std::lock_guard<std::mutex> lock(WarmKitsMutex);
+        WarmKits.emplace_back(child, _kitJobs);
+    }
+
+    Queue->release(_ticket);
+    return reuse;
+}
+
+void ConvertToBroker::releaseKit(const std::shared_ptr<ChildProcess>& kit, const size_t jobs)
+{
+    if (!kit)
+        return;
+
+    if (Queue && kit->isAlive() && (MaxJobsPerKit == 0 || jobs < MaxJobsPerKit))
+    {
+        LOG_DBG("Returning kit [" << kit->getPid() << "] to the pool after " << jobs << " documents.");
+        std::lock_guard<std::mutex> lock(WarmKitsMutex);
+        WarmKits.emplace_back(kit, jobs);
+    }
+    else
+    {
+        LOG_DBG("Closing kit [" << kit->getPid() << "] after " << jobs << " documents.");
+        kit->close();
+    }
+}
+
 void ConvertToBroker::dispose()
 {
     if (!_uriOrig.empty())
@@ -2421,6 +4015,69 @@ void ConvertToBroker::dispose()
         removeFile(_uriOrig);
         _uriOrig.clear();
     }
+
+    // In case we never got to run. A batch releases its ticket once it's done.
+    if (_ticket && !_inBatch)
+        Queue->release(_ticket);
+}
+
+bool ConvertToBatch::takeKit_Blocks(std::shared_ptr<ChildProcess>& kit, size_t& jobs,
+                                    const std::chrono::milliseconds timeout)
+{
+    std::unique_lock<std::mutex> lock(_kitMutex);
+    if (!_kitCV.wait_for(lock, timeout, [this]() { return !_kitInUse || _ended; }) || _ended)
+        return false;
+
+    _kitInUse = true;
+    kit = std::move(_kit);
+    _kit.reset();
+    jobs = _kitJobs;
+    return true;
+}
+
+void ConvertToBatch::putKit(const std::shared_ptr<ChildProcess>& kit, const size_t jobs)
+{
+    {
+        std::unique_lock<std::mutex> lock(_kitMutex);
+        _kitInUse = false;
+        if (!_ended)
+        {
+            _kit = kit;
+            _kitJobs = jobs;
+            _kitCV.notify_all();
+            return;
+        }
+    }
+
+    // The batch ended while we converted its last document.
+    ConvertToBroker::releaseKit(kit, jobs);
+    if (_ticket)
+        ConvertToBroker::Queue->release(_ticket);
+}
+
+void ConvertToBatch::endBatch()
+{
+    std::shared_ptr<ChildProcess> kit;
+    size_t jobs = 0;
+    {
+        std::unique_lock<std::mutex> lock(_kitMutex);
+        if (_ended)
+            return;
+
+        _ended = true;
+        _kitCV.notify_all();
+
+        // Whoever has the kit hands it back once done.
+        if (_kitInUse)
+            return;
+
+        std::swap(kit, _kit);
+        jobs = _kitJobs;
+    }
+
+    ConvertToBroker::releaseKit(kit, jobs);
+    if (_ticket)
+        ConvertToBroker::Queue->release(_ticket);
 }
 
 ConvertToBroker::~ConvertToBroker()
@@ -2469,6 +4126,103 @@ void ConvertToBroker::setLoaded()
 
     _clientSession->handleMessage(saveasRequest);
 }
+
+PreviewCache RenderPreviewBroker::Cache;
+
+RenderPreviewBroker::RenderPreviewBroker(const std::string& uri,
+                                         const Poco::URI& uriPublic,
+                                         const std::string& docKey,
+                                         const int part,
+                                         const int width,
+                                         const int height,
+                                         const std::string& cacheKey,
+                                         const std::shared_ptr<ConvertToQueue::Ticket>& ticket) :
+    ConvertToBroker(uri, uriPublic, docKey, "png", std::string(), ticket),
+    _part(part),
+    _width(width),
+    _height(height),
+    _cacheKey(cacheKey)
+{
+}
+
+std::string RenderPreviewBroker::getLoadOptions() const
+{
+    // Load with the part current, so that the status has its size.
+    return " part=" + std::to_string(_part);
+}
+
+void RenderPreviewBroker::setLoaded()
+{
+    DocumentBroker::setLoaded();
+
+    const std::shared_ptr<ClientSession>& session = getClientSession();
+    const int docWidth = session->getDocWidthTwips();
+    const int docHeight = session->getDocHeightTwips();
+    if (docWidth <= 0 || docHeight <= 0)
+    {
+        LOG_ERR("No document size to render a preview of [" << getDocKey() << "].");
+        finishSession(session->getId(), false);
+        return;
+    }
+
+    // The top of the part, full width, in the proportions asked for; or
+    // full height when the part is wider than that, eg. a slide.
+    int tileWidth = docWidth;
+    int tileHeight = static_cast<int64_t>(docWidth) * _height / _width;
+    if (tileHeight > docHeight)
+    {
+        tileHeight = docHeight;
+        tileWidth = static_cast<int64_t>(docHeight) * _width / _height;
+    }
+
+    LOG_DBG("Rendering preview of part " << _part << " of [" << getDocKey() << "] at " << _width <<
+            'x' << _height << " from " << tileWidth << 'x' << tileHeight << " twips.");
+    TileDesc tile(session->getCanonicalViewId(), _part, _width, _height, 0, 0,
+                  std::max(tileWidth, 1), std::max(tileHeight, 1), -1, 0, -1, false);
+    handleTileRequest(tile, session);
+}
+
+void RenderPreviewBroker::onTileRendered(const TileDesc& tile, const char* data, const size_t size)
+{
+    const std::shared_ptr<ClientSession>& session = getClientSession();
+    if (tile.getPart() != _part || tile.getWidth() != _width || tile.getHeight() != _height ||
+        !session || !session->getSaveAsSocket())
+        return;
+
+    if (size == 0)
+    {
+        LOG_ERR("Empty preview rendered of [" << getDocKey() << "].");
+        std::ostringstream oss;
+        oss << "HTTP/1.1 500\r\n"
+            "Date: " << Util::getHttpTimeNow() << "\r\n"
+            "User-Agent: " HTTP_AGENT_STRING "\r\n"
+            "Content-Length: 0\r\n"
+            "\r\n";
+        session->getSaveAsSocket()->send(oss.str());
+        session->getSaveAsSocket()->shutdown();
+        finishSession(session->getId(), false);
+        return;
+    }
+
+    const std::shared_ptr<const std::string> png = std::make_shared<const std::string>(data, size);
+    Cache.insert(_cacheKey, png);
+
+    sendPreview(session->getSaveAsSocket(), *png);
+    finishSession(session->getId(), true);
+}
+
+void RenderPreviewBroker::sendPreview(const std::shared_ptr<StreamSocket>& socket, const std::string& png)
+{
+    std::ostringstream oss;
+    oss << "HTTP/1.1 200 OK\r\n"
+        "Date: " << Util::getHttpTimeNow() << "\r\n"
+        "User-Agent: " HTTP_AGENT_STRING "\r\n"
+        "Content-Type: image/png\r\n"
+        "Content-Length: " << png.size() << "\r\n"
+        "\r\n" << png;
+    socket->send(oss.str());
+    socket->shutdown();
+}
 #endif
 
 std::vector<std::shared_ptr<ClientSession>> DocumentBroker::getSessionsTestOnlyUnsafe()
@@ -2502,6 +4256,9 @@ void DocumentBroker::dumpState(std::ostream& os)
     os << "\n  sent: " << sent;
     os << "\n  recv: " << recv;
     os << "\n  modified?: " << isModified();
+    if (_hibernated)
+        os << "\n  hibernated" << (_rehydrating ? ", rehydrating" : "") << ": " <<
+            LOOLWSD::anonymizeUrl(_hibernatedPath);
     os << "\n  jail id: " << _jailId;
     os << "\n  filename: " << LOOLWSD::anonymizeUrl(_filename);
     os << "\n  public uri: " << _uriPublic.toString();
@@ -2513,6 +4270,8 @@ void DocumentBroker::dumpState(std::ostream& os)
     os << "\n  last saved: " << Util::getSteadyClockAsString(_lastSaveTime);
     os << "\n  last save request: " << Util::getSteadyClockAsString(_lastSaveRequestTime);
     os << "\n  last save response: " << Util::getSteadyClockAsString(_lastSaveResponseTime);
+    os << "\n  uploading: " << isUploading();
+    os << "\n  downloading: " << isDownloading();
     os << "\n  last storage save was successful: " << isLastStorageSaveSuccessful();
     os << "\n  last modified: " << Util::getHttpTime(_documentLastModifiedTime);
     os << "\n  file last modified: " << Util::getHttpTime(_lastFileModifiedTime);
@@ -20,12 +20,17 @@
 #include <mutex>
 #include <string>
 #include <thread>
+#include <vector>
 
 #include <Poco/URI.h>
 
+#include "ConvertToBatch.hpp"
+#include "ConvertToQueue.hpp"
 #include "Log.hpp"
+#include "PreviewCache.hpp"
 #include "TileDesc.hpp"
 #include "Util.hpp"
+#include "net/MultiplexedPoll.hpp"
 #include "net/Socket.hpp"
 #include "net/WebSocketHandler.hpp"
 
@@ -74,7 +79,8 @@ public:
 
         WSProcess("ChildProcess", pid, socket, std::make_shared<WebSocketHandler>(socket, request)),
         _jailId(jailId),
-        _smapsFD(-1)
+        _smapsFD(-1),
+        _sharedKit(false)
     {
     }
 
@@ -91,10 +97,15 @@ public:
     void setSMapsFD(int smapsFD) { _smapsFD = smapsFD;}
     int getSMapsFD(){ return _smapsFD; }
 
+    /// Whether this is another connection to a kit that hosts other documents too.
+    bool isSharedKit() const { return _sharedKit; }
+    void setSharedKit(bool sharedKit) { _sharedKit = sharedKit; }
+
 private:
     const std::string _jailId;
     std::weak_ptr<DocumentBroker> _docBroker;
     int _smapsFD;
+    bool _sharedKit;
 };
 
 class RequestDetails;
@@ -110,6 +121,8 @@ class ClientSession;
 class DocumentBroker : public std::enable_shared_from_this<DocumentBroker>
 {
     class DocumentBrokerPoll;
+    class SharedPoll;
+    class SharedPollTask;
 
     void setupPriorities();
 
@@ -121,6 +134,13 @@ public:
 
     static Poco::URI sanitizeURI(const std::string& uri);
 
+    /// Multiplex new DocumentBrokers onto @count poll threads
+    /// instead of giving each its own, see per_document.poll_threads.
+    static void startSharedPolls(int count);
+
+    /// Stop and join the shared poll threads, once the DocumentBrokers are done.
+    static void joinSharedPolls();
+
     /// Returns a document-specific key based
     /// on the URI of the document.
     static std::string getDocKey(const Poco::URI& uri);
@@ -139,6 +159,9 @@ public:
     /// Called when removed from the DocBrokers list
     virtual void dispose() {}
 
+    /// Whether we only convert the document, for convert-to.
+    virtual bool isConvertTo() const { return false; }
+
     /// Start processing events
     void startThread();
 
@@ -148,6 +171,11 @@ public:
     /// Hard removes a session by ID, only for ClientSession.
     void finalRemoveSession(const std::string& id);
 
+    /// Called for each session requested, before it's created and before we start.
+    /// If the first is @isReadOnly, we may share a kit with other read-only documents,
+    /// until a later session edits it.
+    void requestSession(bool isReadOnly);
+
     /// Create new client session
     std::shared_ptr<ClientSession> createNewClientSession(
         const std::shared_ptr<ProtocolHandlerInterface> &ws,
@@ -221,6 +249,10 @@ public:
     /// Add a callback to be invoked in our polling thread.
     void addCallback(const SocketPoll::CallbackFn& fn);
 
+    /// Add a callback that adds a session, to be invoked in our polling thread
+    /// once the document isn't downloading, as loading the session needs the storage.
+    void addSessionCallback(const SocketPoll::CallbackFn& fn);
+
     /// Transfer this socket into our polling thread / loop.
     void addSocketToPoll(const std::shared_ptr<Socket>& socket);
 
@@ -253,6 +285,11 @@ public:
     void sendRequestedTiles(const std::shared_ptr<ClientSession>& session);
     void cancelTileRequests(const std::shared_ptr<ClientSession>& session);
 
+    /// When the kit is idle, render the tiles each session is likely to scroll to next.
+    void prefetchTiles();
+    /// Cancel the session's prefetch renders, except those intersecting @keep.
+    void cancelPrefetch(const std::shared_ptr<ClientSession>& session, const Util::Rectangle& keep);
+
     enum ClipboardRequest {
         CLIP_REQUEST_SET,
         CLIP_REQUEST_GET,
@@ -351,6 +388,53 @@ private:
                                const std::string& saveAsFilename = std::string(),
                                const bool isRename = false, const bool force = false);
 
+    struct Upload;
+
+    /// Handles the result of the @upload of the saved document, or of saving
+    /// it as @saveAsPath, to storage.
+    bool handleUploadResult(const Upload& upload, const std::string& saveAsPath, bool isRename);
+
+    /// Runs the @upload in a thread of its own, not to stall editing, nor
+    /// the other documents sharing our poll thread, meanwhile.
+    void startUpload(std::unique_ptr<Upload> upload);
+
+    /// Handles the result of the background upload once it is done.
+    void finishUpload();
+
+    /// Waits for the background upload, if any, to finish; for anything that
+    /// uses the storage, or overwrites the saved document, in the meantime.
+    void waitForUpload();
+
+    /// True while the saved document is uploaded in the background.
+    bool isUploading() const { return _upload != nullptr; }
+
+    /// Reports how long the save took from its request to the end of the
+    /// @upload, and how long of that editing was stalled.
+    void reportSaveDurations(const Upload& upload);
+
+    /// Prepares the document downloaded to @localPath for the kit to load.
+    bool loadLocalFile(std::string localPath, const std::string& templateSource);
+
+    /// Traces the new @session, and sends it how long loading from storage took.
+    void reportLoaded(const std::shared_ptr<ClientSession>& session,
+                      std::chrono::duration<double> getInfoCallDuration);
+
+    struct Download;
+
+    /// Runs the @download in a thread of its own, not to stall the other
+    /// documents sharing our poll thread meanwhile.
+    void startDownload(std::unique_ptr<Download> download);
+
+    /// Loads the document downloaded in the background once it is done,
+    /// or tells the sessions that it failed, and adds those that waited for it.
+    void finishDownload();
+
+    /// Adds the sessions that came while downloading.
+    void addDownloadSessions();
+
+    /// True while the document is downloaded in the background.
+    bool isDownloading() const { return _download != nullptr; }
+
     /**
      * Report back the save result to PostMessage users (Action_Save_Resp)
      * @param success: Whether saving was successful
@@ -386,12 +470,105 @@ private:
     /// associated with this document.
     void pollThread();
 
+    /// One spin of our loop when we share a poll thread. Returns false when finished.
+    bool runSharedPoll(std::chrono::steady_clock::time_point now);
+
     /// Sum the I/O stats from all connected sessions
     void getIOStats(uint64_t &sent, uint64_t &recv);
 
+    /// Where our poll loop is at; only tracked with any precision when sharing a poll thread.
+    enum class PollState
+    {
+        Idle, Starting, Running, Flushing, Finished
+    };
+
+    static std::shared_ptr<SharedPoll> getLeastBusySharedPoll();
+
+    /// Attach the @child and start the loop. Returns false, having cleaned up, without one.
+    bool startPolling(const std::shared_ptr<ChildProcess>& child);
+
+    /// The periodic checks of the poll loop: timeouts, stats, autosave, idle and dead documents.
+    void pollHousekeeping(std::chrono::steady_clock::time_point now);
+
+    /// Sends the sessions' invalidation frames due at @now. Returns the time until
+    /// the next one is due, at most @timeoutMaxMicroS, to poll for.
+    int64_t flushInvalidations(std::chrono::steady_clock::time_point now, int64_t timeoutMaxMicroS);
+
+    /// Puts the saved document aside, out of the jail, and lets the kit go, keeping the sessions.
+    bool hibernate();
+
+    /// Puts the document aside as hibernate() does, to be loaded into another kit.
+    bool putAside();
+
+    /// Moves the document out of the kit it shares with other documents, which
+    /// only hosts read-only views, for @session to edit it.
+    void leaveSharedKit(const std::shared_ptr<ClientSession>& session);
+
+    /// Gets a kit for the hibernated document, without blocking the poll.
+    void rehydrate();
+
+    /// Rehydrates into the kit we got, once we have it.
+    void finishRehydrate();
+
+    /// Waits for the kit we were getting to rehydrate, if any, and closes it, as we go away.
+    void abandonRehydrate();
+
+    /// Loads the hibernated document into @child, and reloads the views where they were.
+    void rehydrateInto(const std::shared_ptr<ChildProcess>& child);
+
+    /// Sends @message to the kit or, while hibernated, holds on to it and rehydrates.
+    void sendToChild(const std::string& message);
+
+    /// Where the document goes in the jail of @jailId.
+    std::string getJailedDocumentDir(const std::string& jailId) const;
+
+    /// Removes the document from the jail of a kit that hosts others too.
+    void removeFromSharedKit();
+
+    /// Leave the loop and start flushing the sockets.
+    void stopPolling();
+
+    /// Terminate the child and drop the sockets, once flushed.
+    void finishPolling();
+
+    /// Remove our sockets from the poll.
+    void releaseSockets();
+
+    /// True while any of our sockets have output pending.
+    bool hasUnflushedSockets() const;
+
+    /// Wake up the poll loop, to act on a changed state.
+    void wakeupPoll();
+
+    /// Run the housekeeping after the current event, as a dedicated loop does anyway.
+    void housekeepSoon();
+
 protected:
+    /// Get a child for the document, retrying for a while.
+    virtual std::shared_ptr<ChildProcess> requestChild_Blocks();
+
+    /// Get a child, retrying for a while after @start.
+    std::shared_ptr<ChildProcess> waitForChild_Blocks(std::chrono::steady_clock::time_point start);
+
+    /// Called when polling stops, before the child is terminated. Returns true
+    /// when the child was taken with detachChild() to serve another document.
+    virtual bool recycleChild() { return false; }
+
+    /// Takes the child out of our poll and off our hands.
+    std::shared_ptr<ChildProcess> detachChild();
+
+    /// Whether the kit is to wait for another document, rather than exit, once our last session is gone.
+    virtual bool isKitReusable() const { return false; }
+
+    bool hasSessions() const { return !_sessions.empty(); }
+
+    /// Called with each tile the kit renders, once it's cached and sent to the subscribers.
+    virtual void onTileRendered(const TileDesc& /*tile*/, const char* /*data*/, size_t /*size*/) {}
+
     /// Seconds to live for, or 0 forever
     int64_t _limitLifeSeconds;
+    /// When we started getting a child, to time the load and our life.
+    std::chrono::steady_clock::time_point _threadStart;
     std::string _uriOrig;
     /// What type are we: affects priority.
     ChildType _type;
@@ -431,6 +608,25 @@ private:
     /// The jailed file last-modified time.
     std::chrono::system_clock::time_point _lastFileModifiedTime;
 
+    /// The hash of the jailed file as last uploaded to, or downloaded from,
+    /// storage, not to upload the same content again.
+    std::string _lastUploadedFileHash;
+
+    /// The bytes written to storage by the uploads, those not written by
+    /// skipping some or sending only the changed members of the package to
+    /// a WOPI host, and the number of uploads skipped.
+    uint64_t _uploadedBytes;
+    uint64_t _uploadSavedBytes;
+    uint64_t _uploadsSkipped;
+
+    /// The upload running in the background, if any.
+    std::unique_ptr<Upload> _upload;
+
+    /// The download running in the background, if any.
+    std::unique_ptr<Download> _download;
+    /// The sessions that came while downloading, to add once it's done.
+    std::vector<SocketPoll::CallbackFn> _downloadCallbacks;
+
     /// All session of this DocBroker by ID.
     SessionMap<ClientSession> _sessions;
 
@@ -448,7 +644,20 @@ private:
     int _cursorWidth;
     int _cursorHeight;
     mutable std::mutex _mutex;
-    std::unique_ptr<DocumentBrokerPoll> _poll;
+    /// The poll thread shared with other documents, if any.
+    std::shared_ptr<SharedPoll> _sharedPoll;
+    std::shared_ptr<SharedPollTask> _sharedPollTask;
+    /// Either our own DocumentBrokerPoll or the _sharedPoll.
+    std::shared_ptr<SocketPoll> _poll;
+    std::atomic<PollState> _pollState;
+    /// Callbacks added before we had a child, to run once we do.
+    std::vector<SocketPoll::CallbackFn> _startupCallbacks;
+    /// Gets the child for the _sharedPoll, as that may block.
+    std::thread _spawnThread;
+    /// Our sockets in the _sharedPoll, which may be added from any thread.
+    std::vector<std::weak_ptr<Socket>> _sockets;
+    mutable std::mutex _socketsMutex;
+    std::chrono::steady_clock::time_point _flushStartTime;
     std::atomic<bool> _stop;
     std::string _closeReason;
     std::unique_ptr<LockContext> _lockCtx;
@@ -460,13 +669,44 @@ private:
     int _debugRenderedTileCount;
 
     std::chrono::steady_clock::time_point _lastActivityTime;
-    std::chrono::steady_clock::time_point _threadStart;
     std::chrono::milliseconds _loadDuration;
     std::chrono::milliseconds _wopiLoadDuration;
 
+    /// Used by the poll loop housekeeping to accumulate B/W deltas, and time its checks.
+    uint64_t _adminSent;
+    uint64_t _adminRecv;
+    std::chrono::steady_clock::time_point _lastBWUpdateTime;
+    std::chrono::steady_clock::time_point _lastClipboardHashUpdateTime;
+    std::chrono::steady_clock::time_point _last30SecCheckTime;
+    std::chrono::steady_clock::time_point _loadDeadline;
+    int _limitLoadSecs;
+
+    /// Set while the document is put aside, at _hibernatedPath, without a kit.
+    bool _hibernated;
+    /// Set while we wait for a kit to load the hibernated document into.
+    bool _rehydrating;
+    /// Gets the kit to rehydrate into, and sets _rehydrateChild and _rehydrateDone.
+    std::thread _rehydrateThread;
+    std::shared_ptr<ChildProcess> _rehydrateChild;
+    std::atomic<bool> _rehydrateDone;
+    std::string _hibernatedPath;
+    /// What came for the kit while hibernated, or downloading, by view, if any,
+    /// to send once it's loaded.
+    std::vector<std::pair<std::string, std::string>> _heldMessages;
+    std::chrono::steady_clock::time_point _rehydrateStart;
+
+    /// Whether a session was requested yet, see requestSession().
+    std::atomic<bool> _sessionRequested;
+    /// Whether the first session asked for is read-only, so we may share a kit with other
+    /// such documents, see per_document.read_only_docs_per_kit, until one edits it.
+    std::atomic<bool> _canShareKit;
+
     /// Unique DocBroker ID for tracing and debugging.
     static std::atomic<unsigned> DocBrokerId;
 
+    /// The poll threads DocumentBrokers share, if so configured.
+    static std::vector<std::shared_ptr<SharedPoll>> SharedPolls;
+
     // Relevant only in the mobile apps
     const unsigned _mobileAppDocId;
 
@@ -475,24 +715,49 @@ private:
 };
 
 #if !MOBILEAPP
-class ConvertToBroker final : public DocumentBroker
+class ConvertToBroker : public DocumentBroker
 {
     const std::string _format;
     const std::string _sOptions;
     std::shared_ptr<ClientSession> _clientSession;
 
+    /// Our place in the queue for a pooled kit, if we use one.
+    const std::shared_ptr<ConvertToQueue::Ticket> _ticket;
+    /// The batch we convert document @_batchIndex of, if we are in one. The
+    /// batch owns us, and may be gone, as when its client is.
+    const bool _inBatch;
+    const std::weak_ptr<ConvertToBatch> _batch;
+    const size_t _batchIndex;
+    /// The number of documents our kit converted before this one.
+    size_t _kitJobs;
+    /// Set once the result is sent back.
+    bool _converted;
+
 public:
     /// Construct DocumentBroker with URI and docKey
     ConvertToBroker(const std::string& uri,
                     const Poco::URI& uriPublic,
                     const std::string& docKey,
                     const std::string& format,
-                    const std::string& sOptions);
+                    const std::string& sOptions,
+                    const std::shared_ptr<ConvertToQueue::Ticket>& ticket = nullptr,
+                    const std::shared_ptr<ConvertToBatch>& batch = nullptr,
+                    size_t batchIndex = 0);
     virtual ~ConvertToBroker();
 
+    bool isConvertTo() const override { return true; }
+
     /// Move socket to this broker for response & do conversion
     bool startConversion(SocketDisposition &disposition, const std::string &id);
 
+    /// Do the conversion for our batch, which gets the result.
+    bool startBatchConversion(const std::string &id);
+
+    /// Called with the converted @resultPath, or empty on failure, once the
+    /// result is sent back, to remove the session @id and either terminate
+    /// or recycle the kit.
+    void finishConversion(const std::string& id, const std::string& resultPath);
+
     /// Called when removed from the DocBrokers list
     void dispose() override;
 
@@ -504,6 +769,88 @@ public:
 
     /// Cleanup path and its parent
     static void removeFile(const std::string &uri);
+
+    /// Convert with up to @maxKits long-lived kits, each recycled after @maxJobsPerKit
+    /// documents, with up to @maxQueued conversions waiting for one. 0 @maxKits
+    /// keeps spawning a kit per conversion.
+    static void initPool(size_t maxKits, size_t maxJobsPerKit, size_t maxQueued);
+
+    /// Queue a conversion for @tenant, if we have a pool.
+    /// Returns nullptr when the queue is full, or there is no pool.
+    static std::shared_ptr<ConvertToQueue::Ticket> enqueue(const std::string& tenant);
+
+    static bool isPooled() { return static_cast<bool>(Queue); }
+
+    /// Close the kits waiting for work.
+    static void shutdownPool();
+
+    static void dumpPoolState(std::ostream& os);
+
+protected:
+    const std::shared_ptr<ClientSession>& getClientSession() const { return _clientSession; }
+
+    /// More options of the load command.
+    virtual std::string getLoadOptions() const { return std::string(); }
+
+    /// Removes the session @id, and terminates the kit, or recycles it when it @converted.
+    void finishSession(const std::string& id, bool converted);
+
+private:
+    friend class ConvertToBatch;
+
+    /// Create the session that loads the document and asks for the conversion.
+    bool createSession(const std::string& id);
+
+    void loadDocument();
+
+    std::shared_ptr<ChildProcess> requestChild_Blocks() override;
+
+    bool recycleChild() override;
+
+    bool isKitReusable() const override { return _ticket || _inBatch; }
+
+    /// Returns a @kit, having converted @jobs documents, to the pool if it can
+    /// convert more, otherwise closes it.
+    static void releaseKit(const std::shared_ptr<ChildProcess>& kit, size_t jobs);
+
+    static std::unique_ptr<ConvertToQueue> Queue;
+};
+
+/// Renders a part of a document as a PNG, for the render-preview REST API,
+/// loading it read-only as for convert-to, but rendering a tile rather than saving.
+class RenderPreviewBroker final : public ConvertToBroker
+{
+    const int _part;
+    const int _width;
+    const int _height;
+    const std::string _cacheKey;
+
+public:
+    /// Render @part at @width x @height pixels, caching the result under @cacheKey.
+    RenderPreviewBroker(const std::string& uri,
+                        const Poco::URI& uriPublic,
+                        const std::string& docKey,
+                        int part,
+                        int width,
+                        int height,
+                        const std::string& cacheKey,
+                        const std::shared_ptr<ConvertToQueue::Ticket>& ticket = nullptr);
+
+    /// When the load completes - render
+    void setLoaded() override;
+
+    /// Previews rendered lately.
+    static PreviewCache& getCache() { return Cache; }
+
+    /// Sends the @png preview as the HTTP response on @socket.
+    static void sendPreview(const std::shared_ptr<StreamSocket>& socket, const std::string& png);
+
+private:
+    std::string getLoadOptions() const override;
+
+    void onTileRendered(const TileDesc& tile, const char* data, size_t size) override;
+
+    static PreviewCache Cache;
 };
 #endif
 
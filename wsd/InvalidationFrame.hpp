@@ -0,0 +1,194 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 100 -*- */
+/*
+ * This file is part of the LibreOffice project.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Rectangle.hpp"
+
+/// The tile invalidations for a client, paced into frames.
+///
+/// Each invalidation makes the client repaint and us request the tiles under
+/// it, so rather than forwarding a burst of them one by one, we collect them
+/// until the frame is due, merging the ones that touch, and send the merged
+/// rectangles. An invalidation after a quiet spell is due right away; the
+/// next ones wait for the frame interval, which follows the round-trip time
+/// to the client within the configured frame rates.
+class InvalidationFrame
+{
+public:
+    using TimePoint = std::chrono::steady_clock::time_point;
+
+    /// More rectangles than this in a part are merged into their bounding box.
+    static constexpr size_t MaxRectangles = 32;
+
+    InvalidationFrame()
+        : _minInterval(0)
+        , _maxInterval(0)
+        , _messagesIn(0)
+        , _messagesOut(0)
+    {
+    }
+
+    /// Sends frames at most @maxFps and at least @minFps times a second,
+    /// when there is something to send. A @maxFps of 0 disables pacing.
+    void configure(const int minFps, const int maxFps)
+    {
+        if (maxFps <= 0)
+        {
+            _minInterval = _maxInterval = std::chrono::milliseconds(0);
+            return;
+        }
+
+        _minInterval = std::chrono::milliseconds(1000 / maxFps);
+        _maxInterval = std::max(_minInterval, std::chrono::milliseconds(1000 / std::max(minFps, 1)));
+    }
+
+    bool isEnabled() const { return _maxInterval.count() > 0; }
+
+    /// The interval between frames for a client @rtt away, if known: half
+    /// of it, as updates faster than the client can answer are wasted.
+    std::chrono::milliseconds getInterval(const std::chrono::microseconds rtt) const
+    {
+        const auto halfRtt = std::chrono::duration_cast<std::chrono::milliseconds>(rtt / 2);
+        return std::min(std::max(halfRtt, _minInterval), _maxInterval);
+    }
+
+    /// Adds the invalidation of @rectangle in @part, or of all the parts if
+    /// @part is negative, due a frame @interval after the last one.
+    void add(const int part, const Util::Rectangle& rectangle, const TimePoint now,
+             const std::chrono::milliseconds interval)
+    {
+        if (_parts.empty())
+            _deadline = std::max(now, _lastFrame + interval);
+
+        ++_messagesIn;
+
+        if (_parts.count(-1))
+            return;
+
+        if (part < 0)
+        {
+            _parts.clear();
+            _parts[-1].push_back(rectangle);
+            return;
+        }
+
+        std::vector<Util::Rectangle>& rectangles = _parts[part];
+        if (!rectangles.empty() && isWholePart(rectangles.front()))
+            return;
+
+        if (isWholePart(rectangle))
+        {
+            rectangles.assign(1, rectangle);
+            return;
+        }
+
+        // Merge with the rectangles it touches, and the ones the merged rectangle touches.
+        Util::Rectangle merged = rectangle;
+        for (bool merging = true; merging;)
+        {
+            merging = false;
+            for (auto it = rectangles.begin(); it != rectangles.end(); ++it)
+            {
+                if (merged.intersects(*it))
+                {
+                    merged = getBoundingBox(merged, *it);
+                    rectangles.erase(it);
+                    merging = true;
+                    break;
+                }
+            }
+        }
+
+        if (rectangles.size() >= MaxRectangles)
+        {
+            for (const Util::Rectangle& other : rectangles)
+                merged = getBoundingBox(merged, other);
+            rectangles.clear();
+        }
+
+        rectangles.push_back(merged);
+    }
+
+    bool isPending() const { return !_parts.empty(); }
+
+    /// When the pending frame is due.
+    TimePoint getDeadline() const { return _deadline; }
+
+    bool isDue(const TimePoint now) const { return isPending() && now >= _deadline; }
+
+    /// The invalidatetiles: messages of the pending frame, which is cleared.
+    std::vector<std::string> take(const TimePoint now)
+    {
+        std::vector<std::string> messages;
+        for (const auto& pair : _parts)
+        {
+            for (const Util::Rectangle& rectangle : pair.second)
+            {
+                if (pair.first < 0)
+                    messages.emplace_back("invalidatetiles: EMPTY");
+                else if (isWholePart(rectangle))
+                    messages.emplace_back("invalidatetiles: EMPTY, " + std::to_string(pair.first));
+                else
+                    messages.emplace_back("invalidatetiles: part=" + std::to_string(pair.first)
+                                          + " x=" + std::to_string(rectangle.getLeft())
+                                          + " y=" + std::to_string(rectangle.getTop())
+                                          + " width=" + std::to_string(rectangle.getWidth())
+                                          + " height=" + std::to_string(rectangle.getHeight()));
+            }
+        }
+
+        _messagesOut += messages.size();
+        _parts.clear();
+        _lastFrame = now;
+        return messages;
+    }
+
+    /// The number of invalidations added, and of the messages they were merged into.
+    uint64_t getMessagesIn() const { return _messagesIn; }
+    uint64_t getMessagesOut() const { return _messagesOut; }
+
+private:
+    /// Whether @rectangle is what EMPTY invalidates, the whole part.
+    static bool isWholePart(const Util::Rectangle& rectangle)
+    {
+        return rectangle.getLeft() <= 0 && rectangle.getTop() <= 0
+               && rectangle.getRight() == INT_MAX && rectangle.getBottom() == INT_MAX;
+    }
+
+    static Util::Rectangle getBoundingBox(const Util::Rectangle& first,
+                                          const Util::Rectangle& second)
+    {
+        Util::Rectangle box;
+        box.setLeft(std::min(first.getLeft(), second.getLeft()));
+        box.setTop(std::min(first.getTop(), second.getTop()));
+        box.setRight(std::max(first.getRight(), second.getRight()));
+        box.setBottom(std::max(first.getBottom(), second.getBottom()));
+        return box;
+    }
+
+    std::chrono::milliseconds _minInterval;
+    std::chrono::milliseconds _maxInterval;
+    /// The rectangles of the pending frame by part, -1 being all of them.
+    std::map<int, std::vector<Util::Rectangle>> _parts;
+    TimePoint _deadline;
+    TimePoint _lastFrame;
+    uint64_t _messagesIn;
+    uint64_t _messagesOut;
+};
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
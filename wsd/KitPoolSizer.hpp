@@ -0,0 +1,227 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 100 -*- */
+/*
+ * This file is part of the LibreOffice project.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+
+/// Sizes the pool of spare kits to the rate at which documents ask for them.
+///
+/// We keep an exponentially weighted moving average of the rate of requests,
+/// and of the time forkit takes to spawn a kit, and aim to have as many spare
+/// kits as would be asked for while their replacements spawn, within the
+/// configured minimum and maximum. So a burst of opens finds kits ready, and
+/// the pool shrinks back to the minimum when it's quiet.
+class KitPoolSizer
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /// The buckets of the time-to-child histogram.
+    static constexpr int BucketCount = 10;
+
+    /// The upper bound, in ms, of bucket @index; the last one is unbounded.
+    static int64_t getBucketBoundMs(const int index)
+    {
+        static const int64_t bounds[BucketCount - 1]
+            = { 10, 50, 100, 250, 500, 1000, 2500, 5000, 10000 };
+        return bounds[index];
+    }
+
+    KitPoolSizer()
+        : _minSpare(1)
+        , _maxSpare(1)
+        , _halfLife(std::chrono::seconds(60))
+        , _refillDelay(0)
+        , _rate(0)
+        , _spawnMs(0)
+        , _jailSetupMs(0)
+        , _requests(0)
+        , _waitBuckets()
+        , _waitCount(0)
+        , _waitTotalMs(0)
+    {
+    }
+
+    /// Keeps between @minSpare and @maxSpare spare kits, with the rate of
+    /// requests halving every @halfLife without any. The @refillDelay is how
+    /// long we take to notice a spare is gone and ask forkit for another.
+    void configure(const size_t minSpare, const size_t maxSpare,
+                   const std::chrono::milliseconds halfLife,
+                   const std::chrono::milliseconds refillDelay)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _minSpare = minSpare;
+        _maxSpare = std::max(minSpare, maxSpare);
+        _halfLife = std::max(halfLife, std::chrono::milliseconds(1));
+        _refillDelay = refillDelay;
+    }
+
+    /// A document asked for a kit at @now.
+    void addRequest(const Clock::time_point now = Clock::now())
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        // Each request adds to the rate so that its contribution,
+        // integrated over its decay, is exactly one request.
+        _rate = decayedRate(now) + std::log(2.0) / halfLifeSecs();
+        _lastRequest = now;
+        ++_requests;
+    }
+
+    /// A kit took @duration from forking to being ready, @jailSetup of it setting up its jail.
+    void addSpawnTime(const std::chrono::milliseconds duration,
+                      const std::chrono::milliseconds jailSetup)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        const bool first = (_spawnMs == 0);
+        const double ms = std::max<int64_t>(duration.count(), 0);
+        _spawnMs = (first ? ms : _spawnMs + (ms - _spawnMs) / 8);
+        const double jailMs = std::max<int64_t>(jailSetup.count(), 0);
+        _jailSetupMs = (first ? jailMs : _jailSetupMs + (jailMs - _jailSetupMs) / 8);
+    }
+
+    /// A document waited @duration to get its kit.
+    void addWaitTime(const std::chrono::milliseconds duration)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        const int64_t ms = std::max<int64_t>(duration.count(), 0);
+        int bucket = 0;
+        while (bucket < BucketCount - 1 && ms > getBucketBoundMs(bucket))
+            ++bucket;
+
+        ++_waitBuckets[bucket];
+        ++_waitCount;
+        _waitTotalMs += ms;
+    }
+
+    /// The average rate of requests, per second, at @now.
+    double getRate(const Clock::time_point now = Clock::now()) const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return decayedRate(now);
+    }
+
+    /// The number of spare kits to keep at @now.
+    size_t getTarget(const Clock::time_point now = Clock::now()) const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return target(now);
+    }
+
+    uint64_t getRequestCount() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _requests;
+    }
+
+    uint64_t getWaitCount() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _waitCount;
+    }
+
+    uint64_t getWaitBucket(const int index) const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _waitBuckets[index];
+    }
+
+    /// Prints the Prometheus metrics of the pool, the time-to-child as a histogram.
+    void getMetrics(std::ostream& os) const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        const Clock::time_point now = Clock::now();
+
+        os << "kit_spare_target_count " << target(now) << std::endl;
+        os << "kit_spare_min_count " << _minSpare << std::endl;
+        os << "kit_spare_max_count " << _maxSpare << std::endl;
+        os << "kit_request_count " << _requests << std::endl;
+        os << "kit_request_rate_per_minute " << decayedRate(now) * 60 << std::endl;
+        os << "kit_spawn_duration_milliseconds " << static_cast<uint64_t>(_spawnMs) << std::endl;
+        os << "kit_jail_setup_duration_milliseconds " << static_cast<uint64_t>(_jailSetupMs)
+           << std::endl;
+
+        uint64_t cumulative = 0;
+        for (int i = 0; i < BucketCount; ++i)
+        {
+            cumulative += _waitBuckets[i];
+            os << "kit_wait_duration_milliseconds_bucket{le=\"";
+            if (i < BucketCount - 1)
+                os << getBucketBoundMs(i);
+            else
+                os << "+Inf";
+            os << "\"} " << cumulative << std::endl;
+        }
+        os << "kit_wait_duration_milliseconds_sum " << _waitTotalMs << std::endl;
+        os << "kit_wait_duration_milliseconds_count " << _waitCount << std::endl;
+    }
+
+    void dumpState(std::ostream& os) const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        const Clock::time_point now = Clock::now();
+        os << "\n  Spare kits: " << target(now) << " targeted in [" << _minSpare << ", "
+           << _maxSpare << "], " << decayedRate(now) * 60 << " requests/min, spawning in "
+           << static_cast<uint64_t>(_spawnMs) << "ms (jail "
+           << static_cast<uint64_t>(_jailSetupMs) << "ms), " << _waitCount << " waited, avg "
+           << (_waitCount ? _waitTotalMs / _waitCount : 0) << "ms";
+    }
+
+private:
+    double halfLifeSecs() const
+    {
+        return std::chrono::duration<double>(_halfLife).count();
+    }
+
+    double decayedRate(const Clock::time_point now) const
+    {
+        if (_rate == 0)
+            return 0;
+
+        const double elapsed = std::chrono::duration<double>(now - _lastRequest).count();
+        return _rate * std::exp2(-std::max(elapsed, 0.0) / halfLifeSecs());
+    }
+
+    size_t target(const Clock::time_point now) const
+    {
+        // Cover the requests expected until a kit we ask for now is ready.
+        const double leadSecs = (_spawnMs + _refillDelay.count()) / 1000.0;
+        const double expected = std::ceil(decayedRate(now) * leadSecs);
+        if (expected <= _minSpare)
+            return _minSpare;
+        return std::min<size_t>(static_cast<size_t>(expected), _maxSpare);
+    }
+
+    mutable std::mutex _mutex;
+
+    size_t _minSpare;
+    size_t _maxSpare;
+    std::chrono::milliseconds _halfLife;
+    std::chrono::milliseconds _refillDelay;
+
+    /// Requests per second, as of _lastRequest.
+    double _rate;
+    Clock::time_point _lastRequest;
+    /// The average time to spawn a kit, and to set up its jail.
+    double _spawnMs;
+    double _jailSetupMs;
+    uint64_t _requests;
+
+    uint64_t _waitBuckets[BucketCount];
+    uint64_t _waitCount;
+    uint64_t _waitTotalMs;
+};
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -53,6 +53,7 @@
 #include <chrono>
 #include <fstream>
 #include <iostream>
+#include <limits>
 #include <map>
 #include <mutex>
 #include <sstream>
@@ -66,6 +67,7 @@
 #include <Poco/Net/HTTPRequest.h>
 #include <Poco/Net/IPAddress.h>
 #include <Poco/Net/MessageHeader.h>
+#include <Poco/Net/MultipartReader.h>
 #include <Poco/Net/NameValueCollection.h>
 #include <Poco/Net/Net.h>
 #include <Poco/Net/NetException.h>
@@ -84,6 +86,7 @@ using Poco::Net::PartHandler;
 #include <Poco/DOM/Element.h>
 #include <Poco/DOM/NodeList.h>
 #include <Poco/DateTimeFormatter.h>
+#include <Poco/DigestStream.h>
 #include <Poco/DirectoryIterator.h>
 #include <Poco/Exception.h>
 #include <Poco/File.h>
@@ -93,6 +96,7 @@ using Poco::Net::PartHandler;
 #include <Poco/Net/HostEntry.h>
 #include <Poco/Path.h>
 #include <Poco/SAX/InputSource.h>
+#include <Poco/SHA1Engine.h>
 #include <Poco/StreamCopier.h>
 #include <Poco/TemporaryFile.h>
 #include <Poco/URI.h>
@@ -197,6 +201,8 @@ std::string MasterLocation;
 static std::mutex NewChildrenMutex;
 static std::condition_variable NewChildrenCV;
 static std::vector<std::shared_ptr<ChildProcess> > NewChildren;
+// The connections kits offer for more read-only documents, see per_document.read_only_docs_per_kit.
+static std::vector<std::shared_ptr<ChildProcess> > SharedKitChildren;
 
 static std::chrono::steady_clock::time_point LastForkRequestTime = std::chrono::steady_clock::now();
 static std::atomic<int> OutstandingForks(0);
@@ -411,6 +417,15 @@ static bool cleanupChildren()
         }
     }
 
+    for (int i = static_cast<int>(SharedKitChildren.size()) - 1; i >= 0; --i)
+    {
+        if (!SharedKitChildren[i]->isAlive())
+        {
+            LOG_DBG("Removing dead shared kit child [" << SharedKitChildren[i]->getPid() << "].");
+            SharedKitChildren.erase(SharedKitChildren.begin() + i);
+        }
+    }
+
     return static_cast<int>(NewChildren.size()) != count;
 }
 
@@ -459,7 +474,21 @@ static bool prespawnChildren()
 {
     // Rebalance if not forking already.
     std::unique_lock<std::mutex> lock(NewChildrenMutex, std::defer_lock);
-    return lock.try_lock() && (rebalanceChildren(LOOLWSD::NumPreSpawnedChildren) > 0);
+    if (!lock.try_lock())
+        return false;
+
+    // Let go of the spares we no longer expect to need, one at a time.
+    const size_t target = LOOLWSD::SpareKits.getTarget();
+    if (NewChildren.size() > target)
+    {
+        LOG_DBG("prespawnChildren: Have " << NewChildren.size() << " spare children, above the " <<
+                target << " targeted, closing [" << NewChildren.front()->getPid() << "].");
+        NewChildren.front()->close();
+        NewChildren.erase(NewChildren.begin());
+        return false;
+    }
+
+    return rebalanceChildren(target) > 0;
 }
 
 #endif
@@ -485,6 +514,37 @@ static size_t addNewChild(const std::shared_ptr<ChildProcess>& child)
     return count;
 }
 
+/// A kit offers to host another read-only document, in a connection of its own.
+static void addSharedKitChild(const std::shared_ptr<ChildProcess>& child)
+{
+    std::unique_lock<std::mutex> lock(NewChildrenMutex);
+
+    SharedKitChildren.emplace_back(child);
+    LOG_INF("Have " << SharedKitChildren.size() << " shared kit children after adding [" <<
+            child->getPid() << "].");
+}
+
+std::shared_ptr<ChildProcess> getSharedKitChild()
+{
+    std::unique_lock<std::mutex> lock(NewChildrenMutex);
+
+    while (!SharedKitChildren.empty())
+    {
+        std::shared_ptr<ChildProcess> child = SharedKitChildren.back();
+        SharedKitChildren.pop_back();
+        if (child->isAlive())
+        {
+            LOG_DBG("getSharedKitChild: Have " << SharedKitChildren.size() <<
+                    " shared kit children after poping [" << child->getPid() << "].");
+            return child;
+        }
+
+        LOG_WRN("getSharedKitChild: popped dead child, need to find another.");
+    }
+
+    return nullptr;
+}
+
 #if MOBILEAPP
 #ifndef IOS
 std::mutex LOOLWSD::lokit_main_mutex;
@@ -501,7 +561,7 @@ std::shared_ptr<ChildProcess> getNewChild_Blocks(unsigned mobileAppDocId)
     (void) mobileAppDocId;
 
     LOG_DBG("getNewChild: Rebalancing children.");
-    int numPreSpawn = LOOLWSD::NumPreSpawnedChildren;
+    int numPreSpawn = static_cast<int>(LOOLWSD::SpareKits.getTarget());
     ++numPreSpawn; // Replace the one we'll dispatch just now.
     if (rebalanceChildren(numPreSpawn) < 0)
     {
@@ -618,27 +678,466 @@ public:
         if (!params.has("filename"))
             return;
 
+        _filename = createTempFile(params.get("filename"), _convertTo);
+
+        // Copy the stream to _filename.
+        std::ofstream fileStream;
+        fileStream.open(_filename);
+        StreamCopier::copyStream(stream, fileStream);
+        fileStream.close();
+    }
+
+    /// Creates a private temporary directory for the uploaded @filename,
+    /// and returns the path of the file in it.
+    static std::string createTempFile(const std::string& filename, bool convertTo)
+    {
         // FIXME: needs wrapping - until then - keep in sync with ~ConvertToBroker
         Path tempPath = Path::forDirectory(
-            Poco::TemporaryFile::tempName(_convertTo ? "/tmp/convert-to" : "") + '/');
+            Poco::TemporaryFile::tempName(convertTo ? "/tmp/convert-to" : "") + '/');
         LOG_TRC("Creating temporary convert-to path: " << tempPath.toString());
         File(tempPath).createDirectories();
         chmod(tempPath.toString().c_str(), S_IXUSR | S_IWUSR | S_IRUSR);
 
         // Prevent user inputting anything funny here.
         // A "filename" should always be a filename, not a path
-        const Path filenameParam(params.get("filename"));
+        const Path filenameParam(filename);
         tempPath.setFileName(filenameParam.getFileName());
-        _filename = tempPath.toString();
+        return tempPath.toString();
+    }
+};
 
-        // Copy the stream to _filename.
-        std::ofstream fileStream;
-        fileStream.open(_filename);
-        StreamCopier::copyStream(stream, fileStream);
-        fileStream.close();
+/// Reads the files of a convert-to-batch form, one at a time.
+class ConvertToBatchFormReader final : public ConvertToBatch::Reader
+{
+public:
+    ConvertToBatchFormReader(std::istream& stream, const std::string& boundary)
+        : _reader(stream, boundary)
+    {
+    }
+
+    bool next(const ConvertToBatch::CreateFile& createFile, ConvertToBatch::Document& document) override
+    {
+        document = ConvertToBatch::Document();
+        try
+        {
+            while (!_failed && _reader.hasNextPart())
+            {
+                MessageHeader header;
+                _reader.nextPart(header);
+
+                std::string disp;
+                NameValueCollection params;
+                if (header.has("Content-Disposition"))
+                {
+                    std::string cd = header.get("Content-Disposition");
+                    MessageHeader::splitParameters(cd, disp, params);
+                }
+
+                std::istream& stream = _reader.stream();
+                const std::string filename = Path(params.get("filename", "")).getFileName();
+                if (filename.empty())
+                {
+                    if (params.get("name", "") == "format")
+                        StreamCopier::copyToString(stream, _format);
+                    else
+                        stream.ignore(std::numeric_limits<std::streamsize>::max());
+                    continue;
+                }
+
+                document._name = filename;
+                if (!createFile)
+                {
+                    stream.ignore(std::numeric_limits<std::streamsize>::max());
+                    return true;
+                }
+
+                document._path = createFile(filename);
+                std::ofstream file(document._path, std::ios::binary);
+                StreamCopier::copyStream(stream, file);
+                file.close();
+                if (!file)
+                {
+                    _failed = true;
+                    return false;
+                }
+
+                return true;
+            }
+        }
+        catch (const Poco::Exception& exc)
+        {
+            LOG_WRN("Malformed form in batch conversion request: " << exc.displayText());
+            _failed = true;
+        }
+
+        return false;
+    }
+
+    /// The format field of the form, if read yet.
+    const std::string& getFormat() const { return _format; }
+
+private:
+    Poco::Net::MultipartReader _reader;
+    std::string _format;
+};
+
+/// Converts the documents of a convert-to-batch request one after another,
+/// with the same kit, and streams the results back as they come.
+///
+/// The response is a chunked multipart/mixed body with a part per document,
+/// in the order of the request, whose X-Convert-Status header tells whether
+/// it converted. We don't start the next document while the client is behind
+/// reading the results. Each document is written out of the request only
+/// once its turn comes. All the batches run as tasks of one poll thread.
+class ConvertToBatchRequest final : public MultiplexedPoll::Task,
+                                   public ConvertToBatch,
+                                   public std::enable_shared_from_this<ConvertToBatchRequest>
+{
+public:
+    /// Converts the @count documents of a tar archive, or of a form with
+    /// @formBoundary, to @format.
+    ConvertToBatchRequest(size_t count,
+                          const std::string& formBoundary,
+                          const std::string& format,
+                          const std::shared_ptr<ConvertToQueue::Ticket>& ticket)
+        : ConvertToBatch(ticket)
+        , _count(count)
+        , _formBoundary(formBoundary)
+        , _format(format)
+        , _boundary("lool-convert-to-batch-" + Util::rng::getHexString(16))
+        , _started(false)
+        , _index(0)
+        , _finished(false)
+        , _converted(false)
+        , _converting(false)
+    {
+    }
+
+    ~ConvertToBatchRequest()
+    {
+        // Just in case we never started. The current document's broker removes
+        // its own file, and the others are not written out.
+        endBatch();
+    }
+
+    /// Reads the documents of a tar archive, or of a form with @formBoundary, from @stream.
+    static std::unique_ptr<ConvertToBatch::Reader> createReader(std::istream& stream,
+                                                               const std::string& formBoundary)
+    {
+        if (formBoundary.empty())
+            return std::unique_ptr<ConvertToBatch::Reader>(new TarReader(stream));
+
+        return std::unique_ptr<ConvertToBatch::Reader>(new ConvertToBatchFormReader(stream, formBoundary));
+    }
+
+    /// Takes over the client's socket, as @disposition moves it, and starts converting.
+    void start(SocketDisposition& disposition)
+    {
+        std::shared_ptr<ConvertToBatchRequest> batch = shared_from_this();
+        disposition.setMove([batch](const std::shared_ptr<Socket>& moveSocket)
+            {
+                const std::shared_ptr<MultiplexedPoll> poll = getPoll();
+                if (!poll)
+                    return;
+
+                batch->_socket = std::static_pointer_cast<StreamSocket>(moveSocket);
+
+                // The socket kept the request body, past the header the dispatcher
+                // took, which we read the documents from as we get to them.
+                batch->_body.swap(batch->_socket->getInBuffer());
+                batch->_bodyStream.reset(new Poco::MemoryInputStream(batch->_body.data(),
+                                                                     batch->_body.size()));
+                batch->_reader = createReader(*batch->_bodyStream, batch->_formBoundary);
+
+                // We no longer own this socket.
+                moveSocket->setThreadOwner(std::thread::id(0));
+                poll->insertNewSocket(moveSocket);
+                poll->addTask(batch);
+            });
+    }
+
+    bool run(std::chrono::steady_clock::time_point now) override
+    {
+        if (!_started)
+        {
+            _started = true;
+            sendHeader();
+        }
+
+        if (!pump())
+        {
+            stop();
+            return false;
+        }
+
+        // Results wake us up, but the client reading them doesn't.
+        setDeadline(now + PumpInterval);
+        return true;
+    }
+
+    void abandon() override
+    {
+        stop();
+    }
+
+    void onConverted(size_t index, const std::string& resultPath) override
+    {
+        std::string data;
+        bool converted = false;
+        if (!resultPath.empty())
+        {
+            std::ifstream file(resultPath, std::ios::binary);
+            std::ostringstream oss;
+            oss << file.rdbuf();
+            converted = static_cast<bool>(file);
+            data = oss.str();
+        }
+
+        LOG_DBG("Batch document #" << index << (converted ? " converted." : " failed to convert."));
+        {
+            std::lock_guard<std::mutex> lock(_resultMutex);
+            _converted = converted;
+            _result = std::move(data);
+            _converting = false;
+        }
+
+        const std::shared_ptr<MultiplexedPoll> poll = getPoll();
+        if (poll)
+            poll->wakeupTask(*this);
+    }
+
+    /// Stops the batches, at shutdown.
+    static void stopAll()
+    {
+        std::shared_ptr<MultiplexedPoll> poll;
+        {
+            std::lock_guard<std::mutex> lock(PollMutex);
+            std::swap(poll, Poll);
+            Stopped = true;
+        }
+
+        if (poll)
+            poll->joinThread();
+    }
+
+private:
+    /// The poll of all the batches, started with the first of them.
+    static std::shared_ptr<MultiplexedPoll> getPoll()
+    {
+        std::lock_guard<std::mutex> lock(PollMutex);
+        if (!Poll && !Stopped)
+        {
+            Poll = std::make_shared<MultiplexedPoll>("convert_batch");
+            Poll->startThread();
+        }
+
+        return Poll;
+    }
+
+    /// We convert no more: the current document's broker finishes on its own,
+    /// without us, and we let go of the request.
+    void stop()
+    {
+        _docBroker.reset();
+        _reader.reset();
+        _bodyStream.reset();
+        std::vector<char>().swap(_body);
+        endBatch();
+    }
+
+    void sendHeader()
+    {
+        LOG_INF("Converting a batch of " << _count << " documents to " << _format << '.');
+        std::ostringstream oss;
+        oss << "HTTP/1.1 200 OK\r\n"
+            "Date: " << Util::getHttpTimeNow() << "\r\n"
+            "User-Agent: " HTTP_AGENT_STRING "\r\n"
+            "Content-Type: multipart/mixed; boundary=" << _boundary << "\r\n"
+            "Transfer-Encoding: chunked\r\n"
+            "\r\n";
+        _socket->send(oss.str());
+    }
+
+    void sendChunk(const std::string& data)
+    {
+        std::ostringstream oss;
+        oss << std::hex << data.size() << "\r\n";
+        _socket->send(oss.str(), false);
+        _socket->send(data, false);
+        _socket->send("\r\n");
+    }
+
+    /// Sends the result of the current document, @converted to @data or not.
+    void sendResult(bool converted, const std::string& data)
+    {
+        Path fileName(_name);
+        fileName.setExtension(_format);
+
+        std::ostringstream oss;
+        oss << "--" << _boundary << "\r\n"
+            "Content-Disposition: attachment; filename=\"" << fileName.getFileName() << "\"\r\n"
+            "Content-Type: application/octet-stream\r\n"
+            "X-Convert-Status: " << (converted ? "ok" : "failed") << "\r\n"
+            "Content-Length: " << data.size() << "\r\n"
+            "\r\n" << data << "\r\n";
+        sendChunk(oss.str());
+    }
+
+    /// Moves the batch along: sends the current document's result when it's in,
+    /// and starts the next document when the client is keeping up.
+    /// Returns false once the batch is done.
+    bool pump()
+    {
+        if (_socket->isClosed())
+        {
+            if (!_finished)
+                LOG_WRN("Client gone with " << _count - _index << " of batch left to convert.");
+            return false;
+        }
+
+        // Give the client a while to read the last results.
+        if (_finished)
+        {
+            if (std::chrono::steady_clock::now() - _finishTime > std::chrono::milliseconds(COMMAND_TIMEOUT_MS * 6))
+            {
+                LOG_WRN("Client too slow to read the last results of batch.");
+                _socket->closeConnection();
+                return false;
+            }
+            return true;
+        }
+
+        if (_docBroker)
+        {
+            // Results are in before the broker is done.
+            const bool alive = _docBroker->isAlive();
+            std::unique_lock<std::mutex> lock(_resultMutex);
+            if (_converting && alive)
+                return true;
+
+            sendResult(_converted && !_converting, _result);
+            _result.clear();
+            _converting = false;
+            lock.unlock();
+
+            _docBroker.reset();
+            ++_index;
+        }
+
+        // Wait for the client to catch up with the results.
+        if (_socket->getOutBuffer().size() > MaxBufferedBytes)
+            return true;
+
+        if (!SigUtil::getShutdownRequestFlag() && convertNext())
+            return true;
+
+        // All done.
+        LOG_INF("Finished converting a batch of " << _index << " documents.");
+        _finished = true;
+        _finishTime = std::chrono::steady_clock::now();
+        sendChunk("--" + _boundary + "--\r\n");
+        _socket->send("0\r\n\r\n");
+        _socket->shutdown();
+        endBatch();
+        return true;
     }
+
+    /// Writes the next document out of the request, and starts converting it.
+    /// Returns false when there are no more.
+    bool convertNext()
+    {
+        Document document;
+        const auto createFile = [](const std::string& name)
+        {
+            return ConvertToPartHandler::createTempFile(name, true);
+        };
+
+        if (!_reader->next(createFile, document))
+        {
+            if (_reader->isFailed())
+            {
+                LOG_ERR("Failed to write batch document #" << _index << ", ending the batch.");
+                if (!document._path.empty())
+                    ConvertToBroker::removeFile(document._path);
+            }
+
+            return false;
+        }
+
+        _name = document._name;
+        const std::string& fromPath = document._path;
+        const Poco::URI uriPublic = DocumentBroker::sanitizeURI(fromPath);
+        const std::string docKey = DocumentBroker::getDocKey(uriPublic);
+        LOG_DBG("Converting batch document #" << _index << " as [" << docKey << "].");
+
+        {
+            std::lock_guard<std::mutex> lock(_resultMutex);
+            _converting = true;
+        }
+
+        std::unique_lock<std::mutex> docBrokersLock(DocBrokersMutex);
+        _docBroker = std::make_shared<ConvertToBroker>(fromPath, uriPublic, docKey, _format, std::string(),
+                                                       nullptr, shared_from_this(), _index);
+
+        cleanupDocBrokers();
+
+        DocBrokers.emplace(docKey, _docBroker);
+        LOG_TRC("Have " << DocBrokers.size() << " DocBrokers after inserting [" << docKey << "].");
+
+        if (!_docBroker->startBatchConversion(LOOLWSD::GetConnectionId()))
+        {
+            LOG_WRN("Failed to create Client Session on docKey [" << docKey << "].");
+            cleanupDocBrokers();
+        }
+
+        return true;
+    }
+
+    /// Don't convert more while the client has this much left to read.
+    static constexpr size_t MaxBufferedBytes = 4 * 1024 * 1024;
+
+    /// How often to check whether the client caught up.
+    static constexpr std::chrono::milliseconds PumpInterval = std::chrono::milliseconds(100);
+
+    static std::mutex PollMutex;
+    static std::shared_ptr<MultiplexedPoll> Poll;
+    /// No new batches once we stop.
+    static bool Stopped;
+
+    /// The number of documents in the request.
+    const size_t _count;
+    /// The boundary of the form, empty for a tar archive.
+    const std::string _formBoundary;
+    /// The request body, and what reads the documents from it, once we have the socket.
+    std::vector<char> _body;
+    std::unique_ptr<Poco::MemoryInputStream> _bodyStream;
+    std::unique_ptr<ConvertToBatch::Reader> _reader;
+
+    const std::string _format;
+    const std::string _boundary;
+    std::shared_ptr<StreamSocket> _socket;
+    /// Sent the header, only used in the poll thread.
+    bool _started;
+
+    /// The document we convert, its name, and its broker.
+    size_t _index;
+    std::string _name;
+    std::shared_ptr<ConvertToBroker> _docBroker;
+    bool _finished;
+    std::chrono::steady_clock::time_point _finishTime;
+
+    std::mutex _resultMutex;
+    /// The result of the current document, set by its broker.
+    bool _converted;
+    bool _converting;
+    std::string _result;
 };
 
+constexpr std::chrono::milliseconds ConvertToBatchRequest::PumpInterval;
+std::mutex ConvertToBatchRequest::PollMutex;
+std::shared_ptr<MultiplexedPoll> ConvertToBatchRequest::Poll;
+bool ConvertToBatchRequest::Stopped = false;
+
 namespace
 {
 
@@ -765,6 +1264,7 @@ std::chrono::time_point<std::chrono::system_clock> LOOLWSD::StartTime;
 static std::string UnitTestLibrary;
 
 unsigned int LOOLWSD::NumPreSpawnedChildren = 0;
+KitPoolSizer LOOLWSD::SpareKits;
 std::unique_ptr<TraceFileWriter> LOOLWSD::TraceDumper;
 #if !MOBILEAPP
 std::unique_ptr<ClipboardCache> LOOLWSD::SavedClipboards;
@@ -859,6 +1359,20 @@ void ForKitProcWSHandler::handleMessage(const std::vector<char> &data)
             LOG_WRN("Invalid 'segfaultcount' message received.");
         }
     }
+    else if (tokens.size() == 8 && tokens.equals(0, "kitspawn"))
+    {
+        // Timed by the kit, from forkit forking it to it being ready.
+        const int spawnMs = std::stoi(tokens[2]);
+        const int jailSetupMs = std::stoi(tokens[3]);
+        LOG_DBG("Kit [" << tokens[1] << "] spawned in " << spawnMs << " ms, " << jailSetupMs <<
+                " ms of it setting up the jail.");
+        LOOLWSD::SpareKits.addSpawnTime(std::chrono::milliseconds(spawnMs),
+                                        std::chrono::milliseconds(jailSetupMs));
+
+        // And its memory, before and after trimming it.
+        Admin::instance().addSpareKitMemory(std::stoul(tokens[4]), std::stoul(tokens[5]),
+                                            std::stoul(tokens[6]), std::stoul(tokens[7]));
+    }
     else
     {
         LOG_ERR("ForKitProcWSHandler: unknown command: " << tokens[0]);
@@ -906,6 +1420,7 @@ void LOOLWSD::initialize(Application& self)
             { "logging.anonymize.filenames", "false" }, // Deprecated.
             { "logging.anonymize.usernames", "false" }, // Deprecated.
             // { "logging.anonymize.anonymize_user_data", "false" }, // Do not set to fallback on filename/username.
+            { "logging.async", "true" },
             { "logging.color", "true" },
             { "logging.file.property[0]", "loolwsd.log" },
             { "logging.file.property[0][@name]", "path" },
@@ -928,6 +1443,8 @@ void LOOLWSD::initialize(Application& self)
             { "logging.lokit_sal_log", "-INFO-WARN" },
             { "loleaflet_html", "loleaflet.html" },
             { "loleaflet_logging", "false" },
+            { "max_prespawn_children", "1" },
+            { "mount_jail_overlay", "false" },
             { "mount_jail_tree", "true" },
             { "net.connection_timeout_secs", "30" },
             { "net.listen", "any" },
@@ -935,8 +1452,10 @@ void LOOLWSD::initialize(Application& self)
             { "net.service_root", "" },
             { "net.proxy_prefix", "false" },
             { "num_prespawn_children", "1" },
+            { "prespawn_half_life_secs", "60" },
             { "per_document.always_save_on_exit", "false" },
             { "per_document.autosave_duration_secs", "300" },
+            { "per_document.background_upload", "true" },
             { "per_document.cleanup.cleanup_interval_ms", "10000" },
             { "per_document.cleanup.bad_behavior_period_secs", "60" },
             { "per_document.cleanup.idle_time_secs", "300" },
@@ -944,6 +1463,7 @@ void LOOLWSD::initialize(Application& self)
             { "per_document.cleanup.limit_cpu_per", "85" },
             { "per_document.cleanup[@enable]", "false" },
             { "per_document.document_signing_url", VEREIGN_URL },
+            { "per_document.hibernate_idle_secs", "0" },
             { "per_document.idle_timeout_secs", "3600" },
             { "per_document.idlesave_duration_secs", "30" },
             { "per_document.limit_file_size_mb", "0" },
@@ -953,9 +1473,20 @@ void LOOLWSD::initialize(Application& self)
             { "per_document.limit_stack_mem_kb", "8000" },
             { "per_document.limit_virt_mem_mb", "0" },
             { "per_document.max_concurrency", "4" },
+            { "per_document.poll_threads", "0" },
             { "per_document.batch_priority", "5" },
+            { "per_document.convert_kits", "0" },
+            { "per_document.convert_kit_max_jobs", "100" },
+            { "per_document.convert_queue_size", "100" },
+            { "per_document.preview_cache_size_mb", "64" },
+            { "per_document.clipboard_cache_size_mb", "64" },
+            { "per_document.clipboard_spill_size_mb", "256" },
+            { "per_document.clipboard_spill_threshold_kb", "1024" },
+            { "per_document.read_only_docs_per_kit", "1" },
             { "per_document.redlining_as_comments", "false" },
             { "per_view.idle_timeout_secs", "900" },
+            { "per_view.invalidation_max_fps", "60" },
+            { "per_view.invalidation_min_fps", "30" },
             { "per_view.out_of_focus_timeout_secs", "120" },
             { "security.capabilities", "true" },
             { "security.seccomp", "true" },
@@ -978,13 +1509,16 @@ void LOOLWSD::initialize(Application& self)
             { "storage.wopi[@allow]", "true" },
             { "storage.wopi.locking.refresh", "900" },
             { "sys_template_path", "systemplate" },
+            { "trace.path[@binary]", "false" },
             { "trace.path[@compress]", "true" },
             { "trace.path[@snapshot]", "false" },
             { "trace[@enable]", "false" },
+            { "trim_kit_memory", "false" },
             { "welcome.enable", ENABLE_WELCOME_MESSAGE },
             { "welcome.enable_button", ENABLE_WELCOME_MESSAGE_BUTTON },
             { "welcome.path", "loleaflet/welcome" },
-            { "user_interface.mode", USER_INTERFACE_MODE }
+            { "user_interface.mode", USER_INTERFACE_MODE },
+            { "warm_document_types", "" }
           };
 
     // Set default values, in case they are missing from the config file.
@@ -1070,6 +1604,13 @@ void LOOLWSD::initialize(Application& self)
 
     // Log at trace level until we complete the initialization.
     Log::initialize("wsd", "trace", withColor, logToFile, logProperties);
+
+    // Forkit is not to have threads when it forks, so it logs synchronously.
+    if (getConfigValue<bool>(conf, "logging.async", true))
+    {
+        setenv("LOOL_LOGASYNC", "1", true);
+        Log::startAsync();
+    }
     if (LogLevel != "trace")
     {
         LOG_INF("Setting log-level to [trace] and delaying setting to configured [" << LogLevel << "] until after WSD initialization.");
@@ -1230,7 +1771,8 @@ void LOOLWSD::initialize(Application& self)
 
 #if !MOBILEAPP
     // Setup the jails.
-    JailUtil::setupJails(getConfigValue<bool>(conf, "mount_jail_tree", true), ChildRoot,
+    JailUtil::setupJails(getConfigValue<bool>(conf, "mount_jail_tree", true),
+                         getConfigValue<bool>(conf, "mount_jail_overlay", false), ChildRoot,
                          SysTemplate);
 
     LOG_DBG("FileServerRoot before config: " << FileServerRoot);
@@ -1249,6 +1791,15 @@ void LOOLWSD::initialize(Application& self)
     }
     LOG_INF("NumPreSpawnedChildren set to " << NumPreSpawnedChildren << '.');
 
+    // Up to this many spare kits when documents are opened in quick succession.
+    const int maxPreSpawnedChildren = getConfigValue<int>(conf, "max_prespawn_children", 1);
+    const int preSpawnHalfLifeSecs = getConfigValue<int>(conf, "prespawn_half_life_secs", 60);
+    SpareKits.configure(NumPreSpawnedChildren, std::max(maxPreSpawnedChildren, 0),
+                        std::chrono::seconds(std::max(preSpawnHalfLifeSecs, 1)),
+                        std::chrono::milliseconds(CHILD_REBALANCE_INTERVAL_MS));
+    LOG_INF("Spare kits between " << NumPreSpawnedChildren << " and " <<
+            std::max<int>(NumPreSpawnedChildren, maxPreSpawnedChildren) << '.');
+
     FileUtil::registerFileSystemForDiskSpaceChecks(ChildRoot);
 
     const auto maxConcurrency = getConfigValue<int>(conf, "per_document.max_concurrency", 4);
@@ -1363,13 +1914,33 @@ void LOOLWSD::initialize(Application& self)
         }
 
         const auto compress = getConfigValue<bool>(conf, "trace.path[@compress]", false);
+        const auto binary = getConfigValue<bool>(conf, "trace.path[@binary]", false);
         const auto takeSnapshot = getConfigValue<bool>(conf, "trace.path[@snapshot]", false);
-        TraceDumper.reset(new TraceFileWriter(path, recordOutgoing, compress, takeSnapshot, filters));
+        TraceDumper.reset(new TraceFileWriter(path, recordOutgoing, compress, binary, takeSnapshot, filters));
     }
 
 #if !MOBILEAPP
     SavedClipboards.reset(new ClipboardCache());
 
+    // Large clipboards go deflated out of the jails, dropping those a previous run left.
+    std::string clipboardSpillDir = Poco::Path(ChildRoot, "tmp/clipboards/").toString();
+    try
+    {
+        FileUtil::removeFile(clipboardSpillDir, true);
+        Poco::File(clipboardSpillDir).createDirectories();
+    }
+    catch (const Poco::Exception& exc)
+    {
+        LOG_WRN("Failed to create [" << clipboardSpillDir << "], not spilling clipboards to disk: " <<
+                exc.displayText());
+        clipboardSpillDir.clear();
+    }
+    SavedClipboards->configure(
+        static_cast<size_t>(getConfigValue<int>(conf, "per_document.clipboard_cache_size_mb", 64)) * 1024 * 1024,
+        static_cast<size_t>(getConfigValue<int>(conf, "per_document.clipboard_spill_size_mb", 256)) * 1024 * 1024,
+        static_cast<size_t>(getConfigValue<int>(conf, "per_document.clipboard_spill_threshold_kb", 1024)) * 1024,
+        clipboardSpillDir);
+
     FileServerRequestHandler::initialize();
 #endif
 
@@ -1886,6 +2457,17 @@ bool LOOLWSD::createForKit()
 
     args.push_back("--ui=" + UserInterface);
 
+    const std::string warmDocumentTypes = getConfigValue<std::string>("warm_document_types", "");
+    if (!warmDocumentTypes.empty())
+        args.push_back("--warm=" + warmDocumentTypes);
+
+    if (getConfigValue<bool>("trim_kit_memory", false))
+        args.push_back("--trim-memory");
+
+    const int docsPerKit = getConfigValue<int>("per_document.read_only_docs_per_kit", 1);
+    if (docsPerKit > 1)
+        args.push_back("--docs-per-kit=" + std::to_string(docsPerKit));
+
     if (!CheckLoolUser)
         args.push_back("--disable-lool-user-checking");
 
@@ -1927,7 +2509,7 @@ bool LOOLWSD::createForKit()
     // Init the Admin manager
     Admin::instance().setForKitPid(ForKitProcId);
 
-    const int balance = LOOLWSD::NumPreSpawnedChildren - OutstandingForks;
+    const int balance = static_cast<int>(LOOLWSD::SpareKits.getTarget()) - OutstandingForks;
     if (balance > 0)
         rebalanceChildren(balance);
 
@@ -2137,11 +2719,15 @@ private:
             const Poco::URI::QueryParameters params = requestURI.getQueryParameters();
             int pid = socket->getPid();
             std::string jailId;
+            bool shared = false;
             for (const auto& param : params)
             {
                 if (param.first == "jailid")
                     jailId = param.second;
 
+                else if (param.first == "shared")
+                    shared = (param.second == "1");
+
                 else if (param.first == "version")
                     LOOLWSD::LOKitVersion = param.second;
             }
@@ -2160,12 +2746,13 @@ private:
 
             socket->getInBuffer().clear();
 
-            LOG_INF("New child [" << pid << "], jailId: " << jailId << '.');
+            LOG_INF("New " << (shared ? "shared kit " : "") << "child [" << pid << "], jailId: " << jailId << '.');
 
             UnitWSD::get().newChild(*this);
 #else
             pid_t pid = 100;
             std::string jailId = "jail";
+            const bool shared = false;
             socket->getInBuffer().clear();
 #endif
             LOG_TRC("Calling make_shared<ChildProcess>, for NewChildren?");
@@ -2173,12 +2760,19 @@ private:
             auto child = std::make_shared<ChildProcess>(pid, jailId, socket, request);
 
             child->setSMapsFD(socket->getIncomingFD());
+            child->setSharedKit(shared);
             _childProcess = child; // weak
 
             // Remove from prisoner poll since there is no activity
             // until we attach the childProcess (with this socket)
             // to a docBroker, which will do the polling.
-            disposition.setMove([child](const std::shared_ptr<Socket> &){
+            disposition.setMove([child, shared](const std::shared_ptr<Socket> &){
+                    if (shared)
+                    {
+                        addSharedKitChild(child);
+                        return;
+                    }
+
                     LOG_TRC("Calling addNewChild in disposition's move thing to add to NewChildren");
                     addNewChild(child);
                 });
@@ -2980,6 +3574,177 @@ private:
                || sContentType == "application/vnd.ms-excel";
     }
 
+    /// Sends an empty response with @status, and any @extraHeaders, and closes the connection.
+    static void sendEmptyResponse(const std::shared_ptr<StreamSocket>& socket, const std::string& status,
+                                  const std::string& extraHeaders = std::string())
+    {
+        std::ostringstream oss;
+        oss << "HTTP/1.1 " << status << "\r\n"
+            "Date: " << Util::getHttpTimeNow() << "\r\n"
+            "User-Agent: " HTTP_AGENT_STRING "\r\n"
+            << extraHeaders <<
+            "Content-Length: 0\r\n"
+            "\r\n";
+        socket->send(oss.str());
+        socket->shutdown();
+    }
+
+    /// Renders a part of a posted document as a PNG, for thumbnails, from our cache when we can.
+    void handleRenderPreviewRequest(const Poco::Net::HTTPRequest& request,
+                                    Poco::MemoryInputStream& message,
+                                    SocketDisposition& disposition,
+                                    const std::shared_ptr<StreamSocket>& socket)
+    {
+        // Validate sender - FIXME: should do this even earlier.
+        if (!allowConvertTo(socket->clientAddress(), request, true))
+        {
+            LOG_WRN("Conversion requests not allowed from this address: " << socket->clientAddress());
+            sendEmptyResponse(socket, "403");
+            return;
+        }
+
+        ConvertToPartHandler handler(/*convertTo =*/ true);
+        HTMLForm form(request, message, handler);
+
+        constexpr int MaxPreviewSize = 2048;
+        const int part = std::atoi(form.get("part", "0").c_str());
+        const int width = std::atoi(form.get("width", "256").c_str());
+        const int height = std::atoi(form.get("height", "256").c_str());
+        const std::string fromPath = handler.getFilename();
+        LOG_INF("Preview request for URI [" << fromPath << "] part " << part << " at " << width << 'x' << height << '.');
+        if (fromPath.empty() || part < 0 || width <= 0 || height <= 0 ||
+            width > MaxPreviewSize || height > MaxPreviewSize)
+        {
+            sendEmptyResponse(socket, "400");
+            return;
+        }
+
+        // By content, so that the same document uploaded again, or under another name, hits.
+        std::ifstream istr(fromPath, std::ios::binary);
+        Poco::SHA1Engine sha1;
+        Poco::DigestOutputStream dos(sha1);
+        StreamCopier::copyStream(istr, dos);
+        dos.close();
+        const std::string cacheKey = PreviewCache::makeKey(Poco::DigestEngine::digestToHex(sha1.digest()),
+                                                           part, width, height);
+
+        const PreviewCache::Data png = RenderPreviewBroker::getCache().lookup(cacheKey);
+        if (png)
+        {
+            LOG_DBG("Sending cached preview [" << cacheKey << "].");
+            RenderPreviewBroker::sendPreview(socket, *png);
+            return;
+        }
+
+        // Wait for a pooled kit, in turn with the other clients, if we have a pool.
+        std::shared_ptr<ConvertToQueue::Ticket> ticket;
+        if (ConvertToBroker::isPooled())
+        {
+            ticket = ConvertToBroker::enqueue(socket->clientAddress());
+            if (!ticket)
+            {
+                LOG_WRN("Conversion queue is full, rejecting preview from " << socket->clientAddress());
+                sendEmptyResponse(socket, "503", "Retry-After: 1\r\n");
+                return;
+            }
+        }
+
+        Poco::URI uriPublic = DocumentBroker::sanitizeURI(fromPath);
+        const std::string docKey = DocumentBroker::getDocKey(uriPublic);
+
+        std::unique_lock<std::mutex> docBrokersLock(DocBrokersMutex);
+
+        LOG_DBG("New DocumentBroker for docKey [" << docKey << "].");
+        auto docBroker = std::make_shared<RenderPreviewBroker>(fromPath, uriPublic, docKey, part, width, height,
+                                                               cacheKey, ticket);
+        handler.takeFile();
+
+        cleanupDocBrokers();
+
+        DocBrokers.emplace(docKey, docBroker);
+        LOG_TRC("Have " << DocBrokers.size() << " DocBrokers after inserting [" << docKey << "].");
+
+        if (!docBroker->startConversion(disposition, _id))
+        {
+            LOG_WRN("Failed to create Client Session with id [" << _id << "] on docKey [" << docKey << "].");
+            cleanupDocBrokers();
+        }
+    }
+
+    /// Converts many documents, posted as form files or as a tar archive,
+    /// streaming the results back as they come.
+    void handleConvertToBatchRequest(const RequestDetails &requestDetails,
+                                     const Poco::Net::HTTPRequest& request,
+                                     Poco::MemoryInputStream& message,
+                                     SocketDisposition& disposition,
+                                     const std::shared_ptr<StreamSocket>& socket)
+    {
+        // Validate sender - FIXME: should do this even earlier.
+        if (!allowConvertTo(socket->clientAddress(), request, true))
+        {
+            LOG_WRN("Conversion requests not allowed from this address: " << socket->clientAddress());
+            sendEmptyResponse(socket, "403");
+            return;
+        }
+
+        // prefer what is in the URI
+        std::string format = (requestDetails.size() > 2 ? requestDetails[2] : "");
+
+        // Count the documents, and find the format of a form, without writing them out:
+        // they are, one at a time, as the batch gets to them.
+        std::string formBoundary;
+        size_t count = 0;
+        bool malformed = false;
+        ConvertToBatch::Document document;
+        if (request.getContentType() == "application/x-tar")
+        {
+            ConvertToBatch::TarReader reader(message);
+            while (reader.next(nullptr, document))
+                ++count;
+            malformed = reader.isFailed();
+        }
+        else
+        {
+            std::string mediaType;
+            NameValueCollection params;
+            MessageHeader::splitParameters(request.getContentType(), mediaType, params);
+            formBoundary = params.get("boundary", "");
+            if (mediaType == "multipart/form-data" && !formBoundary.empty())
+            {
+                ConvertToBatchFormReader reader(message, formBoundary);
+                while (reader.next(nullptr, document))
+                    ++count;
+                malformed = reader.isFailed();
+                if (format.empty())
+                    format = reader.getFormat();
+            }
+        }
+
+        LOG_INF("Batch conversion request for " << count << " documents to format [" << format << "].");
+        if (malformed || count == 0 || format.empty())
+        {
+            if (malformed)
+                LOG_WRN("Malformed batch conversion request.");
+            sendEmptyResponse(socket, "400");
+            return;
+        }
+
+        // The batch takes one pooled kit, in turn with the other clients, if we have a pool.
+        std::shared_ptr<ConvertToQueue::Ticket> ticket;
+        if (ConvertToBroker::isPooled())
+        {
+            ticket = ConvertToBroker::enqueue(socket->clientAddress());
+            if (!ticket)
+            {
+                LOG_WRN("Conversion queue is full, rejecting batch from " << socket->clientAddress());
+                sendEmptyResponse(socket, "503", "Retry-After: 1\r\n");
+                return;
+            }
+        }
+
+        std::make_shared<ConvertToBatchRequest>(count, formBoundary, format, ticket)->start(disposition);
+    }
+
     void handlePostRequest(const RequestDetails &requestDetails,
                            const Poco::Net::HTTPRequest& request,
                            Poco::MemoryInputStream& message,
@@ -2992,7 +3757,17 @@ private:
 
         Poco::Net::HTTPResponse response;
 
-        if (requestDetails.equals(1, "convert-to"))
+        if (requestDetails.equals(1, "convert-to-batch"))
+        {
+            handleConvertToBatchRequest(requestDetails, request, message, disposition, socket);
+            return;
+        }
+        else if (requestDetails.equals(1, "render-preview"))
+        {
+            handleRenderPreviewRequest(request, message, disposition, socket);
+            return;
+        }
+        else if (requestDetails.equals(1, "convert-to"))
         {
             // Validate sender - FIXME: should do this even earlier.
             if (!allowConvertTo(socket->clientAddress(), request, true))
@@ -3021,6 +3796,27 @@ private:
             LOG_INF("Conversion request for URI [" << fromPath << "] format [" << format << "].");
             if (!fromPath.empty() && !format.empty())
             {
+                // Wait for a pooled kit, in turn with the other clients, if we have a pool.
+                std::shared_ptr<ConvertToQueue::Ticket> ticket;
+                if (ConvertToBroker::isPooled())
+                {
+                    ticket = ConvertToBroker::enqueue(socket->clientAddress());
+                    if (!ticket)
+                    {
+                        LOG_WRN("Conversion queue is full, rejecting request from " << socket->clientAddress());
+                        std::ostringstream oss;
+                        oss << "HTTP/1.1 503\r\n"
+                            "Date: " << Util::getHttpTimeNow() << "\r\n"
+                            "User-Agent: " HTTP_AGENT_STRING "\r\n"
+                            "Retry-After: 1\r\n"
+                            "Content-Length: 0\r\n"
+                            "\r\n";
+                        socket->send(oss.str());
+                        socket->shutdown();
+                        return;
+                    }
+                }
+
                 Poco::URI uriPublic = DocumentBroker::sanitizeURI(fromPath);
                 const std::string docKey = DocumentBroker::getDocKey(uriPublic);
 
@@ -3039,7 +3835,7 @@ private:
                 std::unique_lock<std::mutex> docBrokersLock(DocBrokersMutex);
 
                 LOG_DBG("New DocumentBroker for docKey [" << docKey << "].");
-                auto docBroker = std::make_shared<ConvertToBroker>(fromPath, uriPublic, docKey, format, options);
+                auto docBroker = std::make_shared<ConvertToBroker>(fromPath, uriPublic, docKey, format, options, ticket);
                 handler.takeFile();
 
                 cleanupDocBrokers();
@@ -3226,6 +4022,9 @@ private:
             none, DocumentBroker::ChildType::Interactive, url, docKey, _id, uriPublic);
         if (docBroker)
         {
+            // Before the broker gets a kit, which may be shared if we are read-only.
+            docBroker->requestSession(isReadOnly);
+
             // need to move into the DocumentBroker context before doing session lookup / creation etc.
             std::string id = _id;
             disposition.setMove([docBroker, id, uriPublic,
@@ -3239,8 +4038,8 @@ private:
                     // We no longer own this socket.
                     moveSocket->setThreadOwner(std::thread::id());
 
-                    docBroker->addCallback([docBroker, id, uriPublic, isReadOnly,
-                                            requestDetails, moveSocket]()
+                    docBroker->addSessionCallback([docBroker, id, uriPublic, isReadOnly,
+                                                   requestDetails, moveSocket]()
                         {
                             // Now inside the document broker thread ...
                             LOG_TRC("In the docbroker thread for " << docBroker->getDocKey());
@@ -3359,6 +4158,9 @@ private:
                 DocumentBroker::ChildType::Interactive, url, docKey, _id, uriPublic, mobileAppDocId);
             if (docBroker)
             {
+                // Before the broker gets a kit, which may be shared if we are read-only.
+                docBroker->requestSession(isReadOnly);
+
                 std::shared_ptr<ClientSession> clientSession =
                     docBroker->createNewClientSession(ws, _id, uriPublic, isReadOnly, requestDetails);
                 if (clientSession)
@@ -3373,7 +4175,7 @@ private:
                         // We no longer own this socket.
                         moveSocket->setThreadOwner(std::thread::id());
 
-                        docBroker->addCallback([docBroker, moveSocket, clientSession, ws]()
+                        docBroker->addSessionCallback([docBroker, moveSocket, clientSession, ws]()
                         {
                             try
                             {
@@ -3714,6 +4516,7 @@ public:
            << "\n  TerminationFlag: " << SigUtil::getTerminationFlag()
            << "\n  isShuttingDown: " << SigUtil::getShutdownRequestFlag()
            << "\n  NewChildren: " << NewChildren.size()
+           << "\n  SharedKitChildren: " << SharedKitChildren.size()
            << "\n  OutstandingForks: " << OutstandingForks
            << "\n  NumPreSpawnedChildren: " << LOOLWSD::NumPreSpawnedChildren
            << "\n  ChildSpawnTimeoutMs: " << ChildSpawnTimeoutMs
@@ -3741,6 +4544,7 @@ public:
            << "\n  OverrideWatermark: " << LOOLWSD::OverrideWatermark
            << "\n  UserInterface: " << LOOLWSD::UserInterface
             ;
+        LOOLWSD::SpareKits.dumpState(os);
 
         os << "\nServer poll:\n";
         _acceptPoll.dumpState(os);
@@ -3766,6 +4570,10 @@ public:
 
 #if !MOBILEAPP
         os << "Converter count: " << ConvertToBroker::getInstanceCount() << '\n';
+        ConvertToBroker::dumpPoolState(os);
+        os << "Preview cache: " << RenderPreviewBroker::getCache().getCount() << " previews in " <<
+            RenderPreviewBroker::getCache().getSize() << " bytes, " << RenderPreviewBroker::getCache().getHits() <<
+            " hits, " << RenderPreviewBroker::getCache().getMisses() << " misses\n";
 #endif
 
         Socket::InhibitThreadChecks = false;
@@ -4004,7 +4812,7 @@ int LOOLWSD::innerMain()
     if (LogLevel != "trace")
     {
         LOG_INF("WSD initialization complete: setting log-level to [" << LogLevel << "] as configured.");
-        Log::logger().setLevel(LogLevel);
+        Log::setLevel(LogLevel);
     }
 
 #endif
@@ -4012,6 +4820,19 @@ int LOOLWSD::innerMain()
     // URI with /contents are public and we don't need to anonymize them.
     Util::mapAnonymized("contents", "contents");
 
+#if !MOBILEAPP
+    // Multiplex the documents onto a few poll threads, rather than one each.
+    const int docPollThreads = getConfigValue<int>("per_document.poll_threads", 0);
+    DocumentBroker::startSharedPolls(docPollThreads);
+
+    // Convert with a pool of kits that take one document after another, if so configured.
+    ConvertToBroker::initPool(getConfigValue<int>("per_document.convert_kits", 0),
+                              getConfigValue<int>("per_document.convert_kit_max_jobs", 100),
+                              getConfigValue<int>("per_document.convert_queue_size", 100));
+    RenderPreviewBroker::getCache().setMaxBytes(
+        static_cast<size_t>(getConfigValue<int>("per_document.preview_cache_size_mb", 64)) * 1024 * 1024);
+#endif
+
     // Start the server.
     srv.start();
 
@@ -4040,6 +4861,12 @@ int LOOLWSD::innerMain()
         // Wake the prisoner poll to spawn some children, if necessary.
         PrisonerPoll.wakeup();
 
+#if !MOBILEAPP
+        SavedClipboards->checkexpiry();
+        Admin::instance().setClipboardCacheStats(SavedClipboards->getCount(), SavedClipboards->getMemorySize(),
+                                                 SavedClipboards->getSpillSize(), SavedClipboards->getEvictions());
+#endif
+
         const std::chrono::milliseconds::rep timeSinceStartMs = std::chrono::duration_cast<std::chrono::milliseconds>(
                                             std::chrono::steady_clock::now() - startStamp).count();
 
@@ -4122,6 +4949,13 @@ int LOOLWSD::innerMain()
         DocBrokers.clear();
     }
 
+    DocumentBroker::joinSharedPolls();
+
+#if !MOBILEAPP
+    ConvertToBatchRequest::stopAll();
+    ConvertToBroker::shutdownPool();
+#endif
+
 #if !defined(KIT_IN_PROCESS) && !MOBILEAPP
     // Terminate child processes
     LOG_INF("Requesting forkit process " << ForKitProcId << " to terminate.");
@@ -4138,6 +4972,7 @@ int LOOLWSD::innerMain()
     }
 
     NewChildren.clear();
+    SharedKitChildren.clear();
 
 #if !MOBILEAPP
 #ifndef KIT_IN_PROCESS
@@ -27,6 +27,7 @@
 
 #include "Util.hpp"
 #include "FileUtil.hpp"
+#include "KitPoolSizer.hpp"
 #include "RequestDetails.hpp"
 #include "WebSocketHandler.hpp"
 
@@ -36,6 +37,8 @@ class DocumentBroker;
 class ClipboardCache;
 
 std::shared_ptr<ChildProcess> getNewChild_Blocks(unsigned mobileAppDocId = 0);
+/// Returns a kit's offer to host another read-only document, if any.
+std::shared_ptr<ChildProcess> getSharedKitChild();
 
 // A WSProcess object in the WSD process represents a descendant process, either the direct child
 // process FORKIT or a grandchild KIT process, with which the WSD process communicates through a
@@ -217,6 +220,8 @@ public:
     // so just keep these as statics.
     static std::atomic<uint64_t> NextConnectionId;
     static unsigned int NumPreSpawnedChildren;
+    /// How many spare kits to keep, from NumPreSpawnedChildren up, by demand.
+    static KitPoolSizer SpareKits;
 #if !MOBILEAPP
     static bool NoCapsForKit;
     static bool NoSeccomp;
@@ -0,0 +1,198 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 100 -*- */
+/*
+ * This file is part of the LibreOffice project.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <ostream>
+
+#include "Common.hpp"
+
+/// Estimates the bandwidth and round-trip time of the link to a client
+/// from the tiles it acknowledges (tileprocessed) and websocket pings.
+///
+/// Modelled on BBR: the bottleneck bandwidth is the windowed maximum of the
+/// delivery rate, the propagation delay the windowed minimum of the RTT, and
+/// we keep about twice their product in flight. That fills a fast link
+/// without queueing seconds' worth of tiles in front of a slow one.
+class LinkEstimator
+{
+public:
+    using TimePoint = std::chrono::steady_clock::time_point;
+
+    /// Samples older than this are forgotten by the min/max filters.
+    static constexpr int FilterWindowMs = 10000;
+
+    /// How many times the bandwidth-delay product to keep in flight.
+    static constexpr int WindowGain = 2;
+
+    /// Bounds of the tile acknowledgement timeout.
+    static constexpr int MinTimeoutMs = 1000;
+    static constexpr int MaxTimeoutMs = 4 * TILE_ROUNDTRIP_TIMEOUT_MS;
+
+    /// The state of the link when a tile was sent, to take
+    /// a delivery rate sample when it is acknowledged.
+    struct Sample
+    {
+        TimePoint _sent;
+        /// Bytes acknowledged, and when the last was, at the time of sending.
+        uint64_t _delivered;
+        TimePoint _deliveredTime;
+        size_t _size;
+        /// We had less than a window in flight, so the rate is a lower bound.
+        bool _appLimited;
+    };
+
+    LinkEstimator()
+        : _delivered(0)
+        , _avgTileSize(0)
+        , _bandwidth(0)
+        , _minRtt(0)
+        , _srtt(0)
+        , _rttVar(0)
+    {
+    }
+
+    /// Called when a tile of @size bytes is sent with @inFlight tiles unacknowledged.
+    Sample onSend(const size_t size, const size_t inFlight, const TimePoint now)
+    {
+        if (_deliveredTime == TimePoint())
+            _deliveredTime = now;
+
+        _avgTileSize = (_avgTileSize == 0 ? size : (_avgTileSize * 7 + size) / 8);
+
+        const size_t window = getWindowTiles();
+        return Sample{ now, _delivered, _deliveredTime, size, window == 0 || inFlight < window };
+    }
+
+    /// Called when the client acknowledges the tile sent with @sample.
+    void onAck(const Sample& sample, const TimePoint now)
+    {
+        _delivered += sample._size;
+        _deliveredTime = now;
+
+        const std::chrono::microseconds rtt
+            = std::chrono::duration_cast<std::chrono::microseconds>(now - sample._sent);
+        updateMinRtt(rtt, now);
+        updateSmoothedRtt(rtt);
+
+        // The longer of the send and ack intervals, so ack compression can't inflate the rate.
+        const int64_t intervalUs = std::max(
+            std::chrono::duration_cast<std::chrono::microseconds>(now - sample._sent).count(),
+            std::chrono::duration_cast<std::chrono::microseconds>(now - sample._deliveredTime).count());
+        if (intervalUs <= 0)
+            return;
+
+        const uint64_t rate = (_delivered - sample._delivered) * 1000000 / intervalUs;
+        if (rate >= _bandwidth || (!sample._appLimited && isExpired(_bandwidthTime, now)))
+        {
+            _bandwidth = rate;
+            _bandwidthTime = now;
+        }
+    }
+
+    /// Called with the RTT measured by a websocket ping.
+    void onPing(const std::chrono::microseconds rtt, const TimePoint now)
+    {
+        if (rtt.count() > 0)
+            updateMinRtt(rtt, now);
+    }
+
+    /// True once we have both a bandwidth and an RTT estimate.
+    bool hasEstimate() const { return _bandwidth > 0 && _minRtt.count() > 0; }
+
+    /// Estimated bottleneck bandwidth in bytes per second, 0 if unknown.
+    uint64_t getBandwidth() const { return _bandwidth; }
+
+    /// Estimated minimum round-trip time, 0 if unknown.
+    std::chrono::microseconds getMinRtt() const { return _minRtt; }
+
+    /// Smoothed RTT of tiles, including the client's time to process them.
+    std::chrono::microseconds getSmoothedRtt() const { return _srtt; }
+
+    /// The number of tiles to keep in flight, 0 if we don't know yet.
+    size_t getWindowTiles() const
+    {
+        if (!hasEstimate() || _avgTileSize == 0)
+            return 0;
+
+        const double bdp = _bandwidth * (_minRtt.count() / 1000000.0);
+        return std::ceil(WindowGain * bdp / _avgTileSize);
+    }
+
+    /// How long to wait for a tile to be acknowledged before giving up on it.
+    std::chrono::milliseconds getTimeout() const
+    {
+        if (_srtt.count() == 0)
+            return std::chrono::milliseconds(TILE_ROUNDTRIP_TIMEOUT_MS);
+
+        const int64_t timeoutMs
+            = std::chrono::duration_cast<std::chrono::milliseconds>(_srtt + 4 * _rttVar).count();
+        return std::chrono::milliseconds(
+            std::min<int64_t>(std::max<int64_t>(timeoutMs, MinTimeoutMs), MaxTimeoutMs));
+    }
+
+    void dumpState(std::ostream& os) const
+    {
+        os << "bandwidth " << _bandwidth / 1024 << " KB/s, min RTT " << _minRtt.count() / 1000.
+           << "ms, smoothed RTT " << _srtt.count() / 1000. << "ms, window " << getWindowTiles()
+           << " tiles, avg tile " << _avgTileSize << " bytes, timeout " << getTimeout().count()
+           << "ms";
+    }
+
+private:
+    static bool isExpired(const TimePoint sampleTime, const TimePoint now)
+    {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(now - sampleTime).count()
+               > FilterWindowMs;
+    }
+
+    void updateMinRtt(const std::chrono::microseconds rtt, const TimePoint now)
+    {
+        if (_minRtt.count() == 0 || rtt <= _minRtt || isExpired(_minRttTime, now))
+        {
+            _minRtt = rtt;
+            _minRttTime = now;
+        }
+    }
+
+    /// RFC 6298 smoothing, for the timeout.
+    void updateSmoothedRtt(const std::chrono::microseconds rtt)
+    {
+        if (_srtt.count() == 0)
+        {
+            _srtt = rtt;
+            _rttVar = rtt / 2;
+        }
+        else
+        {
+            const std::chrono::microseconds delta = (_srtt > rtt ? _srtt - rtt : rtt - _srtt);
+            _rttVar = (3 * _rttVar + delta) / 4;
+            _srtt = (7 * _srtt + rtt) / 8;
+        }
+    }
+
+private:
+    uint64_t _delivered;
+    TimePoint _deliveredTime;
+    size_t _avgTileSize;
+
+    uint64_t _bandwidth;
+    TimePoint _bandwidthTime;
+    std::chrono::microseconds _minRtt;
+    TimePoint _minRttTime;
+
+    std::chrono::microseconds _srtt;
+    std::chrono::microseconds _rttVar;
+};
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -0,0 +1,140 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 100 -*- */
+/*
+ * This file is part of the LibreOffice project.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+/// A cache of rendered previews, by document content, part and size.
+///
+/// Listing views ask for the same thumbnails over and over, so we keep the
+/// most recently used ones, up to a budget of bytes, and drop the least
+/// recently used ones to make room.
+class PreviewCache
+{
+public:
+    using Data = std::shared_ptr<const std::string>;
+
+    PreviewCache(const size_t maxBytes = 0)
+        : _maxBytes(maxBytes)
+        , _size(0)
+        , _hits(0)
+        , _misses(0)
+    {
+    }
+
+    /// The key of the preview of @part of the document hashed to @docHash, at @width x @height.
+    static std::string makeKey(const std::string& docHash, const int part, const int width,
+                               const int height)
+    {
+        return docHash + '/' + std::to_string(part) + '/' + std::to_string(width) + 'x'
+               + std::to_string(height);
+    }
+
+    /// Caches up to @maxBytes of previews, 0 for none.
+    void setMaxBytes(const size_t maxBytes)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _maxBytes = maxBytes;
+        evict(0);
+    }
+
+    /// Returns the preview of @key, or nullptr.
+    Data lookup(const std::string& key)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        const auto it = _index.find(key);
+        if (it == _index.end())
+        {
+            ++_misses;
+            return nullptr;
+        }
+
+        ++_hits;
+        _entries.splice(_entries.begin(), _entries, it->second);
+        return it->second->second;
+    }
+
+    void insert(const std::string& key, const Data& data)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!data || data->size() > _maxBytes)
+            return;
+
+        const auto it = _index.find(key);
+        if (it != _index.end())
+        {
+            _size -= it->second->second->size();
+            _entries.erase(it->second);
+            _index.erase(it);
+        }
+
+        evict(data->size());
+
+        _entries.emplace_front(key, data);
+        _index.emplace(key, _entries.begin());
+        _size += data->size();
+    }
+
+    /// The bytes of previews cached.
+    size_t getSize() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _size;
+    }
+
+    size_t getCount() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _entries.size();
+    }
+
+    uint64_t getHits() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _hits;
+    }
+
+    uint64_t getMisses() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _misses;
+    }
+
+private:
+    /// Drops the least recently used previews to leave room for @bytes more.
+    void evict(const size_t bytes)
+    {
+        while (!_entries.empty() && _size + bytes > _maxBytes)
+        {
+            _size -= _entries.back().second->size();
+            _index.erase(_entries.back().first);
+            _entries.pop_back();
+        }
+    }
+
+    mutable std::mutex _mutex;
+    size_t _maxBytes;
+
+    /// Most recently used first.
+    std::list<std::pair<std::string, Data>> _entries;
+    std::unordered_map<std::string, std::list<std::pair<std::string, Data>>::iterator> _index;
+    size_t _size;
+
+    uint64_t _hits;
+    uint64_t _misses;
+};
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
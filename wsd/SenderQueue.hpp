@@ -9,40 +9,144 @@
 
 #pragma once
 
+#include <algorithm>
+#include <chrono>
 #include <condition_variable>
+#include <cstdint>
 #include <deque>
 #include <memory>
 #include <mutex>
+#include <ostream>
+#include <string>
 #include <thread>
+#include <unordered_map>
 #include <vector>
 
-#include <Poco/Dynamic/Var.h>
-#include <Poco/JSON/JSON.h>
-#include <Poco/JSON/Object.h>
-#include <Poco/JSON/Parser.h>
-
 #include "common/SigUtil.hpp"
 #include "Log.hpp"
-#include "TileDesc.hpp"
+
+/// The classes of outgoing messages, most urgent first.
+enum class SendPriority
+{
+    Cursor = 0,  ///< Cursor and selection updates, tiny and latency-critical.
+    Text,        ///< All other textual callbacks and responses.
+    VisibleTile, ///< Tiles (and other binary payloads) the user is looking at.
+    PrefetchTile ///< Tiles outside the visible area, thumbnails and previews.
+};
+
+constexpr int SendPriorityCount = 4;
+
+inline const char* nameShort(const SendPriority priority)
+{
+    switch (priority)
+    {
+        case SendPriority::Cursor:       return "cursor";
+        case SendPriority::Text:         return "text";
+        case SendPriority::VisibleTile:  return "tile";
+        case SendPriority::PrefetchTile: return "prefetch";
+    }
+
+    return "unknown";
+}
+
+/// A histogram of queueing latencies with power-of-two millisecond buckets.
+class LatencyHistogram
+{
+public:
+    /// Buckets are [0, 1), [1, 2), [2, 4) ... [512, 1024), [1024, inf) ms.
+    static constexpr int BucketCount = 12;
+
+    LatencyHistogram()
+        : _buckets()
+        , _count(0)
+        , _totalMs(0)
+        , _maxMs(0)
+    {
+    }
+
+    void add(const std::chrono::milliseconds latency)
+    {
+        const uint64_t ms = std::max<int64_t>(latency.count(), 0);
+        int bucket = 0;
+        while (bucket < BucketCount - 1 && ms >= (1ULL << bucket))
+            ++bucket;
+
+        ++_buckets[bucket];
+        ++_count;
+        _totalMs += ms;
+        _maxMs = std::max(_maxMs, ms);
+    }
+
+    uint64_t getCount() const { return _count; }
+    uint64_t getMaxMs() const { return _maxMs; }
+    uint64_t getBucket(int index) const { return _buckets[index]; }
+
+    void dumpState(std::ostream& os) const
+    {
+        os << _count << " sent, avg " << (_count ? _totalMs / _count : 0) << "ms, max " << _maxMs
+           << "ms, buckets:";
+        for (int i = 0; i < BucketCount; ++i)
+            os << ' ' << _buckets[i];
+    }
+
+private:
+    uint64_t _buckets[BucketCount];
+    uint64_t _count;
+    uint64_t _totalMs;
+    uint64_t _maxMs;
+};
 
 /// A queue of data to send to certain Session's WS.
+///
+/// Items are queued per SendPriority and dequeued by deficit round-robin over the
+/// classes: each visit gives a class a byte quantum, more for the urgent classes,
+/// so a multi-MB tile can't hold cursor updates back, yet tiles are never starved.
+///
+/// Items carry a dedup key (see Message::dedupKey()); enqueueing an item
+/// supersedes any queued one with the same key, which is dropped in O(1)
+/// by clearing its slot rather than searching and erasing it.
 template <typename Item>
 class SenderQueue final
 {
 public:
+    /// Above this many queued bytes we consider the socket backed up.
+    static constexpr size_t BackloggedBytes = 512 * 1024;
 
     SenderQueue()
+        : _current(0)
+        , _visiting(false)
+        , _liveCount(0)
+        , _liveBytes(0)
+        , _enqueuedCount(0)
+        , _dedupHitCount(0)
+        , _droppedCount(0)
+        , _maxSize(0)
     {
     }
 
+    /// Enqueue with the priority derived from the message type.
     size_t enqueue(const Item& item)
+    {
+        return enqueue(item, getPriority(item));
+    }
+
+    size_t enqueue(const Item& item, const SendPriority priority)
     {
         std::unique_lock<std::mutex> lock(_mutex);
 
-        if (!SigUtil::getTerminationFlag() && deduplicate(item))
-            _queue.push_back(item);
+        if (!SigUtil::getTerminationFlag())
+        {
+            Class& cls = _classes[static_cast<int>(priority)];
+            const uint64_t seq = cls._frontSeq + cls._slots.size();
+            deduplicate(item, priority, seq);
+            cls._slots.emplace_back(item, std::chrono::steady_clock::now());
+            ++_liveCount;
+            _liveBytes += item->size();
+            ++_enqueuedCount;
+            _maxSize = std::max(_maxSize, _liveCount);
+        }
 
-        return _queue.size();
+        return _liveCount;
     }
 
     /// Dequeue an item if we have one - @returns true if we do, else false.
@@ -50,109 +154,301 @@ public:
     {
         std::unique_lock<std::mutex> lock(_mutex);
 
-        if (!_queue.empty() && !SigUtil::getTerminationFlag())
+        if (SigUtil::getTerminationFlag())
+        {
+            LOG_DBG("SenderQueue: TerminationFlag is set");
+            return false;
+        }
+
+        if (_liveCount == 0)
+            return false;
+
+        // Each round adds a quantum to every non-empty class, so this terminates.
+        for (;;)
         {
-            item = _queue.front();
-            _queue.pop_front();
+            Class& cls = _classes[_current];
+            popEmptySlots(cls);
+            if (cls._slots.empty())
+            {
+                cls._deficit = 0;
+                nextClass();
+                continue;
+            }
+
+            if (!_visiting)
+            {
+                cls._deficit += Quantum[_current];
+                _visiting = true;
+            }
+
+            const size_t size = cls._slots.front()._item->size();
+            if (size > cls._deficit)
+            {
+                nextClass();
+                continue;
+            }
+
+            cls._deficit -= size;
+            Slot& slot = cls._slots.front();
+            item = std::move(slot._item);
+            cls._latency.add(std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - slot._time));
+            const uint64_t seq = cls._frontSeq++;
+            cls._slots.pop_front();
+
+            const std::string& key = item->dedupKey();
+            if (!key.empty())
+            {
+                const auto it = _latest.find(key);
+                if (it != _latest.end() && it->second._seq == seq &&
+                    it->second._priority == static_cast<SendPriority>(_current))
+                    _latest.erase(it);
+            }
+
+            --_liveCount;
+            _liveBytes -= size;
             return true;
         }
-        else
+    }
+
+    /// Drops queued items of the given priority, or less urgent ones, for which
+    /// obsolete(item) returns true, e.g. tiles of a zoom level the client has left.
+    /// Returns the dropped items.
+    template <typename Predicate>
+    std::vector<Item> dropObsolete(const SendPriority from, Predicate obsolete)
+    {
+        std::vector<Item> dropped;
+
+        std::unique_lock<std::mutex> lock(_mutex);
+        for (int i = static_cast<int>(from); i < SendPriorityCount; ++i)
         {
-            if (SigUtil::getTerminationFlag())
-                LOG_DBG("SenderQueue: TerminationFlag is set");
-            return false;
+            for (Slot& slot : _classes[i]._slots)
+            {
+                if (slot._item && obsolete(slot._item))
+                {
+                    const std::string& key = slot._item->dedupKey();
+                    if (!key.empty())
+                        _latest.erase(key);
+
+                    _liveBytes -= slot._item->size();
+                    --_liveCount;
+                    ++_droppedCount;
+                    dropped.push_back(std::move(slot._item));
+                    slot._item = Item();
+                }
+            }
         }
+
+        return dropped;
     }
 
     size_t size() const
     {
         std::lock_guard<std::mutex> lock(_mutex);
-        return _queue.size();
+        return _liveCount;
+    }
+
+    /// Number of bytes waiting to be sent.
+    size_t getBytes() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _liveBytes;
+    }
+
+    /// True when the client isn't keeping up with what we send.
+    bool isBacklogged() const { return getBytes() > BackloggedBytes; }
+
+    /// Total number of items ever enqueued.
+    size_t getEnqueuedCount() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _enqueuedCount;
+    }
+
+    /// Number of queued items dropped because a newer one superseded them.
+    size_t getDedupHitCount() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _dedupHitCount;
+    }
+
+    /// Number of queued items dropped as obsolete.
+    size_t getDroppedCount() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _droppedCount;
+    }
+
+    /// The highest number of items waiting to be sent at once.
+    size_t getMaxSize() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _maxSize;
+    }
+
+    /// The time items of the given priority spent queued.
+    LatencyHistogram getLatency(const SendPriority priority) const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _classes[static_cast<int>(priority)]._latency;
     }
 
     void dumpState(std::ostream& os)
     {
-        os << "\n\t\tqueue size " << _queue.size() << '\n';
         std::lock_guard<std::mutex> lock(_mutex);
-        for (const Item &item : _queue)
+        os << "\n\t\tqueue size " << _liveCount << " (" << _liveBytes << " bytes, max "
+           << _maxSize << "), enqueued " << _enqueuedCount << ", deduplicated "
+           << _dedupHitCount << ", dropped " << _droppedCount << '\n';
+        for (int i = 0; i < SendPriorityCount; ++i)
         {
-            os << "\t\t\ttype: " << (item->isBinary() ? "binary\n" : "text\n");
-            os << "\t\t\t" << item->abbr() << '\n';
+            os << "\t\t" << nameShort(static_cast<SendPriority>(i)) << " latency: ";
+            _classes[i]._latency.dumpState(os);
+            os << '\n';
+            for (const Slot& slot : _classes[i]._slots)
+            {
+                if (!slot._item)
+                    continue;
+
+                os << "\t\t\ttype: " << (slot._item->isBinary() ? "binary\n" : "text\n");
+                os << "\t\t\t" << slot._item->abbr() << '\n';
+            }
         }
     }
 
-private:
-    /// Deduplicate messages based on the new one.
-    /// Returns true if the new message should be
-    /// enqueued, otherwise false.
-    bool deduplicate(const Item& item)
-    {
-        // Deduplicate messages based on the incoming one.
-        const std::string command = item->firstToken();
-        if (command == "tile:")
+    /// The priority of a message by its type; tiles are assumed visible.
+    /// Tile invalidations go with the tiles, so that one never overtakes a
+    /// tile queued before it, which would then stay stale on the client.
+    static SendPriority getPriority(const Item& item)
+    {
+        const StringVector& tokens = item->tokens();
+        if (tokens.equals(0, "invalidatecursor:") ||
+            tokens.equals(0, "invalidateviewcursor:") ||
+            tokens.equals(0, "cursorvisible:") ||
+            tokens.equals(0, "viewcursorvisible:") ||
+            tokens.equals(0, "cellcursor:") ||
+            tokens.equals(0, "cellviewcursor:") ||
+            tokens.equals(0, "textselection:") ||
+            tokens.equals(0, "textselectionstart:") ||
+            tokens.equals(0, "textselectionend:") ||
+            tokens.equals(0, "textviewselection:") ||
+            tokens.equals(0, "graphicselection:") ||
+            tokens.equals(0, "graphicviewselection:") ||
+            tokens.equals(0, "cellselectionarea:"))
         {
-            // Remove previous identical tile, if any, and use most recent (incoming).
-            const TileDesc newTile = TileDesc::parse(item->firstLine());
-            const auto& pos = std::find_if(_queue.begin(), _queue.end(),
-                [&newTile](const queue_item_t& cur)
-                {
-                    return cur->firstToken() == "tile:" &&
-                           newTile == TileDesc::parse(cur->firstLine());
-                });
+            return SendPriority::Cursor;
+        }
+
+        if (tokens.equals(0, "invalidatetiles:"))
+            return SendPriority::VisibleTile;
+
+        return item->isBinary() ? SendPriority::VisibleTile : SendPriority::Text;
+    }
 
-            if (pos != _queue.end())
-                _queue.erase(pos);
+private:
+    /// Drops the queued item, if any, that the new one
+    /// (about to be enqueued at seq) supersedes.
+    void deduplicate(const Item& item, const SendPriority priority, const uint64_t seq)
+    {
+        const std::string& key = item->dedupKey();
+        if (key.empty())
+            return;
+
+        const auto result = _latest.emplace(key, Latest(priority, seq));
+        if (!result.second)
+        {
+            // Remove previous identical entry, and use most recent (incoming).
+            Latest& latest = result.first->second;
+            Class& cls = _classes[static_cast<int>(latest._priority)];
+            Slot& slot = cls._slots[latest._seq - cls._frontSeq];
+            _liveBytes -= slot._item->size();
+            slot._item = Item();
+            latest = Latest(priority, seq);
+            --_liveCount;
+            ++_dedupHitCount;
         }
-        else if (command == "statusindicatorsetvalue:" ||
-                 command == "invalidatecursor:" ||
-                 command == "setpart:")
+    }
+
+    void nextClass()
+    {
+        _current = (_current + 1) % SendPriorityCount;
+        _visiting = false;
+    }
+
+private:
+    struct Slot
+    {
+        Slot(const Item& item, std::chrono::steady_clock::time_point time)
+            : _item(item)
+            , _time(time)
         {
-            // Remove previous identical entries of this command,
-            // if any, and use most recent (incoming).
-            const auto& pos = std::find_if(_queue.begin(), _queue.end(),
-                [&command](const queue_item_t& cur)
-                {
-                    return cur->firstToken() == command;
-                });
+        }
+
+        /// Empty when superseded.
+        Item _item;
+        std::chrono::steady_clock::time_point _time;
+    };
 
-            if (pos != _queue.end())
-                _queue.erase(pos);
+    struct Class
+    {
+        Class()
+            : _frontSeq(0)
+            , _deficit(0)
+        {
         }
-        else if (command == "invalidateviewcursor:")
+
+        std::deque<Slot> _slots;
+        /// The sequence number of the slot at the front.
+        uint64_t _frontSeq;
+        /// Bytes this class may still send in the current round.
+        size_t _deficit;
+        LatencyHistogram _latency;
+    };
+
+    /// Where the queued item holding a dedup key lives.
+    struct Latest
+    {
+        Latest(SendPriority priority, uint64_t seq)
+            : _priority(priority)
+            , _seq(seq)
         {
-            // Remove previous cursor invalidation for same view,
-            // if any, and use most recent (incoming).
-            const std::string newMsg = item->jsonString();
-            Poco::JSON::Parser newParser;
-            const Poco::Dynamic::Var newResult = newParser.parse(newMsg);
-            const auto& newJson = newResult.extract<Poco::JSON::Object::Ptr>();
-            const std::string viewId = newJson->get("viewId").toString();
-            const auto& pos = std::find_if(_queue.begin(), _queue.end(),
-                [command, viewId](const queue_item_t& cur)
-                {
-                    if (cur->firstToken() == command)
-                    {
-                        const std::string msg = cur->jsonString();
-                        Poco::JSON::Parser parser;
-                        const Poco::Dynamic::Var result = parser.parse(msg);
-                        const auto& json = result.extract<Poco::JSON::Object::Ptr>();
-                        return viewId == json->get("viewId").toString();
-                    }
-
-                    return false;
-                });
-
-            if (pos != _queue.end())
-                _queue.erase(pos);
         }
 
-        return true;
+        SendPriority _priority;
+        uint64_t _seq;
+    };
+
+    /// Pops the slots emptied by deduplication off the front.
+    static void popEmptySlots(Class& cls)
+    {
+        while (!cls._slots.empty() && !cls._slots.front()._item)
+        {
+            cls._slots.pop_front();
+            ++cls._frontSeq;
+        }
     }
 
-private:
+    /// Bytes per round-robin visit for each class.
+    static constexpr size_t Quantum[SendPriorityCount] = { 64 * 1024, 32 * 1024, 16 * 1024, 4 * 1024 };
+
     mutable std::mutex _mutex;
-    std::deque<Item> _queue;
-    typedef typename std::deque<Item>::value_type queue_item_t;
+    Class _classes[SendPriorityCount];
+    /// The class being visited by the round-robin.
+    int _current;
+    /// Whether the current class got its quantum for this visit already.
+    bool _visiting;
+    /// Maps dedup keys to the queued item holding it.
+    std::unordered_map<std::string, Latest> _latest;
+    /// Number of non-empty slots, and the bytes in them.
+    size_t _liveCount;
+    size_t _liveBytes;
+
+    size_t _enqueuedCount;
+    size_t _dedupHitCount;
+    size_t _droppedCount;
+    size_t _maxSize;
 };
 
+template <typename Item> constexpr size_t SenderQueue<Item>::Quantum[SendPriorityCount];
+template <typename Item> constexpr size_t SenderQueue<Item>::BackloggedBytes;
+
 /* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -14,10 +14,12 @@
 #include <algorithm>
 #include <memory>
 #include <cassert>
+#include <cstring>
 #include <errno.h>
 #include <fstream>
 #include <iconv.h>
 #include <string>
+#include <sys/stat.h>
 
 #include <Poco/Exception.h>
 #include <Poco/JSON/Object.h>
@@ -46,6 +48,7 @@
 #include <Common.hpp>
 #include "Exceptions.hpp"
 #include <Log.hpp>
+#include <SpookyV2.h>
 #include <Unit.hpp>
 #include <Util.hpp>
 #include "ProofKey.hpp"
@@ -62,6 +65,30 @@ Util::RegexListMatcher StorageBase::WopiHosts;
 
 #if !MOBILEAPP
 
+std::string StorageBase::moveToJail(const std::string& localStorePath, const std::string& jailPath,
+                                    const std::string& filePath)
+{
+    _localStorePath = localStorePath;
+    _jailPath = jailPath;
+
+    const std::string filename = Poco::Path(filePath).getFileName();
+    setRootFilePath(Poco::Path(getLocalRootPath(), filename).toString());
+    setRootFilePathAnonym(LOOLWSD::anonymizeUrl(getRootFilePath()));
+    LOG_INF("Moving [" << LOOLWSD::anonymizeUrl(filePath) << "] into jail as [" <<
+            getRootFilePathAnonym() << "].");
+
+    // Keep the timestamp, which tells whether the kit saved it since we last uploaded it.
+    if (!FileUtil::copyAtomic(filePath, getRootFilePath(), /*preserveTimestamps=*/true))
+        throw std::runtime_error("Failed to copy into jail as " + getRootFilePathAnonym());
+
+    // Now return the jailed path.
+#if !MOBILEAPP && !defined(KIT_IN_PROCESS)
+    if (!LOOLWSD::NoCapsForKit)
+        return Poco::Path(getJailPath(), filename).toString();
+#endif
+    return getRootFilePath();
+}
+
 std::string StorageBase::getLocalRootPath() const
 {
     std::string localPath = _jailPath;
@@ -78,12 +105,35 @@ std::string StorageBase::getLocalRootPath() const
     return rootPath.toString();
 }
 
+#endif
+
 size_t StorageBase::getFileSize(const std::string& filename)
 {
     return std::ifstream(filename, std::ifstream::ate | std::ifstream::binary).tellg();
 }
 
-#endif
+std::string StorageBase::getFileHash(const std::string& filename)
+{
+    std::ifstream file(filename, std::ifstream::binary);
+    if (!file)
+        return std::string();
+
+    SpookyHash hash;
+    hash.Init(0, 0);
+
+    // SpookyHash wants the data 8-byte aligned.
+    alignas(8) char buffer[64 * 1024];
+    while (file.read(buffer, sizeof(buffer)) || file.gcount() > 0)
+        hash.Update(buffer, file.gcount());
+
+    if (file.bad())
+        return std::string();
+
+    uint64_t hash1;
+    uint64_t hash2;
+    hash.Final(&hash1, &hash2);
+    return Util::encodeId(hash1, 16) + Util::encodeId(hash2, 16);
+}
 
 void StorageBase::initialize()
 {
@@ -372,6 +422,14 @@ std::string LocalStorage::loadStorageFileToLocal(const Authorization& /*auth*/,
 
 }
 
+std::string LocalStorage::moveToJail(const std::string& localStorePath, const std::string& jailPath,
+                                     const std::string& filePath)
+{
+    // No longer linked to the original, so copy it back when saving.
+    _isCopy = true;
+    return StorageBase::moveToJail(localStorePath, jailPath, filePath);
+}
+
 StorageBase::SaveResult
 LocalStorage::saveLocalFileToStorage(const Authorization& /*auth*/, const std::string& /*cookies*/,
                                      LockContext& /*lockCtx*/, const std::string& /*saveAsPath*/,
@@ -380,9 +438,34 @@ LocalStorage::saveLocalFileToStorage(const Authorization& /*auth*/, const std::s
     try
     {
         LOG_TRC("Saving local file to local file storage (isCopy: " << _isCopy << ") for " << getRootFilePathAnonym());
-        // Copy the file back.
+        const uint64_t uploadedBytes = getFileSize(getRootFilePath());
+
+        // Copy the file back, to a temporary file beside the stored one that
+        // then replaces it, lest a failure leave the stored document half-written.
         if (_isCopy && Poco::File(getRootFilePath()).exists())
-            FileUtil::copyFileTo(getRootFilePath(), getUri().getPath());
+        {
+            const std::string storedPath = getUri().getPath();
+            const std::string tempPath = storedPath + ".lool-" + Util::rng::getHexString(8) + ".tmp";
+            try
+            {
+                FileUtil::copyFileTo(getRootFilePath(), tempPath);
+
+                struct stat st;
+                if (stat(storedPath.c_str(), &st) == 0)
+                    chmod(tempPath.c_str(), st.st_mode & 07777);
+
+                if (rename(tempPath.c_str(), storedPath.c_str()) != 0)
+                    throw Poco::FileException("Failed to replace " + LOOLWSD::anonymizeUrl(storedPath)
+                                              + ": " + std::strerror(errno));
+            }
+            catch (...)
+            {
+                FileUtil::removeFile(tempPath);
+                throw;
+            }
+        }
+
+        setUploadedBytes(uploadedBytes);
 
         // update its fileinfo object. This is used later to check if someone else changed the
         // document while we are/were editing it
@@ -652,6 +735,8 @@ std::unique_ptr<WopiStorage::WOPIFileInfo> WopiStorage::getWOPIFileInfo(const Au
         if (wopiInfo->getSupportsLocks())
             lockCtx.initSupportsLocks();
 
+        _supportsPackageDelta = wopiInfo->getSupportsPackageDelta();
+
         return wopiInfo;
     }
     else
@@ -684,6 +769,7 @@ void WopiStorage::WOPIFileInfo::init()
     _enableShare = false;
     _supportsLocks = false;
     _supportsRename = false;
+    _supportsPackageDelta = false;
     _userCanRename = false;
     _hideUserList = "false";
     _disableChangeTrackingRecord = WOPIFileInfo::TriState::Unset;
@@ -758,6 +844,7 @@ WopiStorage::WOPIFileInfo::WOPIFileInfo(const FileInfo &fileInfo,
     JsonUtil::findJSONValue(object, "HideUserList", _hideUserList);
     JsonUtil::findJSONValue(object, "SupportsLocks", _supportsLocks);
     JsonUtil::findJSONValue(object, "SupportsRename", _supportsRename);
+    JsonUtil::findJSONValue(object, "SupportsPackageDelta", _supportsPackageDelta);
     JsonUtil::findJSONValue(object, "UserCanRename", _userCanRename);
     JsonUtil::findJSONValue(object, "BreadcrumbDocName", _breadcrumbDocName);
     bool booleanFlag = false;
@@ -919,12 +1006,29 @@ std::string WopiStorage::loadStorageFileToLocal(const Authorization& auth,
             setRootFilePath(Poco::Path(getLocalRootPath(), getFileInfo().getFilename()).toString());
             setRootFilePathAnonym(LOOLWSD::anonymizeUrl(getRootFilePath()));
             std::ofstream ofs(getRootFilePath());
-            std::copy(std::istreambuf_iterator<char>(rs),
-                      std::istreambuf_iterator<char>(),
-                      std::ostreambuf_iterator<char>(ofs));
+            const uint64_t total = (response.hasContentLength() ? response.getContentLength64() : 0);
+            uint64_t downloaded = 0;
+            char buffer[64 * 1024];
+            while (rs.read(buffer, sizeof(buffer)) || rs.gcount() > 0)
+            {
+                ofs.write(buffer, rs.gcount());
+                downloaded += rs.gcount();
+                if (_downloadProgressHandler)
+                    _downloadProgressHandler(downloaded, total);
+            }
+
             ofs.close();
             LOG_INF("WOPI::GetFile downloaded " << getFileSize(getRootFilePath()) << " bytes from [" <<
                     uriAnonym << "] -> " << getRootFilePathAnonym() << " in " << diff.count() << 's');
+
+            // What the host has, for the first save to send the changes to.
+            if (_supportsPackageDelta)
+            {
+                std::ifstream ifs(getRootFilePath(), std::ifstream::binary);
+                if (!_storedPackage.read(ifs))
+                    LOG_DBG("WOPI::GetFile: [" << getRootFilePathAnonym() << "] is not a package we can send the changes of.");
+            }
+
             setLoaded(true);
 
             // Now return the jailed path.
@@ -961,6 +1065,31 @@ WopiStorage::saveLocalFileToStorage(const Authorization& auth, const std::string
 
     const size_t size = getFileSize(filePath);
 
+    // Send only the changed members of the package, if the host takes them and
+    // they are at most half of it; the host has the others from the last upload.
+    ZipPackage package;
+    std::string delta;
+    std::vector<std::string> removed;
+    if (!isSaveAs && !isRename && _supportsPackageDelta)
+    {
+        std::ifstream ifs(filePath, std::ifstream::binary);
+        if (package.read(ifs) && !_storedPackage.isEmpty() && !getForceSave())
+        {
+            uint64_t changedSize = 0;
+            for (const ZipPackage::Member* member : package.getChanged(_storedPackage))
+                changedSize += member->_length;
+
+            std::ostringstream oss;
+            if (changedSize <= size / 2 && package.writeDelta(ifs, _storedPackage, oss))
+            {
+                delta = oss.str();
+                removed = package.getRemoved(_storedPackage);
+            }
+        }
+    }
+
+    const uint64_t uploadSize = (delta.empty() ? size : delta.size());
+
     Poco::URI uriObject(getUri());
     uriObject.setPath(isSaveAs || isRename? uriObject.getPath(): uriObject.getPath() + "/contents");
     auth.authorizeURI(uriObject);
@@ -997,6 +1126,23 @@ WopiStorage::saveLocalFileToStorage(const Authorization& auth, const std::string
                 // Request WOPI host to not overwrite if timestamps mismatch
                 request.set("X-LOOL-WOPI-Timestamp", Util::getIso8601FracformatTime(getFileInfo().getModifiedTime()));
             }
+
+            if (!delta.empty())
+            {
+                // The body is a package of the changed members, to apply to what the host has.
+                request.set("X-LOOL-WOPI-PackageDelta", "true");
+
+                std::string removedNames;
+                for (const std::string& name : removed)
+                {
+                    std::string encodedName;
+                    Poco::URI::encode(name, ",", encodedName);
+                    removedNames += (removedNames.empty() ? "" : ",") + encodedName;
+                }
+
+                if (!removedNames.empty())
+                    request.set("X-LOOL-WOPI-PackageRemoved", removedNames);
+            }
         }
         else
         {
@@ -1046,12 +1192,17 @@ WopiStorage::saveLocalFileToStorage(const Authorization& auth, const std::string
         }
 
         request.setContentType("application/octet-stream");
-        request.setContentLength(size);
+        request.setContentLength(uploadSize);
 
         std::ostream& os = psession->sendRequest(request);
 
-        std::ifstream ifs(filePath);
-        Poco::StreamCopier::copyStream(ifs, os);
+        if (delta.empty())
+        {
+            std::ifstream ifs(filePath);
+            Poco::StreamCopier::copyStream(ifs, os);
+        }
+        else
+            os.write(delta.data(), delta.size());
 
         Poco::Net::HTTPResponse response;
         std::istream& rs = psession->receiveResponse(response);
@@ -1097,13 +1248,17 @@ WopiStorage::saveLocalFileToStorage(const Authorization& auth, const std::string
             }
 
             LOG_INF(wopiLog << " response: " << responseString);
-            LOG_INF(wopiLog << " uploaded " << size << " bytes from [" << filePathAnonym <<
+            LOG_INF(wopiLog << " uploaded " << uploadSize << " bytes" << (delta.empty() ? "" : " of changes")
+                    << " from [" << filePathAnonym <<
                     "] -> [" << uriAnonym << "]: " << response.getStatus() << ' ' << response.getReason());
         }
 
         if (response.getStatus() == Poco::Net::HTTPResponse::HTTP_OK)
         {
             saveResult.setResult(StorageBase::SaveResult::OK);
+            setUploadedBytes(uploadSize);
+            if (!isSaveAs && !isRename)
+                _storedPackage = package;
             Poco::JSON::Object::Ptr object;
             if (JsonUtil::parseJSON(oss.str(), object))
             {
@@ -1141,6 +1296,8 @@ WopiStorage::saveLocalFileToStorage(const Authorization& auth, const std::string
         }
         else if (response.getStatus() == Poco::Net::HTTPResponse::HTTP_CONFLICT)
         {
+            // The host has someone else's version, which we don't know the members of.
+            _storedPackage = ZipPackage();
             saveResult.setResult(StorageBase::SaveResult::CONFLICT);
             Poco::JSON::Object::Ptr object;
             if (JsonUtil::parseJSON(oss.str(), object))
@@ -11,9 +11,11 @@
 
 #pragma once
 
+#include <atomic>
 #include <set>
 #include <string>
 #include <chrono>
+#include <functional>
 
 #include <Poco/URI.h>
 #include <Poco/Util/Application.h>
@@ -23,6 +25,7 @@
 #include "LOOLWSD.hpp"
 #include "Log.hpp"
 #include "Util.hpp"
+#include "ZipPackage.hpp"
 #include <common/Authorization.hpp>
 
 namespace Poco
@@ -177,7 +180,8 @@ public:
         _forceSave(false),
         _isUserModified(false),
         _isAutosave(false),
-        _isExitSave(false)
+        _isExitSave(false),
+        _uploadedBytes(0)
     {
         LOG_DBG("Storage ctor: " << LOOLWSD::anonymizeUrl(uri.toString()));
     }
@@ -237,6 +241,11 @@ public:
 
     std::string getFileExtension() const { return Poco::Path(_fileInfo.getFilename()).getExtension(); }
 
+    /// The bytes the last successful save wrote to storage, less than the size
+    /// of the file when only the changed members of the package were, to a WOPI
+    /// host that takes them.
+    uint64_t getUploadedBytes() const { return _uploadedBytes; }
+
     /// Update the locking state (check-in/out) of the associated file
     virtual bool updateLockState(const Authorization& auth, const std::string& cookies,
                                  LockContext& lockCtx, bool lock)
@@ -258,8 +267,17 @@ public:
                            const std::string& saveAsFilename, const bool isRename)
         = 0;
 
+    /// Copies @filePath, the document put aside from an earlier jail, into the
+    /// jail at @localStorePath, to use from now on. Returns the jailed path, as
+    /// loadStorageFileToLocal does, and throws on failure.
+    virtual std::string moveToJail(const std::string& localStorePath, const std::string& jailPath,
+                                   const std::string& filePath);
+
     static size_t getFileSize(const std::string& filename);
 
+    /// A hash of the content of the file, read in chunks; empty if it can't be read.
+    static std::string getFileHash(const std::string& filename);
+
     /// Must be called at startup to configure.
     static void initialize();
 
@@ -279,18 +297,21 @@ protected:
     /// Returns the client-provided extended data to send to the WOPI host.
     const std::string& getExtendedData() const { return _extendedData; }
 
+    void setUploadedBytes(uint64_t uploadedBytes) { _uploadedBytes = uploadedBytes; }
+
 private:
     const Poco::URI _uri;
-    const std::string _localStorePath;
-    const std::string _jailPath;
+    std::string _localStorePath;
+    std::string _jailPath;
     std::string _jailedFilePath;
     std::string _jailedFilePathAnonym;
     FileInfo _fileInfo;
     bool _isLoaded;
     bool _forceSave;
 
-    /// The document has been modified by the user.
-    bool _isUserModified;
+    /// The document has been modified by the user. Set as the user edits,
+    /// while an upload may be reading it in the background.
+    std::atomic<bool> _isUserModified;
 
     /// This save operation is an autosave.
     bool _isAutosave;
@@ -298,6 +319,7 @@ private:
     bool _isExitSave;
     /// The client-provided saving extended data to send to the WOPI host.
     std::string _extendedData;
+    uint64_t _uploadedBytes;
 
     static bool FilesystemEnabled;
     static bool WopiEnabled;
@@ -360,6 +382,9 @@ public:
                                       const std::string& saveAsFilename,
                                       const bool isRename) override;
 
+    std::string moveToJail(const std::string& localStorePath, const std::string& jailPath,
+                           const std::string& filePath) override;
+
 private:
     /// True if the jailed file is not linked but copied.
     bool _isCopy;
@@ -376,6 +401,7 @@ public:
         StorageBase(uri, localStorePath, jailPath),
         _wopiLoadDuration(0),
         _wopiSaveDuration(0),
+        _supportsPackageDelta(false),
         _reuseCookies(false)
     {
         const auto& app = Poco::Util::Application::instance();
@@ -427,6 +453,7 @@ public:
         bool getEnableShare() const { return _enableShare; }
         bool getSupportsRename() const { return _supportsRename; }
         bool getSupportsLocks() const { return _supportsLocks; }
+        bool getSupportsPackageDelta() const { return _supportsPackageDelta; }
         bool getUserCanRename() const { return _userCanRename; }
         std::string& getHideUserList() { return _hideUserList; }
         TriState getDisableChangeTrackingShow() const { return _disableChangeTrackingShow; }
@@ -492,6 +519,8 @@ public:
         bool _supportsLocks;
         /// If WOPI host supports rename
         bool _supportsRename;
+        /// If WOPI host takes only the changed members of the package in PutFile
+        bool _supportsPackageDelta;
         /// If user is allowed to rename the document
         bool _userCanRename;
 
@@ -525,6 +554,12 @@ public:
     std::chrono::duration<double> getWopiLoadDuration() const { return _wopiLoadDuration; }
     std::chrono::duration<double> getWopiSaveDuration() const { return _wopiSaveDuration; }
 
+    /// Called with the bytes downloaded so far and the total, 0 if unknown,
+    /// as the document is downloaded.
+    using ProgressHandler = std::function<void(uint64_t, uint64_t)>;
+
+    void setDownloadProgressHandler(const ProgressHandler& handler) { _downloadProgressHandler = handler; }
+
 private:
     /// Initialize an HTTPRequest instance with the common settings and headers.
     /// Older Poco versions don't support copying HTTPRequest objects, so we can't generate them.
@@ -535,8 +570,14 @@ private:
     // Time spend in loading the file from storage
     std::chrono::duration<double> _wopiLoadDuration;
     std::chrono::duration<double> _wopiSaveDuration;
+    /// Whether PutFile takes a package of the changed members, applied to what
+    /// the host has: a LOOL extension, SupportsPackageDelta in CheckFileInfo.
+    bool _supportsPackageDelta;
+    /// The members of the package the host has, as last downloaded or uploaded.
+    ZipPackage _storedPackage;
     /// Whether or not to re-use cookies from the browser for the WOPI requests.
     bool _reuseCookies;
+    ProgressHandler _downloadProgressHandler;
 };
 
 /// WebDAV protocol backed storage.
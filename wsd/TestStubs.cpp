@@ -19,7 +19,7 @@
 
 void DocumentBroker::assertCorrectThread() const {}
 
-void ClientSession::traceTileBySend(const TileDesc& /*tile*/, bool /*deduplicated = false*/) {}
+void ClientSession::traceTileBySend(const TileDesc& /*tile*/, size_t /*size*/, bool /*deduplicated = false*/) {}
 
 void ClientSession::enqueueSendMessage(const std::shared_ptr<Message>& /*data*/) {};
 
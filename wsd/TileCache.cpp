@@ -38,6 +38,8 @@ TileCache::TileCache(std::string docURL, const std::chrono::system_clock::time_p
     , _dontCache(dontCache)
     , _cacheSize(0)
     , _maxCacheSize(512 * 1024)
+    , _prefetchCount(0)
+    , _prefetchHitCount(0)
 {
 #ifndef BUILDING_TESTS
     LOG_INF("TileCache ctor for uri [" << LOOLWSD::anonymizeUrl(_docURL) <<
@@ -58,6 +60,7 @@ TileCache::~TileCache()
 void TileCache::clear()
 {
     _cache.clear();
+    _prefetched.clear();
     _cacheSize = 0;
     for (auto i : _streamCache)
         i.clear();
@@ -164,6 +167,10 @@ TileCache::Tile TileCache::lookupTile(const TileDesc& tile)
 
     TileCache::Tile ret = findTile(tile);
 
+    // A prefetch still rendering helps too, if less.
+    if (!_prefetched.empty() && _prefetched.erase(tile) && (ret || findTileBeingRendered(tile)))
+        ++_prefetchHitCount;
+
     UnitWSD::get().lookupTile(tile.getPart(), tile.getWidth(), tile.getHeight(),
                               tile.getTilePosX(), tile.getTilePosY(),
                               tile.getTileWidth(), tile.getTileHeight(), ret);
@@ -312,6 +319,7 @@ void TileCache::invalidateTiles(int part, int x, int y, int width, int height, i
         {
             LOG_TRC("Removing tile: " << it->first.serialize());
             _cacheSize -= itemCacheSize(it->second);
+            _prefetched.erase(it->first);
             it = _cache.erase(it);
         }
         else
@@ -354,11 +362,11 @@ std::pair<int, Util::Rectangle> TileCache::parseInvalidateMsg(const std::string&
         int width;
         int height;
         if (tokens.size() == 6 &&
-            getTokenInteger(tokens[1], "part", part) &&
-            getTokenInteger(tokens[2], "x", x) &&
-            getTokenInteger(tokens[3], "y", y) &&
-            getTokenInteger(tokens[4], "width", width) &&
-            getTokenInteger(tokens[5], "height", height))
+            getTokenInteger(tokens, 1, "part", part) &&
+            getTokenInteger(tokens, 2, "x", x) &&
+            getTokenInteger(tokens, 3, "y", y) &&
+            getTokenInteger(tokens, 4, "width", width) &&
+            getTokenInteger(tokens, 5, "height", height))
         {
             return std::pair<int, Util::Rectangle>(part, Util::Rectangle(x, y, width, height));
         }
@@ -519,6 +527,46 @@ std::string TileCache::cancelTiles(const std::shared_ptr<ClientSession> &subscri
     return canceltiles.empty() ? canceltiles : "canceltiles " + canceltiles;
 }
 
+bool TileCache::registerTilePrefetch(const TileDesc& tile)
+{
+    assertCorrectThread();
+
+    if (_dontCache || findTile(tile) || findTileBeingRendered(tile))
+        return false;
+
+    registerTileBeingRendered(tile);
+    _prefetched.insert(tile);
+    ++_prefetchCount;
+    return true;
+}
+
+std::string TileCache::cancelPrefetch(int normalizedViewId, const Util::Rectangle& keep)
+{
+    assertCorrectThread();
+
+    std::ostringstream oss;
+
+    for (auto it = _tilesBeingRendered.begin(); it != _tilesBeingRendered.end(); )
+    {
+        const TileDesc& tile = it->second->getTile();
+        if (it->second->getSubscribers().empty() &&
+            tile.getNormalizedViewId() == normalizedViewId &&
+            !tile.intersectsWithRect(keep.getLeft(), keep.getTop(), keep.getWidth(), keep.getHeight()) &&
+            _prefetched.erase(tile))
+        {
+            LOG_TRC("Cancelling prefetch of tile " << tile.serialize());
+            oss << it->second->getVersion() << ',';
+            it = _tilesBeingRendered.erase(it);
+            continue;
+        }
+
+        ++it;
+    }
+
+    const std::string canceltiles = oss.str();
+    return canceltiles.empty() ? canceltiles : "canceltiles " + canceltiles;
+}
+
 void TileCache::assertCorrectThread()
 {
     const bool correctThread = _owner == std::thread::id() || std::this_thread::get_id() == _owner;
@@ -629,6 +677,7 @@ void TileCache::ensureCacheSize()
         {
             LOG_TRC("cleaned out tile: " << it->first.serialize());
             _cacheSize -= itemCacheSize(it->second);
+            _prefetched.erase(it->first);
             it = _cache.erase(it);
         }
         else
@@ -702,6 +751,9 @@ void TileCache::dumpState(std::ostream& os)
         }
     }
 
+    os << "  prefetched tiles: " << _prefetchCount << ", served from cache: " << _prefetchHitCount
+       << ", pending: " << _prefetched.size() << '\n';
+
     os << "  tiles being rendered " << _tilesBeingRendered.size() << '\n';
     for (const auto& it : _tilesBeingRendered)
         it.second->dumpState(os);
@@ -14,6 +14,7 @@
 #include <string>
 #include <thread>
 #include <unordered_map>
+#include <unordered_set>
 
 #include <Rectangle.hpp>
 
@@ -92,6 +93,18 @@ public:
     /// Cancels all tile requests by the given subscriber.
     std::string cancelTiles(const std::shared_ptr<ClientSession>& subscriber);
 
+    /// Registers a speculative render of a tile nobody asked for yet.
+    /// Returns false, registering nothing, if the tile is cached or being rendered.
+    bool registerTilePrefetch(const TileDesc& tile);
+
+    /// Cancels the prefetch renders of the given view that nobody subscribed
+    /// to since, except those intersecting @keep. Returns the canceltiles message.
+    std::string cancelPrefetch(int normalizedViewId, const Util::Rectangle& keep);
+
+    /// Number of tiles prefetched, and of those later served from the cache.
+    size_t getPrefetchCount() const { return _prefetchCount; }
+    size_t getPrefetchHitCount() const { return _prefetchHitCount; }
+
     /// Find the tile with this description
     Tile lookupTile(const TileDesc& tile);
 
@@ -133,6 +146,8 @@ public:
 
     int getTileBeingRenderedVersion(const TileDesc& tileDesc);
 
+    size_t getTilesBeingRenderedCount() const { return _tilesBeingRendered.size(); }
+
     /// Set the high watermark for tilecache size
     void setMaxCacheSize(size_t cacheSize);
 
@@ -191,6 +206,11 @@ private:
                        TileDescCacheHasher,
                        TileDescCacheCompareEq> _tilesBeingRendered;
 
+    /// Prefetched tiles not requested by a client yet.
+    std::unordered_set<TileDesc, TileDescCacheHasher, TileDescCacheCompareEq> _prefetched;
+    size_t _prefetchCount;
+    size_t _prefetchHitCount;
+
     // old-style file-name to data grab-bag.
     std::map<std::string, Tile> _streamCache[static_cast<int>(StreamType::Last)];
 };
@@ -217,9 +217,9 @@ public:
         TileWireId wireId = 0;
         for (size_t i = 0; i < tokens.size(); ++i)
         {
-            if (LOOLProtocol::getTokenUInt32(tokens[i], "oldwid", oldWireId))
+            if (LOOLProtocol::getTokenUInt32(tokens, i, "oldwid", oldWireId))
                 ;
-            else if (LOOLProtocol::getTokenUInt32(tokens[i], "wid", wireId))
+            else if (LOOLProtocol::getTokenUInt32(tokens, i, "wid", wireId))
                 ;
             else
             {
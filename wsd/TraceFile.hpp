@@ -9,7 +9,16 @@
 
 #pragma once
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
+#include <iterator>
+#include <memory>
 #include <mutex>
 #include <sstream>
 #include <string>
@@ -81,37 +90,351 @@ private:
     std::string _payload;
 };
 
+/// The binary trace file format: compact and cheap to write, for tracing busy servers.
+///
+/// The file starts with the magic, and the start of the trace in microseconds
+/// since the epoch, as 8 little-endian bytes. Each record follows, as the
+/// direction character, the microseconds since the start as a varint, then
+/// the id, the session id and the payload, each as its length as a varint and
+/// its bytes. The records are in the order their threads flushed them, not in
+/// time order. A zero byte where a record would start ends the file, as when
+/// the writer was not closed.
+class BinaryTraceFormat
+{
+public:
+    static constexpr size_t MagicSize = 8;
+    static constexpr size_t HeaderSize = MagicSize + 8;
+
+    struct Record
+    {
+        char _dir;
+        uint64_t _usec;
+        std::string _id;
+        std::string _sessionId;
+        std::string _payload;
+    };
+
+    static const char* getMagic() { return "LOOLTRCB"; }
+
+    static void appendHeader(std::vector<char>& out, const uint64_t epochStart)
+    {
+        out.insert(out.end(), getMagic(), getMagic() + MagicSize);
+        for (int i = 0; i < 8; ++i)
+            out.push_back(static_cast<char>(epochStart >> (8 * i)));
+    }
+
+    static void appendRecord(std::vector<char>& out, const char dir, const uint64_t usec,
+                             const std::string& id, const std::string& sessionId,
+                             const std::string& payload)
+    {
+        out.push_back(dir);
+        appendVarint(out, usec);
+        appendString(out, id);
+        appendString(out, sessionId);
+        appendString(out, payload);
+    }
+
+    /// Whether @data, of @size bytes, starts as a binary trace file does.
+    static bool isBinary(const char* data, const size_t size)
+    {
+        return size >= MagicSize && std::memcmp(data, getMagic(), MagicSize) == 0;
+    }
+
+    /// Reads the trace file in @data. Returns false if it is not a binary trace file.
+    static bool read(const std::string& data, uint64_t& epochStart, std::vector<Record>& records)
+    {
+        if (data.size() < HeaderSize || !isBinary(data.data(), data.size()))
+            return false;
+
+        epochStart = 0;
+        for (int i = 0; i < 8; ++i)
+            epochStart |= static_cast<uint64_t>(static_cast<unsigned char>(data[MagicSize + i])) << (8 * i);
+
+        size_t pos = HeaderSize;
+        while (pos < data.size() && data[pos] != 0)
+        {
+            Record rec;
+            rec._dir = data[pos++];
+            if (!readVarint(data, pos, rec._usec) || !readString(data, pos, rec._id)
+                || !readString(data, pos, rec._sessionId) || !readString(data, pos, rec._payload))
+                break; // Truncated.
+
+            records.push_back(std::move(rec));
+        }
+
+        return true;
+    }
+
+private:
+    static void appendVarint(std::vector<char>& out, uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+            value >>= 7;
+        }
+
+        out.push_back(static_cast<char>(value));
+    }
+
+    static void appendString(std::vector<char>& out, const std::string& value)
+    {
+        appendVarint(out, value.size());
+        out.insert(out.end(), value.begin(), value.end());
+    }
+
+    static bool readVarint(const std::string& data, size_t& pos, uint64_t& value)
+    {
+        value = 0;
+        for (int shift = 0; pos < data.size() && shift < 64; shift += 7)
+        {
+            const unsigned char byte = data[pos++];
+            value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+                return true;
+        }
+
+        return false;
+    }
+
+    static bool readString(const std::string& data, size_t& pos, std::string& value)
+    {
+        uint64_t size = 0;
+        if (!readVarint(data, pos, size) || size > data.size() - pos)
+            return false;
+
+        value.assign(data, pos, size);
+        pos += size;
+        return true;
+    }
+};
+
+/// A trace file in the binary format, written through a buffer per thread
+/// to a mapping of the file, which is grown and mapped a window at a time.
+/// The threads only contend when one of them copies its full buffer to the
+/// mapping, or the trace is flushed.
+class MappedTraceFile
+{
+public:
+    /// The buffer of a thread is copied to the mapping once this full.
+    static constexpr size_t BufferSize = 64 * 1024;
+    static constexpr size_t WindowSize = 16 * 1024 * 1024;
+
+    MappedTraceFile(const std::string& path, const uint64_t epochStart)
+        : _fd(open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600))
+        , _map(nullptr)
+        , _offset(0)
+        , _used(WindowSize)
+    {
+        if (_fd < 0)
+            LOG_SYS("TraceFile: Failed to open [" << path << ']');
+
+        std::vector<char> header;
+        BinaryTraceFormat::appendHeader(header, epochStart);
+        std::unique_lock<std::mutex> lock(_mutex);
+        appendLocked(header.data(), header.size());
+    }
+
+    ~MappedTraceFile()
+    {
+        flush();
+
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (_map)
+            munmap(_map, WindowSize);
+        if (_fd >= 0)
+        {
+            // Drop what is left of the last window.
+            if (ftruncate(_fd, _offset + (_map ? _used : 0)) != 0)
+                LOG_SYS("TraceFile: Failed to truncate the trace file");
+            close(_fd);
+        }
+    }
+
+    /// Adds a record to the buffer of the calling thread.
+    void write(const char dir, const uint64_t usec, const std::string& id,
+               const std::string& sessionId, const std::string& payload)
+    {
+        Buffer& buffer = getBuffer();
+        std::unique_lock<std::mutex> bufferLock(buffer._mutex);
+        BinaryTraceFormat::appendRecord(buffer._data, dir, usec, id, sessionId, payload);
+        if (buffer._data.size() >= BufferSize)
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            appendLocked(buffer._data.data(), buffer._data.size());
+            buffer._data.clear();
+        }
+    }
+
+    /// Copies the buffers of all the threads to the mapping.
+    void flush()
+    {
+        std::vector<std::shared_ptr<Buffer>> buffers;
+        {
+            std::unique_lock<std::mutex> lock(_buffersMutex);
+            buffers = _buffers;
+        }
+
+        for (const std::shared_ptr<Buffer>& buffer : buffers)
+        {
+            std::unique_lock<std::mutex> bufferLock(buffer->_mutex);
+            if (!buffer->_data.empty())
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                appendLocked(buffer->_data.data(), buffer->_data.size());
+                buffer->_data.clear();
+            }
+
+            if (buffer->_closed)
+            {
+                std::unique_lock<std::mutex> lock(_buffersMutex);
+                _buffers.erase(std::remove(_buffers.begin(), _buffers.end(), buffer), _buffers.end());
+            }
+        }
+    }
+
+private:
+    struct Buffer
+    {
+        Buffer()
+            : _closed(false)
+        {
+            _data.reserve(BufferSize + 1024);
+        }
+
+        std::mutex _mutex;
+        std::vector<char> _data;
+        /// The thread is gone, so the buffer can go once flushed.
+        bool _closed;
+    };
+
+    /// The buffer of the calling thread, made on its first record.
+    Buffer& getBuffer()
+    {
+        struct BufferHolder
+        {
+            const MappedTraceFile* _file = nullptr;
+            std::shared_ptr<Buffer> _buffer;
+
+            ~BufferHolder()
+            {
+                if (_buffer)
+                {
+                    std::unique_lock<std::mutex> lock(_buffer->_mutex);
+                    _buffer->_closed = true;
+                }
+            }
+        };
+
+        static thread_local BufferHolder holder;
+        if (holder._file != this)
+        {
+            holder._buffer = std::make_shared<Buffer>();
+            holder._file = this;
+            std::unique_lock<std::mutex> lock(_buffersMutex);
+            _buffers.push_back(holder._buffer);
+        }
+
+        return *holder._buffer;
+    }
+
+    void appendLocked(const char* data, size_t size)
+    {
+        Util::assertIsLocked(_mutex);
+
+        while (size > 0)
+        {
+            if (_used == WindowSize && !mapNextLocked())
+                return;
+
+            const size_t count = std::min(size, WindowSize - _used);
+            std::memcpy(_map + _used, data, count);
+            _used += count;
+            data += count;
+            size -= count;
+        }
+    }
+
+    /// Grows the file by a window, and maps it in place of the last one.
+    bool mapNextLocked()
+    {
+        if (_fd < 0)
+            return false;
+
+        if (_map)
+        {
+            munmap(_map, WindowSize);
+            _map = nullptr;
+            _offset += WindowSize;
+        }
+
+        if (ftruncate(_fd, _offset + WindowSize) != 0)
+        {
+            LOG_SYS("TraceFile: Failed to grow the trace file to " << _offset + WindowSize << " bytes");
+            return false;
+        }
+
+        void* map = mmap(nullptr, WindowSize, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, _offset);
+        if (map == MAP_FAILED)
+        {
+            LOG_SYS("TraceFile: Failed to map the trace file at " << _offset);
+            return false;
+        }
+
+        _map = static_cast<char*>(map);
+        _used = 0;
+        return true;
+    }
+
+    const int _fd;
+    /// The window of the file mapped, its offset, and the bytes of it used.
+    char* _map;
+    off_t _offset;
+    size_t _used;
+    std::mutex _mutex;
+
+    std::vector<std::shared_ptr<Buffer>> _buffers;
+    std::mutex _buffersMutex;
+};
+
 /// Trace-file generator class.
-/// Writes records into a trace file.
+/// Writes records into a trace file, as text, or in the binary format, which
+/// is what is cheap enough for busy servers.
 class TraceFileWriter
 {
 public:
     TraceFileWriter(const std::string& path,
                     const bool recordOugoing,
                     const bool compress,
+                    const bool binary,
                     const bool takeSnapshot,
                     const std::vector<std::string>& filters) :
         _epochStart(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now()
                                                             .time_since_epoch()).count()),
         _recordOutgoing(recordOugoing),
-        _compress(compress),
+        _compress(compress && !binary),
         _takeSnapshot(takeSnapshot),
         _path(Poco::Path(path).parent().toString()),
         _filter(true),
-        _stream(processPath(path), compress ? std::ios::binary : std::ios::out),
         _deflater(_stream, Poco::DeflatingStreamBuf::STREAM_GZIP)
     {
         for (const auto& f : filters)
         {
             _filter.deny(f);
         }
+
+        if (binary)
+            _binary.reset(new MappedTraceFile(processPath(path), _epochStart));
+        else
+            _stream.open(processPath(path), _compress ? std::ios::binary : std::ios::out);
     }
 
     ~TraceFileWriter()
     {
-        std::unique_lock<std::mutex> lock(_mutex);
+        std::unique_lock<std::mutex> lock(_streamMutex);
 
-        _deflater.close();
+        if (!_binary)
+            _deflater.close();
         _stream.close();
     }
 
@@ -149,9 +472,11 @@ public:
             }
         }
 
+        lock.unlock();
+
         const auto data = "NewSession: " + snapshot;
-        writeLocked(id, sessionId, data, static_cast<char>(TraceFileRecord::Direction::Event));
-        flushLocked();
+        write(id, sessionId, data, static_cast<char>(TraceFileRecord::Direction::Event));
+        flush();
     }
 
     void endSession(const std::string& id, const std::string& sessionId, const std::string& uri)
@@ -176,28 +501,27 @@ public:
             }
         }
 
+        lock.unlock();
+
         const auto data = "EndSession: " + snapshot;
-        writeLocked(id, sessionId, data, static_cast<char>(TraceFileRecord::Direction::Event));
-        flushLocked();
+        write(id, sessionId, data, static_cast<char>(TraceFileRecord::Direction::Event));
+        flush();
     }
 
     void writeEvent(const std::string& id, const std::string& sessionId, const std::string& data)
     {
-        std::unique_lock<std::mutex> lock(_mutex);
-
-        writeLocked(id, sessionId, data, static_cast<char>(TraceFileRecord::Direction::Event));
-        flushLocked();
+        write(id, sessionId, data, static_cast<char>(TraceFileRecord::Direction::Event));
+        flush();
     }
 
     void writeIncoming(const std::string& id, const std::string& sessionId, const std::string& data)
     {
-        std::unique_lock<std::mutex> lock(_mutex);
-
         if (_filter.match(data))
         {
             // Remap the URL to the snapshot.
             if (LOOLProtocol::matchPrefix("load", data))
             {
+                std::unique_lock<std::mutex> lock(_mutex);
                 StringVector tokens = Util::tokenize(data);
                 if (tokens.size() >= 2)
                 {
@@ -224,39 +548,51 @@ public:
                                 newData += tokens.getParam(token) + ' ';
                             }
 
-                            writeLocked(id, sessionId, newData, static_cast<char>(TraceFileRecord::Direction::Incoming));
+                            write(id, sessionId, newData, static_cast<char>(TraceFileRecord::Direction::Incoming));
                             return;
                         }
                     }
                 }
             }
 
-            writeLocked(id, sessionId, data, static_cast<char>(TraceFileRecord::Direction::Incoming));
+            write(id, sessionId, data, static_cast<char>(TraceFileRecord::Direction::Incoming));
         }
     }
 
     void writeOutgoing(const std::string& id, const std::string& sessionId, const std::string& data)
     {
-        std::unique_lock<std::mutex> lock(_mutex);
-
         if (_recordOutgoing && _filter.match(data))
         {
-            writeLocked(id, sessionId, data, static_cast<char>(TraceFileRecord::Direction::Outgoing));
+            write(id, sessionId, data, static_cast<char>(TraceFileRecord::Direction::Outgoing));
         }
     }
 
 private:
-    void flushLocked()
+    void flush()
     {
-        Util::assertIsLocked(_mutex);
+        if (_binary)
+        {
+            _binary->flush();
+            return;
+        }
+
+        std::unique_lock<std::mutex> lock(_streamMutex);
 
         _deflater.flush();
         _stream.flush();
     }
 
-    void writeLocked(const std::string& id, const std::string& sessionId, const std::string& data, const char delim)
+    void write(const std::string& id, const std::string& sessionId, const std::string& data, const char delim)
     {
-        Util::assertIsLocked(_mutex);
+        if (_binary)
+        {
+            const Poco::Int64 usec = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono
+                                            ::system_clock::now().time_since_epoch()).count() - _epochStart;
+            _binary->write(delim, usec, id, sessionId, data);
+            return;
+        }
+
+        std::unique_lock<std::mutex> lock(_streamMutex);
 
         const Poco::Int64 usec = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono
                                         ::system_clock::now().time_since_epoch()).count() - _epochStart;
@@ -336,12 +672,16 @@ private:
     Util::RegexListMatcher _filter;
     std::ofstream _stream;
     Poco::DeflatingOutputStream _deflater;
+    /// Guards the text stream.
+    std::mutex _streamMutex;
+    std::unique_ptr<MappedTraceFile> _binary;
+    /// Guards the snapshots.
     std::mutex _mutex;
     std::map<std::string, SnapshotData> _urlToSnapshot;
 };
 
 /// Trace-file parser class.
-/// Reads records from a trace file.
+/// Reads records from a trace file, as text, or in the binary format.
 class TraceFileReader
 {
 public:
@@ -407,6 +747,12 @@ private:
     {
         _records.clear();
 
+        if (!_compressed && readBinaryFile())
+        {
+            validate();
+            return;
+        }
+
         std::string line;
         for (;;)
         {
@@ -431,6 +777,49 @@ private:
                 fprintf(stderr, "Invalid trace file record, expected 4 tokens. [%s]\n", line.c_str());
         }
 
+        validate();
+    }
+
+    /// Reads the records of a binary trace file, in time order.
+    /// Returns false, with the stream rewound, if it is not one.
+    bool readBinaryFile()
+    {
+        char magic[BinaryTraceFormat::MagicSize];
+        if (!_stream.read(magic, sizeof(magic)) || !BinaryTraceFormat::isBinary(magic, sizeof(magic)))
+        {
+            _stream.clear();
+            _stream.seekg(0);
+            return false;
+        }
+
+        std::string data(magic, sizeof(magic));
+        data.append(std::istreambuf_iterator<char>(_stream), std::istreambuf_iterator<char>());
+
+        uint64_t epochStart = 0;
+        std::vector<BinaryTraceFormat::Record> records;
+        if (!BinaryTraceFormat::read(data, epochStart, records))
+            return false;
+
+        std::stable_sort(records.begin(), records.end(),
+                         [](const BinaryTraceFormat::Record& lhs, const BinaryTraceFormat::Record& rhs)
+                         { return lhs._usec < rhs._usec; });
+
+        for (const BinaryTraceFormat::Record& record : records)
+        {
+            TraceFileRecord rec;
+            rec.setDir(static_cast<TraceFileRecord::Direction>(record._dir));
+            rec.setTimestampNs(record._usec);
+            rec.setPid(std::atoi(record._id.c_str()));
+            rec.setSessionId(record._sessionId);
+            rec.setPayload(record._payload);
+            _records.push_back(rec);
+        }
+
+        return true;
+    }
+
+    void validate()
+    {
         if (_records.empty() ||
             _records[0].getDir() != TraceFileRecord::Direction::Event ||
             _records[0].getPayload().find("NewSession") != 0)
@@ -0,0 +1,309 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 100 -*- */
+/*
+ * This file is part of the LibreOffice project.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <config.h>
+
+#include "ZipPackage.hpp"
+
+#include <algorithm>
+
+namespace
+{
+constexpr uint32_t LocalHeaderSignature = 0x04034b50;
+constexpr uint32_t CentralHeaderSignature = 0x02014b50;
+constexpr uint32_t EndSignature = 0x06054b50;
+constexpr uint32_t DescriptorSignature = 0x08074b50;
+
+constexpr size_t LocalHeaderSize = 30;
+constexpr size_t CentralHeaderSize = 46;
+constexpr size_t EndSize = 22;
+constexpr size_t MaxCommentSize = 0xffff;
+
+/// Where the offset of the local header is in a central directory record.
+constexpr size_t RecordOffsetPos = 42;
+
+uint16_t get16(const char* p)
+{
+    return static_cast<uint8_t>(p[0]) | static_cast<uint8_t>(p[1]) << 8;
+}
+
+uint32_t get32(const char* p)
+{
+    return get16(p) | static_cast<uint32_t>(get16(p + 2)) << 16;
+}
+
+void set16(char* p, const uint16_t value)
+{
+    p[0] = static_cast<char>(value & 0xff);
+    p[1] = static_cast<char>(value >> 8);
+}
+
+void set32(char* p, const uint32_t value)
+{
+    set16(p, value & 0xffff);
+    set16(p + 2, value >> 16);
+}
+
+bool readAt(std::istream& stream, const uint64_t offset, char* buffer, const size_t size)
+{
+    stream.clear();
+    stream.seekg(offset);
+    stream.read(buffer, size);
+    return static_cast<size_t>(stream.gcount()) == size;
+}
+
+/// Copies @length bytes at @offset of @from to @to.
+bool copyRange(std::istream& from, const uint64_t offset, uint64_t length, std::ostream& to)
+{
+    from.clear();
+    from.seekg(offset);
+
+    char buffer[64 * 1024];
+    while (length > 0)
+    {
+        const size_t size = std::min<uint64_t>(length, sizeof(buffer));
+        from.read(buffer, size);
+        if (static_cast<size_t>(from.gcount()) != size)
+            return false;
+
+        to.write(buffer, size);
+        length -= size;
+    }
+
+    return to.good();
+}
+
+/// Writes the central directory of the members whose @records are given,
+/// and the end record, at @offset. Returns the bytes written.
+uint64_t writeDirectory(std::ostream& out, const std::vector<std::string>& records,
+                        const uint64_t offset)
+{
+    uint64_t size = 0;
+    for (const std::string& record : records)
+    {
+        out.write(record.data(), record.size());
+        size += record.size();
+    }
+
+    char end[EndSize] = {};
+    set32(end, EndSignature);
+    set16(end + 8, records.size());
+    set16(end + 10, records.size());
+    set32(end + 12, size);
+    set32(end + 16, offset);
+    out.write(end, EndSize);
+
+    return size + EndSize;
+}
+
+/// Copies @member of @stream to @out at @offset, adding its central directory
+/// record, pointing there, to @records.
+bool addMember(std::istream& stream, const ZipPackage::Member& member, std::ostream& out,
+               uint64_t& offset, std::vector<std::string>& records)
+{
+    if (offset + member._length >= 0xffffffff || records.size() >= 0xffff)
+        return false;
+
+    if (!copyRange(stream, member._offset, member._length, out))
+        return false;
+
+    records.push_back(member._record);
+    set32(&records.back()[RecordOffsetPos], offset);
+    offset += member._length;
+    return true;
+}
+}
+
+bool ZipPackage::read(std::istream& stream)
+{
+    _members.clear();
+    _index.clear();
+    if (readDirectory(stream))
+        return true;
+
+    _members.clear();
+    _index.clear();
+    return false;
+}
+
+bool ZipPackage::readDirectory(std::istream& stream)
+{
+    stream.clear();
+    stream.seekg(0, std::ios::end);
+    const std::streamoff size = stream.tellg();
+    if (size < static_cast<std::streamoff>(EndSize))
+        return false;
+
+    _size = size;
+
+    // The end record is last, but for a comment of up to 64KB.
+    const size_t tailSize = std::min<uint64_t>(_size, EndSize + MaxCommentSize);
+    std::string tail(tailSize, '\0');
+    if (!readAt(stream, _size - tailSize, &tail[0], tailSize))
+        return false;
+
+    size_t endPos = std::string::npos;
+    for (size_t pos = tailSize - EndSize + 1; pos-- > 0;)
+    {
+        if (get32(&tail[pos]) == EndSignature && pos + EndSize + get16(&tail[pos + 20]) == tailSize)
+        {
+            endPos = pos;
+            break;
+        }
+    }
+
+    if (endPos == std::string::npos)
+        return false;
+
+    // Spanning disks, or ZIP64, where these would be placeholders.
+    const char* end = &tail[endPos];
+    const uint16_t count = get16(end + 10);
+    const uint32_t directorySize = get32(end + 12);
+    _directoryOffset = get32(end + 16);
+    if (get16(end + 4) != 0 || get16(end + 6) != 0 || get16(end + 8) != count || count == 0xffff
+        || directorySize == 0xffffffff || _directoryOffset == 0xffffffff
+        || _directoryOffset + directorySize > _size - tailSize + endPos)
+        return false;
+
+    std::string directory(directorySize, '\0');
+    if (directorySize && !readAt(stream, _directoryOffset, &directory[0], directorySize))
+        return false;
+
+    size_t pos = 0;
+    for (uint16_t i = 0; i < count; ++i)
+    {
+        if (pos + CentralHeaderSize > directory.size()
+            || get32(&directory[pos]) != CentralHeaderSignature)
+            return false;
+
+        const char* record = &directory[pos];
+        const size_t recordSize
+            = CentralHeaderSize + get16(record + 28) + get16(record + 30) + get16(record + 32);
+        if (pos + recordSize > directory.size())
+            return false;
+
+        Member member;
+        member._name.assign(record + CentralHeaderSize, get16(record + 28));
+        member._crc = get32(record + 16);
+        member._compressedSize = get32(record + 20);
+        member._size = get32(record + 24);
+        member._offset = get32(record + RecordOffsetPos);
+        if (member._compressedSize == 0xffffffff || member._size == 0xffffffff
+            || member._offset == 0xffffffff || _index.count(member._name))
+            return false;
+
+        // The length is that of the local header, which may have a different extra
+        // field, the data, and the descriptor after it, if bit 3 of the flags is set.
+        char local[LocalHeaderSize];
+        if (!readAt(stream, member._offset, local, LocalHeaderSize)
+            || get32(local) != LocalHeaderSignature)
+            return false;
+
+        member._length = LocalHeaderSize + get16(local + 26) + get16(local + 28)
+                         + member._compressedSize;
+        if (get16(record + 8) & 0x08)
+        {
+            char descriptor[4];
+            if (!readAt(stream, member._offset + member._length, descriptor, sizeof(descriptor)))
+                return false;
+
+            member._length += (get32(descriptor) == DescriptorSignature ? 16 : 12);
+        }
+
+        if (member._offset + member._length > _directoryOffset)
+            return false;
+
+        member._record.assign(record, recordSize);
+        _index.emplace(member._name, _members.size());
+        _members.push_back(std::move(member));
+        pos += recordSize;
+    }
+
+    return true;
+}
+
+const ZipPackage::Member* ZipPackage::find(const std::string& name) const
+{
+    const auto it = _index.find(name);
+    return (it != _index.end() ? &_members[it->second] : nullptr);
+}
+
+std::vector<const ZipPackage::Member*> ZipPackage::getChanged(const ZipPackage& base) const
+{
+    std::vector<const Member*> changed;
+    for (const Member& member : _members)
+    {
+        const Member* old = base.find(member._name);
+        if (!old || !old->isSame(member))
+            changed.push_back(&member);
+    }
+
+    return changed;
+}
+
+std::vector<std::string> ZipPackage::getRemoved(const ZipPackage& base) const
+{
+    std::vector<std::string> removed;
+    for (const Member& member : base._members)
+    {
+        if (!find(member._name))
+            removed.push_back(member._name);
+    }
+
+    return removed;
+}
+
+uint64_t ZipPackage::writeDelta(std::istream& stream, const ZipPackage& base,
+                                std::ostream& delta) const
+{
+    uint64_t offset = 0;
+    std::vector<std::string> records;
+    for (const Member* member : getChanged(base))
+    {
+        if (!addMember(stream, *member, delta, offset, records))
+            return 0;
+    }
+
+    offset += writeDirectory(delta, records, offset);
+    return (delta.good() ? offset : 0);
+}
+
+bool ZipPackage::applyDelta(std::istream& base, std::istream& delta,
+                            const std::vector<std::string>& removed, std::ostream& result)
+{
+    ZipPackage basePackage;
+    ZipPackage deltaPackage;
+    if (!basePackage.read(base) || !deltaPackage.read(delta))
+        return false;
+
+    // Keep the order of the base, where the mimetype member of ODF has to come first.
+    uint64_t offset = 0;
+    std::vector<std::string> records;
+    for (const Member& member : basePackage._members)
+    {
+        if (std::find(removed.begin(), removed.end(), member._name) != removed.end())
+            continue;
+
+        const Member* replacement = deltaPackage.find(member._name);
+        if (replacement ? !addMember(delta, *replacement, result, offset, records)
+                        : !addMember(base, member, result, offset, records))
+            return false;
+    }
+
+    for (const Member& member : deltaPackage._members)
+    {
+        if (!basePackage.find(member._name) && !addMember(delta, member, result, offset, records))
+            return false;
+    }
+
+    writeDirectory(result, records, offset);
+    return result.good();
+}
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
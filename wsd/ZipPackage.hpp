@@ -0,0 +1,98 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 100 -*- */
+/*
+ * This file is part of the LibreOffice project.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/// The members of a ZIP package, as ODF and OOXML documents are, from its
+/// central directory.
+///
+/// The core writes the whole package on every save, but an edit changes only
+/// a few of its members (a sheet, content.xml, meta.xml), so storage can be
+/// given just those, and keep the others it has. The members are copied as
+/// they are, compressed and with their local header; only the central
+/// directory is written anew. ZIP64 and multi-disk packages are not handled.
+class ZipPackage
+{
+public:
+    struct Member
+    {
+        std::string _name;
+        uint32_t _crc;
+        uint64_t _compressedSize;
+        uint64_t _size;
+        /// Where the local header starts, and the length of the header,
+        /// the data and the data descriptor, if any.
+        uint64_t _offset;
+        uint64_t _length;
+        /// The central directory record, as read.
+        std::string _record;
+
+        /// Whether @other has the same name and content.
+        bool isSame(const Member& other) const
+        {
+            return _name == other._name && _crc == other._crc && _size == other._size
+                   && _compressedSize == other._compressedSize;
+        }
+    };
+
+    ZipPackage()
+        : _size(0)
+        , _directoryOffset(0)
+    {
+    }
+
+    /// Reads the central directory of the package in @stream.
+    /// Returns false if it is not a package we can handle.
+    bool read(std::istream& stream);
+
+    bool isEmpty() const { return _members.empty(); }
+
+    const std::vector<Member>& getMembers() const { return _members; }
+
+    /// The member called @name, if any.
+    const Member* find(const std::string& name) const;
+
+    /// The size of the whole package.
+    uint64_t getSize() const { return _size; }
+
+    /// The members that are new, or different from those in @base.
+    std::vector<const Member*> getChanged(const ZipPackage& base) const;
+
+    /// The names of the members of @base that are not in this package.
+    std::vector<std::string> getRemoved(const ZipPackage& base) const;
+
+    /// Writes the members of this package, read from @stream, that are new or
+    /// different from those in @base, as a package of their own, to @delta.
+    /// Returns the bytes written, 0 on failure.
+    uint64_t writeDelta(std::istream& stream, const ZipPackage& base, std::ostream& delta) const;
+
+    /// Writes the package @base, with the members of @delta replacing those of
+    /// the same name or added after them, and those named in @removed left
+    /// out, to @result. This is what storage does with a delta.
+    static bool applyDelta(std::istream& base, std::istream& delta,
+                           const std::vector<std::string>& removed, std::ostream& result);
+
+private:
+    bool readDirectory(std::istream& stream);
+
+    std::vector<Member> _members;
+    /// The index of the members by name.
+    std::map<std::string, size_t> _index;
+    uint64_t _size;
+    uint64_t _directoryOffset;
+};
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */